@@ -0,0 +1,406 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#include "common.h"
+#include "threading.h"
+#include "arena.h"
+
+#if !_WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace X265_NS;
+
+namespace {
+
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+const size_t SLAB_SIZE = 8 * HUGE_PAGE_SIZE;
+const size_t BLOCK_ALIGN = 64;
+
+struct Slab
+{
+    uint8_t* base;
+    size_t   size;
+    size_t   used;      // bytes carved from the start of the slab
+    bool     bHugetlb;
+    Slab*    next;
+};
+
+/* precedes each buffer carved from a slab, sized to keep the buffer aligned */
+struct Block
+{
+    Block*   next;      // free list link
+    size_t   size;      // usable bytes
+    uint8_t  pad[BLOCK_ALIGN - sizeof(Block*) - sizeof(size_t) - sizeof(AllocHeader)];
+    AllocHeader header;
+};
+
+struct Pool
+{
+    Slab*    slabs;     // the slab being carved first
+    Block*   freeList;
+    uint64_t liveBytes;
+    uint64_t freeBytes;
+};
+
+const char* const poolNames[POOL_COUNT] = { "picture", "lowres", "framedata" };
+
+Pool s_pools[POOL_COUNT];
+Lock s_poolLock;
+
+#if _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* the scope of the allocations of this thread */
+THREAD_LOCAL MemoryAccount* t_account;
+THREAD_LOCAL int            t_subsystem;
+
+#if !_WIN32
+
+Slab* mapSlab(size_t size, bool bHugetlb)
+{
+    Slab* slab = (Slab*)malloc(sizeof(Slab));
+    if (!slab)
+        return NULL;
+    slab->size = size;
+    slab->used = 0;
+    slab->bHugetlb = false;
+    slab->next = NULL;
+
+#ifdef MAP_HUGETLB
+    if (bHugetlb)
+    {
+        void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            slab->base = (uint8_t*)ptr;
+            slab->bHugetlb = true;
+            return slab;
+        }
+    }
+#else
+    (void)bHugetlb;
+#endif
+
+    /* over-map by a huge page and trim, so the whole slab may be backed by
+     * transparent huge pages */
+    size_t len = size + HUGE_PAGE_SIZE;
+    void* ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        free(slab);
+        return NULL;
+    }
+    uint8_t* raw = (uint8_t*)ptr;
+    uint8_t* base = (uint8_t*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (base > raw)
+        munmap(raw, base - raw);
+    if (raw + len > base + size)
+        munmap(base + size, raw + len - (base + size));
+#ifdef MADV_HUGEPAGE
+    madvise(base, size, MADV_HUGEPAGE);
+#endif
+    slab->base = base;
+    return slab;
+}
+
+void unmapSlab(Slab* slab)
+{
+    munmap(slab->base, slab->size);
+    free(slab);
+}
+
+uint64_t residentBytes(const Slab* slab)
+{
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t numPages = slab->size / pageSize;
+#if __linux__
+    unsigned char* vec = (unsigned char*)malloc(numPages);
+#else
+    char* vec = (char*)malloc(numPages);
+#endif
+    if (!vec)
+        return 0;
+
+    uint64_t bytes = 0;
+    if (!mincore(slab->base, slab->size, vec))
+    {
+        for (size_t i = 0; i < numPages; i++)
+            bytes += vec[i] & 1;
+        bytes *= pageSize;
+    }
+    free(vec);
+    return bytes;
+}
+
+#else // if !_WIN32
+
+Slab* mapSlab(size_t, bool)    { return NULL; }
+void unmapSlab(Slab*)          {}
+uint64_t residentBytes(const Slab*) { return 0; }
+
+#endif // if !_WIN32
+
+void* carve(int poolIdx, int hugePages, size_t size)
+{
+    Pool& pool = s_pools[poolIdx];
+
+    /* the smallest free buffer which is large enough, without wasting more
+     * than an eighth of it */
+    Block** best = NULL;
+    for (Block** link = &pool.freeList; *link; link = &(*link)->next)
+    {
+        size_t blockSize = (*link)->size;
+        if (blockSize >= size && blockSize - size <= size / 8 && (!best || blockSize < (*best)->size))
+            best = link;
+    }
+    if (best)
+    {
+        Block* block = *best;
+        *best = block->next;
+        pool.freeBytes -= block->size;
+        pool.liveBytes += block->size;
+        return block + 1;
+    }
+
+    size_t need = sizeof(Block) + ((size + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1));
+    Slab* slab = pool.slabs;
+    if (!slab || slab->size - slab->used < need)
+    {
+        size_t slabSize = X265_MAX(SLAB_SIZE, (need + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+        slab = mapSlab(slabSize, hugePages >= 2);
+        if (!slab)
+            return NULL;
+
+        /* keep carving whichever slab has more room left */
+        if (!pool.slabs || slab->size - need > pool.slabs->size - pool.slabs->used)
+        {
+            slab->next = pool.slabs;
+            pool.slabs = slab;
+        }
+        else
+        {
+            slab->next = pool.slabs->next;
+            pool.slabs->next = slab;
+        }
+    }
+
+    Block* block = (Block*)(slab->base + slab->used);
+    slab->used += need;
+    block->next = NULL;
+    block->size = need - sizeof(Block);
+    block->header.pool = poolIdx;
+    pool.liveBytes += block->size;
+    return block + 1;
+}
+
+}
+
+namespace X265_NS {
+
+bool x265_pool_supported()
+{
+#if _WIN32
+    return false;
+#else
+    return true;
+#endif
+}
+
+void* x265_pool_malloc(BufferPool pool, int hugePages, size_t size)
+{
+    if (hugePages && x265_pool_supported())
+    {
+        void* ptr;
+        {
+            ScopedLock lock(s_poolLock);
+            ptr = carve(pool, hugePages, size);
+        }
+        if (ptr)
+        {
+            MemoryAccount::track(ptr, size);
+            return ptr;
+        }
+    }
+    return x265_malloc(size);
+}
+
+void x265_pool_free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    /* heap buffers never touch the pools */
+    int poolIdx = ((const AllocHeader*)ptr - 1)->pool;
+    if (poolIdx < 0)
+    {
+        x265_free(ptr);
+        return;
+    }
+
+    ScopedLock lock(s_poolLock);
+
+    /* the header is rewritten as soon as the block is carved again */
+    MemoryAccount::untrack(ptr);
+
+    Pool& pool = s_pools[poolIdx];
+    Block* block = (Block*)ptr - 1;
+    block->next = pool.freeList;
+    pool.freeList = block;
+    pool.liveBytes -= block->size;
+    pool.freeBytes += block->size;
+}
+
+void x265_pool_trim()
+{
+    ScopedLock lock(s_poolLock);
+    for (int i = 0; i < POOL_COUNT; i++)
+    {
+        Pool& pool = s_pools[i];
+        if (pool.liveBytes)
+            continue;
+        while (pool.slabs)
+        {
+            Slab* next = pool.slabs->next;
+            unmapSlab(pool.slabs);
+            pool.slabs = next;
+        }
+        pool.freeList = NULL;
+        pool.freeBytes = 0;
+    }
+}
+
+void x265_pool_report(x265_pool_stats* stats)
+{
+    ScopedLock lock(s_poolLock);
+    for (int i = 0; i < POOL_COUNT; i++)
+    {
+        const Pool& pool = s_pools[i];
+        x265_pool_stats& s = stats[i];
+        memset(&s, 0, sizeof(s));
+        s.name = poolNames[i];
+        s.liveBytes = pool.liveBytes;
+        s.freeBytes = pool.freeBytes;
+        for (const Slab* slab = pool.slabs; slab; slab = slab->next)
+        {
+            s.numSlabs++;
+            s.mappedBytes += slab->size;
+            s.residentBytes += residentBytes(slab);
+            if (slab->bHugetlb)
+                s.hugetlbBytes += slab->size;
+        }
+    }
+}
+
+MemoryAccount* MemoryAccount::create()
+{
+    MemoryAccount* account = (MemoryAccount*)malloc(sizeof(MemoryAccount));
+    if (account)
+    {
+        memset(account, 0, sizeof(MemoryAccount));
+        account->m_refCount = 1;
+    }
+    return account;
+}
+
+void MemoryAccount::release()
+{
+    if (!ATOMIC_DEC(&m_refCount))
+        free(this);
+}
+
+void MemoryAccount::getStats(x265_memory_stats& stats)
+{
+    for (int i = 0; i < X265_MEM_COUNT; i++)
+        stats.liveBytes[i] = (uint64_t)m_liveBytes[i];
+    stats.totalBytes = (uint64_t)m_totalBytes;
+    stats.peakBytes = (uint64_t)m_peakBytes;
+}
+
+void MemoryAccount::track(void* ptr, size_t size)
+{
+    AllocHeader* header = (AllocHeader*)ptr - 1;
+    MemoryAccount* account = t_account;
+    header->account = account;
+    if (!account)
+        return;
+
+    int subsystem = t_subsystem;
+    header->size = size;
+    header->subsystem = subsystem;
+
+    ATOMIC_INC(&account->m_refCount);
+    ATOMIC_ADD64(&account->m_liveBytes[subsystem], (int64_t)size);
+    int64_t total = ATOMIC_ADD64(&account->m_totalBytes, (int64_t)size) + (int64_t)size;
+
+    int64_t peak = account->m_peakBytes;
+    while (total > peak)
+    {
+        int64_t prev = ATOMIC_CAS64(&account->m_peakBytes, peak, total);
+        if (prev == peak)
+        {
+            for (int i = 0; i < X265_MEM_COUNT; i++)
+                account->m_peakLiveBytes[i] = account->m_liveBytes[i];
+            break;
+        }
+        peak = prev;
+    }
+}
+
+void MemoryAccount::untrack(void* ptr)
+{
+    const AllocHeader* header = (const AllocHeader*)ptr - 1;
+    MemoryAccount* account = header->account;
+    if (!account)
+        return;
+
+    ATOMIC_ADD64(&account->m_liveBytes[header->subsystem], -(int64_t)header->size);
+    ATOMIC_ADD64(&account->m_totalBytes, -(int64_t)header->size);
+    if (!ATOMIC_DEC(&account->m_refCount))
+        free(account);
+}
+
+MemoryScope::MemoryScope(MemoryAccount* account, int subsystem)
+{
+    m_prevAccount = t_account;
+    m_prevSubsystem = t_subsystem;
+    t_account = account;
+    t_subsystem = subsystem;
+}
+
+MemoryScope::MemoryScope(int subsystem)
+{
+    m_prevAccount = t_account;
+    m_prevSubsystem = t_subsystem;
+    t_subsystem = subsystem;
+}
+
+MemoryScope::~MemoryScope()
+{
+    t_account = m_prevAccount;
+    t_subsystem = m_prevSubsystem;
+}
+
+}
@@ -0,0 +1,141 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#ifndef X265_ARENA_H
+#define X265_ARENA_H
+
+#include "common.h"
+
+namespace X265_NS {
+// private namespace
+
+/* The per-frame buffers of pictures, lowres frames and frame data may be
+ * carved from process-wide pools of huge-page backed slabs instead of being
+ * allocated from the heap (x265_param.hugePages). A buffer freed to a pool is
+ * kept on its free list for the next buffer of about the same size, the
+ * slabs are only unmapped by x265_pool_trim() once a pool holds no buffer */
+enum BufferPool
+{
+    POOL_PICTURE,   // PicYuv planes
+    POOL_LOWRES,    // Lowres planes and lookahead cost, MV and QP arrays
+    POOL_FRAMEDATA, // FrameData CU, RC and motion search buffers
+    POOL_COUNT
+};
+
+/* hugePages 0 allocates from the heap with x265_malloc(), 1 from slabs
+ * advised for transparent huge pages, 2 from hugetlbfs (MAP_HUGETLB) slabs
+ * falling back to transparent huge pages. Buffers of either origin must be
+ * released with x265_pool_free() */
+void* x265_pool_malloc(BufferPool pool, int hugePages, size_t size);
+void  x265_pool_free(void* ptr);
+
+/* unmap the slabs of the pools which hold no buffer */
+void  x265_pool_trim();
+
+/* fill stats[POOL_COUNT] with the memory held by each pool */
+void  x265_pool_report(x265_pool_stats* stats);
+
+/* false when the platform has no huge-page support, pools then use the heap */
+bool  x265_pool_supported();
+
+class MemoryAccount;
+
+/* Immediately precedes every buffer of x265_malloc() and of the buffer pools,
+ * within the X265_ALIGNBYTES reserved in front of it */
+struct AllocHeader
+{
+    MemoryAccount* account;   // charged with the buffer, NULL if none
+    size_t         size;
+    int32_t        subsystem;
+    int32_t        pool;      // BufferPool of a pooled buffer, -1 for the heap
+};
+
+/* Live bytes of the buffers an encoder allocates with x265_malloc() or from
+ * the buffer pools, per subsystem (X265_MEM_*). An allocation is charged to
+ * the account and subsystem of the innermost MemoryScope of the allocating
+ * thread, if any, and credited back by whichever thread frees it. Objects
+ * created with new are not accounted. The counters are updated atomically,
+ * the breakdown at the peak is only as consistent as the concurrent
+ * allocations allow */
+class MemoryAccount
+{
+public:
+
+    volatile int64_t m_liveBytes[X265_MEM_COUNT];
+    volatile int64_t m_totalBytes;
+    volatile int64_t m_peakBytes;  // of all the subsystems together
+    int64_t          m_peakLiveBytes[X265_MEM_COUNT]; // live bytes at that peak
+    volatile int     m_refCount;   // live allocations, plus one for the owner
+
+    static MemoryAccount* create();
+
+    /* the owner is done with the account, which is freed along with its
+     * last allocation */
+    void release();
+
+    void getStats(x265_memory_stats& stats);
+
+    /* called by the allocators, which reserve the AllocHeader of ptr */
+    static void track(void* ptr, size_t size);
+    static void untrack(void* ptr);
+};
+
+class MemoryScope
+{
+public:
+
+    MemoryScope(MemoryAccount* account, int subsystem);
+
+    /* charge a different subsystem of the enclosing scope's account */
+    MemoryScope(int subsystem);
+
+    ~MemoryScope();
+
+protected:
+
+    MemoryAccount* m_prevAccount;
+    int            m_prevSubsystem;
+};
+}
+
+#define X265_POOL_FREE(ptr)         X265_NS::x265_pool_free(ptr)
+#define CHECKED_POOL_MALLOC(var, type, count, pool, hugePages) \
+    { \
+        var = (type*)X265_NS::x265_pool_malloc(pool, hugePages, sizeof(type) * (count)); \
+        if (!var) \
+        { \
+            x265_log(NULL, X265_LOG_ERROR, "malloc of size %d failed\n", sizeof(type) * (count)); \
+            goto fail; \
+        } \
+    }
+#define CHECKED_POOL_MALLOC_ZERO(var, type, count, pool, hugePages) \
+    { \
+        var = (type*)X265_NS::x265_pool_malloc(pool, hugePages, sizeof(type) * (count)); \
+        if (var) \
+            memset((void*)var, 0, sizeof(type) * (count)); \
+        else \
+        { \
+            x265_log(NULL, X265_LOG_ERROR, "malloc of size %d failed\n", sizeof(type) * (count)); \
+            goto fail; \
+        } \
+    }
+
+#endif // ifndef X265_ARENA_H
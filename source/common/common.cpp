@@ -24,6 +24,7 @@
 #include "common.h"
 #include "slice.h"
 #include "threading.h"
+#include "arena.h"
 #include "x265.h"
 
 #if _WIN32
@@ -33,6 +34,7 @@
 #include <fcntl.h>
 #else
 #include <sys/time.h>
+#include <sys/mman.h>
 #endif
 
 namespace X265_NS {
@@ -54,6 +56,8 @@ int64_t x265_mdate(void)
 #endif
 }
 
+/* every buffer is preceded by its AllocHeader, in a leading X265_ALIGNBYTES
+ * so the buffer stays aligned */
 #define X265_ALIGNBYTES 64
 
 #if _WIN32
@@ -65,39 +69,60 @@ int64_t x265_mdate(void)
 
 void *x265_malloc(size_t size)
 {
-    return _aligned_malloc(size, X265_ALIGNBYTES);
+    uint8_t *base = (uint8_t*)_aligned_malloc(size + X265_ALIGNBYTES, X265_ALIGNBYTES);
+    if (!base)
+        return NULL;
+    void *ptr = base + X265_ALIGNBYTES;
+    ((AllocHeader*)ptr - 1)->pool = -1;
+    MemoryAccount::track(ptr, size);
+    return ptr;
 }
 
 void x265_free(void *ptr)
 {
-    if (ptr) _aligned_free(ptr);
+    if (ptr)
+    {
+        MemoryAccount::untrack(ptr);
+        _aligned_free((uint8_t*)ptr - X265_ALIGNBYTES);
+    }
 }
 
 #else // if _WIN32
 void *x265_malloc(size_t size)
 {
-    void *ptr;
+    uint8_t *base;
 
-    if (posix_memalign((void**)&ptr, X265_ALIGNBYTES, size) == 0)
+    if (posix_memalign((void**)&base, X265_ALIGNBYTES, size + X265_ALIGNBYTES) == 0)
+    {
+        void *ptr = base + X265_ALIGNBYTES;
+        ((AllocHeader*)ptr - 1)->pool = -1;
+        MemoryAccount::track(ptr, size);
         return ptr;
+    }
     else
         return NULL;
 }
 
 void x265_free(void *ptr)
 {
-    if (ptr) free(ptr);
+    if (ptr)
+    {
+        MemoryAccount::untrack(ptr);
+        free((uint8_t*)ptr - X265_ALIGNBYTES);
+    }
 }
 
 #endif // if _WIN32
 
 /* Not a general-purpose function; multiplies input by -1/6 to convert
- * qp to qscale. */
-int x265_exp2fix8(double x)
+ * qp to qscale. The input is a QP offset in Q8.8 fixed point */
+int x265_exp2fix8(int qpFix8)
 {
-    int i = (int)(x * (-64.f / 6.f) + 512.5f);
+    /* i = floor(512.5 - (qpFix8 / 256) * 64 / 6) */
+    int n = 12300 - qpFix8;
 
-    if (i < 0) return 0;
+    if (n < 0) return 0;
+    int i = n / 24;
     if (i > 1023) return 0xffff;
     return (x265_exp2_lut[i & 63] + 256) << (i >> 6) >> 8;
 }
@@ -306,4 +331,41 @@ error:
     return NULL;
 }
 
+#if _WIN32
+
+const uint8_t* x265_map_file(FILE* fp, uint64_t size)
+{
+    if ((uint64_t)(SIZE_T)size != size)
+        return NULL;
+    HANDLE file = (HANDLE)_get_osfhandle(_fileno(fp));
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+        return NULL;
+    void* ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    return (const uint8_t*)ptr;
+}
+
+void x265_unmap_file(const uint8_t* base, uint64_t)
+{
+    UnmapViewOfFile(base);
+}
+
+#else
+
+const uint8_t* x265_map_file(FILE* fp, uint64_t size)
+{
+    if ((uint64_t)(size_t)size != size)
+        return NULL;
+    void* ptr = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+    return ptr == MAP_FAILED ? NULL : (const uint8_t*)ptr;
+}
+
+void x265_unmap_file(const uint8_t* base, uint64_t size)
+{
+    munmap((void*)base, (size_t)size);
+}
+
+#endif
+
 }
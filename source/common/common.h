@@ -172,6 +172,11 @@ inline T x265_clip3(T minVal, T maxVal, T a) { return x265_min(x265_max(minVal,
 template<typename T> /* clip to pixel range, 0..255 or 0..1023 */
 inline pixel x265_clip(T x) { return (pixel)x265_min<T>(T((1 << X265_DEPTH) - 1), x265_max<T>(T(0), x)); }
 
+/* the AQ and cuTree QP offset maps hold signed Q8.8 fixed point values */
+inline int16_t x265_qp2fix8(double qp) { return (int16_t)x265_clip3(-32768.0, 32767.0, qp * 256.0 + (qp < 0 ? -0.5 : 0.5)); }
+inline double  x265_fix82qp(int qpFix8) { return qpFix8 * (1.0 / 256); }
+inline int16_t x265_clip_fix8(int qpFix8) { return (int16_t)x265_clip3(-32768, 32767, qpFix8); }
+
 typedef int16_t  coeff_t;      // transform coefficient
 
 #define X265_MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -427,7 +432,7 @@ int      x265_rename(const char* oldName, const char* newName);
 #define  x265_unlink(fileName) unlink(fileName)
 #define  x265_rename(oldName, newName) rename(oldName, newName)
 #endif
-int      x265_exp2fix8(double x);
+int      x265_exp2fix8(int qpFix8);
 
 double   x265_ssim2dB(double ssim);
 double   x265_qScale2qp(double qScale);
@@ -437,6 +442,9 @@ uint32_t x265_picturePlaneSize(int csp, int width, int height, int plane);
 void*    x265_malloc(size_t size);
 void     x265_free(void *ptr);
 char*    x265_slurp_file(const char *filename);
+/* read-only mapping of the first size bytes of fp, NULL if it can't be mapped */
+const uint8_t* x265_map_file(FILE* fp, uint64_t size);
+void     x265_unmap_file(const uint8_t* base, uint64_t size);
 
 /* located in primitives.cpp */
 void     x265_setup_primitives(x265_param* param);
@@ -100,6 +100,9 @@ extern const double g_YUVtoRGB_BT2020[3][3];
 #define CBCR_OFFSET 512
 extern const double g_ST2084_PQTable[MAX_HDR_LEGAL_RANGE - MIN_HDR_LEGAL_RANGE + 1];
 
+/* CRC of the decoded picture hash SEI, byte t followed by 16 zero bits */
+extern const uint16_t g_picHashCRCTable[256];
+
 }
 
 #endif
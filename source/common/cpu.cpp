@@ -76,6 +76,7 @@ const cpu_name_t cpu_names[] =
     { "SSE4.1",      SSE2 | X265_CPU_SSE3 | X265_CPU_SSSE3 | X265_CPU_SSE4 },
     { "SSE4",        SSE2 | X265_CPU_SSE3 | X265_CPU_SSSE3 | X265_CPU_SSE4 },
     { "SSE4.2",      SSE2 | X265_CPU_SSE3 | X265_CPU_SSSE3 | X265_CPU_SSE4 | X265_CPU_SSE42 },
+    { "PCLMUL",      X265_CPU_PCLMUL },
 #define AVX SSE2 | X265_CPU_SSE3 | X265_CPU_SSSE3 | X265_CPU_SSE4 | X265_CPU_SSE42 | X265_CPU_AVX
     { "AVX",         AVX },
     { "XOP",         AVX | X265_CPU_XOP },
@@ -163,6 +164,8 @@ uint32_t cpu_detect(bool benableavx512 )
         cpu |= X265_CPU_SSE4;
     if (ecx & 0x00100000)
         cpu |= X265_CPU_SSE42;
+    if (ecx & 0x00000002)
+        cpu |= X265_CPU_PCLMUL;
 
     if (ecx & 0x08000000) /* XGETBV supported and XSAVE enabled by OS */
     {
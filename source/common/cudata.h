@@ -25,6 +25,7 @@
 #define X265_CUDATA_H
 
 #include "common.h"
+#include "arena.h"
 #include "slice.h"
 #include "mv.h"
 
@@ -361,23 +362,24 @@ struct CUDataMemPool
     CUDataMemPool() { charMemBlock = NULL; trCoeffMemBlock = NULL; mvMemBlock = NULL; distortionMemBlock = NULL; 
                       dynRefineRdBlock = NULL; dynRefCntBlock = NULL; dynRefVarBlock = NULL;}
 
-    bool create(uint32_t depth, uint32_t csp, uint32_t numInstances, const x265_param& param)
+    /* hugePages selects the buffer pool of the frame data, see x265_pool_malloc() */
+    bool create(uint32_t depth, uint32_t csp, uint32_t numInstances, const x265_param& param, int hugePages = 0)
     {
         uint32_t numPartition = param.num4x4Partitions >> (depth * 2);
         uint32_t cuSize = param.maxCUSize >> depth;
         uint32_t sizeL = cuSize * cuSize;
         if (csp == X265_CSP_I400)
         {
-            CHECKED_MALLOC(trCoeffMemBlock, coeff_t, (sizeL) * numInstances);
+            CHECKED_POOL_MALLOC(trCoeffMemBlock, coeff_t, (sizeL) * numInstances, POOL_FRAMEDATA, hugePages);
         }
         else
         {            
             uint32_t sizeC = sizeL >> (CHROMA_H_SHIFT(csp) + CHROMA_V_SHIFT(csp));
-            CHECKED_MALLOC(trCoeffMemBlock, coeff_t, (sizeL + sizeC * 2) * numInstances);
+            CHECKED_POOL_MALLOC(trCoeffMemBlock, coeff_t, (sizeL + sizeC * 2) * numInstances, POOL_FRAMEDATA, hugePages);
         }
-        CHECKED_MALLOC(charMemBlock, uint8_t, numPartition * numInstances * CUData::BytesPerPartition);
-        CHECKED_MALLOC_ZERO(mvMemBlock, MV, numPartition * 4 * numInstances);
-        CHECKED_MALLOC(distortionMemBlock, sse_t, numPartition * numInstances);
+        CHECKED_POOL_MALLOC(charMemBlock, uint8_t, numPartition * numInstances * CUData::BytesPerPartition, POOL_FRAMEDATA, hugePages);
+        CHECKED_POOL_MALLOC_ZERO(mvMemBlock, MV, numPartition * 4 * numInstances, POOL_FRAMEDATA, hugePages);
+        CHECKED_POOL_MALLOC(distortionMemBlock, sse_t, numPartition * numInstances, POOL_FRAMEDATA, hugePages);
         return true;
     fail:
         return false;
@@ -385,10 +387,10 @@ struct CUDataMemPool
 
     void destroy()
     {
-        X265_FREE(trCoeffMemBlock);
-        X265_FREE(mvMemBlock);
-        X265_FREE(charMemBlock);
-        X265_FREE(distortionMemBlock);
+        X265_POOL_FREE(trCoeffMemBlock);
+        X265_POOL_FREE(mvMemBlock);
+        X265_POOL_FREE(charMemBlock);
+        X265_POOL_FREE(distortionMemBlock);
     }
 };
 }
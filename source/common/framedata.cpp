@@ -40,12 +40,12 @@ bool FrameData::create(const x265_param& param, const SPS& sps, int csp)
     m_spsrpsIdx = -1;
     if (param.rc.bStatWrite)
         m_spsrps = const_cast<RPS*>(sps.spsrps);
-    bool isallocated = m_cuMemPool.create(0, param.internalCsp, sps.numCUsInFrame, param);
+    bool isallocated = m_cuMemPool.create(0, param.internalCsp, sps.numCUsInFrame, param, param.hugePages);
     if (m_param->bDynamicRefine)
     {
-        CHECKED_MALLOC_ZERO(m_cuMemPool.dynRefineRdBlock, uint64_t, MAX_NUM_DYN_REFINE * sps.numCUsInFrame);
-        CHECKED_MALLOC_ZERO(m_cuMemPool.dynRefCntBlock, uint32_t, MAX_NUM_DYN_REFINE * sps.numCUsInFrame);
-        CHECKED_MALLOC_ZERO(m_cuMemPool.dynRefVarBlock, uint32_t, MAX_NUM_DYN_REFINE * sps.numCUsInFrame);
+        CHECKED_POOL_MALLOC_ZERO(m_cuMemPool.dynRefineRdBlock, uint64_t, MAX_NUM_DYN_REFINE * sps.numCUsInFrame, POOL_FRAMEDATA, param.hugePages);
+        CHECKED_POOL_MALLOC_ZERO(m_cuMemPool.dynRefCntBlock, uint32_t, MAX_NUM_DYN_REFINE * sps.numCUsInFrame, POOL_FRAMEDATA, param.hugePages);
+        CHECKED_POOL_MALLOC_ZERO(m_cuMemPool.dynRefVarBlock, uint32_t, MAX_NUM_DYN_REFINE * sps.numCUsInFrame, POOL_FRAMEDATA, param.hugePages);
     }
     if (isallocated)
     {
@@ -62,8 +62,8 @@ bool FrameData::create(const x265_param& param, const SPS& sps, int csp)
     }
     else
         return false;
-    CHECKED_MALLOC_ZERO(m_cuStat, RCStatCU, sps.numCUsInFrame);
-    CHECKED_MALLOC(m_rowStat, RCStatRow, sps.numCuInHeight);
+    CHECKED_POOL_MALLOC_ZERO(m_cuStat, RCStatCU, sps.numCUsInFrame, POOL_FRAMEDATA, param.hugePages);
+    CHECKED_POOL_MALLOC(m_rowStat, RCStatRow, sps.numCuInHeight, POOL_FRAMEDATA, param.hugePages);
     reinit(sps);
     
     for (int i = 0; i < INTEGRAL_PLANE_NUM; i++)
@@ -99,18 +99,104 @@ void FrameData::destroy()
 
     if (m_param->bDynamicRefine)
     {
-        X265_FREE(m_cuMemPool.dynRefineRdBlock);
-        X265_FREE(m_cuMemPool.dynRefCntBlock);
-        X265_FREE(m_cuMemPool.dynRefVarBlock);
+        X265_POOL_FREE(m_cuMemPool.dynRefineRdBlock);
+        X265_POOL_FREE(m_cuMemPool.dynRefCntBlock);
+        X265_POOL_FREE(m_cuMemPool.dynRefVarBlock);
     }
-    X265_FREE(m_cuStat);
-    X265_FREE(m_rowStat);
+    X265_POOL_FREE(m_cuStat);
+    X265_POOL_FREE(m_rowStat);
     for (int i = 0; i < INTEGRAL_PLANE_NUM; i++)
     {
         if (m_meBuffer[i] != NULL)
         {
-            X265_FREE(m_meBuffer[i]);
+            X265_POOL_FREE(m_meBuffer[i]);
             m_meBuffer[i] = NULL;
         }
     }
+    m_subpel.destroy();
+}
+
+bool SubpelPlanes::create(const x265_param& param, const PicYuv& recon)
+{
+    padX = param.maxCUSize + 16;
+    padY = param.maxCUSize + 8;
+    width = recon.m_picWidth;
+    height = recon.m_picHeight;
+    log2CUSize = param.maxLog2CUSize;
+    numRows = (height + param.maxCUSize - 1) >> log2CUSize;
+
+    uint32_t numCuInHeight = (height + param.maxCUSize - 1) / param.maxCUSize;
+    size_t planeSize = recon.m_stride * (numCuInHeight * param.maxCUSize + recon.m_lumaMarginY * 2);
+    intptr_t origin = recon.m_lumaMarginY * recon.m_stride + recon.m_lumaMarginX;
+    for (int idx = 1; idx < 16; idx++)
+    {
+        /* the half-pel planes, or all of them */
+        if (param.subpelPlanes < 2 && (idx & 5))
+            continue;
+        CHECKED_POOL_MALLOC(buf[idx], pixel, planeSize, POOL_FRAMEDATA, param.hugePages);
+        plane[idx] = buf[idx] + origin;
+    }
+    CHECKED_MALLOC_ZERO(rowState, uint32_t, numRows);
+    return true;
+
+fail:
+    return false;
+}
+
+void SubpelPlanes::destroy()
+{
+    for (int idx = 0; idx < 16; idx++)
+    {
+        X265_POOL_FREE(buf[idx]);
+        buf[idx] = plane[idx] = NULL;
+    }
+    X265_FREE((void*)rowState);
+    rowState = NULL;
+    bActive = false;
+}
+
+void SubpelPlanes::interpolateRow(const PicYuv& recon, int row)
+{
+    int cuSize = 1 << log2CUSize;
+    int top = row ? row * cuSize : -padY;
+    int bottom = row == numRows - 1 ? height + padY : (row + 1) * cuSize;
+    intptr_t stride = recon.m_stride;
+    ALIGN_VAR_32(int16_t, immed[64 * (16 + NTAPS_LUMA - 1)]);
+
+    /* the region is tiled with the largest PU partitions whose interpolation
+     * primitives fit, all dimensions are multiples of 8 */
+    for (int y = top; y < bottom;)
+    {
+        int tileHeight = bottom - y >= 16 ? 16 : 8;
+        for (int x = -padX; x < width + padX;)
+        {
+            int left = width + padX - x;
+            int tileWidth = tileHeight == 16 ? (left >= 64 ? 64 : left >= 16 ? 16 : 8) : (left >= 32 ? 32 : 8);
+            int part = partitionFromSizes(tileWidth, tileHeight);
+            intptr_t offset = y * stride + x;
+            const pixel* src = recon.m_picOrg[0] + offset;
+
+            for (int xFrac = 1; xFrac < 4; xFrac++)
+                if (plane[xFrac])
+                    primitives.pu[part].luma_hpp(src, stride, plane[xFrac] + offset, stride, xFrac);
+            for (int yFrac = 1; yFrac < 4; yFrac++)
+                if (plane[yFrac << 2])
+                    primitives.pu[part].luma_vpp(src, stride, plane[yFrac << 2] + offset, stride, yFrac);
+
+            /* same arithmetic as luma_hvpp, with the horizontal pass shared
+             * by the planes of each xFrac */
+            for (int xFrac = 1; xFrac < 4; xFrac++)
+            {
+                if (!plane[(2 << 2) | xFrac])
+                    continue;
+                primitives.pu[part].luma_hps(src, stride, immed, tileWidth, xFrac, 1);
+                for (int yFrac = 1; yFrac < 4; yFrac++)
+                    if (plane[(yFrac << 2) | xFrac])
+                        primitives.pu[part].luma_vsp(immed + (NTAPS_LUMA / 2 - 1) * tileWidth, tileWidth,
+                                                     plane[(yFrac << 2) | xFrac] + offset, stride, yFrac);
+            }
+            x += tileWidth;
+        }
+        y += tileHeight;
+    }
 }
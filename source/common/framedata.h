@@ -37,6 +37,48 @@ class JobProvider;
 #define INTER_MODES 4 // 2Nx2N, 2NxN, Nx2N, AMP modes
 #define INTRA_MODES 3 // DC, Planar, Angular modes
 
+/* Luma sub-pel planes of a reference picture (--subpel-planes), interpolated
+ * once as its CTU rows are reconstructed and shared by all the motion
+ * searches referencing it. Each plane has the layout of the reconstructed
+ * luma plane, its sample at (x, y) is the reference at (x + xFrac/4,
+ * y + yFrac/4), for -padX <= x < width + padX and -padY <= y < height + padY */
+struct SubpelPlanes
+{
+    enum { ROW_BUSY = 1, ROW_DONE = 2 };
+
+    pixel*             plane[16];   // indexed by (yFrac << 2) | xFrac, NULL if not built
+    pixel*             buf[16];
+    volatile uint32_t* rowState;    // per CTU row ROW_* flags, the rows above and below are
+                                    // interpolated with the first and last row
+    bool               bActive;     // planes are being built for the current picture
+    int                padX;
+    int                padY;
+    int                width;
+    int                height;
+    int                log2CUSize;
+    int                numRows;
+
+    bool create(const x265_param& param, const PicYuv& recon);
+    void destroy();
+
+    /* interpolate the planes of one CTU row, the reconstructed rows above
+     * and below it must be complete up to the filter taps */
+    void interpolateRow(const PicYuv& recon, int row);
+
+    /* true if the planes hold the w x h block at (x, y) of the picture */
+    bool isReady(int x, int y, int w, int h) const
+    {
+        if (x < -padX || y < -padY || x + w > width + padX || y + h > height + padY)
+            return false;
+        int firstRow = X265_MIN(X265_MAX(y, 0) >> log2CUSize, numRows - 1);
+        int lastRow = X265_MIN(X265_MAX(y + h - 1, 0) >> log2CUSize, numRows - 1);
+        for (int row = firstRow; row <= lastRow; row++)
+            if (!(rowState[row] & ROW_DONE))
+                return false;
+        return true;
+    }
+};
+
 /* Current frame stats for 2 pass */
 struct FrameStats
 {
@@ -171,6 +213,8 @@ public:
     uint32_t*              m_meIntegral[INTEGRAL_PLANE_NUM];       // 12 integral planes for 32x32, 32x24, 32x8, 24x32, 16x16, 16x12, 16x4, 12x16, 8x32, 8x8, 4x16 and 4x4.
     uint32_t*              m_meBuffer[INTEGRAL_PLANE_NUM];
 
+    SubpelPlanes           m_subpel;
+
     FrameData();
 
     bool create(const x265_param& param, const SPS& sps, int csp);
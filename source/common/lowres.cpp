@@ -24,6 +24,7 @@
 
 #include "picyuv.h"
 #include "lowres.h"
+#include "arena.h"
 #include "mv.h"
 
 using namespace X265_NS;
@@ -35,12 +36,12 @@ bool PicQPAdaptationLayer::create(uint32_t width, uint32_t height, uint32_t part
     numAQPartInWidth = (width + partWidth - 1) / partWidth;
     numAQPartInHeight = (height + partHeight - 1) / partHeight;
 
-    CHECKED_MALLOC_ZERO(dActivity, double, numAQPartInWidthExt * numAQPartInHeightExt);
-    CHECKED_MALLOC_ZERO(dQpOffset, double, numAQPartInWidthExt * numAQPartInHeightExt);
-    CHECKED_MALLOC_ZERO(dCuTreeOffset, double, numAQPartInWidthExt * numAQPartInHeightExt);
+    CHECKED_MALLOC_ZERO(dActivity, float, numAQPartInWidthExt * numAQPartInHeightExt);
+    CHECKED_MALLOC_ZERO(dQpOffset, int16_t, numAQPartInWidthExt * numAQPartInHeightExt);
+    CHECKED_MALLOC_ZERO(dCuTreeOffset, int16_t, numAQPartInWidthExt * numAQPartInHeightExt);
 
     if (bQpSize)
-        CHECKED_MALLOC_ZERO(dCuTreeOffset8x8, double, numAQPartInWidthExt * numAQPartInHeightExt);
+        CHECKED_MALLOC_ZERO(dCuTreeOffset8x8, int16_t, numAQPartInWidthExt * numAQPartInHeightExt);
 
     return true;
 fail:
@@ -49,6 +50,8 @@ fail:
 
 bool Lowres::create(x265_param* param, PicYuv *origPic, uint32_t qgSize)
 {
+    MemoryScope memScope(X265_MEM_LOOKAHEAD);
+
     isLowres = true;
     bframes = param->bframes;
     widthFullRes = origPic->m_picWidth;
@@ -73,17 +76,17 @@ bool Lowres::create(x265_param* param, PicYuv *origPic, uint32_t qgSize)
     size_t padoffset = lumaStride * origPic->m_lumaMarginY + origPic->m_lumaMarginX;
     if (!!param->rc.aqMode || !!param->rc.hevcAq || !!param->bAQMotion)
     {
-        CHECKED_MALLOC_ZERO(qpAqOffset, double, cuCountFullRes);
-        CHECKED_MALLOC_ZERO(invQscaleFactor, int, cuCountFullRes);
-        CHECKED_MALLOC_ZERO(qpCuTreeOffset, double, cuCountFullRes);
+        CHECKED_POOL_MALLOC_ZERO(qpAqOffset, int16_t, cuCountFullRes, POOL_LOWRES, param->hugePages);
+        CHECKED_POOL_MALLOC_ZERO(invQscaleFactor, int, cuCountFullRes, POOL_LOWRES, param->hugePages);
+        CHECKED_POOL_MALLOC_ZERO(qpCuTreeOffset, int16_t, cuCountFullRes, POOL_LOWRES, param->hugePages);
         if (qgSize == 8)
-            CHECKED_MALLOC_ZERO(invQscaleFactor8x8, int, cuCount);
+            CHECKED_POOL_MALLOC_ZERO(invQscaleFactor8x8, int, cuCount, POOL_LOWRES, param->hugePages);
     }
 
     if (origPic->m_param->bAQMotion)
-        CHECKED_MALLOC_ZERO(qpAqMotionOffset, double, cuCountFullRes);
+        CHECKED_POOL_MALLOC_ZERO(qpAqMotionOffset, int16_t, cuCountFullRes, POOL_LOWRES, param->hugePages);
     if (origPic->m_param->bDynamicRefine || origPic->m_param->bEnableFades)
-        CHECKED_MALLOC_ZERO(blockVariance, uint32_t, cuCountFullRes);
+        CHECKED_POOL_MALLOC_ZERO(blockVariance, uint32_t, cuCountFullRes, POOL_LOWRES, param->hugePages);
 
     if (!!param->rc.hevcAq)
     {
@@ -123,10 +126,12 @@ bool Lowres::create(x265_param* param, PicYuv *origPic, uint32_t qgSize)
             pAQLayer[d].create(origPic->m_picWidth, origPic->m_picHeight, partWidth, partHeight, nAQPartInWidth, nAQPartInHeight);
         }
     }
-    CHECKED_MALLOC(propagateCost, uint16_t, cuCount);
+    CHECKED_POOL_MALLOC(propagateCost, uint16_t, cuCount, POOL_LOWRES, param->hugePages);
+    if (param->rc.cuTree && param->bCUTreeIncremental)
+        CHECKED_POOL_MALLOC(propagateDelta, uint16_t, 2 * cuCount, POOL_LOWRES, param->hugePages);
 
     /* allocate lowres buffers */
-    CHECKED_MALLOC_ZERO(buffer[0], pixel, 4 * planesize);
+    CHECKED_POOL_MALLOC_ZERO(buffer[0], pixel, 4 * planesize, POOL_LOWRES, param->hugePages);
 
     buffer[1] = buffer[0] + planesize;
     buffer[2] = buffer[1] + planesize;
@@ -137,24 +142,56 @@ bool Lowres::create(x265_param* param, PicYuv *origPic, uint32_t qgSize)
     lowresPlane[2] = buffer[2] + padoffset;
     lowresPlane[3] = buffer[3] + padoffset;
 
-    CHECKED_MALLOC(intraCost, int32_t, cuCount);
-    CHECKED_MALLOC(intraMode, uint8_t, cuCount);
+    if (param->bLookaheadHME)
+    {
+        /* the quarter resolution blocks cover 2x2 lowres CUs */
+        int lowerMarginX = origPic->m_lumaMarginX / 2;
+        int lowerMarginY = origPic->m_lumaMarginY / 2;
+        int lowerCuCount = ((maxBlocksInRow + 1) >> 1) * ((maxBlocksInCol + 1) >> 1);
+        lowerResWidth = ((maxBlocksInRow + 1) >> 1) * X265_LOWRES_CU_SIZE;
+        lowerResLines = ((maxBlocksInCol + 1) >> 1) * X265_LOWRES_CU_SIZE;
+        lowerRes.lumaStride = lowerResWidth + 2 * lowerMarginX;
+        if (lowerRes.lumaStride & 31)
+            lowerRes.lumaStride += 32 - (lowerRes.lumaStride & 31);
+
+        size_t lowerPlaneSize = lowerRes.lumaStride * (lowerResLines + 2 * lowerMarginY);
+        size_t lowerPadOffset = lowerRes.lumaStride * lowerMarginY + lowerMarginX;
+        CHECKED_POOL_MALLOC_ZERO(lowerResBuffer, pixel, 4 * lowerPlaneSize, POOL_LOWRES, param->hugePages);
+        for (int i = 0; i < 4; i++)
+            lowerRes.lowresPlane[i] = lowerResBuffer + i * lowerPlaneSize + lowerPadOffset;
+        lowerRes.fpelPlane[0] = lowerRes.lowresPlane[0];
+        lowerRes.isLowres = true;
+
+        for (int i = !!param->memoryBudget; i < bframes + 2; i++)
+        {
+            CHECKED_POOL_MALLOC(lowerResMvs[0][i], MV, lowerCuCount, POOL_LOWRES, param->hugePages);
+            CHECKED_POOL_MALLOC(lowerResMvs[1][i], MV, lowerCuCount, POOL_LOWRES, param->hugePages);
+        }
+    }
+
+    CHECKED_POOL_MALLOC(intraCost, int32_t, cuCount, POOL_LOWRES, param->hugePages);
+    CHECKED_POOL_MALLOC(intraMode, uint8_t, cuCount, POOL_LOWRES, param->hugePages);
 
+    /* costs are indexed by the distances to the references [b - p0][p1 - b],
+     * at most bframes + 1 apart. Budget mode leaves the other distances and
+     * the MVs of distance 0 unallocated */
     for (int i = 0; i < bframes + 2; i++)
     {
         for (int j = 0; j < bframes + 2; j++)
         {
-            CHECKED_MALLOC(rowSatds[i][j], int32_t, maxBlocksInCol);
-            CHECKED_MALLOC(lowresCosts[i][j], uint16_t, cuCount);
+            if (param->memoryBudget && i + j > bframes + 1)
+                continue;
+            CHECKED_POOL_MALLOC(rowSatds[i][j], int32_t, maxBlocksInCol, POOL_LOWRES, param->hugePages);
+            CHECKED_POOL_MALLOC(lowresCosts[i][j], uint16_t, cuCount, POOL_LOWRES, param->hugePages);
         }
     }
 
-    for (int i = 0; i < bframes + 2; i++)
+    for (int i = !!param->memoryBudget; i < bframes + 2; i++)
     {
-        CHECKED_MALLOC(lowresMvs[0][i], MV, cuCount);
-        CHECKED_MALLOC(lowresMvs[1][i], MV, cuCount);
-        CHECKED_MALLOC(lowresMvCosts[0][i], int32_t, cuCount);
-        CHECKED_MALLOC(lowresMvCosts[1][i], int32_t, cuCount);
+        CHECKED_POOL_MALLOC(lowresMvs[0][i], MV, cuCount, POOL_LOWRES, param->hugePages);
+        CHECKED_POOL_MALLOC(lowresMvs[1][i], MV, cuCount, POOL_LOWRES, param->hugePages);
+        CHECKED_POOL_MALLOC(lowresMvCosts[0][i], int32_t, cuCount, POOL_LOWRES, param->hugePages);
+        CHECKED_POOL_MALLOC(lowresMvCosts[1][i], int32_t, cuCount, POOL_LOWRES, param->hugePages);
     }
 
     return true;
@@ -165,33 +202,37 @@ fail:
 
 void Lowres::destroy()
 {
-    X265_FREE(buffer[0]);
-    X265_FREE(intraCost);
-    X265_FREE(intraMode);
+    X265_POOL_FREE(buffer[0]);
+    X265_POOL_FREE(intraCost);
+    X265_POOL_FREE(intraMode);
 
     for (int i = 0; i < bframes + 2; i++)
     {
         for (int j = 0; j < bframes + 2; j++)
         {
-            X265_FREE(rowSatds[i][j]);
-            X265_FREE(lowresCosts[i][j]);
+            X265_POOL_FREE(rowSatds[i][j]);
+            X265_POOL_FREE(lowresCosts[i][j]);
         }
     }
 
     for (int i = 0; i < bframes + 2; i++)
     {
-        X265_FREE(lowresMvs[0][i]);
-        X265_FREE(lowresMvs[1][i]);
-        X265_FREE(lowresMvCosts[0][i]);
-        X265_FREE(lowresMvCosts[1][i]);
+        X265_POOL_FREE(lowresMvs[0][i]);
+        X265_POOL_FREE(lowresMvs[1][i]);
+        X265_POOL_FREE(lowresMvCosts[0][i]);
+        X265_POOL_FREE(lowresMvCosts[1][i]);
+        X265_POOL_FREE(lowerResMvs[0][i]);
+        X265_POOL_FREE(lowerResMvs[1][i]);
     }
-    X265_FREE(qpAqOffset);
-    X265_FREE(invQscaleFactor);
-    X265_FREE(qpCuTreeOffset);
-    X265_FREE(propagateCost);
-    X265_FREE(invQscaleFactor8x8);
-    X265_FREE(qpAqMotionOffset);
-    X265_FREE(blockVariance);
+    X265_POOL_FREE(lowerResBuffer);
+    X265_POOL_FREE(qpAqOffset);
+    X265_POOL_FREE(invQscaleFactor);
+    X265_POOL_FREE(qpCuTreeOffset);
+    X265_POOL_FREE(propagateCost);
+    X265_POOL_FREE(propagateDelta);
+    X265_POOL_FREE(invQscaleFactor8x8);
+    X265_POOL_FREE(qpAqMotionOffset);
+    X265_POOL_FREE(blockVariance);
     if (maxAQDepth > 0)
     {
         for (uint32_t d = 0; d < 4; d++)
@@ -221,6 +262,7 @@ void Lowres::init(PicYuv *origPic, int poc)
     frameNum = poc;
     leadingBframes = 0;
     indB = 0;
+    cuTreeRun = -1;
     memset(costEst, -1, sizeof(costEst));
     memset(weightedCostDelta, 0, sizeof(weightedCostDelta));
 
@@ -229,12 +271,16 @@ void Lowres::init(PicYuv *origPic, int poc)
 
     for (int y = 0; y < bframes + 2; y++)
         for (int x = 0; x < bframes + 2; x++)
-            rowSatds[y][x][0] = -1;
+            if (rowSatds[y][x])
+                rowSatds[y][x][0] = -1;
 
     for (int i = 0; i < bframes + 2; i++)
     {
-        lowresMvs[0][i][0].x = 0x7FFF;
-        lowresMvs[1][i][0].x = 0x7FFF;
+        if (lowresMvs[0][i])
+        {
+            lowresMvs[0][i][0].x = 0x7FFF;
+            lowresMvs[1][i][0].x = 0x7FFF;
+        }
     }
 
     for (int i = 0; i < bframes + 2; i++)
@@ -254,4 +300,16 @@ void Lowres::init(PicYuv *origPic, int poc)
     extendPicBorder(lowresPlane[2], lumaStride, width, lines, origPic->m_lumaMarginX, origPic->m_lumaMarginY);
     extendPicBorder(lowresPlane[3], lumaStride, width, lines, origPic->m_lumaMarginX, origPic->m_lumaMarginY);
     fpelPlane[0] = lowresPlane[0];
+
+    if (lowerResBuffer)
+    {
+        /* downscale the lowres plane the same way, the rows and columns past
+         * its width and height come from the extended border */
+        primitives.frameInitLowres(lowresPlane[0],
+                                   lowerRes.lowresPlane[0], lowerRes.lowresPlane[1], lowerRes.lowresPlane[2], lowerRes.lowresPlane[3],
+                                   lumaStride, lowerRes.lumaStride, lowerResWidth, lowerResLines);
+        for (int i = 0; i < 4; i++)
+            extendPicBorder(lowerRes.lowresPlane[i], lowerRes.lumaStride, lowerResWidth, lowerResLines,
+                            origPic->m_lumaMarginX / 2, origPic->m_lumaMarginY / 2);
+    }
 }
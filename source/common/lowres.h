@@ -32,6 +32,8 @@
 namespace X265_NS {
 // private namespace
 
+struct SubpelPlanes;
+
 struct ReferencePlanes
 {
     ReferencePlanes() { memset(this, 0, sizeof(ReferencePlanes)); }
@@ -39,6 +41,7 @@ struct ReferencePlanes
     pixel*   fpelPlane[3];
     pixel*   lowresPlane[4];
     PicYuv*  reconPic;
+    SubpelPlanes* subpel;   // shared luma sub-pel planes of fpelPlane[0], or NULL
 
     bool     isWeighted;
     bool     isLowres;
@@ -134,11 +137,11 @@ struct PicQPAdaptationLayer
     uint32_t numAQPartInWidth;
     uint32_t numAQPartInHeight;
     uint32_t minAQDepth;
-    double*  dActivity;
-    double*  dQpOffset;
+    float*   dActivity;
+    int16_t* dQpOffset;        // Q8.8
 
-    double*  dCuTreeOffset;
-    double*  dCuTreeOffset8x8;
+    int16_t* dCuTreeOffset;    // Q8.8
+    int16_t* dCuTreeOffset8x8; // log2 ratios of the 8x8 blocks, Q8.8
     double   dAvgActivity;
     bool     bQpSize;
 
@@ -151,6 +154,14 @@ struct Lowres : public ReferencePlanes
 {
     pixel *buffer[4];
 
+    /* --lookahead-hme: the lowres plane downscaled once more, with its hpel
+     * planes, searched in 8x8 blocks to seed the lowres motion search */
+    pixel*          lowerResBuffer;
+    ReferencePlanes lowerRes;
+    int             lowerResWidth;
+    int             lowerResLines;
+    MV*             lowerResMvs[2][X265_BFRAME_MAX + 2];
+
     int    frameNum;         // Presentation frame number
     int    sliceType;        // Slice type decided by lookahead
     int    width;            // width of lowres frame in pixels
@@ -167,6 +178,8 @@ struct Lowres : public ReferencePlanes
     /* lookahead output data */
     int64_t   costEst[X265_BFRAME_MAX + 2][X265_BFRAME_MAX + 2];
     int64_t   costEstAq[X265_BFRAME_MAX + 2][X265_BFRAME_MAX + 2];
+    int64_t   costEstCuTree[X265_BFRAME_MAX + 2][X265_BFRAME_MAX + 2]; // cuTree weighted costs of a lookahead leader
+    int       costRefDist[2];  // distances to the references of the decided frame cost, set by miniGopCosts()
     int32_t*  rowSatds[X265_BFRAME_MAX + 2][X265_BFRAME_MAX + 2];
     int       intraMbs[X265_BFRAME_MAX + 2];
     int32_t*  intraCost;
@@ -188,9 +201,9 @@ struct Lowres : public ReferencePlanes
     int       bframes;
 
     /* rate control / adaptive quant data */
-    double*   qpAqOffset;      // AQ QP offset values for each 16x16 CU
-    double*   qpCuTreeOffset;  // cuTree QP offset values for each 16x16 CU
-    double*   qpAqMotionOffset;
+    int16_t*  qpAqOffset;      // AQ QP offset values for each 16x16 CU, Q8.8
+    int16_t*  qpCuTreeOffset;  // cuTree QP offset values for each 16x16 CU, Q8.8
+    int16_t*  qpAqMotionOffset; // Q8.8
     int*      invQscaleFactor; // qScale values for qp Aq Offsets
     int*      invQscaleFactor8x8; // temporary buffer for qg-size 8
     uint32_t* blockVariance;
@@ -207,6 +220,12 @@ struct Lowres : public ReferencePlanes
     uint32_t m_qgSize;
     
     uint16_t* propagateCost;
+
+    /* incremental cuTree, see Lookahead::cuTreeIncremental() */
+    uint16_t* propagateDelta;   // propagate cost added, then cost removed, since the last run
+    int       cuTreeRun;        // last cuTree() run which propagated into or from this frame
+    int       cuTreeStep[3];    // frameNum of p0 and p1, and referenced, of that run's propagation; -1 if none
+
     double    weightedCostDelta[X265_BFRAME_MAX + 2];
     ReferencePlanes weightedRef[X265_BFRAME_MAX + 2];
     bool create(x265_param* param, PicYuv *origPic, uint32_t qgSize);
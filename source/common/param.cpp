@@ -253,6 +253,17 @@ void x265_param_default(x265_param* param)
     param->rc.aqStrength = 1.0;
     param->rc.qpAdaptationRange = 1.0;
     param->rc.cuTree = 1;
+    param->bCUTreeIncremental = 0;
+    param->bLookaheadHME = 0;
+    param->subpelPlanes = 0;
+    param->hugePages = 0;
+    param->memoryBudget = 0;
+    param->analysisSaveFormat = 1;
+    param->bAnalysisSaveCompress = 0;
+    param->statsFormat = 1;
+    param->bStatsTextDump = 0;
+    param->chunkParallel = 0;
+    param->chunkFrames = 0;
     param->rc.rfConstantMax = 0;
     param->rc.rfConstantMin = 0;
     param->rc.bStatRead = 0;
@@ -334,6 +345,13 @@ void x265_param_default(x265_param* param)
     param->pictureStructure = -1;
     param->bEmitCLL = 1;
 
+    /* Threading */
+    param->sharedThreadPool = NULL;
+    param->bCacheAffinity = 0;
+    param->minFrameThreads = 0;
+    param->frameThreadsLogSave = NULL;
+    param->frameThreadsLogLoad = NULL;
+
     /* SVT Hevc Encoder specific params */
     param->bEnableSvtHevc = 0;
     param->svtHevcParam = NULL;
@@ -905,6 +923,10 @@ int x265_param_parse(x265_param* p, const char* name, const char* value)
     OPT("open-gop") p->bOpenGOP = atobool(value);
     OPT("intra-refresh") p->bIntraRefresh = atobool(value);
     OPT("lookahead-slices") p->lookaheadSlices = atoi(value);
+    OPT("lookahead-hme") p->bLookaheadHME = atobool(value);
+    OPT("subpel-planes") p->subpelPlanes = atoi(value);
+    OPT("huge-pages") p->hugePages = atoi(value);
+    OPT("memory-budget") p->memoryBudget = atoi(value);
     OPT("scenecut")
     {
         p->scenecutThreshold = atobool(value);
@@ -1066,6 +1088,7 @@ int x265_param_parse(x265_param* p, const char* name, const char* value)
     OPT("input-csp") p->internalCsp = parseName(value, x265_source_csp_names, bError);
     OPT("me")        p->searchMethod = parseName(value, x265_motion_est_names, bError);
     OPT("cutree")    p->rc.cuTree = atobool(value);
+    OPT("cutree-incremental") p->bCUTreeIncremental = atobool(value);
     OPT("slow-firstpass") p->rc.bEnableSlowFirstPass = atobool(value);
     OPT("strict-cbr")
     {
@@ -1235,6 +1258,12 @@ int x265_param_parse(x265_param* p, const char* name, const char* value)
         OPT("gop-lookahead") p->gopLookahead = atoi(value);
         OPT("analysis-save") p->analysisSave = strdup(value);
         OPT("analysis-load") p->analysisLoad = strdup(value);
+        OPT("analysis-save-format") p->analysisSaveFormat = atoi(value);
+        OPT("analysis-save-compress") p->bAnalysisSaveCompress = atobool(value);
+        OPT("stats-format") p->statsFormat = atoi(value);
+        OPT("stats-text-dump") p->bStatsTextDump = atobool(value);
+        OPT("chunk-parallel") p->chunkParallel = atoi(value);
+        OPT("chunk-frames") p->chunkFrames = atoi(value);
         OPT("radl") p->radl = atoi(value);
         OPT("max-ausize-factor") p->maxAUSizeFactor = atof(value);
         OPT("dynamic-refine") p->bDynamicRefine = atobool(value);
@@ -1280,6 +1309,10 @@ int x265_param_parse(x265_param* p, const char* name, const char* value)
         OPT("svt-fps-in-vps") x265_log(p, X265_LOG_WARNING, "Option %s is SVT-HEVC Encoder specific; Disabling it here \n", name);
 #endif
         OPT("fades") p->bEnableFades = atobool(value);
+        OPT("cache-affinity") p->bCacheAffinity = atobool(value);
+        OPT("min-frame-threads") p->minFrameThreads = atoi(value);
+        OPT("frame-threads-log-save") p->frameThreadsLogSave = strdup(value);
+        OPT("frame-threads-log-load") p->frameThreadsLogLoad = strdup(value);
         OPT("field") p->bField = atobool( value );
         OPT("cll") p->bEmitCLL = atobool(value);
         else
@@ -1464,12 +1497,24 @@ int x265_check_params(x265_param* param)
           "subme must be less than or equal to X265_MAX_SUBPEL_LEVEL (7)");
     CHECK(param->subpelRefine < 0,
           "subme must be greater than or equal to 0");
+    CHECK(param->subpelPlanes < 0 || param->subpelPlanes > 2,
+          "subpel-planes must be 0, 1 or 2");
+    CHECK(param->hugePages < 0 || param->hugePages > 2,
+          "huge-pages must be 0, 1 or 2");
+    CHECK(param->memoryBudget < 0,
+          "memory-budget must be positive, or 0 for unlimited");
     CHECK(param->limitReferences > 3,
           "limitReferences must be 0, 1, 2 or 3");
     CHECK(param->limitModes > 1,
           "limitRectAmp must be 0, 1");
     CHECK(param->frameNumThreads < 0 || param->frameNumThreads > X265_MAX_FRAME_THREADS,
           "frameNumThreads (--frame-threads) must be [0 .. X265_MAX_FRAME_THREADS)");
+    CHECK(param->minFrameThreads < 0 || param->minFrameThreads > X265_MAX_FRAME_THREADS,
+          "minFrameThreads (--min-frame-threads) must be [0 .. X265_MAX_FRAME_THREADS)");
+    CHECK(param->frameNumThreads && param->minFrameThreads > param->frameNumThreads,
+          "minFrameThreads (--min-frame-threads) must not exceed frameNumThreads (--frame-threads)");
+    CHECK(param->frameThreadsLogSave && param->frameThreadsLogLoad,
+          "--frame-threads-log-save and --frame-threads-log-load are mutually exclusive");
     CHECK(param->cbQpOffset < -12, "Min. Chroma Cb QP Offset is -12");
     CHECK(param->cbQpOffset >  12, "Max. Chroma Cb QP Offset is  12");
     CHECK(param->crQpOffset < -12, "Min. Chroma Cr QP Offset is -12");
@@ -1626,6 +1671,18 @@ int x265_check_params(x265_param* param)
           "Strict-cbr cannot be applied without specifying target bitrate or vbv bufsize");
     CHECK((param->analysisSave || param->analysisLoad) && (param->analysisReuseLevel < 1 || param->analysisReuseLevel > 10),
         "Invalid analysis refine level. Value must be between 1 and 10 (inclusive)");
+    CHECK(param->analysisSaveFormat < 1 || param->analysisSaveFormat > 2,
+        "Invalid analysis-save-format. Supports 1 (sequential) and 2 (indexed)");
+    CHECK(param->bAnalysisSaveCompress && param->analysisSaveFormat != 2,
+        "analysis-save-compress requires analysis-save-format 2");
+    CHECK(param->statsFormat < 1 || param->statsFormat > 2,
+        "Invalid stats-format. Supports 1 (text) and 2 (binary)");
+    CHECK(param->bStatsTextDump && param->statsFormat != 2,
+        "stats-text-dump requires stats-format 2");
+    CHECK(param->chunkParallel < 0 || param->chunkParallel > X265_MAX_CHUNK_PARALLEL,
+        "chunk-parallel must be between 0 and 64");
+    CHECK(param->chunkFrames < 0,
+        "chunk-frames must be positive");
     CHECK(param->scaleFactor > 2, "Invalid scale-factor. Supports factor <= 2");
     CHECK(param->rc.qpMax < QP_MIN || param->rc.qpMax > QP_MAX_MAX,
         "qpmax exceeds supported range (0 to 69)");
@@ -1809,6 +1866,7 @@ void x265_print_params(x265_param* param)
     TOOLOPT(param->bEnableStrongIntraSmoothing, "strong-intra-smoothing");
     TOOLVAL(param->lookaheadSlices, "lslices=%d");
     TOOLVAL(param->lookaheadThreads, "lthreads=%d")
+    TOOLOPT(param->bLookaheadHME, "lookahead-hme");
     TOOLVAL(param->bCTUInfo, "ctu-info=%d");
     if (param->bAnalysisType == AVC_INFO)
     {
@@ -1858,8 +1916,11 @@ char *x265_param2string(x265_param* p, int padx, int pady)
 
     s += sprintf(s, "cpuid=%d", p->cpuid);
     s += sprintf(s, " frame-threads=%d", p->frameNumThreads);
+    if (p->minFrameThreads)
+        s += sprintf(s, " min-frame-threads=%d", p->minFrameThreads);
     if (p->numaPools)
         s += sprintf(s, " numa-pools=%s", p->numaPools);
+    BOOL(p->bCacheAffinity, "cache-affinity");
     BOOL(p->bEnableWavefront, "wpp");
     BOOL(p->bDistributeModeAnalysis, "pmode");
     BOOL(p->bDistributeMotionEstimation, "pme");
@@ -1900,6 +1961,7 @@ char *x265_param2string(x265_param* p, int padx, int pady)
     s += sprintf(s, " bframe-bias=%d", p->bFrameBias);
     s += sprintf(s, " rc-lookahead=%d", p->lookaheadDepth);
     s += sprintf(s, " lookahead-slices=%d", p->lookaheadSlices);
+    BOOL(p->bLookaheadHME, "lookahead-hme");
     s += sprintf(s, " scenecut=%d", p->scenecutThreshold);
     s += sprintf(s, " radl=%d", p->radl);
     BOOL(p->bEnableHRDConcatFlag, "splice");
@@ -1989,6 +2051,8 @@ char *x265_param2string(x265_param* p, int padx, int pady)
     s += sprintf(s, " aq-mode=%d", p->rc.aqMode);
     s += sprintf(s, " aq-strength=%.2f", p->rc.aqStrength);
     BOOL(p->rc.cuTree, "cutree");
+    if (p->rc.cuTree)
+        BOOL(p->bCUTreeIncremental, "cutree-incremental");
     s += sprintf(s, " zone-count=%d", p->rc.zoneCount);
     if (p->rc.zoneCount)
     {
@@ -2395,6 +2459,24 @@ void x265_copy_params(x265_param* dst, x265_param* src)
     dst->bEnableSvtHevc = src->bEnableSvtHevc;
     dst->bEnableFades = src->bEnableFades;
     dst->bField = src->bField;
+    dst->sharedThreadPool = src->sharedThreadPool;
+    dst->bCacheAffinity = src->bCacheAffinity;
+    dst->minFrameThreads = src->minFrameThreads;
+    dst->bCUTreeIncremental = src->bCUTreeIncremental;
+    dst->bLookaheadHME = src->bLookaheadHME;
+    dst->subpelPlanes = src->subpelPlanes;
+    dst->hugePages = src->hugePages;
+    dst->memoryBudget = src->memoryBudget;
+    dst->analysisSaveFormat = src->analysisSaveFormat;
+    dst->bAnalysisSaveCompress = src->bAnalysisSaveCompress;
+    dst->statsFormat = src->statsFormat;
+    dst->bStatsTextDump = src->bStatsTextDump;
+    dst->chunkParallel = src->chunkParallel;
+    dst->chunkFrames = src->chunkFrames;
+    if (src->frameThreadsLogSave) dst->frameThreadsLogSave = strdup(src->frameThreadsLogSave);
+    else dst->frameThreadsLogSave = NULL;
+    if (src->frameThreadsLogLoad) dst->frameThreadsLogLoad = strdup(src->frameThreadsLogLoad);
+    else dst->frameThreadsLogLoad = NULL;
 
 #ifdef SVT_HEVC
     memcpy(dst->svtHevcParam, src->svtHevcParam, sizeof(EB_H265_ENC_CONFIGURATION));
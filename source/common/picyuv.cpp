@@ -24,6 +24,7 @@
 
 #include "common.h"
 #include "picyuv.h"
+#include "arena.h"
 #include "slice.h"
 #include "primitives.h"
 
@@ -95,7 +96,7 @@ bool PicYuv::create(x265_param* param, bool picAlloc, pixel *pixelbuf)
     {
         if (picAlloc)
         {
-            CHECKED_MALLOC(m_picBuf[0], pixel, m_stride * (maxHeight + (m_lumaMarginY * 2)));
+            CHECKED_POOL_MALLOC(m_picBuf[0], pixel, m_stride * (maxHeight + (m_lumaMarginY * 2)), POOL_PICTURE, param->hugePages);
             m_picOrg[0] = m_picBuf[0] + m_lumaMarginY * m_stride + m_lumaMarginX;
         }
     }
@@ -107,8 +108,8 @@ bool PicYuv::create(x265_param* param, bool picAlloc, pixel *pixelbuf)
         m_strideC = ((numCuInWidth * m_param->maxCUSize) >> m_hChromaShift) + (m_chromaMarginX * 2);
         if (picAlloc)
         {
-            CHECKED_MALLOC(m_picBuf[1], pixel, m_strideC * ((maxHeight >> m_vChromaShift) + (m_chromaMarginY * 2)));
-            CHECKED_MALLOC(m_picBuf[2], pixel, m_strideC * ((maxHeight >> m_vChromaShift) + (m_chromaMarginY * 2)));
+            CHECKED_POOL_MALLOC(m_picBuf[1], pixel, m_strideC * ((maxHeight >> m_vChromaShift) + (m_chromaMarginY * 2)), POOL_PICTURE, param->hugePages);
+            CHECKED_POOL_MALLOC(m_picBuf[2], pixel, m_strideC * ((maxHeight >> m_vChromaShift) + (m_chromaMarginY * 2)), POOL_PICTURE, param->hugePages);
 
             m_picOrg[1] = m_picBuf[1] + m_chromaMarginY * m_strideC + m_chromaMarginX;
             m_picOrg[2] = m_picBuf[2] + m_chromaMarginY * m_strideC + m_chromaMarginX;
@@ -199,9 +200,9 @@ fail:
 
 void PicYuv::destroy()
 {
-    X265_FREE(m_picBuf[0]);
-    X265_FREE(m_picBuf[1]);
-    X265_FREE(m_picBuf[2]);
+    X265_POOL_FREE(m_picBuf[0]);
+    X265_POOL_FREE(m_picBuf[1]);
+    X265_POOL_FREE(m_picBuf[2]);
 }
 
 /* Copy pixels from an x265_picture into internal PicYuv instance.
@@ -464,79 +465,48 @@ void PicYuv::copyFromPicture(const x265_picture& pic, const x265_param& param, i
 
 namespace X265_NS {
 
-template<uint32_t OUTPUT_BITDEPTH_DIV8>
-static void md5_block(MD5Context& md5, const pixel* plane, uint32_t n)
+namespace {
+/* Reads the samples of a plane in raster order as the bytes the MD5 of the
+ * decoded picture hash covers: the low, then above 8 bits the high byte */
+struct PlaneReader
 {
-    /* create a 64 byte buffer for packing pixel's into */
-    uint8_t buf[64 / OUTPUT_BITDEPTH_DIV8][OUTPUT_BITDEPTH_DIV8];
-
-    for (uint32_t i = 0; i < n; i++)
-    {
-        pixel pel = plane[i];
-        /* perform bitdepth and endian conversion */
-        for (uint32_t d = 0; d < OUTPUT_BITDEPTH_DIV8; d++)
-            buf[i][d] = (uint8_t)(pel >> (d * 8));
-    }
-
-    MD5Update(&md5, (uint8_t*)buf, n * OUTPUT_BITDEPTH_DIV8);
-}
-
-/* Update md5 with all samples in plane in raster order, each sample
- * is adjusted to OUTBIT_BITDEPTH_DIV8 */
-template<uint32_t OUTPUT_BITDEPTH_DIV8>
-static void md5_plane(MD5Context& md5, const pixel* plane, uint32_t width, uint32_t height, intptr_t stride)
-{
-    /* N is the number of samples to process per md5 update.
-     * All N samples must fit in buf */
-    uint32_t N = 32;
-    uint32_t width_modN = width % N;
-    uint32_t width_less_modN = width - width_modN;
-
-    for (uint32_t y = 0; y < height; y++)
-    {
-        /* convert pel's into uint32_t chars in little endian byte order.
-         * NB, for 8bit data, data is truncated to 8bits. */
-        for (uint32_t x = 0; x < width_less_modN; x += N)
-            md5_block<OUTPUT_BITDEPTH_DIV8>(md5, &plane[y * stride + x], N);
-
-        /* mop up any of the remaining line */
-        md5_block<OUTPUT_BITDEPTH_DIV8>(md5, &plane[y * stride + width_less_modN], width_modN);
-    }
-}
-
-void updateCRC(const pixel* plane, uint32_t& crcVal, uint32_t height, uint32_t width, intptr_t stride)
-{
-    uint32_t crcMsb;
-    uint32_t bitVal;
-    uint32_t bitIdx;
-
-    for (uint32_t y = 0; y < height; y++)
+    const pixel* row;
+    intptr_t     stride;
+    uint32_t     width;
+    uint32_t     rowsLeft;
+    uint32_t     x;
+
+    /* copy up to size bytes, returns the number copied */
+    uint32_t read(uint8_t* dst, uint32_t size)
     {
-        for (uint32_t x = 0; x < width; x++)
+        const uint32_t bytesPerSample = X265_DEPTH > 8 ? 2 : 1;
+        uint32_t bytes = 0;
+        while (rowsLeft && bytes + bytesPerSample <= size)
         {
-            // take CRC of first pictureData byte
-            for (bitIdx = 0; bitIdx < 8; bitIdx++)
+            uint32_t n = X265_MIN(width - x, (size - bytes) / bytesPerSample);
+            for (uint32_t i = 0; i < n; i++)
             {
-                crcMsb = (crcVal >> 15) & 1;
-                bitVal = (plane[y * stride + x] >> (7 - bitIdx)) & 1;
-                crcVal = (((crcVal << 1) + bitVal) & 0xffff) ^ (crcMsb * 0x1021);
+                pixel pel = row[x + i];
+                dst[bytes++] = (uint8_t)pel;
+                if (X265_DEPTH > 8)
+                    dst[bytes++] = (uint8_t)(pel >> 8);
             }
-
-#if _MSC_VER
-#pragma warning(disable: 4127) // conditional expression is constant
-#endif
-            // take CRC of second pictureData byte if bit depth is greater than 8-bits
-            if (X265_DEPTH > 8)
+            x += n;
+            if (x == width)
             {
-                for (bitIdx = 0; bitIdx < 8; bitIdx++)
-                {
-                    crcMsb = (crcVal >> 15) & 1;
-                    bitVal = (plane[y * stride + x] >> (15 - bitIdx)) & 1;
-                    crcVal = (((crcVal << 1) + bitVal) & 0xffff) ^ (crcMsb * 0x1021);
-                }
+                row += stride;
+                rowsLeft--;
+                x = 0;
             }
         }
+        return bytes;
     }
+};
+}
+
+void updateCRC(const pixel* plane, uint32_t& crcVal, uint32_t height, uint32_t width, intptr_t stride)
+{
+    crcVal = primitives.picHashCRC(plane, stride, width, height, crcVal);
 }
 
 void crcFinish(uint32_t& crcVal, uint8_t digest[16])
@@ -555,19 +525,8 @@ void crcFinish(uint32_t& crcVal, uint8_t digest[16])
 
 void updateChecksum(const pixel* plane, uint32_t& checksumVal, uint32_t height, uint32_t width, intptr_t stride, int row, uint32_t cuHeight)
 {
-    uint8_t xor_mask;
-
-    for (uint32_t y = row * cuHeight; y < ((row * cuHeight) + height); y++)
-    {
-        for (uint32_t x = 0; x < width; x++)
-        {
-            xor_mask = (uint8_t)((x & 0xff) ^ (y & 0xff) ^ (x >> 8) ^ (y >> 8));
-            checksumVal = (checksumVal + ((plane[y * stride + x] & 0xff) ^ xor_mask)) & 0xffffffff;
-
-            if (X265_DEPTH > 8)
-                checksumVal = (checksumVal + ((plane[y * stride + x] >> 7 >> 1) ^ xor_mask)) & 0xffffffff;
-        }
-    }
+    uint32_t y = row * cuHeight;
+    checksumVal = primitives.picHashChecksum(plane + y * stride, stride, width, height, y, checksumVal);
 }
 
 void checksumFinish(uint32_t checksum, uint8_t digest[16])
@@ -578,13 +537,71 @@ void checksumFinish(uint32_t checksum, uint8_t digest[16])
     digest[3] =  checksum        & 0xff;
 }
 
-void updateMD5Plane(MD5Context& md5, const pixel* plane, uint32_t width, uint32_t height, intptr_t stride)
+void updateMD5Planes(MD5Context* md5, const pixel* const* planes, const uint32_t* width, const uint32_t* height, const intptr_t* stride, int numPlanes)
 {
-    /* choose an md5_plane packing function based on the system bitdepth */
-    typedef void(*MD5PlaneFunc)(MD5Context&, const pixel*, uint32_t, uint32_t, intptr_t);
-    MD5PlaneFunc md5_plane_func;
-    md5_plane_func = X265_DEPTH <= 8 ? (MD5PlaneFunc)md5_plane<1> : (MD5PlaneFunc)md5_plane<2>;
+    /* the planes are hashed side by side, up to STAGE_BLOCKS blocks of each
+     * at a time, their bytes staged after the partial block of their context */
+    enum { STAGE_BLOCKS = 32 };
+    ALIGN_VAR_16(uint8_t, stage[3][STAGE_BLOCKS * 64]);
+    PlaneReader reader[3];
+
+    for (int i = 0; i < numPlanes; i++)
+    {
+        reader[i].row = planes[i];
+        reader[i].stride = stride[i];
+        reader[i].width = width[i];
+        reader[i].rowsLeft = width[i] ? height[i] : 0;
+        reader[i].x = 0;
+    }
+
+    for (;;)
+    {
+        uint32_t* state[3];
+        const uint8_t* data[3];
+        uint32_t blocks[3];
+        uint32_t minBlocks = STAGE_BLOCKS;
+        int numStreams = 0;
+
+        for (int i = 0; i < numPlanes; i++)
+        {
+            if (!reader[i].rowsLeft)
+                continue;
+
+            MD5Context& ctx = md5[i];
+            uint32_t pending = (ctx.bits[0] >> 3) & 0x3f;
+            memcpy(stage[i], ctx.in, pending);
+            uint32_t bytes = reader[i].read(stage[i] + pending, sizeof(stage[i]) - pending);
 
-    md5_plane_func(md5, plane, width, height, stride);
+            uint32_t t = ctx.bits[0];
+            if ((ctx.bits[0] = t + (bytes << 3)) < t)
+                ctx.bits[1]++;
+
+            /* a partial block remains only once the plane is read */
+            uint32_t size = pending + bytes;
+            memcpy(ctx.in, stage[i] + (size & ~63), size & 63);
+
+            if (size >= 64)
+            {
+                state[numStreams] = ctx.buf;
+                data[numStreams] = stage[i];
+                blocks[numStreams] = size >> 6;
+                minBlocks = X265_MIN(minBlocks, blocks[numStreams]);
+                numStreams++;
+            }
+        }
+
+        if (!numStreams)
+            break;
+
+        primitives.md5Blocks(state, data, numStreams, minBlocks);
+        for (int i = 0; i < numStreams; i++)
+        {
+            if (blocks[i] > minBlocks)
+            {
+                const uint8_t* rest = data[i] + minBlocks * 64;
+                primitives.md5Blocks(&state[i], &rest, 1, blocks[i] - minBlocks);
+            }
+        }
+    }
 }
 }
@@ -27,6 +27,8 @@
 #include "common.h"
 #include "slicetype.h"      // LOWRES_COST_MASK
 #include "primitives.h"
+#include "constants.h"
+#include "md5.h"
 #include "x265.h"
 
 #include <cstdlib> // abs()
@@ -918,19 +920,77 @@ static void estimateCUPropagateCost(int* dst, const uint16_t* propagateIn, const
     //}
 }
 
-/* Conversion between double and Q8.8 fixed point (big-endian) for storage */
-static void cuTreeFix8Pack(uint16_t *dst, double *src, int count)
+static int64_t cuTreeWeightCost(const uint16_t* costs, const int16_t* qpFix8, int count)
 {
+    int64_t sum = 0;
     for (int i = 0; i < count; i++)
-        dst[i] = (uint16_t)(int16_t)(src[i] * 256.0);
+        sum += ((costs[i] & LOWRES_COST_MASK) * x265_exp2fix8(qpFix8[i]) + 128) >> 8;
+    return sum;
 }
 
-static void cuTreeFix8Unpack(double *dst, uint16_t *src, int count)
+static uint32_t nalEscape_c(uint8_t* dst, const uint8_t* src, uint32_t size, uint32_t zeros)
 {
-    for (int i = 0; i < count; i++)
+    uint32_t bytes = 0;
+    for (uint32_t i = 0; i < size; i++)
     {
-        int16_t qpFix8 = src[i];
-        dst[i] = (double)(qpFix8) / 256.0;
+        if (zeros >= 2 && src[i] <= 0x03)
+        {
+            /* inject 0x03 to prevent emulating a start code */
+            dst[bytes++] = 0x03;
+            zeros = 0;
+        }
+
+        dst[bytes++] = src[i];
+        zeros = src[i] ? 0 : zeros + 1;
+    }
+
+    return bytes;
+}
+
+static uint32_t picHashCRC_c(const pixel* plane, intptr_t stride, uint32_t width, uint32_t height, uint32_t crc)
+{
+    for (uint32_t y = 0; y < height; y++, plane += stride)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            crc = ((crc << 8) & 0xffff) ^ (plane[x] & 0xff) ^ g_picHashCRCTable[crc >> 8];
+            if (X265_DEPTH > 8)
+                crc = ((crc << 8) & 0xffff) ^ (plane[x] >> 7 >> 1) ^ g_picHashCRCTable[crc >> 8];
+        }
+    }
+
+    return crc;
+}
+
+static uint32_t picHashChecksum_c(const pixel* plane, intptr_t stride, uint32_t width, uint32_t height, uint32_t y, uint32_t checksum)
+{
+    for (uint32_t row = 0; row < height; row++, y++, plane += stride)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint8_t xorMask = (uint8_t)((x & 0xff) ^ (y & 0xff) ^ (x >> 8) ^ (y >> 8));
+            checksum += (plane[x] & 0xff) ^ xorMask;
+            if (X265_DEPTH > 8)
+                checksum += (plane[x] >> 7 >> 1) ^ xorMask;
+        }
+    }
+
+    return checksum;
+}
+
+static void md5Blocks_c(uint32_t* const* state, const uint8_t* const* data, int numStreams, uint32_t numBlocks)
+{
+    uint32_t in[16];
+    for (int i = 0; i < numStreams; i++)
+    {
+        const uint8_t* block = data[i];
+        for (uint32_t b = 0; b < numBlocks; b++, block += 64)
+        {
+            /* the words of a block are little endian */
+            for (int j = 0; j < 16; j++)
+                in[j] = block[4 * j] | (block[4 * j + 1] << 8) | (block[4 * j + 2] << 16) | ((uint32_t)block[4 * j + 3] << 24);
+            MD5Transform(state[i], in);
+        }
     }
 }
 
@@ -1319,8 +1379,11 @@ void setupPixelPrimitives_c(EncoderPrimitives &p)
     p.planeClipAndMax = planeClipAndMax_c;
 #endif
     p.propagateCost = estimateCUPropagateCost;
-    p.fix8Unpack = cuTreeFix8Unpack;
-    p.fix8Pack = cuTreeFix8Pack;
+    p.cutreeWeightCost = cuTreeWeightCost;
+    p.nalEscape = nalEscape_c;
+    p.picHashCRC = picHashCRC_c;
+    p.picHashChecksum = picHashChecksum_c;
+    p.md5Blocks = md5Blocks_c;
 
     p.cu[BLOCK_4x4].ssimDist = ssimDist_c<2>;
     p.cu[BLOCK_8x8].ssimDist = ssimDist_c<3>;
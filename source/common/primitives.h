@@ -208,8 +208,23 @@ typedef pixel (*planeClipAndMax_t)(pixel *src, intptr_t stride, int width, int h
 
 typedef void (*cutree_propagate_cost) (int* dst, const uint16_t* propagateIn, const int32_t* intraCosts, const uint16_t* interCosts, const int32_t* invQscales, const double* fpsFactor, int len);
 
-typedef void (*cutree_fix8_unpack)(double *dst, uint16_t *src, int count);
-typedef void (*cutree_fix8_pack)(uint16_t *dst, double *src, int count);
+/* sum of the lowres costs of count CUs weighted by their Q8.8 QP offsets */
+typedef int64_t (*cutree_weight_cost)(const uint16_t* costs, const int16_t* qpFix8, int count);
+
+/* copy size bytes of RBSP from src to dst inserting emulation prevention bytes,
+ * zeros is the count of 0x00 bytes (0..2) already ending the output. Returns
+ * the number of bytes written to dst */
+typedef uint32_t (*nal_escape_t)(uint8_t* dst, const uint8_t* src, uint32_t size, uint32_t zeros);
+
+/* decoded picture hash SEI. The CRC (polynomial 0x1021, without the final 16
+ * zero bits) and the checksum cover height rows of width samples, each sample
+ * hashed as its low then (above 8 bits) its high byte. crc and checksum are
+ * the values for the rows above, y is the row of plane in the picture. The
+ * MD5 transform hashes numBlocks 64 byte blocks of each of numStreams (1 to 4)
+ * independent messages, updating their state[i] */
+typedef uint32_t (*pic_hash_crc_t)(const pixel* plane, intptr_t stride, uint32_t width, uint32_t height, uint32_t crc);
+typedef uint32_t (*pic_hash_checksum_t)(const pixel* plane, intptr_t stride, uint32_t width, uint32_t height, uint32_t y, uint32_t checksum);
+typedef void (*md5_blocks_t)(uint32_t* const* state, const uint8_t* const* data, int numStreams, uint32_t numBlocks);
 
 typedef int (*scanPosLast_t)(const uint16_t *scan, const coeff_t *coeff, uint16_t *coeffSign, uint16_t *coeffFlag, uint8_t *coeffNum, int numSig, const uint16_t* scanCG4x4, const int trSize);
 typedef uint32_t (*findPosFirstLast_t)(const int16_t *dstCoeff, const intptr_t trSize, const uint16_t scanTbl[16]);
@@ -350,8 +365,7 @@ struct EncoderPrimitives
 
     downscale_t           frameInitLowres;
     cutree_propagate_cost propagateCost;
-    cutree_fix8_unpack    fix8Unpack;
-    cutree_fix8_pack      fix8Pack;
+    cutree_weight_cost    cutreeWeightCost;
 
     extendCURowBorder_t   extendRowBorder;
     planecopy_cp_t        planecopy_cp;
@@ -359,6 +373,12 @@ struct EncoderPrimitives
     planecopy_sp_t        planecopy_sp_shl;
     planeClipAndMax_t     planeClipAndMax;
 
+    nal_escape_t          nalEscape;
+
+    pic_hash_crc_t        picHashCRC;
+    pic_hash_checksum_t   picHashChecksum;
+    md5_blocks_t          md5Blocks;
+
     weightp_sp_t          weight_sp;
     weightp_pp_t          weight_pp;
 
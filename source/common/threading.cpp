@@ -82,6 +82,60 @@ int no_atomic_add(int* ptr, int val)
     pthread_mutex_unlock(&g_mutex);
     return ret;
 }
+
+int64_t no_atomic_add64(int64_t* ptr, int64_t val)
+{
+    pthread_mutex_lock(&g_mutex);
+    int64_t ret = *ptr;
+    *ptr += val;
+    pthread_mutex_unlock(&g_mutex);
+    return ret;
+}
+
+int64_t no_atomic_cas64(int64_t* ptr, int64_t oldval, int64_t newval)
+{
+    pthread_mutex_lock(&g_mutex);
+    int64_t ret = *ptr;
+    if (ret == oldval)
+        *ptr = newval;
+    pthread_mutex_unlock(&g_mutex);
+    return ret;
+}
+#endif
+
+#if X265_FUTEX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+static int initFutexSpinLimit()
+{
+    return sysconf(_SC_NPROCESSORS_ONLN) > 1 ? FUTEX_SPIN_MAX : 0;
+}
+
+int g_futexSpinLimit = initFutexSpinLimit();
+
+bool futexWait(volatile int* addr, int val, int64_t timeoutUs)
+{
+    struct timespec ts;
+    struct timespec* timeout = NULL;
+    if (timeoutUs >= 0)
+    {
+        ts.tv_sec = (time_t)(timeoutUs / 1000000);
+        ts.tv_nsec = (long)(timeoutUs % 1000000) * 1000;
+        timeout = &ts;
+    }
+
+    /* EAGAIN (value already changed) and EINTR are reported as wakeups, the
+     * callers re-check their condition */
+    if (syscall(SYS_futex, (int*)addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0) < 0)
+        return errno != ETIMEDOUT;
+    return true;
+}
+
+void futexWake(volatile int* addr, int count)
+{
+    syscall(SYS_futex, (int*)addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
 #endif
 
 /* C shim for forced stack alignment */
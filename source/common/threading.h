@@ -43,6 +43,14 @@
 #include <sys/sysctl.h>
 #endif
 
+/* futex based Event and ThreadSafeInteger, see ENABLE_FUTEX in CMakeLists.txt */
+#if ENABLE_FUTEX && defined(__linux__) && defined(__GNUC__) && !NO_ATOMICS
+#define X265_FUTEX 1
+#include <limits.h>
+#else
+#define X265_FUTEX 0
+#endif
+
 #if NO_ATOMICS
 
 #include <sys/time.h>
@@ -55,6 +63,8 @@ int no_atomic_and(int* ptr, int mask);
 int no_atomic_inc(int* ptr);
 int no_atomic_dec(int* ptr);
 int no_atomic_add(int* ptr, int val);
+int64_t no_atomic_add64(int64_t* ptr, int64_t val);
+int64_t no_atomic_cas64(int64_t* ptr, int64_t oldval, int64_t newval);
 }
 
 #define CLZ(id, x)            id = (unsigned long)__builtin_clz(x) ^ 31
@@ -64,6 +74,8 @@ int no_atomic_add(int* ptr, int val);
 #define ATOMIC_INC(ptr)       no_atomic_inc((int*)ptr)
 #define ATOMIC_DEC(ptr)       no_atomic_dec((int*)ptr)
 #define ATOMIC_ADD(ptr, val)  no_atomic_add((int*)ptr, val)
+#define ATOMIC_ADD64(ptr, val) no_atomic_add64((int64_t*)ptr, val)
+#define ATOMIC_CAS64(ptr, oldval, newval) no_atomic_cas64((int64_t*)ptr, oldval, newval)
 #define GIVE_UP_TIME()        usleep(0)
 
 #elif __GNUC__               /* GCCs builtin atomics */
@@ -78,6 +90,8 @@ int no_atomic_add(int* ptr, int val);
 #define ATOMIC_INC(ptr)       __sync_add_and_fetch((volatile int32_t*)ptr, 1)
 #define ATOMIC_DEC(ptr)       __sync_add_and_fetch((volatile int32_t*)ptr, -1)
 #define ATOMIC_ADD(ptr, val)  __sync_fetch_and_add((volatile int32_t*)ptr, val)
+#define ATOMIC_ADD64(ptr, val) __sync_fetch_and_add((volatile int64_t*)ptr, val)
+#define ATOMIC_CAS64(ptr, oldval, newval) __sync_val_compare_and_swap((volatile int64_t*)ptr, oldval, newval)
 #define GIVE_UP_TIME()        usleep(0)
 
 #elif defined(_MSC_VER)       /* Windows atomic intrinsics */
@@ -91,6 +105,8 @@ int no_atomic_add(int* ptr, int val);
 #define ATOMIC_ADD(ptr, val)  InterlockedExchangeAdd((volatile LONG*)ptr, val)
 #define ATOMIC_OR(ptr, mask)  _InterlockedOr((volatile LONG*)ptr, (LONG)mask)
 #define ATOMIC_AND(ptr, mask) _InterlockedAnd((volatile LONG*)ptr, (LONG)mask)
+#define ATOMIC_ADD64(ptr, val) InterlockedExchangeAdd64((volatile LONGLONG*)ptr, val)
+#define ATOMIC_CAS64(ptr, oldval, newval) InterlockedCompareExchange64((volatile LONGLONG*)ptr, newval, oldval)
 #define GIVE_UP_TIME()        Sleep(0)
 
 #endif // ifdef __GNUC__
@@ -278,6 +294,213 @@ protected:
     pthread_mutex_t handle;
 };
 
+#if X265_FUTEX
+
+/* Linux futex based Event and ThreadSafeInteger. The uncontended paths are a
+ * single atomic operation; a waiter spins briefly on the futex word before
+ * sleeping in the kernel, and signalers only enter the kernel when a waiter
+ * has announced itself. The spin length adapts per object: it grows while
+ * spinning succeeds and shrinks when the waiter had to sleep anyway */
+
+enum { FUTEX_SPIN_MIN = 16, FUTEX_SPIN_MAX = 1024 };
+
+/* returns false if the wait timed out, else true (woken, value changed, or
+ * spurious). timeoutUs < 0 waits forever */
+bool futexWait(volatile int* addr, int val, int64_t timeoutUs);
+void futexWake(volatile int* addr, int count);
+
+/* zero on uniprocessor systems, where spinning can only delay the signaler */
+extern int g_futexSpinLimit;
+
+#if X265_ARCH_X86
+#define FUTEX_CPU_PAUSE() __builtin_ia32_pause()
+#else
+#define FUTEX_CPU_PAUSE() __asm__ __volatile__("" ::: "memory")
+#endif
+
+class Event
+{
+public:
+
+    Event()
+    {
+        m_counter = 0;
+        m_waiters = 0;
+        m_spin = FUTEX_SPIN_MIN;
+    }
+
+    void wait()
+    {
+        if (spinAcquire())
+            return;
+
+        __atomic_fetch_add(&m_waiters, 1, __ATOMIC_SEQ_CST);
+        while (!tryAcquire())
+            futexWait(&m_counter, 0, -1);
+        __atomic_fetch_sub(&m_waiters, 1, __ATOMIC_SEQ_CST);
+    }
+
+    bool timedWait(uint32_t waitms)
+    {
+        /* returns true if the wait timed out */
+        if (spinAcquire())
+            return false;
+
+        int64_t deadline = x265_mdate() + (int64_t)waitms * 1000;
+        bool bTimedOut = false;
+        __atomic_fetch_add(&m_waiters, 1, __ATOMIC_SEQ_CST);
+        while (!tryAcquire())
+        {
+            int64_t remaining = deadline - x265_mdate();
+            if (remaining <= 0)
+            {
+                bTimedOut = true;
+                break;
+            }
+            futexWait(&m_counter, 0, remaining);
+        }
+        __atomic_fetch_sub(&m_waiters, 1, __ATOMIC_SEQ_CST);
+        return bTimedOut;
+    }
+
+    void trigger()
+    {
+        int count = __atomic_load_n(&m_counter, __ATOMIC_RELAXED);
+        while (count < INT_MAX &&
+               !__atomic_compare_exchange_n(&m_counter, &count, count + 1, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        {}
+
+        /* Signal a single blocking thread */
+        if (__atomic_load_n(&m_waiters, __ATOMIC_SEQ_CST))
+            futexWake(&m_counter, 1);
+    }
+
+protected:
+
+    bool tryAcquire()
+    {
+        int count = __atomic_load_n(&m_counter, __ATOMIC_RELAXED);
+        while (count > 0)
+        {
+            if (__atomic_compare_exchange_n(&m_counter, &count, count - 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return true;
+        }
+        return false;
+    }
+
+    bool spinAcquire()
+    {
+        int spin = X265_MIN(m_spin, g_futexSpinLimit);
+        for (int i = 0; i < spin; i++)
+        {
+            if (tryAcquire())
+            {
+                m_spin = X265_MIN(m_spin * 2, FUTEX_SPIN_MAX);
+                return true;
+            }
+            FUTEX_CPU_PAUSE();
+        }
+        if (tryAcquire())
+            return true;
+        m_spin = X265_MAX(m_spin / 2, FUTEX_SPIN_MIN);
+        return false;
+    }
+
+    volatile int m_counter;
+    volatile int m_waiters;
+    int          m_spin;     // adaptive, updated without synchronization
+};
+
+/* This class is intended for use in signaling state changes safely between CPU
+ * cores. One thread should be a writer and multiple threads may be readers.
+ * Writes are sequentially consistent and reads have acquire semantics, so
+ * writes made by the writer thread are visible prior to readers seeing the
+ * m_val change. Blocking waits sleep on m_seq, which every set(), incr() and
+ * poke() advances */
+class ThreadSafeInteger
+{
+public:
+
+    ThreadSafeInteger()
+    {
+        m_val = 0;
+        m_seq = 0;
+        m_waiters = 0;
+        m_spin = FUTEX_SPIN_MIN;
+    }
+
+    int waitForChange(int prev)
+    {
+        int seq = __atomic_load_n(&m_seq, __ATOMIC_ACQUIRE);
+        int val = get();
+        if (val != prev)
+            return val;
+
+        int spin = X265_MIN(m_spin, g_futexSpinLimit);
+        for (int i = 0; i < spin; i++)
+        {
+            if (__atomic_load_n(&m_seq, __ATOMIC_ACQUIRE) != seq)
+            {
+                m_spin = X265_MIN(m_spin * 2, FUTEX_SPIN_MAX);
+                return get();
+            }
+            FUTEX_CPU_PAUSE();
+        }
+        if (spin)
+            m_spin = X265_MAX(m_spin / 2, FUTEX_SPIN_MIN);
+
+        __atomic_fetch_add(&m_waiters, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&m_val, __ATOMIC_SEQ_CST) == prev)
+            futexWait(&m_seq, seq, -1);
+        __atomic_fetch_sub(&m_waiters, 1, __ATOMIC_SEQ_CST);
+        return get();
+    }
+
+    int get()
+    {
+        return __atomic_load_n(&m_val, __ATOMIC_ACQUIRE);
+    }
+
+    int getIncr(int n = 1)
+    {
+        return __atomic_fetch_add(&m_val, n, __ATOMIC_SEQ_CST);
+    }
+
+    void set(int newval)
+    {
+        __atomic_store_n(&m_val, newval, __ATOMIC_SEQ_CST);
+        wakeAll();
+    }
+
+    void poke(void)
+    {
+        /* awaken all waiting threads, but make no change */
+        wakeAll();
+    }
+
+    void incr()
+    {
+        __atomic_fetch_add(&m_val, 1, __ATOMIC_SEQ_CST);
+        wakeAll();
+    }
+
+protected:
+
+    void wakeAll()
+    {
+        __atomic_fetch_add(&m_seq, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&m_waiters, __ATOMIC_SEQ_CST))
+            futexWake(&m_seq, INT_MAX);
+    }
+
+    volatile int m_val;
+    volatile int m_seq;
+    volatile int m_waiters;
+    int          m_spin;     // adaptive, updated without synchronization
+};
+
+#else /* pthread mutex and condition variable */
+
 class Event
 {
 public:
@@ -443,6 +666,8 @@ protected:
     int             m_val;
 };
 
+#endif // if X265_FUTEX
+
 #endif // ifdef _WIN32
 
 class ScopedLock
@@ -67,6 +67,9 @@
 #if HAVE_LIBNUMA
 #include <numa.h>
 #endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
 #if defined(_MSC_VER)
 # define strcasecmp _stricmp
 #endif
@@ -89,6 +92,78 @@ static int popCount(uint64_t x)
 namespace X265_NS {
 // x265 private namespace
 
+void ThreadBitmap::set(int id)
+{
+    int w = id / SLEEPBITMAP_BITS;
+    sleepbitmap_t bit = (sleepbitmap_t)1 << (id % SLEEPBITMAP_BITS);
+
+    /* word first, then its summary flag. A clearSummary() racing in between
+     * sees the set bit on its re-check and restores the flag, the other
+     * order could leave the bit under a cleared flag, hidden from acquire() */
+    SLEEPBITMAP_OR(&m_word[w], bit);
+    SLEEPBITMAP_OR(&m_summary, (sleepbitmap_t)1 << w);
+}
+
+void ThreadBitmap::clear(int id)
+{
+    int w = id / SLEEPBITMAP_BITS;
+    sleepbitmap_t bit = (sleepbitmap_t)1 << (id % SLEEPBITMAP_BITS);
+
+    if (SLEEPBITMAP_AND(&m_word[w], ~bit) == bit)
+        clearSummary(w);
+}
+
+void ThreadBitmap::clearSummary(int w)
+{
+    sleepbitmap_t wbit = (sleepbitmap_t)1 << w;
+    SLEEPBITMAP_AND(&m_summary, ~wbit);
+
+    /* a concurrent set() may have raced with us, restore the flag */
+    if (m_word[w])
+        SLEEPBITMAP_OR(&m_summary, wbit);
+}
+
+int ThreadBitmap::acquire(const ThreadBitmap* mask)
+{
+    unsigned long w, id;
+
+    sleepbitmap_t words = mask ? m_summary & mask->m_summary : m_summary;
+    while (words)
+    {
+        SLEEPBITMAP_CTZ(w, words);
+
+        sleepbitmap_t masked = mask ? m_word[w] & mask->m_word[w] : m_word[w];
+        while (masked)
+        {
+            SLEEPBITMAP_CTZ(id, masked);
+
+            sleepbitmap_t bit = (sleepbitmap_t)1 << id;
+            sleepbitmap_t prev = SLEEPBITMAP_AND(&m_word[w], ~bit);
+            if (prev & bit)
+            {
+                if (prev == bit)
+                    clearSummary((int)w);
+                return (int)(w * SLEEPBITMAP_BITS + id);
+            }
+
+            masked = mask ? m_word[w] & mask->m_word[w] : m_word[w];
+        }
+
+        words &= ~((sleepbitmap_t)1 << w);
+    }
+
+    return -1;
+}
+
+/* Placeholder provider for the workers of a shared pool which have not yet
+ * been claimed by a provider, or whose provider has been detached */
+class IdleJobProvider : public JobProvider
+{
+public:
+
+    void findJob(int /*workerThreadId*/) { m_helpWanted = false; }
+};
+
 class WorkerThread : public Thread
 {
 private:
@@ -97,20 +172,135 @@ private:
     int          m_id;
     Event        m_wakeEvent;
 
+    /* Job provider hints, pushed by providers which wanted help while no
+     * worker was sleeping. The owner pops the newest hint, thieves take the
+     * oldest. Stale hints are harmless, findJob() simply returns */
+    Lock         m_dequeLock;
+    JobProvider* m_deque[WORKER_DEQUE_SIZE];
+    int          m_dequeHead;
+    int          m_dequeTail;
+    uint32_t     m_randState;
+    uint32_t     m_scanStart;
+
     WorkerThread& operator =(const WorkerThread&);
 
+    JobProvider* findHintedProvider(int curPriority);
+
 public:
 
     JobProvider*     m_curJobProvider;
     BondedTaskGroup* m_bondMaster;
+    volatile int     m_scanCount;  // incremented after each provider selection
+    int              m_cacheDomain;
+    bool             m_bPinned;    // affinity set to the CPUs of m_cacheDomain
+
+    /* telemetry, written only by this worker */
+    int64_t          m_busyTime;
+    int64_t          m_idleTime;
+    int64_t          m_numJobs;
 
-    WorkerThread(ThreadPool& pool, int id) : m_pool(pool), m_id(id) {}
+    WorkerThread(ThreadPool& pool, int id) : m_pool(pool), m_id(id)
+    {
+        m_cacheDomain = -1;
+        m_bPinned = false;
+        m_busyTime = m_idleTime = m_numJobs = 0;
+        m_dequeHead = m_dequeTail = 0;
+        m_randState = 0x9E3779B9u * (uint32_t)(id + 1);
+        m_scanStart = (uint32_t)id;
+        m_scanCount = 0;
+    }
     virtual ~WorkerThread() {}
 
     void threadMain();
     void awaken()           { m_wakeEvent.trigger(); }
+
+    void         pushHint(JobProvider* jp);
+    JobProvider* popHint();
+    JobProvider* stealHint();
+    void         purgeHints(JobProvider* jp);
 };
 
+void WorkerThread::pushHint(JobProvider* jp)
+{
+    ScopedLock s(m_dequeLock);
+
+    /* a full deque drops the hint; the provider's m_helpWanted flag remains */
+    if (m_dequeTail - m_dequeHead < WORKER_DEQUE_SIZE)
+        m_deque[m_dequeTail++ % WORKER_DEQUE_SIZE] = jp;
+}
+
+JobProvider* WorkerThread::popHint()
+{
+    if (m_dequeTail == m_dequeHead)
+        return NULL;
+
+    ScopedLock s(m_dequeLock);
+
+    if (m_dequeTail == m_dequeHead)
+        return NULL;
+    JobProvider* jp = m_deque[--m_dequeTail % WORKER_DEQUE_SIZE];
+    if (m_dequeTail == m_dequeHead)
+        m_dequeHead = m_dequeTail = 0;
+    return jp ? jp : m_pool.m_idleProvider;
+}
+
+JobProvider* WorkerThread::stealHint()
+{
+    /* unlocked peek; thieves should not contend for empty deques */
+    if (m_dequeTail == m_dequeHead)
+        return NULL;
+
+    ScopedLock s(m_dequeLock);
+
+    if (m_dequeTail == m_dequeHead)
+        return NULL;
+    JobProvider* jp = m_deque[m_dequeHead++ % WORKER_DEQUE_SIZE];
+    return jp ? jp : m_pool.m_idleProvider;
+}
+
+void WorkerThread::purgeHints(JobProvider* jp)
+{
+    ScopedLock s(m_dequeLock);
+
+    for (int i = m_dequeHead; i < m_dequeTail; i++)
+        if (m_deque[i % WORKER_DEQUE_SIZE] == jp)
+            m_deque[i % WORKER_DEQUE_SIZE] = NULL;
+}
+
+/* Look for a provider which wants help through the hint deques, first our own
+ * then those of a few randomly chosen victims, so idle workers of a large pool
+ * do not all converge on the provider table */
+JobProvider* WorkerThread::findHintedProvider(int curPriority)
+{
+    JobProvider* jp;
+    while ((jp = popHint()) != NULL)
+    {
+        if (jp->m_helpWanted && jp->m_sliceType < curPriority)
+            return jp;
+    }
+
+    int numWorkers = m_pool.m_numWorkers;
+    int attempts = X265_MIN(numWorkers - 1, 4);
+    for (int i = 0; i < attempts; i++)
+    {
+        /* xorshift32 victim selection */
+        m_randState ^= m_randState << 13;
+        m_randState ^= m_randState >> 17;
+        m_randState ^= m_randState << 5;
+        int victim = (int)(m_randState % (uint32_t)numWorkers);
+        if (victim == m_id)
+            continue;
+
+        while ((jp = m_pool.m_workers[victim].stealHint()) != NULL)
+        {
+            if (jp->m_helpWanted && jp->m_sliceType < curPriority)
+                return jp;
+        }
+    }
+
+    return NULL;
+}
+
 void WorkerThread::threadMain()
 {
     THREAD_NAME("Worker", m_id);
@@ -123,16 +313,25 @@ void WorkerThread::threadMain()
 
     m_pool.setCurrentThreadAffinity();
 
-    sleepbitmap_t idBit = (sleepbitmap_t)1 << m_id;
-    m_curJobProvider = m_pool.m_jpTable[0];
+    m_curJobProvider = m_pool.m_numProviders ? m_pool.m_jpTable[0] : m_pool.m_idleProvider;
     m_bondMaster = NULL;
 
-    SLEEPBITMAP_OR(&m_curJobProvider->m_ownerBitmap, idBit);
-    SLEEPBITMAP_OR(&m_pool.m_sleepBitmap, idBit);
+    m_curJobProvider->m_ownerBitmap.set(m_id);
+    int64_t sleepTime = x265_mdate();
+    m_pool.m_sleepBitmap.set(m_id);
     m_wakeEvent.wait();
+    int64_t wakeTime = x265_mdate();
+    m_idleTime += wakeTime - sleepTime;
 
     while (m_pool.m_isActive)
     {
+        /* the workers of a shared pool are pinned once an encoder asks for it */
+        if (!m_bPinned && m_pool.m_bCacheAffinity)
+        {
+            m_pool.setThreadCacheAffinity(m_cacheDomain);
+            m_bPinned = true;
+        }
+
         if (m_bondMaster)
         {
             m_bondMaster->processTasks(m_id);
@@ -140,104 +339,194 @@ void WorkerThread::threadMain()
             m_bondMaster = NULL;
         }
 
+        /* the provider's job count is only telemetry, it is added to once
+         * the worker leaves the provider rather than on every job */
+        int providerJobs = 0;
         do
         {
             /* do pending work for current job provider */
             m_curJobProvider->findJob(m_id);
+            providerJobs++;
+            m_numJobs++;
 
             /* if the current job provider still wants help, only switch to a
              * higher priority provider (lower slice type). Else take the first
-             * available job provider with the highest priority */
+             * available job provider with the highest priority. Hinted
+             * providers are preferred over a scan of the provider table */
             int curPriority = (m_curJobProvider->m_helpWanted) ? m_curJobProvider->m_sliceType :
                                                                  INVALID_SLICE_PRIORITY + 1;
-            int nextProvider = -1;
-            for (int i = 0; i < m_pool.m_numProviders; i++)
+            JobProvider* next = findHintedProvider(curPriority);
+            if (!next)
             {
-                if (m_pool.m_jpTable[i]->m_helpWanted &&
-                    m_pool.m_jpTable[i]->m_sliceType < curPriority)
+                /* rotate the scan origin so providers of equal priority, for
+                 * instance those of several encoders sharing this pool, are
+                 * served in turn */
+                int numProviders = m_pool.m_numProviders;
+                for (int n = 0; n < numProviders; n++)
                 {
-                    nextProvider = i;
-                    curPriority = m_pool.m_jpTable[i]->m_sliceType;
+                    JobProvider* jp = m_pool.m_jpTable[(m_scanStart + n) % (uint32_t)numProviders];
+                    if (jp->m_helpWanted && jp->m_sliceType < curPriority)
+                    {
+                        next = jp;
+                        curPriority = next->m_sliceType;
+                    }
                 }
+                m_scanStart++;
             }
-            if (nextProvider != -1 && m_curJobProvider != m_pool.m_jpTable[nextProvider])
+            if (next && m_curJobProvider != next)
             {
-                SLEEPBITMAP_AND(&m_curJobProvider->m_ownerBitmap, ~idBit);
-                m_curJobProvider = m_pool.m_jpTable[nextProvider];
-                SLEEPBITMAP_OR(&m_curJobProvider->m_ownerBitmap, idBit);
+                ATOMIC_ADD(&m_curJobProvider->m_numJobs, providerJobs);
+                providerJobs = 0;
+                m_curJobProvider->m_ownerBitmap.clear(m_id);
+                m_curJobProvider = next;
+                m_curJobProvider->m_ownerBitmap.set(m_id);
             }
+            ATOMIC_INC(&m_scanCount);
         }
         while (m_curJobProvider->m_helpWanted);
 
+        /* before the sleep bit is set, a sleeping worker may be retargeted */
+        ATOMIC_ADD(&m_curJobProvider->m_numJobs, providerJobs);
+
         /* While the worker sleeps, a job-provider or bond-group may acquire this
          * worker's sleep bitmap bit. Once acquired, that thread may modify 
          * m_bondMaster or m_curJobProvider, then waken the thread */
-        SLEEPBITMAP_OR(&m_pool.m_sleepBitmap, idBit);
+        sleepTime = x265_mdate();
+        m_busyTime += sleepTime - wakeTime;
+        m_pool.m_sleepBitmap.set(m_id);
         m_wakeEvent.wait();
+        wakeTime = x265_mdate();
+        m_idleTime += wakeTime - sleepTime;
     }
 
-    SLEEPBITMAP_OR(&m_pool.m_sleepBitmap, idBit);
+    m_pool.m_sleepBitmap.set(m_id);
 }
 
 void JobProvider::tryWakeOne()
 {
-    int id = m_pool->tryAcquireSleepingThread(m_ownerBitmap, ALL_POOL_THREADS);
+    /* prefer workers which recently served this provider, then workers which
+     * share its cache domain, then any worker */
+    int id = m_pool->tryAcquireSleepingThread(&m_ownerBitmap, false);
+    if (id < 0 && m_cacheDomain >= 0 && m_cacheDomain < m_pool->m_numCacheDomains)
+        id = m_pool->tryAcquireSleepingThread(&m_pool->m_cacheDomainBitmap[m_cacheDomain], false);
+    if (id < 0)
+        id = m_pool->tryAcquireSleepingThread(NULL, false);
     if (id < 0)
     {
         m_helpWanted = true;
+        m_pool->pushJobHint(this);
         return;
     }
 
     WorkerThread& worker = m_pool->m_workers[id];
     if (worker.m_curJobProvider != this) /* poaching */
     {
-        sleepbitmap_t bit = (sleepbitmap_t)1 << id;
-        SLEEPBITMAP_AND(&worker.m_curJobProvider->m_ownerBitmap, ~bit);
+        worker.m_curJobProvider->m_ownerBitmap.clear(id);
         worker.m_curJobProvider = this;
-        SLEEPBITMAP_OR(&worker.m_curJobProvider->m_ownerBitmap, bit);
+        worker.m_curJobProvider->m_ownerBitmap.set(id);
     }
     worker.awaken();
 }
 
-int ThreadPool::tryAcquireSleepingThread(sleepbitmap_t firstTryBitmap, sleepbitmap_t secondTryBitmap)
+void ThreadPool::pushJobHint(JobProvider* jp)
 {
-    unsigned long id;
-
-    sleepbitmap_t masked = m_sleepBitmap & firstTryBitmap;
-    while (masked)
+    /* spread hints round-robin; idle workers steal them from random victims */
+    int cursor = ATOMIC_INC(&m_hintCursor) & 0x7fffffff;
+    int first = 0, count = m_numWorkers;
+    if (jp->m_cacheDomain >= 0 && jp->m_cacheDomain < m_numCacheDomains)
     {
-        SLEEPBITMAP_CTZ(id, masked);
+        int domainFirst = m_cacheDomainStart[jp->m_cacheDomain];
+        int domainCount = m_cacheDomainStart[jp->m_cacheDomain + 1] - domainFirst;
+        if (domainCount)
+        {
+            first = domainFirst;
+            count = domainCount;
+        }
+    }
+    m_workers[first + cursor % count].pushHint(jp);
+}
 
-        sleepbitmap_t bit = (sleepbitmap_t)1 << id;
-        if (SLEEPBITMAP_AND(&m_sleepBitmap, ~bit) & bit)
-            return (int)id;
+bool ThreadPool::attachProvider(JobProvider& jp)
+{
+    ScopedLock lock(m_jpTableLock);
 
-        masked = m_sleepBitmap & firstTryBitmap;
-    }
+    if (m_numProviders >= m_maxProviders)
+        return false;
+
+    jp.m_pool = this;
+    m_jpTable[m_numProviders] = &jp;
+    ATOMIC_INC(&m_numProviders); /* publish the table entry before the count */
+    return true;
+}
 
-    masked = m_sleepBitmap & secondTryBitmap;
-    while (masked)
+void ThreadPool::detachProvider(JobProvider& jp)
+{
     {
-        SLEEPBITMAP_CTZ(id, masked);
+        ScopedLock lock(m_jpTableLock);
+
+        /* shift later entries down. A worker scanning with the old count sees
+         * a duplicate of the last entry, never a stale or NULL pointer */
+        int i = 0;
+        while (i < m_numProviders && m_jpTable[i] != &jp)
+            i++;
+        if (i == m_numProviders)
+            return;
+        for (; i < m_numProviders - 1; i++)
+            m_jpTable[i] = m_jpTable[i + 1];
+        ATOMIC_DEC(&m_numProviders);
+    }
 
-        sleepbitmap_t bit = (sleepbitmap_t)1 << id;
-        if (SLEEPBITMAP_AND(&m_sleepBitmap, ~bit) & bit)
-            return (int)id;
+    jp.m_helpWanted = false;
 
-        masked = m_sleepBitmap & secondTryBitmap;
+    if (!m_isActive)
+        return;
+
+    /* Wait for each worker to complete a provider selection without choosing
+     * this provider, or retarget it while it sleeps. Holding a worker's sleep
+     * bit gives us exclusive access to its m_curJobProvider */
+    for (int i = 0; i < m_numWorkers; i++)
+    {
+        WorkerThread& worker = m_workers[i];
+        worker.purgeHints(&jp);
+
+        int scanCount = worker.m_scanCount;
+        while (worker.m_scanCount == scanCount || worker.m_curJobProvider == &jp)
+        {
+            ThreadBitmap mask;
+            mask.set(i);
+            if (m_sleepBitmap.acquire(&mask) == i)
+            {
+                if (worker.m_curJobProvider == &jp)
+                {
+                    jp.m_ownerBitmap.clear(i);
+                    worker.m_curJobProvider = m_idleProvider;
+                }
+                m_sleepBitmap.set(i);
+                break;
+            }
+            GIVE_UP_TIME();
+        }
     }
+}
 
-    return -1;
+int ThreadPool::tryAcquireSleepingThread(const ThreadBitmap* firstTryBitmap, bool bAnyThread)
+{
+    /* a NULL bitmap matches every worker of the pool */
+    int id = m_sleepBitmap.acquire(firstTryBitmap);
+    if (id < 0 && bAnyThread && firstTryBitmap)
+        id = m_sleepBitmap.acquire(NULL);
+
+    return id;
 }
 
-int ThreadPool::tryBondPeers(int maxPeers, sleepbitmap_t peerBitmap, BondedTaskGroup& master)
+int ThreadPool::tryBondPeers(int maxPeers, const ThreadBitmap* peerBitmap, BondedTaskGroup& master, JobProvider* jp)
 {
     int bondCount = 0;
     do
     {
-        int id = tryAcquireSleepingThread(peerBitmap, 0);
+        int id = tryAcquireSleepingThread(peerBitmap, false);
         if (id < 0)
-            return bondCount;
+            break;
 
         m_workers[id].m_bondMaster = &master;
         m_workers[id].awaken();
@@ -245,8 +534,29 @@ int ThreadPool::tryBondPeers(int maxPeers, sleepbitmap_t peerBitmap, BondedTaskG
     }
     while (bondCount < maxPeers);
 
+    if (jp)
+    {
+        ATOMIC_INC(&jp->m_bondAttempts);
+        if (bondCount)
+            ATOMIC_INC(&jp->m_bondSuccesses);
+    }
     return bondCount;
 }
+
+void ThreadPool::getStats(ThreadPoolStats& stats) const
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.numWorkers = m_numWorkers;
+    for (int i = 0; i < m_numWorkers; i++)
+    {
+        const WorkerThread& worker = m_workers[i];
+        stats.busyTime += worker.m_busyTime;
+        stats.idleTime += worker.m_idleTime;
+        stats.maxBusyTime = X265_MAX(stats.maxBusyTime, worker.m_busyTime);
+        stats.numJobs += worker.m_numJobs;
+    }
+}
+
 ThreadPool* ThreadPool::allocThreadPools(x265_param* p, int& numPools, bool isThreadsReserved)
 {
     enum { MAX_NODE_NUM = 127 };
@@ -440,7 +750,7 @@ ThreadPool* ThreadPool::allocThreadPools(x265_param* p, int& numPools, bool isTh
 
             else if (i == 0)
                 numThreads -= p->lookaheadThreads;
-            if (!pools[i].create(numThreads, maxProviders, nodeMaskPerPool[node]))
+            if (!pools[i].create(numThreads, maxProviders, nodeMaskPerPool[node], !!p->bCacheAffinity))
             {
                 X265_FREE(pools);
                 numPools = 0;
@@ -458,6 +768,8 @@ ThreadPool* ThreadPool::allocThreadPools(x265_param* p, int& numPools, bool isTh
             }
             else
                 x265_log(p, X265_LOG_INFO, "Thread pool created using %d threads\n", numThreads);
+            if (pools[i].m_numCacheDomains)
+                x265_log(p, X265_LOG_INFO, "Thread pool %d split into %d cache domains\n", i, pools[i].m_numCacheDomains);
             threadsPerPool[node] -= origNumThreads;
         }
     }
@@ -466,12 +778,57 @@ ThreadPool* ThreadPool::allocThreadPools(x265_param* p, int& numPools, bool isTh
     return pools;
 }
 
+ThreadPool* ThreadPool::allocSharedPool(int numThreads, int maxProviders)
+{
+    if (numThreads <= 0)
+        numThreads = getCpuCount();
+    if (numThreads > MAX_POOL_THREADS)
+    {
+        x265_log(NULL, X265_LOG_WARNING, "Shared thread pool limited to %d threads\n", MAX_POOL_THREADS);
+        numThreads = MAX_POOL_THREADS;
+    }
+
+    int numNumaNodes = X265_MIN(getNumaNodeCount(), 64);
+    uint64_t nodeMask = (uint64_t)-1 >> (64 - numNumaNodes);
+
+    ThreadPool *pool = new ThreadPool;
+    pool->m_isShared = true;
+    if (!pool->create(numThreads, maxProviders, nodeMask, false))
+    {
+        delete pool;
+        return NULL;
+    }
+    /* the domains are only used once an encoder with cache affinity attaches */
+    pool->initCacheDomains(nodeMask);
+    pool->start();
+
+    x265_log(NULL, X265_LOG_INFO, "Shared thread pool created using %d threads\n", numThreads);
+    return pool;
+}
+
 ThreadPool::ThreadPool()
 {
-    memset(this, 0, sizeof(*this));
+    m_numProviders = 0;
+    m_maxProviders = 0;
+    m_numWorkers = 0;
+    m_hintCursor = 0;
+    m_numaMask = NULL;
+    m_numCacheDomains = 0;
+    m_cacheDomainCursor = 0;
+    m_bCacheAffinity = 0;
+    memset(m_cacheDomainStart, 0, sizeof(m_cacheDomainStart));
+    m_cacheDomainCpus = NULL;
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= _WIN32_WINNT_WIN7 
+    memset(&m_groupAffinity, 0, sizeof(GROUP_AFFINITY));
+#endif
+    m_isActive = false;
+    m_isShared = false;
+    m_jpTable = NULL;
+    m_idleProvider = NULL;
+    m_workers = NULL;
 }
 
-bool ThreadPool::create(int numThreads, int maxProviders, uint64_t nodeMask)
+bool ThreadPool::create(int numThreads, int maxProviders, uint64_t nodeMask, bool bCacheAffinity)
 {
     X265_CHECK(numThreads <= MAX_POOL_THREADS, "a single thread pool cannot have more than MAX_POOL_THREADS threads\n");
 
@@ -511,6 +868,16 @@ bool ThreadPool::create(int numThreads, int maxProviders, uint64_t nodeMask)
 
     m_jpTable = X265_MALLOC(JobProvider*, maxProviders);
     m_numProviders = 0;
+    m_maxProviders = maxProviders;
+
+    m_idleProvider = new IdleJobProvider;
+    m_idleProvider->m_pool = this;
+
+    if (bCacheAffinity && m_workers)
+    {
+        initCacheDomains(nodeMask);
+        m_bCacheAffinity = !!m_numCacheDomains;
+    }
 
     return m_workers && m_jpTable;
 }
@@ -536,7 +903,7 @@ void ThreadPool::stopWorkers()
         m_isActive = false;
         for (int i = 0; i < m_numWorkers; i++)
         {
-            while (!(m_sleepBitmap & ((sleepbitmap_t)1 << i)))
+            while (!m_sleepBitmap.test(i))
                 GIVE_UP_TIME();
             m_workers[i].awaken();
             m_workers[i].stop();
@@ -554,6 +921,8 @@ ThreadPool::~ThreadPool()
 
     X265_FREE(m_workers);
     X265_FREE(m_jpTable);
+    X265_FREE(m_cacheDomainCpus);
+    delete m_idleProvider;
 
 #if HAVE_LIBNUMA
     if(m_numaMask)
@@ -594,6 +963,202 @@ void ThreadPool::setThreadNodeAffinity(void *numaMask)
     return;
 }
 
+#if defined(__linux__)
+static int readSysfsInt(const char* path)
+{
+    int val = -1;
+    FILE* f = fopen(path, "r");
+    if (f)
+    {
+        if (fscanf(f, "%d", &val) != 1)
+            val = -1;
+        fclose(f);
+    }
+    return val;
+}
+
+/* parse a sysfs CPU list such as "0-7,64-71" */
+static bool readSysfsCpuList(const char* path, cpu_set_t* set)
+{
+    char buf[1024];
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return false;
+    bool ok = !!fgets(buf, sizeof(buf), f);
+    fclose(f);
+
+    CPU_ZERO(set);
+    const char* str = buf;
+    while (ok && *str >= '0' && *str <= '9')
+    {
+        char* end;
+        int first = (int)strtol(str, &end, 10);
+        int last = first;
+        if (*end == '-')
+            last = (int)strtol(end + 1, &end, 10);
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, set);
+        str = (*end == ',') ? end + 1 : end;
+    }
+    return ok && CPU_COUNT(set) > 0;
+}
+
+/* the CPUs sharing the highest level cache of the given CPU */
+static bool getLastLevelCacheCpus(int cpu, cpu_set_t* set)
+{
+    char path[128];
+    int bestLevel = 0, bestIndex = -1;
+    for (int index = 0; index < 16; index++)
+    {
+        sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+        int level = readSysfsInt(path);
+        if (level < 0)
+            break;
+        if (level > bestLevel)
+        {
+            bestLevel = level;
+            bestIndex = index;
+        }
+    }
+    if (bestIndex < 0)
+        return false;
+
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, bestIndex);
+    return readSysfsCpuList(path, set);
+}
+#endif
+
+/* Group the workers by the last level cache of the CPUs this pool may run on,
+ * in proportion to the CPU count of each cache. Workers are later given
+ * affinity to the CPUs of their cache domain, so job providers which prefer a
+ * domain keep their working set within one cache (one CCX/chiplet) */
+void ThreadPool::initCacheDomains(uint64_t nodeMask)
+{
+    m_numCacheDomains = 0;
+#if defined(__linux__)
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed))
+        return;
+
+#if HAVE_LIBNUMA
+    if (numa_available() >= 0)
+    {
+        cpu_set_t nodeCpus;
+        CPU_ZERO(&nodeCpus);
+        struct bitmask* cpus = numa_allocate_cpumask();
+        int numNodes = X265_MIN(getNumaNodeCount(), 64);
+        for (int node = 0; node < numNodes; node++)
+        {
+            if (!((nodeMask >> node) & 1) || numa_node_to_cpus(node, cpus))
+                continue;
+            for (int cpu = 0; cpu < CPU_SETSIZE && cpu < (int)cpus->size; cpu++)
+                if (numa_bitmask_isbitset(cpus, cpu))
+                    CPU_SET(cpu, &nodeCpus);
+        }
+        numa_free_cpumask(cpus);
+        if (CPU_COUNT(&nodeCpus))
+            CPU_AND(&allowed, &allowed, &nodeCpus);
+    }
+#else
+    (void)nodeMask;
+#endif
+
+    cpu_set_t* domains = X265_MALLOC(cpu_set_t, MAX_CACHE_DOMAINS);
+    if (!domains)
+        return;
+
+    int numDomains = 0;
+    int totalCpus = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+
+        bool known = false;
+        for (int d = 0; d < numDomains && !known; d++)
+            known = !!CPU_ISSET(cpu, &domains[d]);
+        if (known)
+            continue;
+
+        cpu_set_t shared;
+        if (numDomains == MAX_CACHE_DOMAINS || !getLastLevelCacheCpus(cpu, &shared))
+        {
+            X265_FREE(domains);
+            return;
+        }
+        CPU_SET(cpu, &shared);
+        CPU_AND(&domains[numDomains], &shared, &allowed);
+        totalCpus += CPU_COUNT(&domains[numDomains]);
+        numDomains++;
+    }
+
+    if (numDomains < 2 || m_numWorkers < numDomains)
+    {
+        X265_FREE(domains);
+        return;
+    }
+
+    /* worker i takes the domain of CPU (i * totalCpus / numWorkers) when the
+     * CPUs are listed domain by domain, so each domain gets a contiguous range
+     * of worker IDs */
+    int d = 0, cpusBefore = 0;
+    m_cacheDomainStart[0] = 0;
+    for (int i = 0; i < m_numWorkers; i++)
+    {
+        int pos = (int)((int64_t)i * totalCpus / m_numWorkers);
+        while (pos >= cpusBefore + CPU_COUNT(&domains[d]))
+        {
+            cpusBefore += CPU_COUNT(&domains[d]);
+            m_cacheDomainStart[++d] = i;
+        }
+        m_cacheDomainBitmap[d].set(i);
+    }
+    while (d < numDomains)
+        m_cacheDomainStart[++d] = m_numWorkers;
+
+    m_cacheDomainCpus = domains;
+    m_numCacheDomains = numDomains;
+    for (d = 0; d < numDomains; d++)
+        for (int i = m_cacheDomainStart[d]; i < m_cacheDomainStart[d + 1]; i++)
+            m_workers[i].m_cacheDomain = d;
+#else
+    (void)nodeMask;
+#endif
+}
+
+void ThreadPool::setThreadCacheAffinity(int domain)
+{
+#if defined(__linux__)
+    if (domain >= 0 && domain < m_numCacheDomains)
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &((cpu_set_t*)m_cacheDomainCpus)[domain]);
+#else
+    (void)domain;
+#endif
+}
+
+/* Pins the workers to the CPUs of their cache domains, each worker the next
+ * time it wakes. Returns true if this call enabled it */
+bool ThreadPool::enableCacheAffinity()
+{
+    return m_numCacheDomains && !ATOMIC_OR(&m_bCacheAffinity, 1);
+}
+
+/* Frame encoders are spread round-robin over the cache domains. The lookahead
+ * is given the last domain, which frame encoders skip when there are three
+ * domains or more, so it only shares a domain on two-domain machines. Returns
+ * -1 if the workers are not pinned to cache domains */
+int ThreadPool::assignCacheDomain(bool bLookahead)
+{
+    if (!m_bCacheAffinity)
+        return -1;
+    if (bLookahead)
+        return m_numCacheDomains - 1;
+
+    int frameDomains = m_numCacheDomains > 2 ? m_numCacheDomains - 1 : m_numCacheDomains;
+    int cursor = (ATOMIC_INC(&m_cacheDomainCursor) - 1) & 0x7fffffff;
+    return cursor % frameDomains;
+}
+
 /* static */
 int ThreadPool::getNumaNodeCount()
 {
@@ -27,6 +27,8 @@
 #include "common.h"
 #include "threading.h"
 
+struct x265_threadpool {};
+
 namespace X265_NS {
 // x265 private namespace
 
@@ -40,9 +42,42 @@ typedef uint64_t sleepbitmap_t;
 typedef uint32_t sleepbitmap_t;
 #endif
 
-static const sleepbitmap_t ALL_POOL_THREADS = (sleepbitmap_t)-1;
-enum { MAX_POOL_THREADS = sizeof(sleepbitmap_t) * 8 };
+enum { SLEEPBITMAP_BITS = sizeof(sleepbitmap_t) * 8 };
+enum { MAX_POOL_WORDS = 8 };
+enum { MAX_POOL_THREADS = SLEEPBITMAP_BITS * MAX_POOL_WORDS };
 enum { INVALID_SLICE_PRIORITY = 10 }; // a value larger than any X265_TYPE_* macro
+enum { WORKER_DEQUE_SIZE = 16 };      // job provider hints queued per worker thread
+enum { MAX_CACHE_DOMAINS = 32 };      // last level cache groups tracked per pool
+
+/* Two-level bitmap of worker thread IDs. Each bit of m_summary flags a word of
+ * m_word which may have bits set, so large pools only scan populated words.
+ * The summary is conservative; a set summary bit may cover an empty word but a
+ * non-empty word always has its summary bit set. Safe for concurrent use */
+class ThreadBitmap
+{
+public:
+
+    sleepbitmap_t m_summary;
+    sleepbitmap_t m_word[MAX_POOL_WORDS];
+
+    ThreadBitmap() { clearAll(); }
+
+    void clearAll()        { memset(this, 0, sizeof(*this)); }
+
+    bool test(int id) const { return !!(m_word[id / SLEEPBITMAP_BITS] & ((sleepbitmap_t)1 << (id % SLEEPBITMAP_BITS))); }
+
+    void set(int id);
+
+    void clear(int id);
+
+    /* Atomically clear one bit which is set both in this bitmap and in mask
+     * (any set bit if mask is NULL). Returns the thread ID or -1 */
+    int  acquire(const ThreadBitmap* mask);
+
+protected:
+
+    void clearSummary(int word);
+};
 
 // Frame level job providers. FrameEncoder and Lookahead derive from
 // this class and implement findJob()
@@ -51,19 +86,26 @@ class JobProvider
 public:
 
     ThreadPool*   m_pool;
-    sleepbitmap_t m_ownerBitmap;
+    ThreadBitmap  m_ownerBitmap;
     int           m_jpId;
     int           m_sliceType;
+    int           m_cacheDomain; // preferred cache domain of the pool, -1 for none
     bool          m_helpWanted;
-    bool          m_isFrameEncoder; /* rather ugly hack, but nothing better presents itself */
+
+    /* scheduler telemetry, the owner may reset these between frames */
+    volatile int  m_numJobs;       // findJob() calls made by worker threads
+    volatile int  m_bondAttempts;  // tryBondPeers() calls charged to this provider
+    volatile int  m_bondSuccesses; // tryBondPeers() calls which bonded at least one peer
 
     JobProvider()
         : m_pool(NULL)
-        , m_ownerBitmap(0)
         , m_jpId(-1)
         , m_sliceType(INVALID_SLICE_PRIORITY)
+        , m_cacheDomain(-1)
         , m_helpWanted(false)
-        , m_isFrameEncoder(false)
+        , m_numJobs(0)
+        , m_bondAttempts(0)
+        , m_bondSuccesses(0)
     {}
 
     virtual ~JobProvider() {}
@@ -76,33 +118,73 @@ public:
     void tryWakeOne();
 };
 
-class ThreadPool
+/* Sums of the per-worker counters of a pool, times in microseconds */
+struct ThreadPoolStats
+{
+    int64_t busyTime;    // time workers spent awake
+    int64_t idleTime;    // time workers spent sleeping
+    int64_t maxBusyTime; // busy time of the busiest worker
+    int64_t numJobs;     // findJob() calls, all providers
+    int     numWorkers;
+};
+
+class ThreadPool : public x265_threadpool
 {
 public:
 
-    sleepbitmap_t m_sleepBitmap;
+    ThreadBitmap  m_sleepBitmap;
     int           m_numProviders;
+    int           m_maxProviders;
     int           m_numWorkers;
+    int           m_hintCursor;
     void*         m_numaMask; // node mask in linux, cpu mask in windows
+
+    /* Workers grouped by shared last level cache. Workers of domain d have
+     * IDs m_cacheDomainStart[d] .. m_cacheDomainStart[d + 1] - 1. Zero
+     * domains if the pool's CPUs share one cache or topology is unknown */
+    int           m_numCacheDomains;
+    int           m_cacheDomainCursor;
+    volatile int  m_bCacheAffinity; // workers are pinned to their cache domain
+    int           m_cacheDomainStart[MAX_CACHE_DOMAINS + 1];
+    ThreadBitmap  m_cacheDomainBitmap[MAX_CACHE_DOMAINS];
+    void*         m_cacheDomainCpus; // cpu_set_t per domain in linux
 #if defined(_WIN32_WINNT) && _WIN32_WINNT >= _WIN32_WINNT_WIN7 
     GROUP_AFFINITY m_groupAffinity;
 #endif
     bool          m_isActive;
+    bool          m_isShared;      // created by x265_threadpool_create(), owned by the application
 
     JobProvider** m_jpTable;
+    JobProvider*  m_idleProvider;  // parking provider for workers without a provider
     WorkerThread* m_workers;
+    Lock          m_jpTableLock;   // serializes attach and detach of providers
 
     ThreadPool();
     ~ThreadPool();
 
-    bool create(int numThreads, int maxProviders, uint64_t nodeMask);
+    bool create(int numThreads, int maxProviders, uint64_t nodeMask, bool bCacheAffinity);
     bool start();
     void stopWorkers();
+
+    /* Add a job provider to the pool, it may be called while the workers are
+     * running. Returns false if all provider slots are in use */
+    bool attachProvider(JobProvider& jp);
+
+    /* Remove a job provider which has no more work to distribute. Returns once
+     * no worker thread references the provider, so it may then be deleted */
+    void detachProvider(JobProvider& jp);
     void setCurrentThreadAffinity();
     void setThreadNodeAffinity(void *numaMask);
-    int  tryAcquireSleepingThread(sleepbitmap_t firstTryBitmap, sleepbitmap_t secondTryBitmap);
-    int  tryBondPeers(int maxPeers, sleepbitmap_t peerBitmap, BondedTaskGroup& master);
+    void initCacheDomains(uint64_t nodeMask);
+    void setThreadCacheAffinity(int domain);
+    bool enableCacheAffinity();
+    int  assignCacheDomain(bool bLookahead);
+    int  tryAcquireSleepingThread(const ThreadBitmap* firstTryBitmap, bool bAnyThread);
+    int  tryBondPeers(int maxPeers, const ThreadBitmap* peerBitmap, BondedTaskGroup& master, JobProvider* jp);
+    void pushJobHint(JobProvider* jp);
+    void getStats(ThreadPoolStats& stats) const;
     static ThreadPool* allocThreadPools(x265_param* p, int& numPools, bool isThreadsReserved);
+    static ThreadPool* allocSharedPool(int numThreads, int maxProviders);
     static int  getCpuCount();
     static int  getNumaNodeCount();
     static void getFrameThreadsCount(x265_param* p,int cpuCount);
@@ -139,17 +221,17 @@ public:
      * maxPeers worker threads will call your processTasks() method. */
     int tryBondPeers(JobProvider& jp, int maxPeers)
     {
-        int count = jp.m_pool->tryBondPeers(maxPeers, jp.m_ownerBitmap, *this);
+        int count = jp.m_pool->tryBondPeers(maxPeers, &jp.m_ownerBitmap, *this, &jp);
         m_bondedPeerCount += count;
         return count;
     }
 
     /* Try to enlist the help of any idle worker threads and "bond" them to work
      * on your tasks. Up to maxPeers worker threads will call your
-     * processTasks() method. */
-    int tryBondPeers(ThreadPool& pool, int maxPeers)
+     * processTasks() method. The attempt is counted against jp, if given */
+    int tryBondPeers(ThreadPool& pool, int maxPeers, JobProvider* jp = NULL)
     {
-        int count = pool.tryBondPeers(maxPeers, ALL_POOL_THREADS, *this);
+        int count = pool.tryBondPeers(maxPeers, NULL, *this, jp);
         m_bondedPeerCount += count;
         return count;
     }
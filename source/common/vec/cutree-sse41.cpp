@@ -0,0 +1,114 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#include "common.h"
+#include "primitives.h"
+#include "constants.h"
+#include "slicetype.h"      // LOWRES_COST_MASK
+#include <xmmintrin.h> // SSE
+#include <smmintrin.h> // SSE4.1
+
+using namespace X265_NS;
+
+namespace {
+
+/* x265_exp2fix8() of eight Q8.8 QP offsets, in 16 bit lanes */
+inline __m128i exp2fix8(__m128i qp, const __m128i lut[4], __m128i pow2lo, __m128i pow2hi)
+{
+    /* i = floor((12300 - qp) / 24) = floor(floor(n / 8) / 3), with n unsigned
+     * unless qp > 12300 */
+    __m128i under = _mm_cmpgt_epi16(qp, _mm_set1_epi16(12300));
+    __m128i n = _mm_sub_epi16(_mm_set1_epi16(12300), qp);
+    __m128i i = _mm_mulhi_epu16(_mm_srli_epi16(n, 3), _mm_set1_epi16(21846));
+    __m128i over = _mm_cmpgt_epi16(i, _mm_set1_epi16(1023));
+    i = _mm_min_epi16(i, _mm_set1_epi16(1023));
+
+    /* the 64 entry exp2 table is looked up 16 entries at a time, the byte
+     * index is in the low byte of each word and the high byte selects zero */
+    __m128i j = _mm_and_si128(i, _mm_set1_epi16(63));
+    __m128i idx = _mm_or_si128(_mm_and_si128(j, _mm_set1_epi16(15)), _mm_set1_epi16((short)0xff00));
+    __m128i bank = _mm_srli_epi16(j, 4);
+    __m128i frac = _mm_setzero_si128();
+    for (int t = 0; t < 4; t++)
+    {
+        __m128i sel = _mm_cmpeq_epi16(bank, _mm_set1_epi16((short)t));
+        frac = _mm_or_si128(frac, _mm_and_si128(sel, _mm_shuffle_epi8(lut[t], idx)));
+    }
+
+    /* ((frac + 256) << (i >> 6)) >> 8, the shift as a 32 bit product with
+     * a power of two from the same kind of lookup */
+    __m128i sh = _mm_or_si128(_mm_srli_epi16(i, 6), _mm_set1_epi16((short)0xff00));
+    __m128i pow2 = _mm_or_si128(_mm_shuffle_epi8(pow2lo, sh), _mm_slli_epi16(_mm_shuffle_epi8(pow2hi, sh), 8));
+    __m128i base = _mm_add_epi16(frac, _mm_set1_epi16(256));
+    __m128i lo = _mm_mullo_epi16(base, pow2);
+    __m128i hi = _mm_mulhi_epu16(base, pow2);
+    __m128i val = _mm_or_si128(_mm_slli_epi16(hi, 8), _mm_srli_epi16(lo, 8));
+
+    val = _mm_or_si128(val, over);
+    return _mm_andnot_si128(under, val);
+}
+
+int64_t weightCost(const uint16_t* costs, const int16_t* qpFix8, int count)
+{
+    __m128i lut[4];
+    for (int t = 0; t < 4; t++)
+        lut[t] = _mm_loadu_si128((const __m128i*)(x265_exp2_lut + 16 * t));
+    const __m128i pow2lo = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pow2hi = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, (char)128);
+
+    const __m128i mask = _mm_set1_epi16(LOWRES_COST_MASK);
+    const __m128i rnd = _mm_set1_epi32(128);
+    __m128i sum = _mm_setzero_si128();
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i cost = _mm_and_si128(_mm_loadu_si128((const __m128i*)(costs + i)), mask);
+        __m128i scale = exp2fix8(_mm_loadu_si128((const __m128i*)(qpFix8 + i)), lut, pow2lo, pow2hi);
+
+        /* at most 16383 * 65535 + 128, which fits in 31 bits */
+        __m128i lo = _mm_mullo_epi16(cost, scale);
+        __m128i hi = _mm_mulhi_epu16(cost, scale);
+        __m128i w0 = _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), rnd), 8);
+        __m128i w1 = _mm_srli_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), rnd), 8);
+        __m128i w = _mm_add_epi32(w0, w1);
+
+        sum = _mm_add_epi64(sum, _mm_cvtepu32_epi64(w));
+        sum = _mm_add_epi64(sum, _mm_cvtepu32_epi64(_mm_srli_si128(w, 8)));
+    }
+
+    ALIGN_VAR_16(int64_t, sums[2]);
+    _mm_store_si128((__m128i*)sums, sum);
+    int64_t total = sums[0] + sums[1];
+    for (; i < count; i++)
+        total += ((costs[i] & LOWRES_COST_MASK) * x265_exp2fix8(qpFix8[i]) + 128) >> 8;
+
+    return total;
+}
+
+} // end anonymous namespace
+
+namespace X265_NS {
+void setupIntrinsicCUTree_sse41(EncoderPrimitives &p)
+{
+    p.cutreeWeightCost = weightCost;
+}
+}
@@ -0,0 +1,94 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#include "common.h"
+#include "primitives.h"
+#include <xmmintrin.h> // SSE
+#include <pmmintrin.h> // SSE3
+
+using namespace X265_NS;
+
+namespace {
+
+/* Emulation prevention, 16 bytes at a time. A block is copied whole unless
+ * some byte <= 0x03 follows two 0x00 bytes (within the block, or carried in
+ * from the previous one), in which case the block is escaped byte by byte.
+ * Such blocks are rare in CABAC data, they mostly come from cabac_zero_words */
+uint32_t nalEscape(uint8_t* dst, const uint8_t* src, uint32_t size, uint32_t zeros)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i three = _mm_set1_epi8(3);
+    uint32_t bytes = 0;
+    uint32_t i = 0;
+
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        uint32_t zm = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        uint32_t lm = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, three), v));
+
+        /* bit j + 2 of zm2 flags a zero at src[i + j], the two low bits are
+         * the zero run ending the output so far */
+        uint32_t zm2 = (zm << 2) | (zeros >= 2 ? 3 : zeros << 1);
+        if (!(lm & zm2 & (zm2 >> 1)))
+        {
+            _mm_storeu_si128((__m128i*)(dst + bytes), v);
+            bytes += 16;
+            zeros = (zm >> 14) == 3 ? 2 : (zm >> 15);
+            continue;
+        }
+
+        for (uint32_t k = i; k < i + 16; k++)
+        {
+            if (zeros >= 2 && src[k] <= 0x03)
+            {
+                dst[bytes++] = 0x03;
+                zeros = 0;
+            }
+
+            dst[bytes++] = src[k];
+            zeros = src[k] ? 0 : zeros + 1;
+        }
+    }
+
+    for (; i < size; i++)
+    {
+        if (zeros >= 2 && src[i] <= 0x03)
+        {
+            dst[bytes++] = 0x03;
+            zeros = 0;
+        }
+
+        dst[bytes++] = src[i];
+        zeros = src[i] ? 0 : zeros + 1;
+    }
+
+    return bytes;
+}
+
+} // end anonymous namespace
+
+namespace X265_NS {
+void setupIntrinsicNal_sse3(EncoderPrimitives &p)
+{
+    p.nalEscape = nalEscape;
+}
+}
@@ -0,0 +1,109 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#include "common.h"
+#include "primitives.h"
+#include "constants.h"
+#include <tmmintrin.h> // SSSE3
+#include <smmintrin.h> // SSE4.1
+#include <wmmintrin.h> // PCLMUL
+
+using namespace X265_NS;
+
+namespace {
+
+/* x^n mod 0x11021, the shifts of the folds */
+const uint64_t K128 = 0xaefc;
+const uint64_t K192 = 0x650b;
+const uint64_t K512 = 0x13fc;
+const uint64_t K576 = 0x8832;
+
+inline uint32_t crcBytes(uint32_t crc, const uint8_t* src, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+        crc = ((crc << 8) & 0xffff) ^ src[i] ^ g_picHashCRCTable[crc >> 8];
+    return crc;
+}
+
+/* a * x^(128 * n) + b, the constants are the shifts of the two halves of a */
+inline __m128i fold(__m128i a, __m128i b, __m128i k)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x11), _mm_clmulepi64_si128(a, k, 0x00)), b);
+}
+
+/* CRC of the decoded picture hash by carry-less multiplication. The CRC is
+ * the remainder of the sample bytes read as one polynomial, so the bytes of
+ * each row are folded 16 at a time into 128 bit remainders, four of them
+ * interleaved, which are only reduced to 16 bits at the end of the row */
+uint32_t picHashCRC(const pixel* plane, intptr_t stride, uint32_t width, uint32_t height, uint32_t crc)
+{
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m128i k1 = _mm_set_epi64x((int64_t)K192, (int64_t)K128);
+    const __m128i k4 = _mm_set_epi64x((int64_t)K576, (int64_t)K512);
+    const uint32_t rowBytes = width * sizeof(pixel);
+    ALIGN_VAR_16(uint8_t, rem[16]);
+
+    for (uint32_t y = 0; y < height; y++, plane += stride)
+    {
+        const uint8_t* src = (const uint8_t*)plane;
+        if (rowBytes < 16)
+        {
+            crc = crcBytes(crc, src, rowBytes);
+            continue;
+        }
+
+#define LOAD(i) _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 16 * (i))), reverse)
+        /* the CRC so far is the remainder of the row above, shifted past the first block */
+        __m128i a = _mm_xor_si128(LOAD(0), _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)crc), k1, 0x00));
+        uint32_t i = 16;
+
+        if (rowBytes >= 64)
+        {
+            __m128i b = LOAD(1), c = LOAD(2), d = LOAD(3);
+            for (i = 64; i + 64 <= rowBytes; i += 64)
+            {
+                a = fold(a, LOAD(i / 16 + 0), k4);
+                b = fold(b, LOAD(i / 16 + 1), k4);
+                c = fold(c, LOAD(i / 16 + 2), k4);
+                d = fold(d, LOAD(i / 16 + 3), k4);
+            }
+            a = fold(fold(fold(a, b, k1), c, k1), d, k1);
+        }
+
+        for (; i + 16 <= rowBytes; i += 16)
+            a = fold(a, LOAD(i / 16), k1);
+#undef LOAD
+
+        _mm_store_si128((__m128i*)rem, _mm_shuffle_epi8(a, reverse));
+        crc = crcBytes(crcBytes(0, rem, 16), src + i, rowBytes - i);
+    }
+
+    return crc;
+}
+
+} // end anonymous namespace
+
+namespace X265_NS {
+void setupIntrinsicPicHash_pclmul(EncoderPrimitives &p)
+{
+    p.picHashCRC = picHashCRC;
+}
+}
@@ -0,0 +1,252 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#include "common.h"
+#include "primitives.h"
+#include "md5.h"
+#include <xmmintrin.h> // SSE
+#include <pmmintrin.h> // SSE3
+
+using namespace X265_NS;
+
+namespace {
+
+/* Checksum of the decoded picture hash. The xor mask of a sample is
+ * (x & 0xff) ^ (x >> 8) ^ (y & 0xff) ^ (y >> 8), so within a vector starting
+ * at an aligned x it is the mask of its first sample xor the lane index */
+uint32_t picHashChecksum(const pixel* plane, intptr_t stride, uint32_t width, uint32_t height, uint32_t y, uint32_t checksum)
+{
+#if HIGH_BIT_DEPTH
+    const __m128i lane = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m128i lowByte = _mm_set1_epi16(0xff);
+    const __m128i one = _mm_set1_epi16(1);
+    const uint32_t N = 8;
+#else
+    const __m128i lane = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i zero = _mm_setzero_si128();
+    const uint32_t N = 16;
+#endif
+    __m128i sum = _mm_setzero_si128();
+    uint32_t widthN = width & ~(N - 1);
+
+    for (uint32_t row = 0; row < height; row++, y++, plane += stride)
+    {
+        uint32_t yMask = (y & 0xff) ^ (y >> 8);
+        uint32_t x = 0;
+
+        for (; x < widthN; x += N)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(plane + x));
+#if HIGH_BIT_DEPTH
+            __m128i mask = _mm_xor_si128(_mm_set1_epi16((int16_t)((x ^ (x >> 8) ^ yMask) & 0xff)), lane);
+            __m128i lo = _mm_xor_si128(_mm_and_si128(v, lowByte), mask);
+            __m128i hi = _mm_xor_si128(_mm_srli_epi16(v, 8), mask);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_add_epi16(lo, hi), one));
+#else
+            __m128i mask = _mm_xor_si128(_mm_set1_epi8((char)(x ^ (x >> 8) ^ yMask)), lane);
+            sum = _mm_add_epi32(sum, _mm_sad_epu8(_mm_xor_si128(v, mask), zero));
+#endif
+        }
+
+        for (; x < width; x++)
+        {
+            uint8_t xorMask = (uint8_t)(x ^ (x >> 8) ^ yMask);
+            checksum += (plane[x] & 0xff) ^ xorMask;
+            if (X265_DEPTH > 8)
+                checksum += (plane[x] >> 7 >> 1) ^ xorMask;
+        }
+    }
+
+    /* the lanes wrap as the checksum does */
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return checksum + (uint32_t)_mm_cvtsi128_si32(sum);
+}
+
+#define MD5_F1(x, y, z) _mm_xor_si128(z, _mm_and_si128(x, _mm_xor_si128(y, z)))
+#define MD5_F2(x, y, z) MD5_F1(z, x, y)
+#define MD5_F3(x, y, z) _mm_xor_si128(_mm_xor_si128(x, y), z)
+#define MD5_F4(x, y, z) _mm_xor_si128(y, _mm_or_si128(x, _mm_xor_si128(z, ones)))
+
+#define MD5_STEP(f, w, x, y, z, i, k, s) \
+    w = _mm_add_epi32(w, _mm_add_epi32(f(x, y, z), _mm_add_epi32(in[i], _mm_set1_epi32((int)k)))); \
+    w = _mm_or_si128(_mm_slli_epi32(w, s), _mm_srli_epi32(w, 32 - s)); \
+    w = _mm_add_epi32(w, x)
+
+/* The MD5 transform of up to four messages at once, one in each lane. Fewer
+ * streams hash copies of the first in the spare lanes */
+void md5Blocks(uint32_t* const* state, const uint8_t* const* data, int numStreams, uint32_t numBlocks)
+{
+    if (numStreams == 1)
+    {
+        const uint8_t* block = data[0];
+        uint32_t in[16];
+        for (uint32_t b = 0; b < numBlocks; b++, block += 64)
+        {
+            memcpy(in, block, sizeof(in));
+            MD5Transform(state[0], in);
+        }
+        return;
+    }
+
+    const uint8_t* src[4];
+    ALIGN_VAR_16(uint32_t, buf[4][4]);
+    for (int j = 0; j < 4; j++)
+    {
+        src[j] = data[j < numStreams ? j : 0];
+        memcpy(buf[j], state[j < numStreams ? j : 0], sizeof(buf[j]));
+    }
+
+    /* transpose to the a, b, c and d of each lane */
+    __m128i t0 = _mm_unpacklo_epi32(_mm_load_si128((__m128i*)buf[0]), _mm_load_si128((__m128i*)buf[1]));
+    __m128i t1 = _mm_unpacklo_epi32(_mm_load_si128((__m128i*)buf[2]), _mm_load_si128((__m128i*)buf[3]));
+    __m128i t2 = _mm_unpackhi_epi32(_mm_load_si128((__m128i*)buf[0]), _mm_load_si128((__m128i*)buf[1]));
+    __m128i t3 = _mm_unpackhi_epi32(_mm_load_si128((__m128i*)buf[2]), _mm_load_si128((__m128i*)buf[3]));
+    __m128i sa = _mm_unpacklo_epi64(t0, t1);
+    __m128i sb = _mm_unpackhi_epi64(t0, t1);
+    __m128i sc = _mm_unpacklo_epi64(t2, t3);
+    __m128i sd = _mm_unpackhi_epi64(t2, t3);
+    const __m128i ones = _mm_set1_epi32(-1);
+
+    for (uint32_t b = 0; b < numBlocks; b++)
+    {
+        __m128i in[16];
+        for (int i = 0; i < 16; i += 4)
+        {
+            __m128i r0 = _mm_loadu_si128((const __m128i*)(src[0] + 4 * i));
+            __m128i r1 = _mm_loadu_si128((const __m128i*)(src[1] + 4 * i));
+            __m128i r2 = _mm_loadu_si128((const __m128i*)(src[2] + 4 * i));
+            __m128i r3 = _mm_loadu_si128((const __m128i*)(src[3] + 4 * i));
+            t0 = _mm_unpacklo_epi32(r0, r1);
+            t1 = _mm_unpacklo_epi32(r2, r3);
+            t2 = _mm_unpackhi_epi32(r0, r1);
+            t3 = _mm_unpackhi_epi32(r2, r3);
+            in[i + 0] = _mm_unpacklo_epi64(t0, t1);
+            in[i + 1] = _mm_unpackhi_epi64(t0, t1);
+            in[i + 2] = _mm_unpacklo_epi64(t2, t3);
+            in[i + 3] = _mm_unpackhi_epi64(t2, t3);
+        }
+        for (int j = 0; j < 4; j++)
+            src[j] += 64;
+
+        __m128i a = sa, bb = sb, c = sc, d = sd;
+
+        MD5_STEP(MD5_F1, a, bb, c, d, 0, 0xd76aa478, 7);
+        MD5_STEP(MD5_F1, d, a, bb, c, 1, 0xe8c7b756, 12);
+        MD5_STEP(MD5_F1, c, d, a, bb, 2, 0x242070db, 17);
+        MD5_STEP(MD5_F1, bb, c, d, a, 3, 0xc1bdceee, 22);
+        MD5_STEP(MD5_F1, a, bb, c, d, 4, 0xf57c0faf, 7);
+        MD5_STEP(MD5_F1, d, a, bb, c, 5, 0x4787c62a, 12);
+        MD5_STEP(MD5_F1, c, d, a, bb, 6, 0xa8304613, 17);
+        MD5_STEP(MD5_F1, bb, c, d, a, 7, 0xfd469501, 22);
+        MD5_STEP(MD5_F1, a, bb, c, d, 8, 0x698098d8, 7);
+        MD5_STEP(MD5_F1, d, a, bb, c, 9, 0x8b44f7af, 12);
+        MD5_STEP(MD5_F1, c, d, a, bb, 10, 0xffff5bb1, 17);
+        MD5_STEP(MD5_F1, bb, c, d, a, 11, 0x895cd7be, 22);
+        MD5_STEP(MD5_F1, a, bb, c, d, 12, 0x6b901122, 7);
+        MD5_STEP(MD5_F1, d, a, bb, c, 13, 0xfd987193, 12);
+        MD5_STEP(MD5_F1, c, d, a, bb, 14, 0xa679438e, 17);
+        MD5_STEP(MD5_F1, bb, c, d, a, 15, 0x49b40821, 22);
+
+        MD5_STEP(MD5_F2, a, bb, c, d, 1, 0xf61e2562, 5);
+        MD5_STEP(MD5_F2, d, a, bb, c, 6, 0xc040b340, 9);
+        MD5_STEP(MD5_F2, c, d, a, bb, 11, 0x265e5a51, 14);
+        MD5_STEP(MD5_F2, bb, c, d, a, 0, 0xe9b6c7aa, 20);
+        MD5_STEP(MD5_F2, a, bb, c, d, 5, 0xd62f105d, 5);
+        MD5_STEP(MD5_F2, d, a, bb, c, 10, 0x02441453, 9);
+        MD5_STEP(MD5_F2, c, d, a, bb, 15, 0xd8a1e681, 14);
+        MD5_STEP(MD5_F2, bb, c, d, a, 4, 0xe7d3fbc8, 20);
+        MD5_STEP(MD5_F2, a, bb, c, d, 9, 0x21e1cde6, 5);
+        MD5_STEP(MD5_F2, d, a, bb, c, 14, 0xc33707d6, 9);
+        MD5_STEP(MD5_F2, c, d, a, bb, 3, 0xf4d50d87, 14);
+        MD5_STEP(MD5_F2, bb, c, d, a, 8, 0x455a14ed, 20);
+        MD5_STEP(MD5_F2, a, bb, c, d, 13, 0xa9e3e905, 5);
+        MD5_STEP(MD5_F2, d, a, bb, c, 2, 0xfcefa3f8, 9);
+        MD5_STEP(MD5_F2, c, d, a, bb, 7, 0x676f02d9, 14);
+        MD5_STEP(MD5_F2, bb, c, d, a, 12, 0x8d2a4c8a, 20);
+
+        MD5_STEP(MD5_F3, a, bb, c, d, 5, 0xfffa3942, 4);
+        MD5_STEP(MD5_F3, d, a, bb, c, 8, 0x8771f681, 11);
+        MD5_STEP(MD5_F3, c, d, a, bb, 11, 0x6d9d6122, 16);
+        MD5_STEP(MD5_F3, bb, c, d, a, 14, 0xfde5380c, 23);
+        MD5_STEP(MD5_F3, a, bb, c, d, 1, 0xa4beea44, 4);
+        MD5_STEP(MD5_F3, d, a, bb, c, 4, 0x4bdecfa9, 11);
+        MD5_STEP(MD5_F3, c, d, a, bb, 7, 0xf6bb4b60, 16);
+        MD5_STEP(MD5_F3, bb, c, d, a, 10, 0xbebfbc70, 23);
+        MD5_STEP(MD5_F3, a, bb, c, d, 13, 0x289b7ec6, 4);
+        MD5_STEP(MD5_F3, d, a, bb, c, 0, 0xeaa127fa, 11);
+        MD5_STEP(MD5_F3, c, d, a, bb, 3, 0xd4ef3085, 16);
+        MD5_STEP(MD5_F3, bb, c, d, a, 6, 0x04881d05, 23);
+        MD5_STEP(MD5_F3, a, bb, c, d, 9, 0xd9d4d039, 4);
+        MD5_STEP(MD5_F3, d, a, bb, c, 12, 0xe6db99e5, 11);
+        MD5_STEP(MD5_F3, c, d, a, bb, 15, 0x1fa27cf8, 16);
+        MD5_STEP(MD5_F3, bb, c, d, a, 2, 0xc4ac5665, 23);
+
+        MD5_STEP(MD5_F4, a, bb, c, d, 0, 0xf4292244, 6);
+        MD5_STEP(MD5_F4, d, a, bb, c, 7, 0x432aff97, 10);
+        MD5_STEP(MD5_F4, c, d, a, bb, 14, 0xab9423a7, 15);
+        MD5_STEP(MD5_F4, bb, c, d, a, 5, 0xfc93a039, 21);
+        MD5_STEP(MD5_F4, a, bb, c, d, 12, 0x655b59c3, 6);
+        MD5_STEP(MD5_F4, d, a, bb, c, 3, 0x8f0ccc92, 10);
+        MD5_STEP(MD5_F4, c, d, a, bb, 10, 0xffeff47d, 15);
+        MD5_STEP(MD5_F4, bb, c, d, a, 1, 0x85845dd1, 21);
+        MD5_STEP(MD5_F4, a, bb, c, d, 8, 0x6fa87e4f, 6);
+        MD5_STEP(MD5_F4, d, a, bb, c, 15, 0xfe2ce6e0, 10);
+        MD5_STEP(MD5_F4, c, d, a, bb, 6, 0xa3014314, 15);
+        MD5_STEP(MD5_F4, bb, c, d, a, 13, 0x4e0811a1, 21);
+        MD5_STEP(MD5_F4, a, bb, c, d, 4, 0xf7537e82, 6);
+        MD5_STEP(MD5_F4, d, a, bb, c, 11, 0xbd3af235, 10);
+        MD5_STEP(MD5_F4, c, d, a, bb, 2, 0x2ad7d2bb, 15);
+        MD5_STEP(MD5_F4, bb, c, d, a, 9, 0xeb86d391, 21);
+
+        sa = _mm_add_epi32(sa, a);
+        sb = _mm_add_epi32(sb, bb);
+        sc = _mm_add_epi32(sc, c);
+        sd = _mm_add_epi32(sd, d);
+    }
+
+    t0 = _mm_unpacklo_epi32(sa, sb);
+    t1 = _mm_unpacklo_epi32(sc, sd);
+    t2 = _mm_unpackhi_epi32(sa, sb);
+    t3 = _mm_unpackhi_epi32(sc, sd);
+    _mm_store_si128((__m128i*)buf[0], _mm_unpacklo_epi64(t0, t1));
+    _mm_store_si128((__m128i*)buf[1], _mm_unpackhi_epi64(t0, t1));
+    _mm_store_si128((__m128i*)buf[2], _mm_unpacklo_epi64(t2, t3));
+    _mm_store_si128((__m128i*)buf[3], _mm_unpackhi_epi64(t2, t3));
+    for (int j = 0; j < numStreams; j++)
+        memcpy(state[j], buf[j], sizeof(buf[j]));
+}
+
+#undef MD5_STEP
+#undef MD5_F4
+#undef MD5_F3
+#undef MD5_F2
+#undef MD5_F1
+
+} // end anonymous namespace
+
+namespace X265_NS {
+void setupIntrinsicPicHash_sse3(EncoderPrimitives &p)
+{
+    p.picHashChecksum = picHashChecksum;
+    p.md5Blocks = md5Blocks;
+}
+}
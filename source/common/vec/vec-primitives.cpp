@@ -30,6 +30,7 @@
 #define HAVE_SSE3
 #define HAVE_SSSE3
 #define HAVE_SSE4
+#define HAVE_PCLMUL
 #define HAVE_AVX2
 #elif defined(__GNUC__)
 #define GCC_VERSION (__GNUC__ * 10000 + __GNUC_MINOR__ * 100 + __GNUC_PATCHLEVEL__)
@@ -38,6 +39,9 @@
 #define HAVE_SSSE3
 #define HAVE_SSE4
 #endif
+#if __clang__ || GCC_VERSION >= 40400 /* gcc_version >= gcc-4.4.0 */
+#define HAVE_PCLMUL
+#endif
 #if __clang__ || GCC_VERSION >= 40700 /* gcc_version >= gcc-4.7.0 */
 #define HAVE_AVX2
 #endif
@@ -45,6 +49,9 @@
 #define HAVE_SSE3
 #define HAVE_SSSE3
 #define HAVE_SSE4
+#if _MSC_VER >= 1600 // VC10
+#define HAVE_PCLMUL
+#endif
 #if _MSC_VER >= 1700 // VC11
 #define HAVE_AVX2
 #endif
@@ -55,8 +62,12 @@ namespace X265_NS {
 // private x265 namespace
 
 void setupIntrinsicDCT_sse3(EncoderPrimitives&);
+void setupIntrinsicNal_sse3(EncoderPrimitives&);
+void setupIntrinsicPicHash_sse3(EncoderPrimitives&);
 void setupIntrinsicDCT_ssse3(EncoderPrimitives&);
 void setupIntrinsicDCT_sse41(EncoderPrimitives&);
+void setupIntrinsicCUTree_sse41(EncoderPrimitives&);
+void setupIntrinsicPicHash_pclmul(EncoderPrimitives&);
 
 /* Use primitives for the best available vector architecture */
 void setupInstrinsicPrimitives(EncoderPrimitives &p, int cpuMask)
@@ -65,6 +76,8 @@ void setupInstrinsicPrimitives(EncoderPrimitives &p, int cpuMask)
     if (cpuMask & X265_CPU_SSE3)
     {
         setupIntrinsicDCT_sse3(p);
+        setupIntrinsicNal_sse3(p);
+        setupIntrinsicPicHash_sse3(p);
     }
 #endif
 #ifdef HAVE_SSSE3
@@ -77,6 +90,13 @@ void setupInstrinsicPrimitives(EncoderPrimitives &p, int cpuMask)
     if (cpuMask & X265_CPU_SSE4)
     {
         setupIntrinsicDCT_sse41(p);
+        setupIntrinsicCUTree_sse41(p);
+    }
+#endif
+#ifdef HAVE_PCLMUL
+    if ((cpuMask & X265_CPU_SSE4) && (cpuMask & X265_CPU_PCLMUL))
+    {
+        setupIntrinsicPicHash_pclmul(p);
     }
 #endif
     (void)p;
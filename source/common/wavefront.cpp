@@ -43,75 +43,141 @@ bool WaveFront::init(int numRows)
     if (m_externalDependencyBitmap)
         memset((void*)m_externalDependencyBitmap, 0, sizeof(uint32_t) * m_numWords);
 
+    m_readyBitmap = X265_MALLOC(uint32_t, m_numWords);
+    if (m_readyBitmap)
+        memset((void*)m_readyBitmap, 0, sizeof(uint32_t) * m_numWords);
+
     m_row_to_idx = X265_MALLOC(uint32_t, m_numRows);
     m_idx_to_row = X265_MALLOC(uint32_t, m_numRows);
 
-    return m_internalDependencyBitmap && m_externalDependencyBitmap;
+    /* the pool is attached before init, size the row locality hints by it */
+    m_numLastRows = m_pool ? m_pool->m_numWorkers : 0;
+    if (m_numLastRows)
+    {
+        m_lastRow = X265_MALLOC(int, m_numLastRows);
+        if (m_lastRow)
+            memset(m_lastRow, -1, sizeof(int) * m_numLastRows);
+        else
+            m_numLastRows = 0;
+    }
+
+    return m_internalDependencyBitmap && m_externalDependencyBitmap && m_readyBitmap;
 }
 
 WaveFront::~WaveFront()
 {
     x265_free((void*)m_row_to_idx);
     x265_free((void*)m_idx_to_row);
+    x265_free(m_lastRow);
 
     x265_free((void*)m_internalDependencyBitmap);
     x265_free((void*)m_externalDependencyBitmap);
+    x265_free((void*)m_readyBitmap);
 }
 
 void WaveFront::clearEnabledRowMask()
 {
     memset((void*)m_externalDependencyBitmap, 0, sizeof(uint32_t) * m_numWords);
     memset((void*)m_internalDependencyBitmap, 0, sizeof(uint32_t) * m_numWords);
+    memset((void*)m_readyBitmap, 0, sizeof(uint32_t) * m_numWords);
 }
 
+/* enqueueRow() and enableRow() each set their own bit and then test the
+ * other; the atomics are full barriers so at least one of them sees both
+ * bits and publishes the row as ready */
 void WaveFront::enqueueRow(int row)
 {
     uint32_t bit = 1 << (row & 31);
     ATOMIC_OR(&m_internalDependencyBitmap[row >> 5], bit);
+    if (m_externalDependencyBitmap[row >> 5] & bit)
+        ATOMIC_OR(&m_readyBitmap[row >> 5], bit);
 }
 
 void WaveFront::enableRow(int row)
 {
     uint32_t bit = 1 << (row & 31);
     ATOMIC_OR(&m_externalDependencyBitmap[row >> 5], bit);
+    if (m_internalDependencyBitmap[row >> 5] & bit)
+        ATOMIC_OR(&m_readyBitmap[row >> 5], bit);
 }
 
 void WaveFront::enableAllRows()
 {
     memset((void*)m_externalDependencyBitmap, ~0, sizeof(uint32_t) * m_numWords);
+    for (int w = 0; w < m_numWords; w++)
+        ATOMIC_OR(&m_readyBitmap[w], m_internalDependencyBitmap[w]);
 }
 
 bool WaveFront::dequeueRow(int row)
 {
+    /* a stale ready bit is cleared by the next findJob() which visits it */
     uint32_t bit = 1 << (row & 31);
     return !!(ATOMIC_AND(&m_internalDependencyBitmap[row >> 5], ~bit) & bit);
 }
 
+/* The ready bit is cleared before the internal bit is claimed, so a row
+ * enqueued again in between either is claimed here or publishes a new ready
+ * bit after this clear */
+bool WaveFront::tryClaimRow(int row)
+{
+    uint32_t bit = 1 << (row & 31);
+    ATOMIC_AND(&m_readyBitmap[row >> 5], ~bit);
+    return !!(ATOMIC_AND(&m_internalDependencyBitmap[row >> 5], ~bit) & bit);
+}
+
 void WaveFront::findJob(int threadId)
 {
     unsigned long id;
+    int* lastRow = threadId >= 0 && threadId < m_numLastRows ? &m_lastRow[threadId] : NULL;
 
-    /* Loop over each word until all available rows are finished */
-    for (int w = 0; w < m_numWords; w++)
+    for (int batch = 0; batch < m_rowBatch; batch++)
     {
-        uint32_t oldval = m_internalDependencyBitmap[w] & m_externalDependencyBitmap[w];
-        while (oldval)
+        int row = -1;
+
+        /* resume the row this worker processed last, or the row after it,
+         * while their CTU data is still in this worker's cache */
+        if (lastRow && *lastRow >= 0 && m_rowStride)
         {
-            CTZ(id, oldval);
+            for (int r = *lastRow; r <= *lastRow + m_rowStride && r < m_numRows; r += m_rowStride)
+            {
+                if ((m_readyBitmap[r >> 5] & (1 << (r & 31))) && tryClaimRow(r))
+                {
+                    row = r;
+                    break;
+                }
+            }
+        }
 
-            uint32_t bit = 1 << id;
-            if (ATOMIC_AND(&m_internalDependencyBitmap[w], ~bit) & bit)
+        /* else the lowest numbered ready row */
+        for (int w = 0; w < m_numWords && row < 0; w++)
+        {
+            uint32_t oldval = m_readyBitmap[w];
+            while (oldval)
             {
-                /* we cleared the bit, we get to process the row */
-                processRow(w * 32 + id, threadId);
-                m_helpWanted = true;
-                return; /* check for a higher priority task */
+                CTZ(id, oldval);
+
+                if (tryClaimRow(w * 32 + id))
+                {
+                    /* we cleared the bit, we get to process the row */
+                    row = w * 32 + id;
+                    break;
+                }
+
+                oldval = m_readyBitmap[w];
             }
+        }
 
-            oldval = m_internalDependencyBitmap[w] & m_externalDependencyBitmap[w];
+        if (row < 0)
+        {
+            m_helpWanted = false;
+            return;
         }
+
+        processRow(row, threadId);
+        if (lastRow)
+            *lastRow = row;
     }
 
-    m_helpWanted = false;
+    m_helpWanted = true; /* check for a higher priority task */
 }
 }
@@ -47,20 +47,49 @@ private:
     uint32_t volatile *m_internalDependencyBitmap;
     uint32_t volatile *m_externalDependencyBitmap;
 
+    // rows with both dependencies resolved. Only this bitmap is scanned by
+    // findJob(), rows still waiting on reference frames are never visited.
+    // A set bit is a hint, the row is claimed by clearing its internal bit
+    uint32_t volatile *m_readyBitmap;
+
     // number of words in the bitmap
     int m_numWords;
 
     int m_numRows;
 
+    // last row processed by each worker thread, -1 if none
+    int *m_lastRow;
+    int  m_numLastRows;
+
+    bool tryClaimRow(int row);
+
 protected:
     uint32_t *m_row_to_idx;
     uint32_t *m_idx_to_row;
 
+    // Rows processed per findJob() call before the worker re-evaluates the
+    // priorities of the pool's job providers. Default WAVEFRONT_ROW_BATCH
+    int m_rowBatch;
+
+    // Distance between a row and the next row of the same kind. A worker
+    // first tries to resume the row it last processed, then the next one.
+    // 0 disables row locality. Default 1
+    int m_rowStride;
+
 public:
 
+    enum { WAVEFRONT_ROW_BATCH = 4 };
+
     WaveFront()
         : m_internalDependencyBitmap(NULL)
         , m_externalDependencyBitmap(NULL)
+        , m_readyBitmap(NULL)
+        , m_lastRow(NULL)
+        , m_numLastRows(0)
+        , m_row_to_idx(NULL)
+        , m_idx_to_row(NULL)
+        , m_rowBatch(WAVEFRONT_ROW_BATCH)
+        , m_rowStride(1)
     {}
 
     virtual ~WaveFront();
@@ -88,9 +117,10 @@ public:
     // resolved before each row may proceed.
     void clearEnabledRowMask();
 
-    // WaveFront's implementation of JobProvider::findJob. Consults
-    // m_queuedBitmap and calls ProcessRow(row) for lowest numbered queued row
-    // processes available rows and returns when no work remains
+    // WaveFront's implementation of JobProvider::findJob. Processes up to
+    // m_rowBatch available rows, preferring the rows this worker processed
+    // last, else the lowest numbered ready row, and returns when no work
+    // remains or the batch is complete
     void findJob(int threadId);
 
     // Start or resume encode processing of this row, must be implemented by
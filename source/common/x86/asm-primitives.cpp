@@ -1180,8 +1180,6 @@ void setupAssemblyPrimitives(EncoderPrimitives &p, int cpuMask) // Main10
         ASSIGN2(p.chroma[X265_CSP_I420].pu[CHROMA_420_8x6].p2s, filterPixelToShort_8x6_ssse3);
 
         p.findPosFirstLast = PFX(findPosFirstLast_ssse3);
-        p.fix8Unpack = PFX(cutree_fix8_unpack_ssse3);
-        p.fix8Pack = PFX(cutree_fix8_pack_ssse3);
     }
     if (cpuMask & X265_CPU_SSE4)
     {
@@ -2297,8 +2295,6 @@ void setupAssemblyPrimitives(EncoderPrimitives &p, int cpuMask) // Main10
 
         p.frameInitLowres = PFX(frame_init_lowres_core_avx2);
         p.propagateCost = PFX(mbtree_propagate_cost_avx2);
-        p.fix8Unpack = PFX(cutree_fix8_unpack_avx2);
-        p.fix8Pack = PFX(cutree_fix8_pack_avx2);
 
         p.integral_initv[INTEGRAL_4] = PFX(integral4v_avx2);
         p.integral_initv[INTEGRAL_8] = PFX(integral8v_avx2);
@@ -3470,8 +3466,6 @@ void setupAssemblyPrimitives(EncoderPrimitives &p, int cpuMask) // Main
         ASSIGN2(p.pu[LUMA_48x64].convert_p2s, filterPixelToShort_48x64_ssse3);
 
         p.findPosFirstLast = PFX(findPosFirstLast_ssse3);
-        p.fix8Unpack = PFX(cutree_fix8_unpack_ssse3);
-        p.fix8Pack = PFX(cutree_fix8_pack_ssse3);
     }
     if (cpuMask & X265_CPU_SSE4)
     {
@@ -4693,8 +4687,6 @@ void setupAssemblyPrimitives(EncoderPrimitives &p, int cpuMask) // Main
         p.pu[LUMA_64x48].sad_x3 = PFX(pixel_sad_x3_64x48_avx2);
         p.pu[LUMA_64x64].sad_x3 = PFX(pixel_sad_x3_64x64_avx2);
         p.pu[LUMA_48x64].sad_x3 = PFX(pixel_sad_x3_48x64_avx2);
-        p.fix8Unpack = PFX(cutree_fix8_unpack_avx2);
-        p.fix8Pack = PFX(cutree_fix8_pack_avx2);
 
         p.integral_initv[INTEGRAL_4] = PFX(integral4v_avx2);
         p.integral_initv[INTEGRAL_8] = PFX(integral8v_avx2);
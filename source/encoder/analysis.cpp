@@ -3576,8 +3576,7 @@ double Analysis::aqQPOffset(const CUData& ctu, const CUGeom& cuGeom)
 
     uint32_t aqStride = pQPLayer->numAQPartInWidth;
 
-    double dQpOffset = pQPLayer->dQpOffset[aqPosY * aqStride + aqPosX];
-    return dQpOffset;
+    return x265_fix82qp(pQPLayer->dQpOffset[aqPosY * aqStride + aqPosX]);
 }
 
 double Analysis::cuTreeQPOffset(const CUData& ctu, const CUGeom& cuGeom)
@@ -3590,8 +3589,7 @@ double Analysis::cuTreeQPOffset(const CUData& ctu, const CUGeom& cuGeom)
 
     uint32_t aqStride = pcAQLayer->numAQPartInWidth;
 
-    double dQpOffset = pcAQLayer->dCuTreeOffset[aqPosY * aqStride + aqPosX];
-    return dQpOffset;
+    return x265_fix82qp(pcAQLayer->dCuTreeOffset[aqPosY * aqStride + aqPosX]);
 }
 
 int Analysis::calculateQpforCuSize(const CUData& ctu, const CUGeom& cuGeom, int32_t complexCheck, double baseQp)
@@ -3641,7 +3639,7 @@ int Analysis::calculateQpforCuSize(const CUData& ctu, const CUGeom& cuGeom, int3
     {
         int loopIncr = (m_param->rc.qgSize == 8) ? 8 : 16;
         /* Use cuTree offsets if cuTree enabled and frame is referenced, else use AQ offsets */
-        double *qpoffs = bCuTreeOffset ? m_frame->m_lowres.qpCuTreeOffset : m_frame->m_lowres.qpAqOffset;
+        int16_t *qpoffs = bCuTreeOffset ? m_frame->m_lowres.qpCuTreeOffset : m_frame->m_lowres.qpAqOffset;
         if (qpoffs)
         {
             uint32_t width = m_frame->m_fencPic->m_picWidth;
@@ -3650,18 +3648,18 @@ int Analysis::calculateQpforCuSize(const CUData& ctu, const CUGeom& cuGeom, int3
             uint32_t block_y = ctu.m_cuPelY + g_zscanToPelY[cuGeom.absPartIdx];
             uint32_t maxCols = (m_frame->m_fencPic->m_picWidth + (loopIncr - 1)) / loopIncr;
             uint32_t blockSize = m_param->maxCUSize >> cuGeom.depth;
-            double dQpOffset = 0;
+            int qpOffsetSum = 0;
             uint32_t cnt = 0;
             for (uint32_t block_yy = block_y; block_yy < block_y + blockSize && block_yy < height; block_yy += loopIncr)
             {
                 for (uint32_t block_xx = block_x; block_xx < block_x + blockSize && block_xx < width; block_xx += loopIncr)
                 {
                     uint32_t idx = ((block_yy / loopIncr) * (maxCols)) + (block_xx / loopIncr);
-                    dQpOffset += qpoffs[idx];
+                    qpOffsetSum += qpoffs[idx];
                     cnt++;
                 }
             }
-            dQpOffset /= cnt;
+            double dQpOffset = x265_fix82qp(qpOffsetSum) / cnt;
             qp += dQpOffset;
             if (complexCheck)
             {
@@ -0,0 +1,383 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#include "common.h"
+#include "analysisfile.h"
+
+#if !_WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace X265_NS;
+
+namespace {
+
+const char     s_magic[8] = { 'X', '2', '6', '5', 'A', 'N', 'A', 'L' };
+const uint32_t s_version = 2;
+const uint32_t BLOCK_ALIGN = 16;
+
+/* PackBits: a control byte c < 128 is followed by c + 1 literal bytes, a
+ * control byte c >= 128 by one byte which is repeated c - 126 times. Packs
+ * count bytes into at most count + (count + 127) / 128 bytes */
+size_t packBytes(uint8_t* dst, const uint8_t* src, size_t count)
+{
+    uint8_t* out = dst;
+    size_t i = 0;
+    while (i < count)
+    {
+        size_t run = 1;
+        while (i + run < count && run < 129 && src[i + run] == src[i])
+            run++;
+        if (run > 1)
+        {
+            *out++ = (uint8_t)(run + 126);
+            *out++ = src[i];
+            i += run;
+        }
+        else
+        {
+            /* extend the literal up to the next repeated byte */
+            size_t start = i;
+            while (i < count && i - start < 128 && !(i + 1 < count && src[i + 1] == src[i]))
+                i++;
+            *out++ = (uint8_t)(i - start - 1);
+            memcpy(out, src + start, i - start);
+            out += i - start;
+        }
+    }
+    return out - dst;
+}
+
+bool unpackBytes(uint8_t* dst, size_t count, const uint8_t* src, size_t size)
+{
+    size_t i = 0, o = 0;
+    while (i < size)
+    {
+        uint32_t c = src[i++];
+        if (c < 128)
+        {
+            size_t len = c + 1;
+            if (len > size - i || len > count - o)
+                return false;
+            memcpy(dst + o, src + i, len);
+            i += len;
+            o += len;
+        }
+        else
+        {
+            size_t len = c - 126;
+            if (i == size || len > count - o)
+                return false;
+            memset(dst + o, src[i++], len);
+            o += len;
+        }
+    }
+    return o == count;
+}
+
+} // end anonymous namespace
+
+AnalysisFile::AnalysisFile()
+{
+    /* close() releases these before it resets every member */
+    m_entries = NULL;
+    m_packBuf = NULL;
+    m_base = NULL;
+    m_pocRecord = NULL;
+    close();
+}
+
+bool AnalysisFile::create(FILE* fp, bool bPack)
+{
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, s_magic, sizeof(header.magic));
+    header.version = s_version;
+    header.flags = bPack ? FLAG_PACKED : 0;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
+        return false;
+
+    m_fp = fp;
+    m_flags = header.flags;
+    m_pos = sizeof(header);
+    return true;
+}
+
+bool AnalysisFile::pad()
+{
+    static const uint8_t zeros[BLOCK_ALIGN] = { 0 };
+    size_t bytes = (size_t)(-(int64_t)m_pos & (BLOCK_ALIGN - 1));
+    if (bytes && fwrite(zeros, 1, bytes, m_fp) != bytes)
+        return false;
+    m_pos += bytes;
+    return true;
+}
+
+bool AnalysisFile::beginRecord(int poc, int sliceType)
+{
+    /* the param block of the first frame was written past m_pos */
+    int64_t pos = ftello(m_fp);
+    if (pos < 0)
+        return false;
+    m_pos = (uint64_t)pos;
+    if (!pad())
+        return false;
+
+    if (m_numEntries)
+        m_entries[m_numEntries - 1].size = m_pos - m_entries[m_numEntries - 1].offset;
+    if (m_numEntries == m_maxEntries)
+    {
+        uint32_t maxEntries = m_maxEntries ? 2 * m_maxEntries : 256;
+        IndexEntry* entries = X265_MALLOC(IndexEntry, maxEntries);
+        if (!entries)
+            return false;
+        if (m_numEntries)
+            memcpy(entries, m_entries, m_numEntries * sizeof(IndexEntry));
+        X265_FREE(m_entries);
+        m_entries = entries;
+        m_maxEntries = maxEntries;
+    }
+
+    IndexEntry& entry = m_entries[m_numEntries++];
+    entry.poc = poc;
+    entry.sliceType = sliceType;
+    entry.offset = m_pos;
+    entry.size = 0;
+    return true;
+}
+
+bool AnalysisFile::write(const void* data, size_t size, size_t count)
+{
+    size_t bytes = size * count;
+    if ((m_flags & FLAG_PACKED) && size == 1)
+    {
+        size_t maxPacked = bytes + (bytes + 127) / 128;
+        if (maxPacked > m_packBufSize)
+        {
+            X265_FREE(m_packBuf);
+            m_packBuf = X265_MALLOC(uint8_t, maxPacked);
+            m_packBufSize = m_packBuf ? maxPacked : 0;
+            if (!m_packBuf)
+                return false;
+        }
+        uint32_t packed = (uint32_t)packBytes(m_packBuf, (const uint8_t*)data, bytes);
+        if (fwrite(&packed, sizeof(packed), 1, m_fp) != 1 ||
+            (packed && fwrite(m_packBuf, 1, packed, m_fp) != packed))
+            return false;
+        m_pos += sizeof(packed) + packed;
+    }
+    else
+    {
+        if (bytes && fwrite(data, 1, bytes, m_fp) != bytes)
+            return false;
+        m_pos += bytes;
+    }
+    return pad();
+}
+
+bool AnalysisFile::finish()
+{
+    if (!pad())
+        return false;
+    if (m_numEntries)
+        m_entries[m_numEntries - 1].size = m_pos - m_entries[m_numEntries - 1].offset;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, s_magic, sizeof(header.magic));
+    header.version = s_version;
+    header.flags = m_flags;
+    header.recordCount = m_numEntries;
+    header.indexOffset = m_pos;
+
+    if (m_numEntries && fwrite(m_entries, sizeof(IndexEntry), m_numEntries, m_fp) != m_numEntries)
+        return false;
+    if (fseeko(m_fp, 0, SEEK_SET) || fwrite(&header, sizeof(header), 1, m_fp) != 1)
+        return false;
+    return !fseeko(m_fp, 0, SEEK_END);
+}
+
+bool AnalysisFile::isIndexed(FILE* fp)
+{
+    char magic[sizeof(s_magic)];
+    bool bIndexed = fread(magic, sizeof(magic), 1, fp) == 1 && !memcmp(magic, s_magic, sizeof(magic));
+    fseeko(fp, 0, SEEK_SET);
+    return bIndexed;
+}
+
+bool AnalysisFile::open(FILE* fp)
+{
+    if (fseeko(fp, 0, SEEK_END))
+        return false;
+    int64_t size = ftello(fp);
+    if (size < (int64_t)sizeof(Header))
+        return false;
+
+    m_fp = fp;
+    m_size = (uint64_t)size;
+    m_base = x265_map_file(fp, m_size);
+    m_bMapped = !!m_base;
+    if (!m_base)
+    {
+        /* no mapping, read the whole file instead */
+        uint8_t* buf = (uint64_t)(size_t)m_size == m_size ? X265_MALLOC(uint8_t, (size_t)m_size) : NULL;
+        m_base = buf;
+        if (!buf || fseeko(fp, 0, SEEK_SET) || fread(buf, 1, (size_t)m_size, fp) != (size_t)m_size)
+        {
+            close();
+            return false;
+        }
+    }
+
+    Header header;
+    memcpy(&header, m_base, sizeof(header));
+    if (memcmp(header.magic, s_magic, sizeof(s_magic)) || header.version != s_version ||
+        header.indexOffset < sizeof(header) || header.indexOffset > m_size || (header.indexOffset & (BLOCK_ALIGN - 1)) ||
+        header.recordCount > (m_size - header.indexOffset) / sizeof(IndexEntry))
+    {
+        close();
+        return false;
+    }
+    m_flags = header.flags;
+    m_index = (const IndexEntry*)(m_base + header.indexOffset);
+
+    int minPoc = INT_MAX, maxPoc = -1;
+    for (uint32_t i = 0; i < header.recordCount; i++)
+    {
+        const IndexEntry& entry = m_index[i];
+        if (entry.poc < 0 || entry.offset < sizeof(header) || entry.offset > header.indexOffset ||
+            entry.size > header.indexOffset - entry.offset)
+        {
+            close();
+            return false;
+        }
+        minPoc = X265_MIN(minPoc, entry.poc);
+        maxPoc = X265_MAX(maxPoc, entry.poc);
+    }
+
+    if (header.recordCount)
+    {
+        /* the POCs of one encode are dense, allow some slack for dropped frames */
+        if ((int64_t)maxPoc - minPoc >= 2 * (int64_t)header.recordCount + 16)
+        {
+            close();
+            return false;
+        }
+        m_pocBase = minPoc;
+        m_pocCount = maxPoc - minPoc + 1;
+        m_pocRecord = X265_MALLOC(int32_t, m_pocCount);
+        if (!m_pocRecord)
+        {
+            close();
+            return false;
+        }
+        for (int i = 0; i < m_pocCount; i++)
+            m_pocRecord[i] = -1;
+        for (uint32_t i = 0; i < header.recordCount; i++)
+            m_pocRecord[m_index[i].poc - m_pocBase] = (int32_t)i;
+    }
+
+    return !fseeko(fp, sizeof(header), SEEK_SET);
+}
+
+bool AnalysisFile::find(int poc, Cursor& cursor) const
+{
+    if (poc < m_pocBase || poc - m_pocBase >= m_pocCount || m_pocRecord[poc - m_pocBase] < 0)
+        return false;
+
+    const IndexEntry& entry = m_index[m_pocRecord[poc - m_pocBase]];
+    cursor.pos = entry.offset;
+    cursor.end = entry.offset + entry.size;
+    return true;
+}
+
+bool AnalysisFile::read(Cursor& cursor, void* dst, size_t size, size_t count) const
+{
+    size_t bytes = size * count;
+    uint64_t pos = cursor.pos;
+    if ((m_flags & FLAG_PACKED) && size == 1)
+    {
+        uint32_t packed;
+        if (sizeof(packed) > cursor.end - pos)
+            return false;
+        memcpy(&packed, m_base + pos, sizeof(packed));
+        pos += sizeof(packed);
+        if (packed > cursor.end - pos || !unpackBytes((uint8_t*)dst, bytes, m_base + pos, packed))
+            return false;
+        pos += packed;
+    }
+    else
+    {
+        if (bytes > cursor.end - pos)
+            return false;
+        memcpy(dst, m_base + pos, bytes);
+        pos += bytes;
+    }
+    cursor.pos = X265_MIN((pos + BLOCK_ALIGN - 1) & ~(uint64_t)(BLOCK_ALIGN - 1), cursor.end);
+    return true;
+}
+
+void AnalysisFile::prefetch(int poc) const
+{
+#if !_WIN32 && defined(MADV_WILLNEED)
+    Cursor cursor;
+    if (!m_bMapped || !find(poc, cursor) || cursor.end == cursor.pos)
+        return;
+
+    uintptr_t pageMask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+    uintptr_t start = (uintptr_t)(m_base + cursor.pos) & ~pageMask;
+    uintptr_t end = (uintptr_t)(m_base + cursor.end);
+    madvise((void*)start, end - start, MADV_WILLNEED);
+#else
+    (void)poc;
+#endif
+}
+
+void AnalysisFile::close()
+{
+    if (m_base)
+    {
+        if (m_bMapped)
+            x265_unmap_file(m_base, m_size);
+        else
+            X265_FREE((void*)m_base);
+    }
+    X265_FREE(m_pocRecord);
+    X265_FREE(m_entries);
+    X265_FREE(m_packBuf);
+
+    m_fp = NULL;
+    m_flags = 0;
+    m_entries = NULL;
+    m_numEntries = 0;
+    m_maxEntries = 0;
+    m_pos = 0;
+    m_packBuf = NULL;
+    m_packBufSize = 0;
+    m_base = NULL;
+    m_size = 0;
+    m_bMapped = false;
+    m_index = NULL;
+    m_pocRecord = NULL;
+    m_pocBase = 0;
+    m_pocCount = 0;
+}
@@ -0,0 +1,131 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#ifndef X265_ANALYSISFILE_H
+#define X265_ANALYSISFILE_H
+
+#include "common.h"
+
+namespace X265_NS {
+// private namespace
+
+/* Indexed container of analysis-save format 2. The file starts with a
+ * header, followed by the param block of Encoder::validateAnalysisData()
+ * and one record per frame, in encode order. Every field of a record is a
+ * block starting on a 16 byte boundary, so a loader may map the file and
+ * copy fields straight out of it. With packing, byte arrays are run-length
+ * packed and prefixed by their packed size. The index, written at close,
+ * gives the offset and size of the record of every POC.
+ *
+ * Reads only take a Cursor and the const mapping, so records of different
+ * POCs may be read concurrently */
+class AnalysisFile
+{
+public:
+
+    enum { FLAG_PACKED = 1 };
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t recordCount;
+        uint32_t reserved;
+        uint64_t indexOffset;
+    };
+
+    struct IndexEntry
+    {
+        int32_t  poc;
+        int32_t  sliceType;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    /* read position within one record */
+    struct Cursor
+    {
+        uint64_t pos;
+        uint64_t end;
+    };
+
+    AnalysisFile();
+    ~AnalysisFile()             { close(); }
+
+    bool isOpen() const         { return !!m_fp; }
+
+    /* save: write the header to an empty file */
+    bool create(FILE* fp, bool bPack);
+
+    /* save: start the record of a frame, at the current end of the file */
+    bool beginRecord(int poc, int sliceType);
+
+    /* save: append one block of count elements of the given size */
+    bool write(const void* data, size_t size, size_t count);
+
+    /* save: append the index and complete the header */
+    bool finish();
+
+    /* load: true if fp, at its start, holds this container */
+    static bool isIndexed(FILE* fp);
+
+    /* load: map the file and its index, leaving fp at the param block */
+    bool open(FILE* fp);
+
+    /* load: position a cursor at the record of poc, false if absent */
+    bool find(int poc, Cursor& cursor) const;
+
+    /* load: read one block of count elements of the given size */
+    bool read(Cursor& cursor, void* dst, size_t size, size_t count) const;
+
+    /* load: advise the system that the record of poc will be read soon */
+    void prefetch(int poc) const;
+
+    void close();
+
+protected:
+
+    FILE*       m_fp;
+    uint32_t    m_flags;
+
+    /* save */
+    IndexEntry* m_entries;
+    uint32_t    m_numEntries;
+    uint32_t    m_maxEntries;
+    uint64_t    m_pos;
+    uint8_t*    m_packBuf;
+    size_t      m_packBufSize;
+
+    /* load */
+    const uint8_t*    m_base;
+    uint64_t          m_size;
+    bool              m_bMapped;
+    const IndexEntry* m_index;
+    int32_t*          m_pocRecord;   // index entry of each POC from m_pocBase, -1 if absent
+    int               m_pocBase;
+    int               m_pocCount;
+
+    bool pad();
+};
+}
+
+#endif // ifndef X265_ANALYSISFILE_H
@@ -24,8 +24,13 @@
 #include "common.h"
 #include "bitstream.h"
 #include "param.h"
+#include "threadpool.h"
+#include "arena.h"
 
 #include "encoder.h"
+#include "lookaheadonly.h"
+#include "asyncencoder.h"
+#include "chunkencoder.h"
 #include "entropy.h"
 #include "level.h"
 #include "nal.h"
@@ -217,6 +222,8 @@ x265_encoder *x265_encoder_open(x265_param *p)
     return encoder;
 
 fail:
+    if (encoder)
+        encoder->detachSharedPool();
     delete encoder;
     PARAM_NS::x265_param_free(param);
     PARAM_NS::x265_param_free(latestParam);
@@ -362,7 +369,8 @@ int x265_encoder_reconfig(x265_encoder* enc, x265_param* param_in)
     return ret;
 }
 
-int x265_encoder_encode(x265_encoder *enc, x265_nal **pp_nal, uint32_t *pi_nal, x265_picture *pic_in, x265_picture *pic_out)
+/* x265_encoder_encode() proper, which the async driver thread also calls */
+static int encodePicture(x265_encoder *enc, x265_nal **pp_nal, uint32_t *pi_nal, x265_picture *pic_in, x265_picture *pic_out)
 {
     if (!enc)
         return -1;
@@ -561,11 +569,68 @@ fail:
         x265_csvlog_frame(encoder->m_param, pic_out);
 
     if (numEncoded < 0)
+    {
         encoder->m_aborted = true;
+        encoder->m_nalStreamFrame.poke();
+    }
 
     return numEncoded;
 }
 
+int x265_encoder_encode(x265_encoder *enc, x265_nal **pp_nal, uint32_t *pi_nal, x265_picture *pic_in, x265_picture *pic_out)
+{
+    if (enc && static_cast<Encoder*>(enc)->m_async)
+    {
+        x265_log(static_cast<Encoder*>(enc)->m_param, X265_LOG_ERROR, "x265_encoder_encode() cannot be used with the async API\n");
+        return -1;
+    }
+
+    return encodePicture(enc, pp_nal, pi_nal, pic_in, pic_out);
+}
+
+int x265_encoder_async_start(x265_encoder *enc, int queueSize, const x265_async_events *events)
+{
+    if (!enc)
+        return -1;
+
+    Encoder *encoder = static_cast<Encoder*>(enc);
+    if (encoder->m_async || queueSize < 1 || !events || !events->pictureReleased || !encoder->m_param->bCopyPicToFrame)
+    {
+        x265_log(encoder->m_param, X265_LOG_ERROR, "async API needs a queue size, a pictureReleased event and copy-pic, and may only be started once\n");
+        return -1;
+    }
+
+    encoder->m_async = new AsyncEncoder;
+    if (!encoder->m_async->create(encoder, encodePicture, queueSize, *events))
+    {
+        x265_log(encoder->m_param, X265_LOG_ERROR, "unable to start the async encoder thread\n");
+        encoder->m_async->destroy();
+        delete encoder->m_async;
+        encoder->m_async = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int x265_encoder_submit(x265_encoder *enc, x265_picture *pic_in)
+{
+    Encoder *encoder = static_cast<Encoder*>(enc);
+    if (!encoder || !encoder->m_async)
+        return -1;
+
+    return encoder->m_async->submit(pic_in);
+}
+
+int x265_encoder_poll(x265_encoder *enc, x265_nal **pp_nal, uint32_t *pi_nal, x265_picture *pic_out, int timeoutMs)
+{
+    Encoder *encoder = static_cast<Encoder*>(enc);
+    if (!encoder || !encoder->m_async)
+        return -2;
+
+    return encoder->m_async->poll(pp_nal, pi_nal, pic_out, timeoutMs);
+}
+
 void x265_encoder_get_stats(x265_encoder *enc, x265_stats *outputStats, uint32_t statsSizeBytes)
 {
     if (enc && outputStats)
@@ -662,6 +727,13 @@ void x265_encoder_close(x265_encoder *enc)
         }
 #endif
 
+        if (encoder->m_async)
+        {
+            encoder->m_async->destroy();
+            delete encoder->m_async;
+            encoder->m_async = NULL;
+        }
+
         encoder->stopJobs();
         encoder->printSummary();
         encoder->destroy();
@@ -687,6 +759,110 @@ int x265_encoder_ctu_info(x265_encoder *enc, int poc, x265_ctu_info_t** ctu)
     return 0;
 }
 
+int x265_encoder_lookahead_follow(x265_encoder *follower, x265_encoder *leader)
+{
+    if (!follower || !leader)
+        return -1;
+
+    Encoder *encoder = static_cast<Encoder*>(follower);
+    return encoder->followLookahead(static_cast<Encoder*>(leader));
+}
+
+int x265_encoder_analysis_follow(x265_encoder *follower, x265_encoder *leader)
+{
+    if (!follower || !leader)
+        return -1;
+
+    Encoder *encoder = static_cast<Encoder*>(follower);
+    return encoder->followAnalysis(static_cast<Encoder*>(leader));
+}
+
+int x265_encode_chunked(x265_param *param, const x265_chunk_io *io)
+{
+    if (!param)
+        return -1;
+
+    x265_log(param, X265_LOG_INFO, "HEVC encoder version %s\n", PFX(version_str));
+    x265_log(param, X265_LOG_INFO, "build info %s\n", PFX(build_info_str));
+
+    /* the chunk encoders are opened through the API of this build */
+    ChunkedEncoder chunked;
+    return chunked.encode(x265_api_get(0), param, io);
+}
+
+x265_lookahead *x265_lookahead_open(x265_param *p)
+{
+    if (!p)
+        return NULL;
+
+    x265_param* param = PARAM_NS::x265_param_alloc();
+    if (!param)
+        return NULL;
+
+    PARAM_NS::x265_param_default(param);
+    if (p->rc.zoneCount || p->rc.zonefileCount)
+    {
+        int zoneCount = p->rc.zonefileCount ? p->rc.zonefileCount : p->rc.zoneCount;
+        param->rc.zones = x265_zone_alloc(zoneCount, !!p->rc.zonefileCount);
+    }
+    x265_copy_params(param, p);
+
+    x265_setup_primitives(param);
+
+    if (x265_check_params(param))
+    {
+        PARAM_NS::x265_param_free(param);
+        return NULL;
+    }
+
+    /* param is owned by the lookahead from here on */
+    LookaheadOnly* lookahead = new LookaheadOnly;
+    if (!lookahead->create(param))
+    {
+        lookahead->destroy();
+        delete lookahead;
+        return NULL;
+    }
+    return lookahead;
+}
+
+int x265_lookahead_push(x265_lookahead *la, x265_picture *pic_in)
+{
+    if (!la)
+        return -1;
+
+    LookaheadOnly* lookahead = static_cast<LookaheadOnly*>(la);
+    return lookahead->push(pic_in);
+}
+
+int x265_lookahead_pull(x265_lookahead *la, x265_lookahead_frame *frame)
+{
+    if (!la || !frame)
+        return -1;
+
+    LookaheadOnly* lookahead = static_cast<LookaheadOnly*>(la);
+    return lookahead->pull(frame);
+}
+
+void x265_lookahead_release(x265_lookahead *la, x265_lookahead_frame *frame)
+{
+    if (!la || !frame)
+        return;
+
+    LookaheadOnly* lookahead = static_cast<LookaheadOnly*>(la);
+    lookahead->release(frame);
+}
+
+void x265_lookahead_close(x265_lookahead *la)
+{
+    if (!la)
+        return;
+
+    LookaheadOnly* lookahead = static_cast<LookaheadOnly*>(la);
+    lookahead->destroy();
+    delete lookahead;
+}
+
 int x265_get_slicetype_poc_and_scenecut(x265_encoder *enc, int *slicetype, int *poc, int *sceneCut)
 {
     if (!enc)
@@ -720,6 +896,7 @@ int x265_set_analysis_data(x265_encoder *enc, x265_analysis_data *analysis_data,
 
 void x265_alloc_analysis_data(x265_param *param, x265_analysis_data* analysis)
 {
+    MemoryScope memScope(X265_MEM_ANALYSIS);
     x265_analysis_inter_data *interData = analysis->interData = NULL;
     x265_analysis_intra_data *intraData = analysis->intraData = NULL;
     x265_analysis_distortion_data *distortionData = analysis->distortionData = NULL;
@@ -902,9 +1079,78 @@ void x265_free_analysis_data(x265_param *param, x265_analysis_data* analysis)
     }
 }
 
+x265_threadpool *x265_threadpool_create(int numThreads, int maxEncoders)
+{
+    if (maxEncoders <= 0)
+        return NULL;
+
+    /* each encoder attaches up to X265_MAX_FRAME_THREADS frame encoders and a lookahead */
+    return ThreadPool::allocSharedPool(numThreads, maxEncoders * (X265_MAX_FRAME_THREADS + 1));
+}
+
+void x265_threadpool_destroy(x265_threadpool *p)
+{
+    if (!p)
+        return;
+
+    ThreadPool *pool = static_cast<ThreadPool*>(p);
+    if (pool->m_numProviders)
+    {
+        x265_log(NULL, X265_LOG_ERROR, "thread pool still in use by an encoder, not destroyed\n");
+        return;
+    }
+
+    pool->stopWorkers();
+    delete pool;
+}
+
+int x265_pool_stats_get(x265_pool_stats *stats, int count)
+{
+    if (!stats || count <= 0)
+        return 0;
+
+    x265_pool_stats all[POOL_COUNT];
+    x265_pool_report(all);
+    count = X265_MIN(count, (int)POOL_COUNT);
+    memcpy(stats, all, count * sizeof(x265_pool_stats));
+    return count;
+}
+
+int x265_encoder_memory_stats(x265_encoder *enc, x265_memory_stats *stats)
+{
+    if (!enc || !stats)
+        return -1;
+
+    Encoder *encoder = static_cast<Encoder*>(enc);
+    if (!encoder->m_memAccount)
+        return -1;
+
+    encoder->m_memAccount->getStats(*stats);
+    stats->estimatedBytes = encoder->m_memEstimate;
+    return 0;
+}
+
+int x265_encoder_nal_callback(x265_encoder *enc, x265_nal_callback callback, void *opaque)
+{
+    if (!enc)
+        return -1;
+
+    Encoder *encoder = static_cast<Encoder*>(enc);
+    if (encoder->m_encodedFrameNum)
+    {
+        x265_log(encoder->m_param, X265_LOG_ERROR, "NAL callback must be set before the first picture is encoded\n");
+        return -1;
+    }
+
+    encoder->m_nalCallback = callback;
+    encoder->m_nalCallbackOpaque = opaque;
+    return 0;
+}
+
 void x265_cleanup(void)
 {
     BitCost::destroy();
+    x265_pool_trim();
 }
 
 x265_picture *x265_picture_alloc()
@@ -1009,7 +1255,23 @@ static const x265_api libapi =
     &x265_calculate_vmaf_framelevelscore,
     &x265_vmaf_encoder_log,
 #endif
-    &PARAM_NS::x265_zone_param_parse
+    &PARAM_NS::x265_zone_param_parse,
+    &x265_threadpool_create,
+    &x265_threadpool_destroy,
+    &x265_encoder_lookahead_follow,
+    &x265_lookahead_open,
+    &x265_lookahead_push,
+    &x265_lookahead_pull,
+    &x265_lookahead_release,
+    &x265_lookahead_close,
+    &x265_pool_stats_get,
+    &x265_encoder_memory_stats,
+    &x265_encoder_nal_callback,
+    &x265_encoder_async_start,
+    &x265_encoder_submit,
+    &x265_encoder_poll,
+    &x265_encoder_analysis_follow,
+    &x265_encode_chunked
 };
 
 typedef const x265_api* (*api_get_func)(int bitDepth);
@@ -1304,7 +1566,7 @@ FILE* x265_csvlog_open(const x265_param* param)
 
                     /* detailed performance statistics */
                     fprintf(csvfp, ", DecideWait (ms), Row0Wait (ms), Wall time (ms), Ref Wait Wall (ms), Total CTU time (ms),"
-                        "Stall Time (ms), Total frame time (ms), Avg WPP, Row Blocks");
+                        "Stall Time (ms), Total frame time (ms), Avg WPP, Row Blocks, Recon Wait (ms), Jobs, Bond Attempts, Bond Successes");
 #if ENABLE_LIBVMAF
                     fprintf(csvfp, ", VMAF Frame Score");
 #endif
@@ -1428,6 +1690,8 @@ void x265_csvlog_frame(const x265_param* param, const x265_picture* pic)
                                                                                      frameStats->totalFrameTime);
 
         fprintf(param->csvfpt, " %.3lf, %d", frameStats->avgWPP, frameStats->countRowBlocks);
+        fprintf(param->csvfpt, ", %.1lf, %d, %d, %d", frameStats->reconRowWaitTime, frameStats->numJobs,
+                                                      frameStats->bondAttempts, frameStats->bondSuccesses);
 #if ENABLE_LIBVMAF
         fprintf(param->csvfpt, ", %lf", frameStats->vmafFrameScore);
 #endif
@@ -1449,6 +1713,9 @@ void x265_csvlog_encode(const x265_param *p, const x265_stats *stats, int padx,
             fputs(summaryCSVHeader, p->csvfpt);
             if (p->csvLogLevel >= 2 || p->maxCLL || p->maxFALL)
                 fputs("MaxCLL, MaxFALL,", p->csvfpt);
+            if (p->csvLogLevel >= 2)
+                fputs(" Workers, Worker Busy (s), Worker Idle (s), Max Worker Busy (s), Worker Jobs, Frame Jobs, Lookahead Jobs,"
+                      " Bond Attempts, Bond Successes, Recon Wait (s),", p->csvfpt);
 #if ENABLE_LIBVMAF
             fputs(" Aggregate VMAF score,", p->csvfpt);
 #endif
@@ -1547,6 +1814,14 @@ void x265_csvlog_encode(const x265_param *p, const x265_stats *stats, int padx,
             fprintf(p->csvfpt, " -, -, -, -, -, -, -,");
         if (p->csvLogLevel >= 2 || p->maxCLL || p->maxFALL)
             fprintf(p->csvfpt, " %-6u, %-6u,", stats->maxCLL, stats->maxFALL);
+        if (p->csvLogLevel >= 2)
+        {
+            fprintf(p->csvfpt, " %d, %.2lf, %.2lf, %.2lf,", stats->numWorkerThreads, stats->workerBusyTime,
+                                                         stats->workerIdleTime, stats->maxWorkerBusyTime);
+            fprintf(p->csvfpt, " " X265_LL ", " X265_LL ", " X265_LL ", " X265_LL ", " X265_LL ", %.2lf,",
+                    stats->workerJobs, stats->frameJobs, stats->lookaheadJobs,
+                    stats->bondAttempts, stats->bondSuccesses, stats->reconRowWaitTime);
+        }
 #if ENABLE_LIBVMAF
         fprintf(p->csvfpt, " %lf,", stats->aggregateVmafScore);
 #endif
@@ -0,0 +1,231 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#include "common.h"
+#include "encoder.h"
+#include "asyncencoder.h"
+
+using namespace X265_NS;
+
+AsyncEncoder::AsyncEncoder()
+{
+    m_encoder = NULL;
+    m_encode = NULL;
+    memset(&m_events, 0, sizeof(m_events));
+    m_inputPic = NULL;
+    m_inputUser = NULL;
+    m_inputSize = m_inputHead = m_inputCount = 0;
+    m_output = NULL;
+    m_outputSize = m_outputHead = m_outputCount = 0;
+    m_bOutputHeld = false;
+    m_status = RUNNING;
+    m_bFlush = false;
+    m_bStop = false;
+    m_bStarted = false;
+}
+
+bool AsyncEncoder::create(Encoder* encoder, encode_picture_t encode, int queueSize, const x265_async_events& events)
+{
+    m_encoder = encoder;
+    m_encode = encode;
+    m_events = events;
+
+    m_inputSize = queueSize;
+    m_inputPic = X265_MALLOC(x265_picture, m_inputSize);
+    m_inputUser = X265_MALLOC(x265_picture*, m_inputSize);
+    m_outputSize = queueSize + 1;
+    m_output = new OutputUnit[m_outputSize];
+    if (!m_inputPic || !m_inputUser)
+        return false;
+
+    for (int i = 0; i < m_outputSize; i++)
+    {
+        m_output[i].nalList.m_annexB = !!encoder->m_param->bAnnexB;
+        x265_picture_init(encoder->m_param, &m_output[i].pic);
+    }
+
+    m_bStarted = start();
+    return m_bStarted;
+}
+
+void AsyncEncoder::destroy()
+{
+    if (m_bStarted)
+    {
+        m_lock.acquire();
+        m_bStop = true;
+        m_lock.release();
+        m_driverEvent.trigger();
+        stop();
+        m_bStarted = false;
+    }
+
+    X265_FREE(m_inputPic);
+    X265_FREE(m_inputUser);
+    delete [] m_output;
+    m_inputPic = NULL;
+    m_inputUser = NULL;
+    m_output = NULL;
+}
+
+int AsyncEncoder::submit(x265_picture* pic)
+{
+    ScopedLock lock(m_lock);
+
+    if (m_bFlush || m_status != RUNNING)
+        return -1;
+
+    if (!pic)
+        m_bFlush = true;
+    else if (m_inputCount == m_inputSize)
+        return 0;
+    else
+    {
+        int slot = (m_inputHead + m_inputCount) % m_inputSize;
+        m_inputPic[slot] = *pic;
+        m_inputUser[slot] = pic;
+        m_inputCount++;
+    }
+
+    m_driverEvent.trigger();
+    return 1;
+}
+
+int AsyncEncoder::poll(x265_nal** pp_nal, uint32_t* pi_nal, x265_picture* pic_out, int timeoutMs)
+{
+    int64_t deadline = x265_mdate() + (int64_t)timeoutMs * 1000;
+
+    m_lock.acquire();
+
+    /* the NALs output by the previous poll are no longer needed */
+    if (m_bOutputHeld)
+    {
+        m_outputHead = (m_outputHead + 1) % m_outputSize;
+        m_outputCount--;
+        m_bOutputHeld = false;
+        m_driverEvent.trigger();
+    }
+
+    while (!m_outputCount && m_status == RUNNING && timeoutMs)
+    {
+        m_lock.release();
+        if (timeoutMs < 0)
+            m_outputEvent.wait();
+        else
+        {
+            int64_t remaining = deadline - x265_mdate();
+            if (remaining <= 0 || m_outputEvent.timedWait((uint32_t)((remaining + 999) / 1000)))
+                timeoutMs = 0;
+        }
+        m_lock.acquire();
+    }
+
+    int ret;
+    if (m_outputCount)
+    {
+        OutputUnit& unit = m_output[m_outputHead];
+        if (pp_nal)
+            *pp_nal = unit.nalList.m_nal;
+        if (pi_nal)
+            *pi_nal = unit.nalList.m_numNal;
+        if (pic_out)
+            *pic_out = unit.pic;
+        m_bOutputHeld = true;
+        ret = 1;
+    }
+    else
+    {
+        if (pi_nal)
+            *pi_nal = 0;
+        ret = m_status == FLUSHED ? -1 : m_status == FAILED ? -2 : 0;
+    }
+
+    m_lock.release();
+    return ret;
+}
+
+void AsyncEncoder::threadMain()
+{
+    THREAD_NAME("AsyncEncoder", 0);
+
+    for (;;)
+    {
+        /* wait for a picture or the flush, and for room to output an access unit */
+        m_lock.acquire();
+        while (!m_bStop && (m_outputCount == m_outputSize || (!m_inputCount && !m_bFlush)))
+        {
+            m_lock.release();
+            m_driverEvent.wait();
+            m_lock.acquire();
+        }
+
+        if (m_bStop)
+        {
+            m_lock.release();
+            break;
+        }
+
+        x265_picture* pic = m_inputCount ? &m_inputPic[m_inputHead] : NULL;
+        x265_picture* userPic = m_inputCount ? m_inputUser[m_inputHead] : NULL;
+        OutputUnit& unit = m_output[(m_outputHead + m_outputCount) % m_outputSize];
+        m_lock.release();
+
+        x265_nal* nal;
+        uint32_t numNal = 0;
+        int ret = m_encode(m_encoder, &nal, &numNal, pic, &unit.pic);
+
+        if (userPic)
+            m_events.pictureReleased(m_events.opaque, userPic);
+
+        bool bOutput = false;
+        m_lock.acquire();
+        if (pic)
+        {
+            m_inputHead = (m_inputHead + 1) % m_inputSize;
+            m_inputCount--;
+        }
+        if (ret > 0 && numNal)
+        {
+            /* the reconstructed planes are recycled by later pictures */
+            for (int i = 0; i < 3; i++)
+                unit.pic.planes[i] = NULL;
+            unit.nalList.takeContents(m_encoder->m_nalList);
+            m_outputCount++;
+            bOutput = true;
+        }
+        else if (ret < 0)
+            m_status = FAILED;
+        else if (!ret && !pic)
+            m_status = FLUSHED;
+        int status = m_status;
+        m_lock.release();
+
+        if (bOutput || status != RUNNING)
+        {
+            m_outputEvent.trigger();
+            if (m_events.outputReady)
+                m_events.outputReady(m_events.opaque);
+        }
+
+        if (status != RUNNING)
+            break;
+    }
+}
@@ -0,0 +1,95 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#ifndef X265_ASYNCENCODER_H
+#define X265_ASYNCENCODER_H
+
+#include "common.h"
+#include "threading.h"
+#include "nal.h"
+#include "x265.h"
+
+namespace X265_NS {
+// private namespace
+
+class Encoder;
+
+typedef int (*encode_picture_t)(x265_encoder*, x265_nal**, uint32_t*, x265_picture*, x265_picture*);
+
+/* Runs the encode loop of an Encoder on its own thread for the asynchronous
+ * API. Input pictures and output access units go through bounded queues so
+ * that submit() and poll() never block on the encoder pipeline */
+class AsyncEncoder : public Thread
+{
+public:
+
+    enum { RUNNING, FLUSHED, FAILED };
+
+    AsyncEncoder();
+
+    bool create(Encoder* encoder, encode_picture_t encode, int queueSize, const x265_async_events& events);
+    void destroy();
+
+    int  submit(x265_picture* pic);
+    int  poll(x265_nal** pp_nal, uint32_t* pi_nal, x265_picture* pic_out, int timeoutMs);
+
+protected:
+
+    struct OutputUnit
+    {
+        NALList      nalList;
+        x265_picture pic;      // output picture metadata, without planes
+    };
+
+    Encoder*          m_encoder;
+    encode_picture_t  m_encode;
+    x265_async_events m_events;
+
+    Lock              m_lock;
+    Event             m_driverEvent;  // input queued, output slot freed or stop
+    Event             m_outputEvent;  // access unit queued or stream ended
+
+    /* input ring of queueSize pictures, the structures are copied and the
+     * application's pointers kept for pictureReleased */
+    x265_picture*     m_inputPic;
+    x265_picture**    m_inputUser;
+    int               m_inputSize;
+    int               m_inputHead;
+    int               m_inputCount;
+
+    /* output ring of queueSize + 1 units, one of which may be held by the
+     * application since its last poll() */
+    OutputUnit*       m_output;
+    int               m_outputSize;
+    int               m_outputHead;
+    int               m_outputCount;
+    bool              m_bOutputHeld;
+
+    int               m_status;
+    bool              m_bFlush;
+    bool              m_bStop;
+    bool              m_bStarted;
+
+    void threadMain();
+};
+}
+
+#endif // ifndef X265_ASYNCENCODER_H
@@ -0,0 +1,445 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#include "common.h"
+#include "encoder.h"
+#include "chunkencoder.h"
+
+using namespace X265_NS;
+
+Chunk::Chunk()
+{
+    m_driver = NULL;
+    m_encoder = NULL;
+    m_reader = 0;
+    m_start = m_end = 0;
+    m_output = NULL;
+    m_outputCount = 0;
+    m_bFailed = false;
+    m_bDone = false;
+}
+
+void Chunk::threadMain()
+{
+    THREAD_NAME("Chunk", m_reader);
+
+    const x265_api* api = m_driver->m_api;
+    const x265_chunk_io* io = m_driver->m_io;
+    Encoder* encoder = static_cast<Encoder*>(m_encoder);
+    int numFrames = m_end - m_start;
+    x265_picture pic;
+
+    /* read and encode the frames of the chunk, then flush the encoder */
+    for (int frame = m_start; !m_bFailed; frame++)
+    {
+        x265_picture* pic_in = NULL;
+        if (frame < m_end)
+        {
+            api->picture_init(&m_driver->m_param, &pic);
+            int ret = io->readPicture(io->opaque, m_reader, frame, &pic);
+            if (ret)
+            {
+                if (ret > 0)
+                    x265_log(&m_driver->m_param, X265_LOG_ERROR, "chunk-parallel: input ended at frame %d, within a chunk\n", frame);
+                m_bFailed = true;
+                break;
+            }
+            pic_in = &pic;
+        }
+
+        if (m_outputCount == numFrames)
+        {
+            if (pic_in)
+                m_bFailed = true;
+            break;
+        }
+
+        OutputUnit& unit = m_output[m_outputCount];
+        x265_nal* nal;
+        uint32_t numNal = 0;
+        int ret = api->encoder_encode(m_encoder, &nal, &numNal, pic_in, &unit.pic);
+        if (ret < 0)
+            m_bFailed = true;
+        else if (ret > 0 && numNal)
+        {
+            /* the reconstructed planes are recycled by later pictures */
+            for (int i = 0; i < 3; i++)
+                unit.pic.planes[i] = NULL;
+            unit.pic.poc += m_start;
+            unit.nalList.takeContents(encoder->m_nalList);
+            m_outputCount++;
+        }
+        else if (!pic_in && !ret)
+            break;
+
+        if (m_driver->m_bAbort)
+            m_bFailed = true;
+    }
+
+    if (!m_bFailed && m_outputCount != numFrames)
+    {
+        x265_log(&m_driver->m_param, X265_LOG_ERROR, "chunk-parallel: chunk at frame %d output %d of its %d frames\n",
+                 m_start, m_outputCount, numFrames);
+        m_bFailed = true;
+    }
+
+    m_driver->chunkDone(this);
+}
+
+ChunkedEncoder::ChunkedEncoder()
+{
+    m_api = NULL;
+    memset(&m_param, 0, sizeof(m_param));
+    m_io = NULL;
+    m_pool = NULL;
+    m_lookahead = NULL;
+    m_bAbort = false;
+    m_bounds = NULL;
+    m_numBounds = m_maxBounds = 0;
+    m_chunkFrames = 0;
+    m_numRead = 0;
+    m_bFlushed = false;
+    memset(m_chunks, 0, sizeof(m_chunks));
+    m_numLaunched = m_numWritten = 0;
+    memset(m_slotBusy, 0, sizeof(m_slotBusy));
+}
+
+bool ChunkedEncoder::validate(const x265_param* param, const x265_chunk_io* io)
+{
+    const char* unsupported = NULL;
+    if (!io || !io->readPicture || !io->writeNals)
+        unsupported = "an io without callbacks";
+    else if (param->chunkParallel < 1 || param->chunkParallel > X265_MAX_CHUNK_PARALLEL)
+        unsupported = "chunk-parallel outside of 1 to 64";
+    else if (param->rc.bStatWrite || param->rc.bStatRead)
+        unsupported = "multi-pass encoding";
+    else if (param->analysisSave || param->analysisLoad)
+        unsupported = "analysis save and load";
+    else if (param->bField)
+        unsupported = "field coding";
+    else if (param->csvfn)
+        unsupported = "CSV logging";
+    else if (param->chunkStart || param->chunkEnd)
+        unsupported = "chunk-start and chunk-end";
+    else if (param->sharedThreadPool)
+        unsupported = "a shared thread pool";
+
+    if (unsupported)
+    {
+        x265_log(param, X265_LOG_ERROR, "chunk-parallel: %s is not supported\n", unsupported);
+        return false;
+    }
+    return true;
+}
+
+int ChunkedEncoder::encode(const x265_api* api, const x265_param* param, const x265_chunk_io* io)
+{
+    m_api = api;
+    m_io = io;
+    if (!validate(param, io))
+        return -1;
+
+    m_param = *param;
+    if (m_param.bOpenGOP)
+    {
+        x265_log(&m_param, X265_LOG_WARNING, "chunk-parallel: open-GOP disabled, chunks start with an IDR picture\n");
+        m_param.bOpenGOP = 0;
+    }
+    m_chunkFrames = m_param.chunkFrames ? m_param.chunkFrames : m_param.keyframeMax > 0 ? m_param.keyframeMax : 250;
+
+    /* the lookahead which splits the input, quietly, on the pool of the
+     * chunk encoders rather than on as many threads again of its own */
+    m_pool = api->threadpool_create(0, m_param.chunkParallel + 1);
+    if (m_pool)
+    {
+        x265_param laParam = m_param;
+        laParam.chunkParallel = 0;
+        laParam.sharedThreadPool = m_pool;
+        laParam.logLevel = X265_MIN(laParam.logLevel, X265_LOG_WARNING);
+        m_lookahead = api->lookahead_open(&laParam);
+    }
+    if (!m_lookahead || !m_pool || !addBound(0))
+    {
+        x265_log(&m_param, X265_LOG_ERROR, "chunk-parallel: unable to create the lookahead or thread pool\n");
+        if (m_lookahead)
+            api->lookahead_close(m_lookahead);
+        if (m_pool)
+            api->threadpool_destroy(m_pool);
+        return -1;
+    }
+
+    int64_t startTime = x265_mdate();
+    uint64_t bytes = 0;
+    int numFrames = 0;
+    bool bFailed = false;
+
+    while (!bFailed)
+    {
+        /* reap the chunks which completed, their slots are free again */
+        bool bReaped = false;
+        for (int i = m_numWritten; i < m_numLaunched; i++)
+        {
+            Chunk* chunk = m_chunks[i % MAX_PENDING];
+            m_lock.acquire();
+            bool bDone = chunk->m_bDone && chunk->m_encoder;
+            m_lock.release();
+            if (!bDone)
+                continue;
+
+            chunk->stop();
+            api->encoder_close(chunk->m_encoder);
+            chunk->m_encoder = NULL;
+            m_slotBusy[chunk->m_reader] = false;
+            bFailed |= chunk->m_bFailed;
+            bReaped = true;
+        }
+
+        /* write the completed chunks in stream order */
+        while (!bFailed && m_numWritten < m_numLaunched && !m_chunks[m_numWritten % MAX_PENDING]->m_encoder)
+        {
+            Chunk*& chunk = m_chunks[m_numWritten % MAX_PENDING];
+            int ret = writeChunk(chunk, bytes);
+            if (ret < 0)
+                bFailed = true;
+            else
+                numFrames += ret;
+            delete chunk;
+            chunk = NULL;
+            m_numWritten++;
+        }
+        if (bFailed)
+            break;
+
+        bool bKnown = m_numLaunched + 1 < m_numBounds;
+        if (m_bFlushed && !bKnown && m_numWritten == m_numLaunched)
+            break;
+
+        int running = 0;
+        for (int i = 0; i < m_param.chunkParallel; i++)
+            running += m_slotBusy[i];
+
+        if (bKnown && running < m_param.chunkParallel && m_numLaunched - m_numWritten < MAX_PENDING)
+        {
+            bFailed = !launch();
+            continue;
+        }
+
+        /* keep the boundaries of the next chunks to launch known ahead */
+        if (!m_bFlushed && m_numBounds - 1 - m_numLaunched <= m_param.chunkParallel)
+        {
+            bFailed = stepLookahead() < 0;
+            continue;
+        }
+
+        if (!bReaped)
+            m_doneEvent.wait();
+    }
+
+    if (bFailed)
+        cancel();
+
+    if (m_lookahead)
+        api->lookahead_close(m_lookahead);
+    m_lookahead = NULL;
+    api->threadpool_destroy(m_pool);
+    m_pool = NULL;
+
+    if (bFailed)
+        return -1;
+
+    double elapsed = (double)(x265_mdate() - startTime) / 1000000;
+    double duration = (double)numFrames * m_param.fpsDenom / m_param.fpsNum;
+    x265_log(&m_param, X265_LOG_INFO, "chunk-parallel: %d frames in %d chunks, %.2f fps, %.2f kb/s\n",
+             numFrames, m_numWritten, elapsed > 0 ? numFrames / elapsed : 0, duration > 0 ? 0.008 * bytes / duration : 0);
+    return numFrames;
+}
+
+bool ChunkedEncoder::addBound(int frame)
+{
+    if (m_numBounds == m_maxBounds)
+    {
+        int maxBounds = m_maxBounds ? 2 * m_maxBounds : 64;
+        int* bounds = X265_MALLOC(int, maxBounds);
+        if (!bounds)
+            return false;
+        if (m_numBounds)
+            memcpy(bounds, m_bounds, m_numBounds * sizeof(int));
+        X265_FREE(m_bounds);
+        m_bounds = bounds;
+        m_maxBounds = maxBounds;
+    }
+    m_bounds[m_numBounds++] = frame;
+    return true;
+}
+
+int ChunkedEncoder::stepLookahead()
+{
+    x265_picture pic;
+    m_api->picture_init(&m_param, &pic);
+    int ret = m_io->readPicture(m_io->opaque, m_param.chunkParallel, m_numRead, &pic);
+    if (ret < 0)
+        return ret;
+
+    bool bEnd = ret > 0;
+    if (bEnd && !m_numRead)
+    {
+        x265_log(&m_param, X265_LOG_ERROR, "chunk-parallel: no input\n");
+        return -1;
+    }
+    if (m_api->lookahead_push(m_lookahead, bEnd ? NULL : &pic) < 0)
+        return -1;
+    if (!bEnd)
+        m_numRead++;
+
+    /* a chunk ends at the first keyframe, an IDR picture with closed-GOP,
+     * chunkFrames after its start. Frames are pulled in encode order, so all
+     * the frames before the keyframe were pulled by then */
+    x265_lookahead_frame frame;
+    while ((ret = m_api->lookahead_pull(m_lookahead, &frame)) > 0)
+    {
+        bool bBound = frame.bKeyframe && frame.poc >= m_bounds[m_numBounds - 1] + m_chunkFrames;
+        m_api->lookahead_release(m_lookahead, &frame);
+        if (bBound && !addBound(frame.poc))
+            return -1;
+    }
+    if (ret < 0)
+        return ret;
+
+    if (bEnd)
+    {
+        /* the last chunk ends with the input */
+        m_api->lookahead_close(m_lookahead);
+        m_lookahead = NULL;
+        m_bFlushed = true;
+        if (m_numRead > m_bounds[m_numBounds - 1] && !addBound(m_numRead))
+            return -1;
+    }
+    return 0;
+}
+
+bool ChunkedEncoder::launch()
+{
+    int index = m_numLaunched;
+    int slot = 0;
+    while (m_slotBusy[slot])
+        slot++;
+
+    /* every chunk encoder has the same parameter sets, their warnings were
+     * given by the lookahead already. Chunks after the first
+     * signal the concatenation in their buffering period SEI and, with VBV,
+     * all but the last end at the buffer fill they started with */
+    x265_param param = m_param;
+    param.chunkParallel = 0;
+    param.sharedThreadPool = m_pool;
+    param.logLevel = X265_MIN(param.logLevel, X265_LOG_ERROR);
+    param.totalFrames = m_bounds[index + 1] - m_bounds[index];
+    if (index)
+        param.bEnableHRDConcatFlag = 1;
+    bool bLast = m_bFlushed && index + 2 == m_numBounds;
+    if (param.rc.vbvBufferSize > 0 && param.rc.vbvMaxBitrate > 0 && !bLast && !param.vbvBufferEnd)
+    {
+        param.vbvBufferEnd = param.rc.vbvBufferInit;
+        if (!param.vbvEndFrameAdjust)
+            param.vbvEndFrameAdjust = 0.9;
+    }
+
+    Chunk* chunk = new Chunk;
+    chunk->m_driver = this;
+    chunk->m_reader = slot;
+    chunk->m_start = m_bounds[index];
+    chunk->m_end = m_bounds[index + 1];
+    chunk->m_output = new Chunk::OutputUnit[chunk->m_end - chunk->m_start];
+    chunk->m_encoder = m_api->encoder_open(&param);
+    if (!chunk->m_encoder)
+    {
+        x265_log(&m_param, X265_LOG_ERROR, "chunk-parallel: failed to open the encoder of the chunk at frame %d\n", chunk->m_start);
+        delete chunk;
+        return false;
+    }
+    for (int i = 0; i < chunk->m_end - chunk->m_start; i++)
+    {
+        chunk->m_output[i].nalList.m_annexB = !!param.bAnnexB;
+        m_api->picture_init(&param, &chunk->m_output[i].pic);
+    }
+
+    if (!index && !m_param.bRepeatHeaders)
+    {
+        x265_nal* nal;
+        uint32_t numNal;
+        if (m_api->encoder_headers(chunk->m_encoder, &nal, &numNal) < 0 ||
+            m_io->writeNals(m_io->opaque, nal, numNal, NULL) < 0)
+        {
+            x265_log(&m_param, X265_LOG_ERROR, "chunk-parallel: failure writing the stream headers\n");
+            m_api->encoder_close(chunk->m_encoder);
+            delete chunk;
+            return false;
+        }
+    }
+
+    m_chunks[index % MAX_PENDING] = chunk;
+    m_slotBusy[slot] = true;
+    m_numLaunched++;
+    if (!chunk->start())
+    {
+        /* reaped as a failed chunk */
+        chunk->m_bFailed = true;
+        chunkDone(chunk);
+    }
+    return true;
+}
+
+void ChunkedEncoder::chunkDone(Chunk* chunk)
+{
+    m_lock.acquire();
+    chunk->m_bDone = true;
+    m_lock.release();
+    m_doneEvent.trigger();
+}
+
+int ChunkedEncoder::writeChunk(Chunk* chunk, uint64_t& bytes)
+{
+    for (int i = 0; i < chunk->m_outputCount; i++)
+    {
+        const Chunk::OutputUnit& unit = chunk->m_output[i];
+        if (m_io->writeNals(m_io->opaque, unit.nalList.m_nal, unit.nalList.m_numNal, &unit.pic) < 0)
+            return -1;
+        for (uint32_t j = 0; j < unit.nalList.m_numNal; j++)
+            bytes += unit.nalList.m_nal[j].sizeBytes;
+    }
+    return chunk->m_outputCount;
+}
+
+void ChunkedEncoder::cancel()
+{
+    m_bAbort = true;
+    for (int i = m_numWritten; i < m_numLaunched; i++)
+    {
+        Chunk*& chunk = m_chunks[i % MAX_PENDING];
+        if (chunk->m_encoder)
+        {
+            chunk->stop();
+            m_api->encoder_close(chunk->m_encoder);
+        }
+        delete chunk;
+        chunk = NULL;
+    }
+    m_numWritten = m_numLaunched;
+}
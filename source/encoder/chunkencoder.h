@@ -0,0 +1,119 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#ifndef X265_CHUNKENCODER_H
+#define X265_CHUNKENCODER_H
+
+#include "common.h"
+#include "threading.h"
+#include "nal.h"
+#include "x265.h"
+
+namespace X265_NS {
+// private namespace
+
+class ChunkedEncoder;
+
+/* Encodes the frames [m_start, m_end) of the input with an encoder of its
+ * own, on its own thread, and keeps the access units until the driver
+ * writes them out in stream order */
+class Chunk : public Thread
+{
+public:
+
+    struct OutputUnit
+    {
+        NALList      nalList;
+        x265_picture pic;      // output picture metadata, without planes
+    };
+
+    ChunkedEncoder* m_driver;
+    x265_encoder*   m_encoder;
+    int             m_reader;   // reader of the chunk io, the slot of the chunk
+    int             m_start;
+    int             m_end;
+
+    OutputUnit*     m_output;   // one unit per frame
+    int             m_outputCount;
+    bool            m_bFailed;
+    bool            m_bDone;    // protected by the lock of the driver
+
+    Chunk();
+    ~Chunk()                    { delete [] m_output; }
+
+protected:
+
+    void threadMain();
+};
+
+/* Driver of x265_encode_chunked(). A lookahead pass over the input places the
+ * chunk boundaries at IDR pictures, up to chunkParallel chunks are encoded at
+ * once on a thread pool shared by their encoders, and the access units of
+ * the chunks are written in order from the thread of the caller */
+class ChunkedEncoder
+{
+public:
+
+    const x265_api*     m_api;
+    x265_param          m_param;
+    const x265_chunk_io* m_io;
+    x265_threadpool*    m_pool;
+    x265_lookahead*     m_lookahead;
+
+    Lock                m_lock;
+    Event               m_doneEvent;   // a chunk completed
+    volatile bool       m_bAbort;
+
+    ChunkedEncoder();
+    ~ChunkedEncoder()           { X265_FREE(m_bounds); }
+
+    /* returns the number of frames encoded, negative on error */
+    int  encode(const x265_api* api, const x265_param* param, const x265_chunk_io* io);
+
+    void chunkDone(Chunk* chunk);
+
+protected:
+
+    /* chunks are launched at most this far ahead of the one being written */
+    enum { MAX_PENDING = 2 * X265_MAX_CHUNK_PARALLEL };
+
+    int*        m_bounds;      // first frame of each chunk, then the frame count once known
+    int         m_numBounds;
+    int         m_maxBounds;
+    int         m_chunkFrames;
+    int         m_numRead;     // frames pushed to the lookahead
+    bool        m_bFlushed;    // the lookahead is flushed, all the boundaries are known
+
+    Chunk*      m_chunks[MAX_PENDING];   // by chunk index modulo MAX_PENDING
+    int         m_numLaunched;
+    int         m_numWritten;
+    bool        m_slotBusy[X265_MAX_CHUNK_PARALLEL];
+
+    bool        validate(const x265_param* param, const x265_chunk_io* io);
+    bool        addBound(int frame);
+    int         stepLookahead();
+    bool        launch();
+    int         writeChunk(Chunk* chunk, uint64_t& bytes);
+    void        cancel();
+};
+}
+
+#endif // ifndef X265_CHUNKENCODER_H
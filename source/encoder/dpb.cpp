@@ -96,7 +96,7 @@ void DPB::recycleUnreferenced()
             {
                 if (curFrame->m_encData->m_meBuffer[i] != NULL)
                 {
-                    X265_FREE(curFrame->m_encData->m_meBuffer[i]);
+                    X265_POOL_FREE(curFrame->m_encData->m_meBuffer[i]);
                     curFrame->m_encData->m_meBuffer[i] = NULL;
                 }
             }
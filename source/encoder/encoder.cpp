@@ -31,6 +31,7 @@
 #include "frame.h"
 #include "framedata.h"
 #include "picyuv.h"
+#include "arena.h"
 
 #include "bitcost.h"
 #include "encoder.h"
@@ -92,13 +93,28 @@ Encoder::Encoder()
     m_reconfigureRc = false;
     m_encodedFrameNum = 0;
     m_pocLast = -1;
+    m_nalCallback = NULL;
+    m_nalCallbackOpaque = NULL;
+    m_async = NULL;
     m_curEncoder = 0;
     m_numLumaWPFrames = 0;
     m_numChromaWPFrames = 0;
     m_numLumaWPBiFrames = 0;
     m_numChromaWPBiFrames = 0;
+    m_reconRowWaitTime = 0;
+    m_frameJobs = 0;
+    m_frameBondAttempts = 0;
+    m_frameBondSuccesses = 0;
+    m_bAdaptiveFrameThreads = false;
+    m_feLogFileOut = NULL;
+    m_feLogFileIn = NULL;
+    m_feLogOrder = -1;
+    m_feLogCount = 0;
     m_lookahead = NULL;
     m_rateControl = NULL;
+    m_memAccount = NULL;
+    m_memEstimate = 0;
+    memset(m_memEstimateSubsystem, 0, sizeof(m_memEstimateSubsystem));
     m_dpb = NULL;
     m_exportedPic = NULL;
     m_numDelayedPic = 0;
@@ -106,8 +122,12 @@ Encoder::Encoder()
     m_param = NULL;
     m_latestParam = NULL;
     m_threadPool = NULL;
+    m_bSharedPool = false;
     m_analysisFileIn = NULL;
     m_analysisFileOut = NULL;
+    m_analysisShare = NULL;
+    m_analysisSource = NULL;
+    m_analysisSourceSlot = -1;
     m_naluFile = NULL;
     m_offsetEmergency = NULL;
     m_iFrameNum = 0;
@@ -146,6 +166,74 @@ inline char *strcatFilename(const char *input, const char *suffix)
     return output;
 }
 
+/* Footprint of the buffers of an encoder with the param, per subsystem. The
+ * frames in flight are those of the lookahead queue and its decided
+ * mini-GOP, of the frame encoders and the references they hold; frame data
+ * and reconstructed pictures are held by the references and the frames being
+ * encoded. numWorkers is the number of worker threads of the pools, each of
+ * which has analysis buffers (plus one per frame encoder without WPP) */
+uint64_t Encoder::estimateMemory(const x265_param* p, int numWorkers, uint64_t* subsystem)
+{
+    uint64_t ctu = p->maxCUSize;
+    uint64_t numCuInWidth = (p->sourceWidth + ctu - 1) / ctu;
+    uint64_t numCuInHeight = (p->sourceHeight + ctu - 1) / ctu;
+    uint64_t marginX = ctu + 32, marginY = ctu + 16;
+    uint64_t lumaArea = ctu * ctu;
+    uint64_t chromaArea = p->internalCsp == X265_CSP_I400 ? 0 : 2 * (lumaArea >> (CHROMA_H_SHIFT(p->internalCsp) + CHROMA_V_SHIFT(p->internalCsp)));
+
+    /* PicYuv */
+    uint64_t stride = numCuInWidth * ctu + 2 * marginX;
+    uint64_t lumaPlane = stride * (numCuInHeight * ctu + 2 * marginY);
+    uint64_t picBytes = lumaPlane * (lumaArea + chromaArea) / lumaArea * sizeof(pixel);
+
+    /* Lowres, with the cost and MV arrays of all the B-frame distances or
+     * only of those searched in budget mode */
+    uint64_t blocksInRow = (p->sourceWidth / 2 + X265_LOWRES_CU_SIZE - 1) >> X265_LOWRES_CU_BITS;
+    uint64_t blocksInCol = (p->sourceHeight / 2 + X265_LOWRES_CU_SIZE - 1) >> X265_LOWRES_CU_BITS;
+    uint64_t cuCount = blocksInRow * blocksInCol;
+    uint64_t lowresStride = (p->sourceWidth / 2 + 2 * marginX + 31) & ~31;
+    uint64_t lowresPlane = lowresStride * (blocksInCol * X265_LOWRES_CU_SIZE + 2 * marginY) * sizeof(pixel);
+    uint64_t numCosts = p->memoryBudget ? (p->bframes + 2) * (p->bframes + 3) / 2 : (p->bframes + 2) * (p->bframes + 2);
+    uint64_t numMvs = p->memoryBudget ? p->bframes + 1 : p->bframes + 2;
+    uint64_t lowresBytes = 4 * lowresPlane + cuCount * (sizeof(int32_t) + sizeof(uint8_t) + sizeof(uint16_t));
+    lowresBytes += numCosts * (cuCount * sizeof(uint16_t) + blocksInCol * sizeof(int32_t));
+    lowresBytes += numMvs * 2 * cuCount * (sizeof(MV) + sizeof(int32_t));
+    if (p->rc.aqMode || p->rc.hevcAq || p->bAQMotion)
+        lowresBytes += (p->rc.qgSize == 8 ? 4 : 1) * cuCount * (2 * sizeof(int16_t) + sizeof(int));
+    if (p->bLookaheadHME)
+        lowresBytes += lowresPlane + numMvs * 2 * (cuCount / 4) * sizeof(MV);
+
+    /* FrameData with its reconstructed picture */
+    uint64_t numCUs = numCuInWidth * numCuInHeight;
+    uint64_t numPartitions = lumaArea / 16;
+    uint64_t frameDataBytes = picBytes + numCUs * ((lumaArea + chromaArea) * sizeof(coeff_t) + sizeof(FrameData::RCStatCU) +
+                              numPartitions * (CUData::BytesPerPartition + 4 * sizeof(MV) + sizeof(sse_t)));
+    if (p->searchMethod == X265_SEA)
+        frameDataBytes += INTEGRAL_PLANE_NUM * lumaPlane * sizeof(uint32_t);
+    if (p->subpelPlanes)
+        frameDataBytes += (p->subpelPlanes == 1 ? 3 : 15) * lumaPlane * sizeof(pixel);
+
+    int numFrames = p->lookaheadDepth + p->bframes + p->frameNumThreads + p->maxNumReferences + 9;
+    int numFrameData = p->maxNumReferences + p->frameNumThreads + 1;
+    int numTLD = X265_MAX(numWorkers, 1) + (p->bEnableWavefront ? 0 : p->frameNumThreads);
+
+    uint64_t est[X265_MEM_COUNT];
+    est[X265_MEM_LOOKAHEAD] = numFrames * lowresBytes;
+    est[X265_MEM_DPB] = numFrames * picBytes + numFrameData * frameDataBytes;
+    est[X265_MEM_FRAME_ENCODERS] = (1 << 20) + p->frameNumThreads * numCUs * lumaArea / 4;
+    est[X265_MEM_ANALYSIS] = numTLD * 256 * lumaArea;
+    est[X265_MEM_RATECONTROL] = p->rc.vbvBufferSize ? (QP_MAX_MAX - QP_MAX_SPEC) * MAX_NUM_TR_CATEGORIES * MAX_NUM_TR_COEFFS * sizeof(uint16_t) : 0;
+
+    uint64_t total = 0;
+    for (int i = 0; i < X265_MEM_COUNT; i++)
+    {
+        total += est[i];
+        if (subsystem)
+            subsystem[i] = est[i];
+    }
+    return total;
+}
+
 void Encoder::create()
 {
     if (!primitives.pu[0].sad)
@@ -157,6 +245,9 @@ void Encoder::create()
 
     x265_param* p = m_param;
 
+    m_memAccount = MemoryAccount::create();
+    MemoryScope memScope(m_memAccount, X265_MEM_FRAME_ENCODERS);
+
     int rows = (p->sourceHeight + p->maxCUSize - 1) >> g_log2Size[p->maxCUSize];
     int cols = (p->sourceWidth  + p->maxCUSize - 1) >> g_log2Size[p->maxCUSize];
 
@@ -174,7 +265,20 @@ void Encoder::create()
         allowPools = false;
 
     m_numPools = 0;
-    if (allowPools)
+    if (allowPools && p->sharedThreadPool)
+    {
+        m_threadPool = static_cast<ThreadPool*>(p->sharedThreadPool);
+        m_numPools = 1;
+        m_bSharedPool = true;
+        if (p->lookaheadThreads)
+        {
+            x265_log(p, X265_LOG_WARNING, "--lookahead-threads is ignored with a shared thread pool\n");
+            p->lookaheadThreads = 0;
+        }
+        if (!p->frameNumThreads)
+            ThreadPool::getFrameThreadsCount(p, m_threadPool->m_numWorkers);
+    }
+    else if (allowPools)
         m_threadPool = ThreadPool::allocThreadPools(p, m_numPools, 0);
     else
     {
@@ -202,6 +306,39 @@ void Encoder::create()
         p->bEnableWavefront = p->bDistributeModeAnalysis = p->bDistributeMotionEstimation = p->lookaheadSlices = 0;
     }
 
+    int numWorkers = 0;
+    for (int i = 0; i < m_numPools; i++)
+        numWorkers += m_threadPool[i].m_numWorkers;
+    m_memEstimate = estimateMemory(p, numWorkers, NULL);
+    if (p->memoryBudget)
+    {
+        /* shorten the lookahead down to a single mini-GOP, then encode fewer
+         * frames concurrently */
+        uint64_t budget = (uint64_t)p->memoryBudget << 20;
+        int lookaheadDepth = p->lookaheadDepth, frameNumThreads = p->frameNumThreads;
+        int minDepth = X265_MIN(p->lookaheadDepth, p->bframes + 1);
+        while (m_memEstimate > budget && p->lookaheadDepth > minDepth)
+        {
+            p->lookaheadDepth--;
+            m_memEstimate = estimateMemory(p, numWorkers, NULL);
+        }
+        while (m_memEstimate > budget && p->frameNumThreads > 1)
+        {
+            p->frameNumThreads--;
+            m_memEstimate = estimateMemory(p, numWorkers, NULL);
+        }
+        if (p->minFrameThreads > p->frameNumThreads)
+            p->minFrameThreads = p->frameNumThreads;
+
+        if (p->lookaheadDepth != lookaheadDepth || p->frameNumThreads != frameNumThreads)
+            x265_log(p, X265_LOG_INFO, "memory budget %d MiB: rc-lookahead %d -> %d, frame threads %d -> %d\n",
+                     p->memoryBudget, lookaheadDepth, p->lookaheadDepth, frameNumThreads, p->frameNumThreads);
+        if (m_memEstimate > budget)
+            x265_log(p, X265_LOG_WARNING, "memory budget %d MiB exceeded, estimated footprint %.1f MiB\n",
+                     p->memoryBudget, (double)m_memEstimate / (1 << 20));
+    }
+    estimateMemory(p, numWorkers, m_memEstimateSubsystem);
+
     x265_log(p, X265_LOG_INFO, "Slices                              : %d\n", p->maxSlices);
 
     char buf[128];
@@ -223,17 +360,41 @@ void Encoder::create()
         m_frameEncoder[i]->m_nalList.m_annexB = !!m_param->bAnnexB;
     }
 
+    m_bAdaptiveFrameThreads = p->frameThreadsLogLoad || (p->minFrameThreads && p->minFrameThreads < p->frameNumThreads);
+    if (p->minFrameThreads && !m_bAdaptiveFrameThreads)
+        x265_log(p, X265_LOG_WARNING, "--min-frame-threads %d is not less than frame threads %d, adaptive frame threads disabled\n",
+                 p->minFrameThreads, p->frameNumThreads);
+    initFrameEncoderCycle();
+
     if (m_numPools)
     {
         for (int i = 0; i < m_param->frameNumThreads; i++)
         {
             int pool = i % m_numPools;
-            m_frameEncoder[i]->m_pool = &m_threadPool[pool];
-            m_frameEncoder[i]->m_jpId = m_threadPool[pool].m_numProviders++;
-            m_threadPool[pool].m_jpTable[m_frameEncoder[i]->m_jpId] = m_frameEncoder[i];
+            m_frameEncoder[i]->m_jpId = i / m_numPools;
+            if (!m_threadPool[pool].attachProvider(*m_frameEncoder[i]))
+            {
+                x265_log(p, X265_LOG_ERROR, "thread pool has no free job provider slots, aborting\n");
+                m_aborted = true;
+                return;
+            }
+        }
+        if (m_bSharedPool && p->bCacheAffinity && m_threadPool->enableCacheAffinity())
+            x265_log(p, X265_LOG_INFO, "Shared thread pool split into %d cache domains\n", m_threadPool->m_numCacheDomains);
+        for (int i = 0; i < m_param->frameNumThreads; i++)
+        {
+            /* frame encoders of one pool share its worker thread local data,
+             * plus one instance per frame encoder when WPP is disabled */
+            int poolPeers = (m_param->frameNumThreads - i % m_numPools + m_numPools - 1) / m_numPools;
+            m_frameEncoder[i]->m_numTLD = m_frameEncoder[i]->m_pool->m_numWorkers + (m_param->bEnableWavefront ? 0 : poolPeers);
+            if (p->bCacheAffinity)
+                m_frameEncoder[i]->m_cacheDomain = m_frameEncoder[i]->m_pool->assignCacheDomain(false);
+        }
+        if (!m_bSharedPool)
+        {
+            for (int i = 0; i < m_numPools; i++)
+                m_threadPool[i].start();
         }
-        for (int i = 0; i < m_numPools; i++)
-            m_threadPool[i].start();
     }
     else
     {
@@ -262,24 +423,40 @@ void Encoder::create()
     }
     else
         lookAheadThreadPool = m_threadPool;
-    m_lookahead = new Lookahead(m_param, lookAheadThreadPool);
+    {
+        MemoryScope lookaheadScope(X265_MEM_LOOKAHEAD);
+        m_lookahead = new Lookahead(m_param, lookAheadThreadPool);
+    }
     if (pools)
     {
-        m_lookahead->m_jpId = lookAheadThreadPool[0].m_numProviders++;
-        lookAheadThreadPool[0].m_jpTable[m_lookahead->m_jpId] = m_lookahead;
+        m_lookahead->m_jpId = lookAheadThreadPool[0].m_numProviders;
+        if (!lookAheadThreadPool[0].attachProvider(*m_lookahead))
+        {
+            x265_log(p, X265_LOG_ERROR, "thread pool has no free job provider slots, aborting\n");
+            m_aborted = true;
+            return;
+        }
+        /* keep the lookahead away from the caches of the frame encoders, a
+         * dedicated lookahead pool has no such conflict */
+        if (!m_param->lookaheadThreads && p->bCacheAffinity)
+            m_lookahead->m_cacheDomain = lookAheadThreadPool[0].assignCacheDomain(true);
     }
     if (m_param->lookaheadThreads > 0)
         for (int i = 0; i < pools; i++)
             lookAheadThreadPool[i].start();
     m_lookahead->m_numPools = pools;
     m_dpb = new DPB(m_param);
-    m_rateControl = new RateControl(*m_param);
+    {
+        MemoryScope rcScope(X265_MEM_RATECONTROL);
+        m_rateControl = new RateControl(*m_param);
+    }
     initVPS(&m_vps);
     initSPS(&m_sps);
     initPPS(&m_pps);
    
     if (m_param->rc.vbvBufferSize)
     {
+        MemoryScope rcScope(X265_MEM_RATECONTROL);
         m_offsetEmergency = (uint16_t(*)[MAX_NUM_TR_CATEGORIES][MAX_NUM_TR_COEFFS])X265_MALLOC(uint16_t, MAX_NUM_TR_CATEGORIES * MAX_NUM_TR_COEFFS * (QP_MAX_MAX - QP_MAX_SPEC));
         if (!m_offsetEmergency)
         {
@@ -371,13 +548,19 @@ void Encoder::create()
         m_frameEncoder[i]->m_done.wait(); /* wait for thread to initialize */
     }
 
-    if (m_param->bEmitHRDSEI)
-        m_rateControl->initHRD(m_sps);
+    {
+        MemoryScope rcScope(X265_MEM_RATECONTROL);
+        if (m_param->bEmitHRDSEI)
+            m_rateControl->initHRD(m_sps);
 
-    if (!m_rateControl->init(m_sps))
-        m_aborted = true;
-    if (!m_lookahead->create())
-        m_aborted = true;
+        if (!m_rateControl->init(m_sps))
+            m_aborted = true;
+    }
+    {
+        MemoryScope lookaheadScope(X265_MEM_LOOKAHEAD);
+        if (!m_lookahead->create())
+            m_aborted = true;
+    }
 
     initRefIdx();
     if (m_param->analysisSave && m_param->bUseAnalysisFile)
@@ -395,6 +578,11 @@ void Encoder::create()
             x265_log_file(NULL, X265_LOG_ERROR, "Analysis save: failed to open file %s.temp\n", m_param->analysisSave);
             m_aborted = true;
         }
+        else if (m_param->analysisSaveFormat == 2 && !m_indexedAnalysisOut.create(m_analysisFileOut, !!m_param->bAnalysisSaveCompress))
+        {
+            x265_log_file(NULL, X265_LOG_ERROR, "Analysis save: failed to write file %s.temp\n", m_param->analysisSave);
+            m_aborted = true;
+        }
     }
     if (m_param->analysisLoad && m_param->bUseAnalysisFile)
     {
@@ -404,6 +592,32 @@ void Encoder::create()
             x265_log_file(NULL, X265_LOG_ERROR, "Analysis load: failed to open file %s\n", m_param->analysisLoad);
             m_aborted = true;
         }
+        else if (AnalysisFile::isIndexed(m_analysisFileIn) && !m_indexedAnalysisIn.open(m_analysisFileIn))
+        {
+            x265_log_file(NULL, X265_LOG_ERROR, "Analysis load: invalid indexed analysis file %s\n", m_param->analysisLoad);
+            m_aborted = true;
+        }
+    }
+
+    if (m_param->frameThreadsLogSave)
+    {
+        m_feLogFileOut = x265_fopen(m_param->frameThreadsLogSave, "w");
+        if (!m_feLogFileOut)
+        {
+            x265_log_file(NULL, X265_LOG_ERROR, "Frame threads log: failed to open file %s\n", m_param->frameThreadsLogSave);
+            m_aborted = true;
+        }
+    }
+    if (m_param->frameThreadsLogLoad)
+    {
+        m_feLogFileIn = x265_fopen(m_param->frameThreadsLogLoad, "r");
+        if (!m_feLogFileIn)
+        {
+            x265_log_file(NULL, X265_LOG_ERROR, "Frame threads log: failed to open file %s\n", m_param->frameThreadsLogLoad);
+            m_aborted = true;
+        }
+        else if (!readFrameThreadsLog())
+            m_aborted = true;
     }
 
     if (m_param->analysisMultiPassRefine || m_param->analysisMultiPassDistortion)
@@ -494,13 +708,278 @@ void Encoder::stopJobs()
         }
     }
 
-    if (m_threadPool)
+    if (m_bSharedPool)
+        detachSharedPool();
+    else if (m_threadPool)
     {
         for (int i = 0; i < m_numPools; i++)
             m_threadPool[i].stopWorkers();
     }
 }
 
+/* Release this encoder's job provider slots of a shared pool; the workers
+ * keep running for the other encoders attached to it */
+void Encoder::detachSharedPool()
+{
+    if (!m_bSharedPool)
+        return;
+
+    for (int i = 0; i < m_param->frameNumThreads; i++)
+    {
+        if (m_frameEncoder[i] && m_frameEncoder[i]->m_pool)
+            m_threadPool->detachProvider(*m_frameEncoder[i]);
+    }
+    if (m_lookahead && m_lookahead->m_pool)
+        m_threadPool->detachProvider(*m_lookahead);
+}
+
+/* Take the slice decisions of the leader's lookahead instead of running
+ * this encoder's own. Both encoders must be opened with the same GOP
+ * structure and neither may have received a picture yet */
+int Encoder::followLookahead(Encoder* leader)
+{
+    x265_param* lp = leader->m_param;
+    const char* reason = NULL;
+
+    if (leader == this)
+        reason = "an encoder cannot follow itself";
+    else if (m_pocLast >= 0 || leader->m_pocLast >= 0)
+        reason = "pictures were already encoded";
+    else if (m_lookahead->m_share || leader->m_lookahead->m_bShareFollower)
+        reason = "an encoder is either a leader or a follower";
+    else if (m_param->keyframeMax != lp->keyframeMax || m_param->keyframeMin != lp->keyframeMin ||
+             m_param->bframes != lp->bframes || m_param->bBPyramid != lp->bBPyramid ||
+             m_param->bOpenGOP != lp->bOpenGOP || m_param->radl != lp->radl ||
+             m_param->bIntraRefresh != lp->bIntraRefresh || m_param->lookaheadDepth != lp->lookaheadDepth)
+        reason = "GOP structure differs from the leader";
+    else if (m_param->rc.cuTree != lp->rc.cuTree || m_param->rc.hevcAq || lp->rc.hevcAq)
+        reason = "cutree must match the leader and hevc-aq is not supported";
+    else if (m_param->rc.bStatRead || lp->rc.bStatRead || m_param->analysisLoad || lp->analysisLoad)
+        reason = "multi-pass and analysis load are not supported";
+    else if (m_param->rc.rateControlMode != X265_RC_CQP && lp->rc.rateControlMode == X265_RC_CQP)
+        reason = "the leader does not estimate frame costs in CQP mode";
+    else if (m_rateControl->m_isVbv && !leader->m_rateControl->m_isVbv)
+        reason = "a VBV follower needs a VBV leader";
+
+    if (reason || !leader->m_lookahead->addFollower(*m_lookahead))
+    {
+        x265_log(m_param, X265_LOG_ERROR, "unable to follow lookahead: %s\n", reason ? reason : "too many followers");
+        return -1;
+    }
+    return 0;
+}
+
+/* Take the analysis of the pictures the leader outputs instead of reading
+ * an analysis-load file. The leader must be in analysis save mode and this
+ * encoder in analysis load mode without a file; neither may have received
+ * a picture yet */
+int Encoder::followAnalysis(Encoder* leader)
+{
+    x265_param* lp = leader->m_param;
+    const char* reason = NULL;
+    int slot = -1;
+
+    if (leader == this)
+        reason = "an encoder cannot follow itself";
+    else if (m_pocLast >= 0 || leader->m_pocLast >= 0)
+        reason = "pictures were already encoded";
+    else if (m_analysisSource)
+        reason = "the encoder already follows a leader";
+    else if (m_analysisShare && leader->m_analysisSource == m_analysisShare)
+        reason = "the leader follows this encoder";
+    else if (!lp->analysisSave)
+        reason = "the leader is not in analysis save mode";
+    else if (!m_param->analysisLoad || m_param->bUseAnalysisFile || m_param->bAnalysisType)
+        reason = "the follower must load analysis through the API";
+    else if (m_param->analysisReuseLevel != lp->analysisReuseLevel)
+        reason = "analysis-reuse-level differs from the leader";
+    else
+    {
+        if (!leader->m_analysisShare)
+            leader->m_analysisShare = new AnalysisShare(*lp);
+        slot = leader->m_analysisShare->addFollower();
+        if (slot < 0)
+            reason = "too many followers";
+    }
+
+    if (reason)
+    {
+        x265_log(m_param, X265_LOG_ERROR, "unable to follow analysis: %s\n", reason);
+        return -1;
+    }
+    m_analysisSource = leader->m_analysisShare;
+    m_analysisSourceSlot = slot;
+    return 0;
+}
+
+AnalysisShare::AnalysisShare(const x265_param& leaderParam)
+{
+    m_head = m_tail = NULL;
+    m_followers = 0;
+    m_refCount = 1;
+    m_bLeaderClosed = false;
+
+    /* records may outlive the leader's param */
+    memset(&m_freeParam, 0, sizeof(m_freeParam));
+    m_freeParam.rc.vbvMaxBitrate = leaderParam.rc.vbvMaxBitrate;
+    m_freeParam.rc.vbvBufferSize = leaderParam.rc.vbvBufferSize;
+    m_freeParam.rc.bStatRead = leaderParam.rc.bStatRead;
+    m_freeParam.rc.cuTree = leaderParam.rc.cuTree;
+    m_freeParam.bDisableLookahead = leaderParam.bDisableLookahead;
+    m_freeParam.bAnalysisType = leaderParam.bAnalysisType;
+    m_freeParam.analysisReuseLevel = leaderParam.analysisReuseLevel;
+    m_freeParam.analysisLoad = leaderParam.analysisLoad ? "" : NULL;
+}
+
+AnalysisShare::~AnalysisShare()
+{
+    while (m_head)
+    {
+        Record* rec = m_head;
+        m_head = rec->next;
+        x265_free_analysis_data(&m_freeParam, &rec->data);
+        delete rec;
+    }
+}
+
+int AnalysisShare::addFollower()
+{
+    ScopedLock lock(m_lock);
+    if (m_bLeaderClosed)
+        return -1;
+    for (int slot = 0; slot < MAX_FOLLOWERS; slot++)
+    {
+        if (!(m_followers & (1u << slot)))
+        {
+            m_followers |= 1u << slot;
+            m_refCount++;
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/* Drop a follower, releasing the POCs it has not read */
+void AnalysisShare::removeFollower(int slot)
+{
+    ScopedLock lock(m_lock);
+    m_followers &= ~(1u << slot);
+    for (Record* rec = m_head; rec; rec = rec->next)
+        rec->pending &= ~(1u << slot);
+    freeDoneLocked();
+}
+
+void AnalysisShare::publish(const x265_analysis_data& data, bool bExported)
+{
+    Record* rec = new Record;
+    rec->data = data;
+    rec->bExported = bExported;
+    rec->next = NULL;
+    {
+        ScopedLock lock(m_lock);
+        rec->pending = m_followers;
+        if (m_tail)
+            m_tail->next = rec;
+        else
+            m_head = rec;
+        m_tail = rec;
+        freeDoneLocked();
+    }
+    m_updates.incr();
+}
+
+/* Returns false if poc was never published, its buffers then remain the
+ * leader's to free */
+bool AnalysisShare::releaseExported(int poc)
+{
+    ScopedLock lock(m_lock);
+    Record* rec = findLocked(poc);
+    if (!rec)
+        return false;
+    rec->bExported = false;
+    freeDoneLocked();
+    return true;
+}
+
+/* Block until the leader has output poc. Returns NULL if the leader closed
+ * without it. The data stays valid until the follower consumes it */
+const x265_analysis_data* AnalysisShare::acquire(int slot, int poc)
+{
+    for (;;)
+    {
+        int updates = m_updates.get();
+        {
+            ScopedLock lock(m_lock);
+            Record* rec = findLocked(poc);
+            if (rec)
+                return rec->pending & (1u << slot) ? &rec->data : NULL;
+            if (m_bLeaderClosed)
+                return NULL;
+        }
+        m_updates.waitForChange(updates);
+    }
+}
+
+void AnalysisShare::consume(int slot, int poc)
+{
+    ScopedLock lock(m_lock);
+    Record* rec = findLocked(poc);
+    if (rec)
+    {
+        rec->pending &= ~(1u << slot);
+        freeDoneLocked();
+    }
+}
+
+void AnalysisShare::closeLeader()
+{
+    m_bLeaderClosed = true;
+    m_updates.incr();
+}
+
+void AnalysisShare::release()
+{
+    m_lock.acquire();
+    bool bLast = !--m_refCount;
+    m_lock.release();
+    if (bLast)
+        delete this;
+}
+
+AnalysisShare::Record* AnalysisShare::findLocked(int poc)
+{
+    for (Record* rec = m_head; rec; rec = rec->next)
+    {
+        if ((int)rec->data.poc == poc)
+            return rec;
+    }
+    return NULL;
+}
+
+void AnalysisShare::freeDoneLocked()
+{
+    Record* prev = NULL;
+    Record* rec = m_head;
+    while (rec)
+    {
+        Record* next = rec->next;
+        if (!rec->pending && !rec->bExported)
+        {
+            if (prev)
+                prev->next = next;
+            else
+                m_head = next;
+            if (m_tail == rec)
+                m_tail = prev;
+            x265_free_analysis_data(&m_freeParam, &rec->data);
+            delete rec;
+        }
+        else
+            prev = rec;
+        rec = next;
+    }
+}
+
 int Encoder::copySlicetypePocAndSceneCut(int *slicetype, int *poc, int *sceneCut)
 {
     Frame *FramePtr = m_dpb->m_picList.getCurFrame();
@@ -781,8 +1260,9 @@ void Encoder::destroy()
     }
 
     // thread pools can be cleaned up now that all the JobProviders are
-    // known to be shutdown
-    delete [] m_threadPool;
+    // known to be shutdown. A shared pool belongs to the application
+    if (!m_bSharedPool)
+        delete [] m_threadPool;
 
     if (m_lookahead)
     {
@@ -791,6 +1271,11 @@ void Encoder::destroy()
     }
 
     delete m_dpb;
+
+    /* unmap the slabs of the pools this encoder emptied */
+    if (m_param->hugePages)
+        x265_pool_trim();
+
     if (m_rateControl)
     {
         m_rateControl->destroy();
@@ -806,12 +1291,27 @@ void Encoder::destroy()
 
         PARAM_NS::x265_param_free(m_latestParam);
     }
+    if (m_analysisShare)
+    {
+        /* followers blocked on a POC the leader did not output give up */
+        m_analysisShare->closeLeader();
+        m_analysisShare->release();
+    }
+    if (m_analysisSource)
+    {
+        m_analysisSource->removeFollower(m_analysisSourceSlot);
+        m_analysisSource->release();
+    }
+    m_indexedAnalysisIn.close();
     if (m_analysisFileIn)
         fclose(m_analysisFileIn);
 
     if (m_analysisFileOut)
     {
         int bError = 1;
+        if (m_indexedAnalysisOut.isOpen() && !m_indexedAnalysisOut.finish())
+            x265_log(m_param, X265_LOG_ERROR, "failed to write the index of the analysis file\n");
+        m_indexedAnalysisOut.close();
         fclose(m_analysisFileOut);
         const char* name = m_param->analysisSave ? m_param->analysisSave : m_param->analysisReuseFileName;
         if (!name)
@@ -830,6 +1330,10 @@ void Encoder::destroy()
      }
     if (m_naluFile)
         fclose(m_naluFile);
+    if (m_feLogFileOut)
+        fclose(m_feLogFileOut);
+    if (m_feLogFileIn)
+        fclose(m_feLogFileIn);
 
 #ifdef SVT_HEVC
     X265_FREE(m_svtAppData);
@@ -849,8 +1353,14 @@ void Encoder::destroy()
         free((char*)m_param->toneMapFile);
         free((char*)m_param->analysisSave);
         free((char*)m_param->analysisLoad);
+        free((char*)m_param->frameThreadsLogSave);
+        free((char*)m_param->frameThreadsLogLoad);
         PARAM_NS::x265_param_free(m_param);
     }
+
+    /* buffers still held by the application keep the account alive */
+    if (m_memAccount)
+        m_memAccount->release();
 }
 
 void Encoder::updateVbvPlan(RateControl* rc)
@@ -910,6 +1420,202 @@ void Encoder::calcRefreshInterval(Frame* frameEnc)
     }
 }
 
+/* All frame encoders start active, in id order. The first frame encoder of
+ * the cycle receives frame 0, the others start without a prior frame */
+void Encoder::initFrameEncoderCycle()
+{
+    int numActive = m_param->frameNumThreads;
+    for (int i = 0; i < numActive; i++)
+    {
+        m_feCycle[i] = i;
+        m_feParkOrder[i] = INT_MAX;
+    }
+    m_feCycleLen = m_numActiveFrameEncoders = m_fePrevActive = numActive;
+    m_feChangeOrder = 0;
+    m_feWaitTime = m_feCompressTime = 0;
+    m_fePoolBusyTime = m_fePoolIdleTime = 0;
+
+    m_rcSuccessorHead = m_rcSuccessorCount = 0;
+    m_rcNumEnds = 0;
+    m_rcFreshPrev = 0;
+    m_rcFreshBegin = 1;
+    m_rcFreshEnd = numActive;
+}
+
+/* read the next decision of the frame threads log, returns false if the
+ * log is malformed */
+bool Encoder::readFrameThreadsLog()
+{
+    char line[64];
+    int prevOrder = m_feLogOrder;
+
+    m_feLogOrder = -1;
+    if (!fgets(line, sizeof(line), m_feLogFileIn))
+        return true;
+    line[strcspn(line, "\r\n")] = 0;
+
+    if (sscanf(line, "%d %d", &m_feLogOrder, &m_feLogCount) != 2 ||
+        m_feLogCount < 1 || m_feLogCount > m_param->frameNumThreads ||
+        m_feLogOrder < X265_MAX(prevOrder, 0) + 2 * m_param->frameNumThreads)
+    {
+        x265_log_file(m_param, X265_LOG_ERROR, "invalid frame threads log entry \"%s\" in %s\n",
+                      line, m_param->frameThreadsLogLoad);
+        m_feLogOrder = -1;
+        return false;
+    }
+    return true;
+}
+
+/* Called as a frame is handed to a frame encoder, before its rate control
+ * ordinals are assigned. Replays the decision log, or at keyframes compares
+ * the time the recently output frames were blocked on reference rows with
+ * their compress time, and the utilization of the worker threads, to decide
+ * whether to park or activate one frame encoder. Changes are at least two
+ * rounds of frame encoders apart, so the previous change has settled */
+void Encoder::adaptFrameEncoders(int encodeOrder, bool bKeyframe)
+{
+    if (m_feLogFileIn)
+    {
+        if (encodeOrder == m_feLogOrder)
+        {
+            setActiveFrameEncoders(m_feLogCount, encodeOrder);
+            if (!readFrameThreadsLog())
+                m_aborted = true;
+        }
+        return;
+    }
+
+    int maxActive = m_param->frameNumThreads;
+    if (!bKeyframe || encodeOrder < m_feChangeOrder + 2 * maxActive)
+        return;
+
+    ThreadPoolStats poolStats;
+    int64_t busyTime = 0, idleTime = 0;
+    for (int i = 0; i < m_numPools; i++)
+    {
+        m_threadPool[i].getStats(poolStats);
+        busyTime += poolStats.busyTime;
+        idleTime += poolStats.idleTime;
+    }
+    int64_t busyDelta = busyTime - m_fePoolBusyTime;
+    int64_t idleDelta = idleTime - m_fePoolIdleTime;
+    double waitRatio = m_feCompressTime ? (double)m_feWaitTime / m_feCompressTime : 0;
+    double poolUsage = busyDelta + idleDelta ? (double)busyDelta / (busyDelta + idleDelta) : 1;
+
+    /* measure afresh from this keyframe */
+    m_feWaitTime = m_feCompressTime = 0;
+    m_fePoolBusyTime = busyTime;
+    m_fePoolIdleTime = idleTime;
+
+    int numActive = m_numActiveFrameEncoders;
+    if (waitRatio > 0.25 && numActive > m_param->minFrameThreads)
+        numActive--;
+    else if (waitRatio < 0.10 && poolUsage < 0.85 && numActive < maxActive)
+        numActive++;
+
+    if (numActive != m_numActiveFrameEncoders)
+    {
+        x265_log(m_param, X265_LOG_DEBUG, "frame %d: %d frame encoders active, recon wait %.1f%%, pool usage %.1f%%\n",
+                 encodeOrder, numActive, waitRatio * 100, poolUsage * 100);
+        if (m_feLogFileOut)
+            fprintf(m_feLogFileOut, "%d %d\n", encodeOrder, numActive);
+        setActiveFrameEncoders(numActive, encodeOrder);
+    }
+}
+
+/* The frame encoder receiving frame encodeOrder is rotated to the front of
+ * the cycle. Activated frame encoders are appended to the cycle and receive
+ * their first frames after the active ones have received one more; parked
+ * frame encoders also receive one more frame and leave the cycle once it is
+ * output */
+void Encoder::setActiveFrameEncoders(int count, int encodeOrder)
+{
+    int prev = m_numActiveFrameEncoders;
+    if (count == prev)
+        return;
+
+    X265_CHECK(m_feCycleLen == prev, "frame encoders still parking\n");
+
+    int cycle[X265_MAX_FRAME_THREADS];
+    int cur = (m_curEncoder + prev - 1) % prev;
+    for (int i = 0; i < prev; i++)
+        cycle[i] = m_feCycle[(cur + i) % prev];
+    memcpy(m_feCycle, cycle, prev * sizeof(int));
+
+    if (count > prev)
+    {
+        for (int id = 0; id < m_param->frameNumThreads && m_feCycleLen < count; id++)
+        {
+            bool bActive = false;
+            for (int i = 0; i < prev; i++)
+                bActive |= m_feCycle[i] == id;
+            if (!bActive)
+                m_feCycle[m_feCycleLen++] = id;
+        }
+
+        m_rcFreshPrev += m_rcFreshEnd - m_rcFreshBegin;
+        m_rcFreshBegin = encodeOrder + prev;
+        m_rcFreshEnd = encodeOrder + count;
+    }
+    else
+    {
+        for (int i = count; i < prev; i++)
+            m_feParkOrder[m_feCycle[i]] = encodeOrder;
+    }
+
+    m_curEncoder = 1 % m_feCycleLen;
+    m_fePrevActive = prev;
+    m_numActiveFrameEncoders = count;
+    m_feChangeOrder = encodeOrder;
+}
+
+/* Encode order of the next frame given to the frame encoder which receives
+ * frame encodeOrder. After a frame encoder is parked its last frame has
+ * none, its rateControlEnd() is ordered with that of the first frame output
+ * after the parking */
+int Encoder::rcSuccessor(int encodeOrder) const
+{
+    int count = m_numActiveFrameEncoders;
+    int prev = m_fePrevActive;
+    int changeOrder = m_feChangeOrder;
+
+    if (count >= prev || encodeOrder >= changeOrder + prev)
+        return encodeOrder + count;
+    else if (encodeOrder < changeOrder + count)
+        return encodeOrder + prev;
+    else
+        return changeOrder + prev + count;
+}
+
+/* number of frames up to encodeOrder, excluding frame 0, which were given to
+ * a frame encoder with no prior frame. Each has a faked rateControlEnd() */
+int Encoder::rcFreshCount(int encodeOrder) const
+{
+    return m_rcFreshPrev + x265_clip3(0, m_rcFreshEnd - m_rcFreshBegin, encodeOrder + 1 - m_rcFreshBegin);
+}
+
+/* Rate control starts and ends are serialized by m_startEndOrder; the start
+ * of a frame is preceded by the starts of all prior frames and by the ends
+ * of all frames whose frame encoder has already received its next frame.
+ * With a fixed number of frame encoders this is 2 * encodeOrder */
+void Encoder::setRcOrdinals(RateControlEntry& rce, int encodeOrder)
+{
+    while (m_rcSuccessorCount && m_rcSuccessor[m_rcSuccessorHead] <= encodeOrder)
+    {
+        m_rcSuccessorHead = (m_rcSuccessorHead + 1) % (2 * X265_MAX_FRAME_THREADS);
+        m_rcSuccessorCount--;
+        m_rcNumEnds++;
+    }
+
+    int successor = rcSuccessor(encodeOrder);
+    X265_CHECK(m_rcSuccessorCount < 2 * X265_MAX_FRAME_THREADS, "rate control successor overflow\n");
+    m_rcSuccessor[(m_rcSuccessorHead + m_rcSuccessorCount++) % (2 * X265_MAX_FRAME_THREADS)] = successor;
+
+    rce.startOrdinal = encodeOrder + m_rcNumEnds + rcFreshCount(encodeOrder);
+    rce.endOrdinal = successor + encodeOrder + rcFreshCount(successor);
+    rce.bFakeEnd = rcFreshCount(encodeOrder + 1) > rcFreshCount(encodeOrder);
+}
+
 void Encoder::copyUserSEIMessages(Frame *frame, const x265_picture* pic_in)
 {
     x265_sei_payload toneMap;
@@ -1001,13 +1707,27 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
         return -1;
     }
 #endif
+    MemoryScope memScope(m_memAccount, X265_MEM_DPB);
     if (m_aborted)
         return -1;
 
+    /* an analysis leader publishes the analysis of pic_out, so it needs one
+     * even when the application does not take the output pictures */
+    x265_picture leaderPicOut;
+    if (!pic_out && m_analysisShare)
+    {
+        x265_picture_init(m_param, &leaderPicOut);
+        pic_out = &leaderPicOut;
+    }
+
     if (m_exportedPic)
     {
         if (!m_param->bUseAnalysisFile && m_param->analysisSave)
-            x265_free_analysis_data(m_param, &m_exportedPic->m_analysisData);
+        {
+            /* an abort may have kept the POC from being published */
+            if (!m_analysisShare || !m_analysisShare->releaseExported(m_exportedPic->m_poc))
+                x265_free_analysis_data(m_param, &m_exportedPic->m_analysisData);
+        }
         ATOMIC_DEC(&m_exportedPic->m_countRefEncoders);
         m_exportedPic = NULL;
         m_dpb->recycleUnreferenced();
@@ -1153,14 +1873,29 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
         /* Load analysis data before lookahead->addPicture, since sliceType has been decided */
         if (m_param->analysisLoad)
         {
+            /* a follower takes the analysis the leader output for this POC */
+            const x265_analysis_data* picData = &pic_in->analysisData;
+            if (m_analysisSource)
+            {
+                picData = m_analysisSource->acquire(m_analysisSourceSlot, inFrame->m_poc);
+                if (!picData)
+                {
+                    x265_log(m_param, X265_LOG_ERROR, "analysis leader closed before it output POC %d\n", inFrame->m_poc);
+                    m_aborted = true;
+                    return -1;
+                }
+            }
+
             /* reads analysis data for the frame and allocates memory based on slicetype */
             static int paramBytes = 0;
             if (!inFrame->m_poc && m_param->bAnalysisType != HEVC_INFO)
             {
-                x265_analysis_data analysisData = pic_in->analysisData;
+                x265_analysis_data analysisData = *picData;
                 paramBytes = validateAnalysisData(&analysisData, 0);
                 if (paramBytes == -1)
                 {
+                    if (m_analysisSource)
+                        m_analysisSource->consume(m_analysisSourceSlot, inFrame->m_poc);
                     m_aborted = true;
                     return -1;
                 }
@@ -1178,10 +1913,12 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
                 uint32_t outOfBoundaryLowresH = extendedHeight - m_param->sourceHeight / 2;
                 if (outOfBoundaryLowresH * 2 >= m_param->maxCUSize)
                     cuLocInFrame.skipHeight = true;
-                readAnalysisFile(&inFrame->m_analysisData, inFrame->m_poc, pic_in, paramBytes, cuLocInFrame);
+                readAnalysisFile(&inFrame->m_analysisData, inFrame->m_poc, picData, paramBytes, cuLocInFrame);
             }
             else
-                readAnalysisFile(&inFrame->m_analysisData, inFrame->m_poc, pic_in, paramBytes);
+                readAnalysisFile(&inFrame->m_analysisData, inFrame->m_poc, picData, paramBytes);
+            if (m_analysisSource)
+                m_analysisSource->consume(m_analysisSourceSlot, inFrame->m_poc);
             inFrame->m_poc = inFrame->m_analysisData.poc;
             sliceType = inFrame->m_analysisData.sliceType;
             inFrame->m_lowres.bScenecut = !!inFrame->m_analysisData.bScenecut;
@@ -1239,8 +1976,10 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
     else
         m_lookahead->flush();
 
-    FrameEncoder *curEncoder = m_frameEncoder[m_curEncoder];
-    m_curEncoder = (m_curEncoder + 1) % m_param->frameNumThreads;
+    int cycleIdx = m_curEncoder;
+    FrameEncoder *curEncoder = m_frameEncoder[m_feCycle[cycleIdx]];
+    m_curEncoder = (m_curEncoder + 1) % m_feCycleLen;
+    bool bParked = false;
     int ret = 0;
 
     /* Normal operation is to wait for the current frame encoder to complete its current frame
@@ -1341,7 +2080,9 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
                     }
                     writeAnalysisFile(&pic_out->analysisData, *outFrame->m_encData);
                     pic_out->analysisData.saveParam = pic_out->analysisData.saveParam;
-                    if (m_param->bUseAnalysisFile)
+                    if (m_analysisShare && !m_aborted)
+                        m_analysisShare->publish(pic_out->analysisData, !m_param->bUseAnalysisFile);
+                    else if (m_param->bUseAnalysisFile)
                         x265_free_analysis_data(m_param, &pic_out->analysisData);
                 }
             }
@@ -1408,6 +2149,13 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
             if (m_aborted)
                 return -1;
 
+            m_reconRowWaitTime += curEncoder->m_reconRowWaitTime;
+            m_frameJobs += curEncoder->m_numJobs;
+            m_frameBondAttempts += curEncoder->m_bondAttempts;
+            m_frameBondSuccesses += curEncoder->m_bondSuccesses;
+            m_feWaitTime += curEncoder->m_reconRowWaitTime;
+            m_feCompressTime += curEncoder->m_endCompressTime - curEncoder->m_startCompressTime;
+
             if ((m_outputCount + 1)  >= m_param->chunkStart)
                 finishFrameStats(outFrame, curEncoder, frameData, m_pocLast);
 
@@ -1452,11 +2200,24 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
                 m_numDelayedPic--;
 
             ret = 1;
+
+            /* a parked frame encoder leaves the cycle once its last frame is output */
+            int feId = m_feCycle[cycleIdx];
+            if (m_feParkOrder[feId] <= outFrame->m_encodeOrder)
+            {
+                m_feParkOrder[feId] = INT_MAX;
+                curEncoder->m_reconfigure = false;
+                m_feCycleLen--;
+                for (int i = cycleIdx; i < m_feCycleLen; i++)
+                    m_feCycle[i] = m_feCycle[i + 1];
+                m_curEncoder = cycleIdx % m_feCycleLen;
+                bParked = true;
+            }
         }
 
         /* pop a single frame from decided list, then provide to frame encoder
          * curEncoder is guaranteed to be idle at this point */
-        if (!pass)
+        if (!pass && !bParked)
             frameEnc = m_lookahead->getDecidedPicture();
         if (frameEnc && !pass && (!m_param->chunkEnd || (m_encodedFrameNum < m_param->chunkEnd)))
         {
@@ -1545,7 +2306,7 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
                 int maxHeight = numCuInHeight * m_param->maxCUSize;
                 for (int i = 0; i < INTEGRAL_PLANE_NUM; i++)
                 {
-                    frameEnc->m_encData->m_meBuffer[i] = X265_MALLOC(uint32_t, frameEnc->m_reconPic->m_stride * (maxHeight + (2 * padY)));
+                    frameEnc->m_encData->m_meBuffer[i] = (uint32_t*)x265_pool_malloc(POOL_FRAMEDATA, m_param->hugePages, sizeof(uint32_t) * frameEnc->m_reconPic->m_stride * (maxHeight + (2 * padY)));
                     if (frameEnc->m_encData->m_meBuffer[i])
                     {
                         memset(frameEnc->m_encData->m_meBuffer[i], 0, sizeof(uint32_t)* frameEnc->m_reconPic->m_stride * (maxHeight + (2 * padY)));
@@ -1555,6 +2316,26 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
                         x265_log(m_param, X265_LOG_ERROR, "SEA motion search: POC %d Integral buffer[%d] unallocated\n", frameEnc->m_poc, i);
                 }
             }
+            if (m_param->subpelPlanes)
+            {
+                /* the planes stay allocated with the FrameData for its next
+                 * reference picture */
+                SubpelPlanes& subpel = frameEnc->m_encData->m_subpel;
+                subpel.bActive = false;
+                if (IS_REFERENCED(frameEnc))
+                {
+                    if (!subpel.rowState && !subpel.create(*m_param, *frameEnc->m_reconPic))
+                    {
+                        subpel.destroy();
+                        x265_log(m_param, X265_LOG_WARNING, "POC %d sub-pel planes unallocated, interpolating during motion search\n", frameEnc->m_poc);
+                    }
+                    else
+                    {
+                        memset((void*)subpel.rowState, 0, subpel.numRows * sizeof(uint32_t));
+                        subpel.bActive = true;
+                    }
+                }
+            }
 
             if (m_param->bOptQpPPS && frameEnc->m_lowres.bKeyframe && m_param->bRepeatHeaders)
             {
@@ -1588,6 +2369,9 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
             frameEnc->m_encData->m_slice->numRefIdxDefault[1] = m_pps.numRefIdxDefault[1];
             frameEnc->m_encData->m_slice->m_iNumRPSInSPS = m_sps.spsrpsNum;
 
+            if (m_bAdaptiveFrameThreads)
+                adaptFrameEncoders(m_encodedFrameNum, !!frameEnc->m_lowres.bKeyframe);
+            setRcOrdinals(curEncoder->m_rce, m_encodedFrameNum);
             curEncoder->m_rce.encodeOrder = frameEnc->m_encodeOrder = m_encodedFrameNum++;
 
             if (!m_param->analysisLoad || !m_param->bDisableLookahead)
@@ -1631,11 +2415,15 @@ int Encoder::encode(const x265_picture* pic_in, x265_picture* pic_out)
             if (!curEncoder->startCompressFrame(frameEnc))
                 m_aborted = true;
         }
-        else if (m_encodedFrameNum)
-            m_rateControl->setFinalFrameCount(m_encodedFrameNum);
+        else if (m_encodedFrameNum && !bParked)
+            m_rateControl->setFinalFrameCount(m_encodedFrameNum, m_encodedFrameNum + m_rcNumEnds + rcFreshCount(m_encodedFrameNum - 1) + 1);
     }
     while (m_bZeroLatency && ++pass < 2);
 
+    /* frame encoders waiting for their turn to stream NALs give up on abort */
+    if (m_aborted)
+        m_nalStreamFrame.poke();
+
     return ret;
 }
 
@@ -1931,6 +2719,26 @@ void Encoder::printSummary()
             m_rateControl->m_numEntries - m_rpsInSpsCount, 
             (float)100.0 * (m_rateControl->m_numEntries - m_rpsInSpsCount) / m_rateControl->m_numEntries);
     }
+    if (m_param->hugePages)
+    {
+        x265_pool_stats pools[POOL_COUNT];
+        x265_pool_report(pools);
+        int p = 0;
+        for (int i = 0; i < POOL_COUNT; i++)
+            p += sprintf(buffer + p, "%s%s %.1f of %.1f MiB", i ? ", " : "", pools[i].name,
+                         pools[i].residentBytes / 1048576.0, pools[i].mappedBytes / 1048576.0);
+        x265_log(m_param, X265_LOG_INFO, "huge-page pools resident: %s\n", buffer);
+    }
+    if (m_param->memoryBudget && m_memAccount)
+    {
+        static const char* names[X265_MEM_COUNT] = { "lookahead", "dpb", "frame encoders", "analysis", "ratecontrol" };
+        int p = 0;
+        for (int i = 0; i < X265_MEM_COUNT; i++)
+            p += sprintf(buffer + p, "%s%s %.1f/%.1f", i ? ", " : "", names[i],
+                         m_memAccount->m_peakLiveBytes[i] / 1048576.0, m_memEstimateSubsystem[i] / 1048576.0);
+        x265_log(m_param, X265_LOG_INFO, "memory peak %.1f MiB of %.1f MiB estimated: %s\n",
+                 m_memAccount->m_peakBytes / 1048576.0, m_memEstimate / 1048576.0, buffer);
+    }
 
     if (m_analyzeAll.m_numPics)
     {
@@ -2163,6 +2971,35 @@ void Encoder::fetchStats(x265_stats *stats, size_t statsSizeBytes)
             stats->maxCLL = m_analyzeAll.m_maxCLL;
             stats->maxFALL = (uint16_t)(m_analyzeAll.m_maxFALL / m_analyzeAll.m_numPics);
         }
+
+        /* scheduler telemetry; worker times and job counts cover every
+         * encoder attached to the pools, bonding and recon waits only this one.
+         * Applications built against an older x265_stats lack these fields */
+        if (statsSizeBytes >= offsetof(x265_stats, reconRowWaitTime) + sizeof(stats->reconRowWaitTime))
+        {
+            ThreadPoolStats poolStats;
+            memset(&poolStats, 0, sizeof(poolStats));
+            for (int i = 0; i < m_numPools; i++)
+            {
+                ThreadPoolStats s;
+                m_threadPool[i].getStats(s);
+                poolStats.busyTime += s.busyTime;
+                poolStats.idleTime += s.idleTime;
+                poolStats.maxBusyTime = X265_MAX(poolStats.maxBusyTime, s.maxBusyTime);
+                poolStats.numJobs += s.numJobs;
+                poolStats.numWorkers += s.numWorkers;
+            }
+            stats->numWorkerThreads = poolStats.numWorkers;
+            stats->workerBusyTime = (double)poolStats.busyTime / 1000000;
+            stats->workerIdleTime = (double)poolStats.idleTime / 1000000;
+            stats->maxWorkerBusyTime = (double)poolStats.maxBusyTime / 1000000;
+            stats->workerJobs = poolStats.numJobs;
+            stats->frameJobs = m_frameJobs;
+            stats->lookaheadJobs = m_lookahead ? m_lookahead->m_numJobs : 0;
+            stats->bondAttempts = m_frameBondAttempts + (m_lookahead ? m_lookahead->m_bondAttempts : 0);
+            stats->bondSuccesses = m_frameBondSuccesses + (m_lookahead ? m_lookahead->m_bondSuccesses : 0);
+            stats->reconRowWaitTime = (double)m_reconRowWaitTime / 1000000;
+        }
     }
     /* If new statistics are added to x265_stats, we must check here whether the
      * structure provided by the user is the new structure or an older one (for
@@ -2297,6 +3134,10 @@ void Encoder::finishFrameStats(Frame* curFrame, FrameEncoder *curEncoder, x265_f
             else
                 frameStats->avgWPP = 1;
             frameStats->countRowBlocks = curEncoder->m_countRowBlocks;
+            frameStats->reconRowWaitTime = ELAPSED_MSEC(0, curEncoder->m_reconRowWaitTime);
+            frameStats->numJobs = curEncoder->m_numJobs;
+            frameStats->bondAttempts = curEncoder->m_bondAttempts;
+            frameStats->bondSuccesses = curEncoder->m_bondSuccesses;
 
             frameStats->avgChromaDistortion = curFrame->m_encData->m_frameStats.avgChromaDistortion;
             frameStats->avgLumaDistortion = curFrame->m_encData->m_frameStats.avgLumaDistortion;
@@ -2778,6 +3619,12 @@ void Encoder::configure(x265_param *p)
     if (!p->rdoqLevel)
         p->psyRdoq = 0;
 
+    if (p->hugePages && !x265_pool_supported())
+    {
+        x265_log(p, X265_LOG_WARNING, "--huge-pages disabled, not supported on this platform\n");
+        p->hugePages = 0;
+    }
+
     /* Disable features which are not supported by the current RD level */
     if (p->rdLevel < 3)
     {
@@ -3381,14 +4228,16 @@ void Encoder::configure(x265_param *p)
     }
 }
 
-void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x265_picture* picIn, int paramBytes)
+void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x265_analysis_data* picData, int paramBytes)
 {
+    MemoryScope memScope(X265_MEM_ANALYSIS);
+
 #define X265_FREAD(val, size, readSize, fileOffset, src)\
     if (!m_param->bUseAnalysisFile)\
         {\
         memcpy(val, src, (size * readSize));\
         }\
-        else if (fread(val, size, readSize, fileOffset) != readSize)\
+        else if (m_indexedAnalysisIn.isOpen() ? !m_indexedAnalysisIn.read(cursor, val, size, readSize) : fread(val, size, readSize, fileOffset) != readSize)\
     {\
         x265_log(NULL, X265_LOG_ERROR, "Error reading analysis data\n");\
         x265_free_analysis_data(m_param, analysis);\
@@ -3399,9 +4248,20 @@ void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x
     static uint64_t consumedBytes = 0;
     static uint64_t totalConsumedBytes = 0;
     uint32_t depthBytes = 0;
-    if (m_param->bUseAnalysisFile)
+    AnalysisFile::Cursor cursor;
+    if (m_indexedAnalysisIn.isOpen())
+    {
+        /* the index locates the record, and the next picture's is read ahead */
+        if (!m_indexedAnalysisIn.find(curPoc, cursor))
+        {
+            x265_log(NULL, X265_LOG_WARNING, "Error reading analysis data: Cannot find POC %d\n", curPoc);
+            x265_free_analysis_data(m_param, analysis);
+            return;
+        }
+        m_indexedAnalysisIn.prefetch(curPoc + 1);
+    }
+    else if (m_param->bUseAnalysisFile)
         fseeko(m_analysisFileIn, totalConsumedBytes + paramBytes, SEEK_SET);
-    const x265_analysis_data *picData = &(picIn->analysisData);
     x265_analysis_intra_data *intraPic = picData->intraData;
     x265_analysis_inter_data *interPic = picData->interData;
     x265_analysis_distortion_data *picDistortion = picData->distortionData;
@@ -3411,7 +4271,7 @@ void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x
     X265_FREAD(&depthBytes, sizeof(uint32_t), 1, m_analysisFileIn, &(picData->depthBytes));
     X265_FREAD(&poc, sizeof(int), 1, m_analysisFileIn, &(picData->poc));
 
-    if (m_param->bUseAnalysisFile)
+    if (m_param->bUseAnalysisFile && !m_indexedAnalysisIn.isOpen())
     {
         uint64_t currentOffset = totalConsumedBytes;
 
@@ -3548,7 +4408,7 @@ void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x
     {
         uint32_t numDir = analysis->sliceType == X265_TYPE_P ? 1 : 2;
         uint32_t numPlanes = m_param->internalCsp == X265_CSP_I400 ? 1 : 3;
-        X265_FREAD((WeightParam*)analysis->wt, sizeof(WeightParam), numPlanes * numDir, m_analysisFileIn, (picIn->analysisData.wt));
+        X265_FREAD((WeightParam*)analysis->wt, sizeof(WeightParam), numPlanes * numDir, m_analysisFileIn, picData->wt);
         if (m_param->analysisReuseLevel < 2)
             return;
 
@@ -3694,14 +4554,16 @@ void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x
 #undef X265_FREAD
 }
 
-void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x265_picture* picIn, int paramBytes, cuLocation cuLoc)
+void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x265_analysis_data* picData, int paramBytes, cuLocation cuLoc)
 {
+    MemoryScope memScope(X265_MEM_ANALYSIS);
+
 #define X265_FREAD(val, size, readSize, fileOffset, src)\
     if (!m_param->bUseAnalysisFile)\
     {\
         memcpy(val, src, (size * readSize));\
     }\
-    else if (fread(val, size, readSize, fileOffset) != readSize)\
+    else if (m_indexedAnalysisIn.isOpen() ? !m_indexedAnalysisIn.read(cursor, val, size, readSize) : fread(val, size, readSize, fileOffset) != readSize)\
     {\
         x265_log(NULL, X265_LOG_ERROR, "Error reading analysis data\n");\
         x265_free_analysis_data(m_param, analysis);\
@@ -3712,10 +4574,21 @@ void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x
     static uint64_t consumedBytes = 0;
     static uint64_t totalConsumedBytes = 0;
     uint32_t depthBytes = 0;
-    if (m_param->bUseAnalysisFile)
+    AnalysisFile::Cursor cursor;
+    if (m_indexedAnalysisIn.isOpen())
+    {
+        /* the index locates the record, and the next picture's is read ahead */
+        if (!m_indexedAnalysisIn.find(curPoc, cursor))
+        {
+            x265_log(NULL, X265_LOG_WARNING, "Error reading analysis data: Cannot find POC %d\n", curPoc);
+            x265_free_analysis_data(m_param, analysis);
+            return;
+        }
+        m_indexedAnalysisIn.prefetch(curPoc + 1);
+    }
+    else if (m_param->bUseAnalysisFile)
         fseeko(m_analysisFileIn, totalConsumedBytes + paramBytes, SEEK_SET);
 
-    const x265_analysis_data *picData = &(picIn->analysisData);
     x265_analysis_intra_data *intraPic = picData->intraData;
     x265_analysis_inter_data *interPic = picData->interData;
     x265_analysis_distortion_data *picDistortion = picData->distortionData;
@@ -3725,7 +4598,7 @@ void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x
     X265_FREAD(&depthBytes, sizeof(uint32_t), 1, m_analysisFileIn, &(picData->depthBytes));
     X265_FREAD(&poc, sizeof(int), 1, m_analysisFileIn, &(picData->poc));
 
-    if (m_param->bUseAnalysisFile)
+    if (m_param->bUseAnalysisFile && !m_indexedAnalysisIn.isOpen())
     {
         uint64_t currentOffset = totalConsumedBytes;
 
@@ -3908,7 +4781,7 @@ void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, const x
     {
         uint32_t numDir = analysis->sliceType == X265_TYPE_P ? 1 : 2;
         uint32_t numPlanes = m_param->internalCsp == X265_CSP_I400 ? 1 : 3;
-        X265_FREAD((WeightParam*)analysis->wt, sizeof(WeightParam), numPlanes * numDir, m_analysisFileIn, (picIn->analysisData.wt));
+        X265_FREAD((WeightParam*)analysis->wt, sizeof(WeightParam), numPlanes * numDir, m_analysisFileIn, picData->wt);
         if (m_param->analysisReuseLevel < 2)
             return;
 
@@ -4329,6 +5202,7 @@ void Encoder::computeDistortionOffset(x265_analysis_data* analysis)
 }
 void Encoder::readAnalysisFile(x265_analysis_data* analysis, int curPoc, int sliceType)
 {
+    MemoryScope memScope(X265_MEM_ANALYSIS);
 
 #define X265_FREAD(val, size, readSize, fileOffset)\
     if (fread(val, size, readSize, fileOffset) != readSize)\
@@ -4452,7 +5326,7 @@ void Encoder::writeAnalysisFile(x265_analysis_data* analysis, FrameData &curEncD
 {
 
 #define X265_FWRITE(val, size, writeSize, fileOffset)\
-    if (fwrite(val, size, writeSize, fileOffset) < writeSize)\
+    if (m_indexedAnalysisOut.isOpen() ? !m_indexedAnalysisOut.write(val, size, writeSize) : fwrite(val, size, writeSize, fileOffset) < writeSize)\
     {\
         x265_log(NULL, X265_LOG_ERROR, "Error writing analysis data\n");\
         x265_free_analysis_data(m_param, analysis);\
@@ -4615,6 +5489,13 @@ void Encoder::writeAnalysisFile(x265_analysis_data* analysis, FrameData &curEncD
     if (!m_param->bUseAnalysisFile)
         return;
 
+    if (m_indexedAnalysisOut.isOpen() && !m_indexedAnalysisOut.beginRecord(analysis->poc, analysis->sliceType))
+    {
+        x265_log(NULL, X265_LOG_ERROR, "Error writing analysis data\n");
+        x265_free_analysis_data(m_param, analysis);
+        m_aborted = true;
+        return;
+    }
     X265_FWRITE(&analysis->frameRecordSize, sizeof(uint32_t), 1, m_analysisFileOut);
     X265_FWRITE(&depthBytes, sizeof(uint32_t), 1, m_analysisFileOut);
     X265_FWRITE(&analysis->poc, sizeof(int), 1, m_analysisFileOut);
@@ -31,6 +31,7 @@
 #include "x265.h"
 #include "nal.h"
 #include "framedata.h"
+#include "analysisfile.h"
 #include "svt.h"
 #ifdef ENABLE_HDR10_PLUS
     #include "dynamicHDR10/hdr10plus.h"
@@ -41,6 +42,8 @@ namespace X265_NS {
 extern const char g_sliceTypeToChar[3];
 
 class Entropy;
+class MemoryAccount;
+class AsyncEncoder;
 
 #ifdef SVT_HEVC
 typedef struct SvtAppContext
@@ -141,11 +144,58 @@ struct puOrientation
     }
 };
 
+/* Analysis data of a leader encoder handed to encoders of other renditions
+ * of the same source (followers), in place of an analysis-save file. The
+ * leader publishes the x265_analysis_data of each picture it outputs; the
+ * buffers then belong to the share, which frees them once every follower
+ * has read the POC and the leader no longer exports it */
+class AnalysisShare
+{
+public:
+
+    struct Record
+    {
+        x265_analysis_data data;
+        uint32_t  pending;         // followers which have not read this POC
+        bool      bExported;       // held by the leader until its next encode call
+        Record*   next;
+    };
+
+    enum { MAX_FOLLOWERS = 16 };
+
+    Lock              m_lock;
+    Record*           m_head;
+    Record*           m_tail;
+    uint32_t          m_followers;     // bitmap of follower slots
+    int               m_refCount;
+    volatile bool     m_bLeaderClosed;
+    ThreadSafeInteger m_updates;       // advanced by each publish and by closeLeader()
+    x265_param        m_freeParam;     // the leader options which x265_free_analysis_data() depends on
+
+    AnalysisShare(const x265_param& leaderParam);
+    ~AnalysisShare();
+
+    int    addFollower();
+    void   removeFollower(int slot);
+    void   publish(const x265_analysis_data& data, bool bExported);
+    bool   releaseExported(int poc);
+    const x265_analysis_data* acquire(int slot, int poc);
+    void   consume(int slot, int poc);
+    void   closeLeader();
+    void   release();
+
+protected:
+
+    Record* findLocked(int poc);
+    void    freeDoneLocked();
+};
+
 
 class FrameEncoder;
 class DPB;
 class Lookahead;
 class RateControl;
+struct RateControlEntry;
 class ThreadPool;
 class FrameData;
 
@@ -174,21 +224,62 @@ public:
     int                m_numChromaWPFrames;  // number of P frames with weighted chroma reference
     int                m_numLumaWPBiFrames;  // number of B frames with weighted luma reference
     int                m_numChromaWPBiFrames; // number of B frames with weighted chroma reference
+
+    // scheduler telemetry, summed over output frames
+    int64_t            m_reconRowWaitTime;   // time frame encoders were blocked on reference recon rows
+    uint64_t           m_frameJobs;          // worker jobs run for frame encoders
+    uint64_t           m_frameBondAttempts;  // peer bonding attempts charged to frame encoders
+    uint64_t           m_frameBondSuccesses; // ... which bonded at least one peer
+
+    // adaptive frame threads (--min-frame-threads)
+    bool               m_bAdaptiveFrameThreads;
+    int                m_feCycle[X265_MAX_FRAME_THREADS];     // active frame encoder ids, in dispatch order
+    int                m_feParkOrder[X265_MAX_FRAME_THREADS]; // park once a frame of this encode order is output, INT_MAX if active
+    int                m_feCycleLen;          // frame encoders in m_feCycle, includes those about to park
+    int                m_numActiveFrameEncoders;
+    int                m_feChangeOrder;       // encode order at which m_numActiveFrameEncoders last changed
+    int                m_fePrevActive;        // m_numActiveFrameEncoders before that change
+    int64_t            m_feWaitTime;          // recon row wait of frames output since that change
+    int64_t            m_feCompressTime;      // compress time of frames output since that change
+    int64_t            m_fePoolBusyTime;      // pool busy time at that change
+    int64_t            m_fePoolIdleTime;      // pool idle time at that change
+    FILE*              m_feLogFileOut;
+    FILE*              m_feLogFileIn;
+    int                m_feLogOrder;          // encode order of the next decision to replay, -1 if none
+    int                m_feLogCount;
+
+    // rate control start/end ordinals, see RateControl::m_startEndOrder
+    int                m_rcSuccessor[2 * X265_MAX_FRAME_THREADS]; // FIFO of next encode order on the same frame encoder
+    int                m_rcSuccessorHead;
+    int                m_rcSuccessorCount;
+    int                m_rcNumEnds;           // frames whose rateControlEnd precedes the start of the next frame
+    int                m_rcFreshPrev;         // frames given to frame encoders with no prior frame, before m_rcFreshBegin
+    int                m_rcFreshBegin;        // latest range of such frames, [begin, end)
+    int                m_rcFreshEnd;
     int                m_conformanceMode;
     int                m_lastBPSEI;
     uint32_t           m_numDelayedPic;
 
     ThreadPool*        m_threadPool;
+    bool               m_bSharedPool;     // m_threadPool was created by x265_threadpool_create()
     FrameEncoder*      m_frameEncoder[X265_MAX_FRAME_THREADS];
     DPB*               m_dpb;
     Frame*             m_exportedPic;
     FILE*              m_analysisFileIn;
     FILE*              m_analysisFileOut;
+    AnalysisFile       m_indexedAnalysisIn;   // analysis-load file of the indexed format
+    AnalysisFile       m_indexedAnalysisOut;  // analysis-save file of --analysis-save-format 2
+    AnalysisShare*     m_analysisShare;       // analysis published to follower encoders, or NULL
+    AnalysisShare*     m_analysisSource;      // analysis of the leader this encoder follows, or NULL
+    int                m_analysisSourceSlot;
     FILE*              m_naluFile;
     x265_param*        m_param;
     x265_param*        m_latestParam;     // Holds latest param during a reconfigure
     RateControl*       m_rateControl;
     Lookahead*         m_lookahead;
+    MemoryAccount*     m_memAccount;      // live bytes per subsystem, see x265_encoder_memory_stats()
+    uint64_t           m_memEstimate;     // footprint estimated from m_param
+    uint64_t           m_memEstimateSubsystem[X265_MEM_COUNT];
 
     bool               m_externalFlush;
     /* Collect statistics globally */
@@ -201,6 +292,11 @@ public:
     PPS                m_pps;
     NALList            m_nalList;
     ScalingList        m_scalingList;      // quantization matrix information
+
+    x265_nal_callback  m_nalCallback;      // see x265_encoder_nal_callback()
+    void*              m_nalCallbackOpaque;
+    ThreadSafeInteger  m_nalStreamFrame;   // encode order of the frame streaming its NALs
+    AsyncEncoder*      m_async;            // driver thread of the async API, see x265_encoder_async_start()
     Window             m_conformanceWindow;
 
     bool               m_bZeroLatency;     // x265_encoder_encode() returns NALs for the input picture, zero lag
@@ -263,7 +359,9 @@ public:
     };
 
     void create();
+    static uint64_t estimateMemory(const x265_param* p, int numWorkers, uint64_t* subsystem);
     void stopJobs();
+    void detachSharedPool();
     void destroy();
 
     int encode(const x265_picture* pic, x265_picture *pic_out);
@@ -276,6 +374,10 @@ public:
 
     int copySlicetypePocAndSceneCut(int *slicetype, int *poc, int *sceneCut);
 
+    int followLookahead(Encoder* leader);
+
+    int followAnalysis(Encoder* leader);
+
     int getRefFrameList(PicYuv** l0, PicYuv** l1, int sliceType, int poc, int* pocL0, int* pocL1);
 
     int setAnalysisDataAfterZScan(x265_analysis_data *analysis_data, Frame* curFrame);
@@ -300,9 +402,9 @@ public:
 
     void readAnalysisFile(x265_analysis_data* analysis, int poc, int sliceType);
 
-    void readAnalysisFile(x265_analysis_data* analysis, int poc, const x265_picture* picIn, int paramBytes);
+    void readAnalysisFile(x265_analysis_data* analysis, int poc, const x265_analysis_data* picData, int paramBytes);
 
-    void readAnalysisFile(x265_analysis_data* analysis, int poc, const x265_picture* picIn, int paramBytes, cuLocation cuLoc);
+    void readAnalysisFile(x265_analysis_data* analysis, int poc, const x265_analysis_data* picData, int paramBytes, cuLocation cuLoc);
 
     void computeDistortionOffset(x265_analysis_data* analysis);
 
@@ -324,6 +426,14 @@ public:
 
     void calcRefreshInterval(Frame* frameEnc);
 
+    void initFrameEncoderCycle();
+    bool readFrameThreadsLog();
+    void adaptFrameEncoders(int encodeOrder, bool bKeyframe);
+    void setActiveFrameEncoders(int count, int encodeOrder);
+    int  rcSuccessor(int encodeOrder) const;
+    int  rcFreshCount(int encodeOrder) const;
+    void setRcOrdinals(RateControlEntry& rce, int encodeOrder);
+
     void initRefIdx();
     void analyseRefIdx(int *numRefIdx);
     void updateRefIdx();
@@ -26,6 +26,7 @@
 #include "common.h"
 #include "frame.h"
 #include "framedata.h"
+#include "arena.h"
 #include "wavefront.h"
 #include "param.h"
 
@@ -42,13 +43,14 @@ FrameEncoder::FrameEncoder()
 {
     m_prevOutputTime = x265_mdate();
     m_reconfigure = false;
-    m_isFrameEncoder = true;
     m_threadActive = true;
     m_slicetypeWaitTime = 0;
+    m_reconRowWaitTime = 0;
     m_activeWorkerCount = 0;
     m_completionCount = 0;
     m_bAllRowsStop = false;
     m_vbvResetTriggerRow = -1;
+    m_rowResumeSlack = 0;
     m_outStreams = NULL;
     m_backupStreams = NULL;
     m_substreamSizes = NULL;
@@ -61,6 +63,7 @@ FrameEncoder::FrameEncoder()
     m_cuGeoms = NULL;
     m_ctuGeomMap = NULL;
     m_localTldIdx = 0;
+    m_numTLD = 1;
     memset(&m_rce, 0, sizeof(RateControlEntry));
 }
 
@@ -68,12 +71,9 @@ void FrameEncoder::destroy()
 {
     if (m_pool)
     {
-        if (!m_jpId)
+        if (!m_jpId && m_tld)
         {
-            int numTLD = m_pool->m_numWorkers;
-            if (!m_param->bEnableWavefront)
-                numTLD += m_pool->m_numProviders;
-            for (int i = 0; i < numTLD; i++)
+            for (int i = 0; i < m_numTLD; i++)
                 m_tld[i].destroy();
             delete [] m_tld;
         }
@@ -168,6 +168,14 @@ bool FrameEncoder::init(Encoder *top, int numRows, int numCols)
         m_pool = NULL;
     }
 
+    /* rows of one slice are maxSlices apart in the queue, each row has an
+     * encoder and a filter entry */
+    m_rowStride = 2 * m_param->maxSlices;
+
+    /* on wide frames, resume a row blocked on the row above only once it may
+     * compress more than one CTU, so a woken worker gets a batch of work */
+    m_rowResumeSlack = numCols >= 64 ? 1 : 0;
+
     m_frameFilter.init(top, this, numRows, numCols);
 
     // initialize HRD parameters of SPS
@@ -282,6 +290,7 @@ void FrameEncoder::threadMain()
 {
     THREAD_NAME("Frame", m_jpId);
 
+    MemoryScope memScope(m_top->m_memAccount, X265_MEM_FRAME_ENCODERS);
     if (m_pool)
     {
         m_pool->setCurrentThreadAffinity();
@@ -291,24 +300,21 @@ void FrameEncoder::threadMain()
          * each FE also needs a TLD instance */
         if (!m_jpId)
         {
-            int numTLD = m_pool->m_numWorkers;
-            if (!m_param->bEnableWavefront)
-                numTLD += m_pool->m_numProviders;
-
-            m_tld = new ThreadLocalData[numTLD];
-            for (int i = 0; i < numTLD; i++)
+            MemoryScope analysisScope(X265_MEM_ANALYSIS);
+            m_tld = new ThreadLocalData[m_numTLD];
+            for (int i = 0; i < m_numTLD; i++)
             {
                 m_tld[i].analysis.initSearch(*m_param, m_top->m_scalingList);
                 m_tld[i].analysis.create(m_tld);
             }
 
-            for (int i = 0; i < m_pool->m_numProviders; i++)
+            /* the pool may be shared with other encoders, only hand the
+             * thread local data to frame encoders of our own encoder */
+            for (int i = 0; i < m_param->frameNumThreads; i++)
             {
-                if (m_pool->m_jpTable[i]->m_isFrameEncoder) /* ugh; over-allocation and other issues here */
-                {
-                    FrameEncoder *peer = dynamic_cast<FrameEncoder*>(m_pool->m_jpTable[i]);
+                FrameEncoder *peer = m_top->m_frameEncoder[i];
+                if (peer->m_pool == m_pool)
                     peer->m_tld = m_tld;
-                }
             }
         }
 
@@ -319,6 +325,7 @@ void FrameEncoder::threadMain()
     }
     else
     {
+        MemoryScope analysisScope(X265_MEM_ANALYSIS);
         m_tld = new ThreadLocalData;
         m_tld->analysis.initSearch(*m_param, m_top->m_scalingList);
         m_tld->analysis.create(NULL);
@@ -436,6 +443,10 @@ void FrameEncoder::compressFrame()
     m_countRowBlocks = 0;
     m_allRowsAvailableTime = 0;
     m_stallStartTime = 0;
+    m_reconRowWaitTime = 0;
+    m_numJobs = 0;
+    m_bondAttempts = 0;
+    m_bondSuccesses = 0;
 
     m_completionCount = 0;
     m_bAllRowsStop = false;
@@ -477,6 +488,7 @@ void FrameEncoder::compressFrame()
             {
                 x265_log(m_param, X265_LOG_ERROR, "compute commonly RPS failed!\n");
                 m_top->m_aborted = true;
+                m_top->m_nalStreamFrame.poke();
             }
             m_top->getStreamHeaders(m_nalList, m_entropyCoder, m_bs);
         }
@@ -538,7 +550,7 @@ void FrameEncoder::compressFrame()
             if ((bUseWeightP || bUseWeightB) && slice->m_weightPredTable[l][ref][0].wtPresent)
                 w = slice->m_weightPredTable[l][ref];
             slice->m_refReconPicList[l][ref] = slice->m_refFrameList[l][ref]->m_reconPic;
-            m_mref[l][ref].init(slice->m_refReconPicList[l][ref], w, *m_param);
+            m_mref[l][ref].init(slice->m_refReconPicList[l][ref], w, *m_param, &slice->m_refFrameList[l][ref]->m_encData->m_subpel);
         }
         if (m_param->analysisSave && (bUseWeightP || bUseWeightB))
         {
@@ -548,11 +560,7 @@ void FrameEncoder::compressFrame()
 
     }
 
-    int numTLD;
-    if (m_pool)
-        numTLD = m_param->bEnableWavefront ? m_pool->m_numWorkers : m_pool->m_numWorkers + m_pool->m_numProviders;
-    else
-        numTLD = 1;
+    int numTLD = m_numTLD;
 
     /* Get the QP for this frame from rate control. This call may block until
      * frames ahead of it in encode order have called rateControlEnd() */
@@ -777,7 +785,7 @@ void FrameEncoder::compressFrame()
     {
         m_top->m_rateControl->m_startEndOrder.incr();
 
-        if (m_rce.encodeOrder < m_param->frameNumThreads - 1)
+        if (m_rce.bFakeEnd)
             m_top->m_rateControl->m_startEndOrder.incr(); // faked rateControlEnd calls for negative frames
     }
 
@@ -790,7 +798,10 @@ void FrameEncoder::compressFrame()
 
     for (uint32_t sliceId = 0; sliceId < m_param->maxSlices; sliceId++)    
         m_rows[m_sliceBaseRow[sliceId]].active = true;
-    
+
+    uint32_t slicesWritten = 0;
+    m_streamedNals = 0;
+
     if (m_param->bEnableWavefront)
     {
         int i = 0;
@@ -835,8 +846,13 @@ void FrameEncoder::compressFrame()
                         // NOTE: we unnecessary wait row that beyond current slice boundary
                         const int rowIdx = X265_MIN(sliceEndRow, (row + m_refLagRows));
 
-                        while (refpic->m_reconRowFlag[rowIdx].get() == 0)
-                            refpic->m_reconRowFlag[rowIdx].waitForChange(0);
+                        if (refpic->m_reconRowFlag[rowIdx].get() == 0)
+                        {
+                            int64_t waitStart = x265_mdate();
+                            while (refpic->m_reconRowFlag[rowIdx].get() == 0)
+                                refpic->m_reconRowFlag[rowIdx].waitForChange(0);
+                            m_reconRowWaitTime += x265_mdate() - waitStart;
+                        }
 
                         if ((bUseWeightP || bUseWeightB) && m_mref[l][ref].isWeighted)
                             m_mref[l][ref].applyWeight(rowIdx, m_numRows, sliceEndRow, sliceId);
@@ -855,6 +871,20 @@ void FrameEncoder::compressFrame()
 
         m_allRowsAvailableTime = x265_mdate();
         tryWakeOne(); /* ensure one thread is active or help-wanted flag is set prior to blocking */
+
+        /* with a NAL callback, write each slice as soon as its last row is
+         * reconstructed, which also makes its SAO parameters final */
+        if (m_top->m_nalCallback)
+        {
+            for (; slicesWritten < m_param->maxSlices; slicesWritten++)
+            {
+                ThreadSafeInteger& lastRow = m_frame->m_reconRowFlag[m_sliceBaseRow[slicesWritten + 1] - 1];
+                while (!lastRow.get())
+                    lastRow.waitForChange(0);
+                encodeSlice(slicesWritten);
+            }
+        }
+
         static const int block_ms = 250;
         while (m_completionEvent.timedWait(block_ms))
             tryWakeOne();
@@ -875,8 +905,13 @@ void FrameEncoder::compressFrame()
                         Frame *refpic = slice->m_refFrameList[list][ref];
 
                         const int rowIdx = X265_MIN(m_numRows - 1, (i + m_refLagRows));
-                        while (refpic->m_reconRowFlag[rowIdx].get() == 0)
-                            refpic->m_reconRowFlag[rowIdx].waitForChange(0);
+                        if (refpic->m_reconRowFlag[rowIdx].get() == 0)
+                        {
+                            int64_t waitStart = x265_mdate();
+                            while (refpic->m_reconRowFlag[rowIdx].get() == 0)
+                                refpic->m_reconRowFlag[rowIdx].waitForChange(0);
+                            m_reconRowWaitTime += x265_mdate() - waitStart;
+                        }
 
                         if ((bUseWeightP || bUseWeightB) && m_mref[l][ref].isWeighted)
                             m_mref[list][ref].applyWeight(rowIdx, m_numRows, m_numRows, 0);
@@ -976,70 +1011,9 @@ void FrameEncoder::compressFrame()
         m_frame->m_encData->m_frameStats.avgResEnergy = (double)(m_frame->m_encData->m_frameStats.resEnergy) / m_frame->m_encData->m_frameStats.totalCtu;
     }
 
-    m_bs.resetBits();
-    m_entropyCoder.load(m_initSliceContext);
-    m_entropyCoder.setBitstream(&m_bs);
-
-    // finish encode of each CTU row, only required when SAO is enabled
-    if (m_param->bEnableSAO)
-        encodeSlice(0);
-
-    m_entropyCoder.setBitstream(&m_bs);
-
-    if (m_param->maxSlices > 1)
-    {
-        uint32_t nextSliceRow = 0;
-
-        for(uint32_t sliceId = 0; sliceId < m_param->maxSlices; sliceId++)
-        {
-            m_bs.resetBits();
-
-            const uint32_t sliceAddr = nextSliceRow * m_numCols;
-            if (m_param->bOptRefListLengthPPS)
-            {
-                ScopedLock refIdxLock(m_top->m_sliceRefIdxLock);
-                m_top->analyseRefIdx(slice->m_numRefIdx);
-            }
-            m_entropyCoder.codeSliceHeader(*slice, *m_frame->m_encData, sliceAddr, m_sliceAddrBits, slice->m_sliceQp);
-
-            // Find rows of current slice
-            const uint32_t prevSliceRow = nextSliceRow;
-            while(nextSliceRow < m_numRows && m_rows[nextSliceRow].sliceId == sliceId)
-                nextSliceRow++;
-
-            // serialize each row, record final lengths in slice header
-            uint32_t maxStreamSize = m_nalList.serializeSubstreams(&m_substreamSizes[prevSliceRow], (nextSliceRow - prevSliceRow), &m_outStreams[prevSliceRow]);
-
-            // complete the slice header by writing WPP row-starts
-            m_entropyCoder.setBitstream(&m_bs);
-            if (slice->m_pps->bEntropyCodingSyncEnabled)
-                m_entropyCoder.codeSliceHeaderWPPEntryPoints(&m_substreamSizes[prevSliceRow], (nextSliceRow - prevSliceRow - 1), maxStreamSize);
-            
-            m_bs.writeByteAlignment();
-
-            m_nalList.serialize(slice->m_nalUnitType, m_bs);
-        }
-    }
-    else
-    {
-        if (m_param->bOptRefListLengthPPS)
-        {
-            ScopedLock refIdxLock(m_top->m_sliceRefIdxLock);
-            m_top->analyseRefIdx(slice->m_numRefIdx);
-        }
-        m_entropyCoder.codeSliceHeader(*slice, *m_frame->m_encData, 0, 0, slice->m_sliceQp);
-
-        // serialize each row, record final lengths in slice header
-        uint32_t maxStreamSize = m_nalList.serializeSubstreams(m_substreamSizes, numSubstreams, m_outStreams);
-
-        // complete the slice header by writing WPP row-starts
-        m_entropyCoder.setBitstream(&m_bs);
-        if (slice->m_pps->bEntropyCodingSyncEnabled)
-            m_entropyCoder.codeSliceHeaderWPPEntryPoints(m_substreamSizes, (slice->m_sps->numCuInHeight - 1), maxStreamSize);
-        m_bs.writeByteAlignment();
-
-        m_nalList.serialize(slice->m_nalUnitType, m_bs);
-    }
+    /* write the slices not streamed while the rows were being coded */
+    for (; slicesWritten < m_param->maxSlices; slicesWritten++)
+        encodeSlice(slicesWritten);
 
     if (m_param->decodedPictureHashSEI)
         writeTrailingSEIMessages();
@@ -1062,7 +1036,10 @@ void FrameEncoder::compressFrame()
     int filler = 0;
     /* rateControlEnd may also block for earlier frames to call rateControlUpdateStats */
     if (m_top->m_rateControl->rateControlEnd(m_frame, m_accessUnitBits, &m_rce, &filler) < 0)
+    {
         m_top->m_aborted = true;
+        m_top->m_nalStreamFrame.poke();
+    }
 
     if (filler > 0)
     {
@@ -1088,6 +1065,9 @@ void FrameEncoder::compressFrame()
         m_nalList.serialize(NAL_UNIT_UNSPECIFIED, m_bs);
     }
 
+    if (m_top->m_nalCallback)
+        streamNals(true);
+
     m_endCompressTime = x265_mdate();
 
     /* Decrement referenced frame reference counts, allow them to be recycled */
@@ -1155,24 +1135,24 @@ void FrameEncoder::initDecodedPictureHashSEI(int row, int cuAddr, int height)
     if (m_param->decodedPictureHashSEI == 1)
     {
         if (!row)
-            MD5Init(&m_seiReconPictureDigest.m_state[0]);
+        {
+            for (int i = 0; i < 3; i++)
+                MD5Init(&m_seiReconPictureDigest.m_state[i]);
+        }
 
-        updateMD5Plane(m_seiReconPictureDigest.m_state[0], reconPic->getLumaAddr(cuAddr), width, height, stride);
+        /* the three planes are hashed together, side by side */
+        const pixel* planes[3] = { reconPic->getLumaAddr(cuAddr) };
+        uint32_t widths[3] = { width, width >> hChromaShift, width >> hChromaShift };
+        uint32_t heights[3] = { (uint32_t)height, (uint32_t)height >> vChromaShift, (uint32_t)height >> vChromaShift };
+        intptr_t strides[3] = { stride, reconPic->m_strideC, reconPic->m_strideC };
+        int numPlanes = 1;
         if (m_param->internalCsp != X265_CSP_I400)
         {
-            if (!row)
-            {
-                MD5Init(&m_seiReconPictureDigest.m_state[1]);
-                MD5Init(&m_seiReconPictureDigest.m_state[2]);
-            }
-
-            width >>= hChromaShift;
-            height >>= vChromaShift;
-            stride = reconPic->m_strideC;
-
-            updateMD5Plane(m_seiReconPictureDigest.m_state[1], reconPic->getCbAddr(cuAddr), width, height, stride);
-            updateMD5Plane(m_seiReconPictureDigest.m_state[2], reconPic->getCrAddr(cuAddr), width, height, stride);
+            planes[1] = reconPic->getCbAddr(cuAddr);
+            planes[2] = reconPic->getCrAddr(cuAddr);
+            numPlanes = 3;
         }
+        updateMD5Planes(m_seiReconPictureDigest.m_state, planes, widths, heights, strides, numPlanes);
     }
     else if (m_param->decodedPictureHashSEI == 2)
     {
@@ -1214,78 +1194,131 @@ void FrameEncoder::initDecodedPictureHashSEI(int row, int cuAddr, int height)
     }
 }
 
-void FrameEncoder::encodeSlice(uint32_t sliceAddr)
+void FrameEncoder::encodeSlice(uint32_t sliceId)
 {
     Slice* slice = m_frame->m_encData->m_slice;
     const uint32_t widthInLCUs = slice->m_sps->numCuInWidth;
-    const uint32_t lastCUAddr = (slice->m_endCUAddr + m_param->num4x4Partitions - 1) / m_param->num4x4Partitions;
-    const uint32_t numSubstreams = m_param->bEnableWavefront ? slice->m_sps->numCuInHeight : 1;
+    const uint32_t startRow = m_sliceBaseRow[sliceId];
+    const uint32_t endRow = m_sliceBaseRow[sliceId + 1];
+    const uint32_t sliceAddr = startRow * widthInLCUs;
 
-    SAOParam* saoParam = slice->m_sps->bUseSAO ? m_frame->m_encData->m_saoParam : NULL;
-    for (uint32_t cuAddr = sliceAddr; cuAddr < lastCUAddr; cuAddr++)
+    // finish encode of each CTU row, only required when SAO is enabled
+    if (m_param->bEnableSAO)
     {
-        uint32_t col = cuAddr % widthInLCUs;
-        uint32_t row = cuAddr / widthInLCUs;
-        uint32_t subStrm = row % numSubstreams;
-        CUData* ctu = m_frame->m_encData->getPicCTU(cuAddr);
-
-        m_entropyCoder.setBitstream(&m_outStreams[subStrm]);
+        const uint32_t lastCUAddr = X265_MIN(endRow * widthInLCUs, (slice->m_endCUAddr + m_param->num4x4Partitions - 1) / m_param->num4x4Partitions);
+        const uint32_t numSubstreams = m_param->bEnableWavefront ? slice->m_sps->numCuInHeight : 1;
 
-        // Synchronize cabac probabilities with upper-right CTU if it's available and we're at the start of a line.
-        if (m_param->bEnableWavefront && !col && row)
+        SAOParam* saoParam = slice->m_sps->bUseSAO ? m_frame->m_encData->m_saoParam : NULL;
+        for (uint32_t cuAddr = sliceAddr; cuAddr < lastCUAddr; cuAddr++)
         {
-            m_entropyCoder.copyState(m_initSliceContext);
-            m_entropyCoder.loadContexts(m_rows[row - 1].bufferedEntropy);
-        }
+            uint32_t col = cuAddr % widthInLCUs;
+            uint32_t row = cuAddr / widthInLCUs;
+            uint32_t subStrm = row % numSubstreams;
+            CUData* ctu = m_frame->m_encData->getPicCTU(cuAddr);
 
-        // Initialize slice context
-        if (ctu->m_bFirstRowInSlice && !col)
-            m_entropyCoder.load(m_initSliceContext);
+            m_entropyCoder.setBitstream(&m_outStreams[subStrm]);
 
-        if (saoParam)
-        {
-            if (saoParam->bSaoFlag[0] || saoParam->bSaoFlag[1])
+            // Synchronize cabac probabilities with upper-right CTU if it's available and we're at the start of a line.
+            if (m_param->bEnableWavefront && !col && row)
+            {
+                m_entropyCoder.copyState(m_initSliceContext);
+                m_entropyCoder.loadContexts(m_rows[row - 1].bufferedEntropy);
+            }
+
+            // Initialize slice context
+            if (ctu->m_bFirstRowInSlice && !col)
+                m_entropyCoder.load(m_initSliceContext);
+
+            if (saoParam)
             {
-                int mergeLeft = col && saoParam->ctuParam[0][cuAddr].mergeMode == SAO_MERGE_LEFT;
-                int mergeUp = !ctu->m_bFirstRowInSlice && saoParam->ctuParam[0][cuAddr].mergeMode == SAO_MERGE_UP;
-                if (col)
-                    m_entropyCoder.codeSaoMerge(mergeLeft);
-                if (!ctu->m_bFirstRowInSlice && !mergeLeft)
-                    m_entropyCoder.codeSaoMerge(mergeUp);
-                if (!mergeLeft && !mergeUp)
+                if (saoParam->bSaoFlag[0] || saoParam->bSaoFlag[1])
                 {
-                    if (saoParam->bSaoFlag[0])
-                        m_entropyCoder.codeSaoOffset(saoParam->ctuParam[0][cuAddr], 0);
-                    if (saoParam->bSaoFlag[1])
+                    int mergeLeft = col && saoParam->ctuParam[0][cuAddr].mergeMode == SAO_MERGE_LEFT;
+                    int mergeUp = !ctu->m_bFirstRowInSlice && saoParam->ctuParam[0][cuAddr].mergeMode == SAO_MERGE_UP;
+                    if (col)
+                        m_entropyCoder.codeSaoMerge(mergeLeft);
+                    if (!ctu->m_bFirstRowInSlice && !mergeLeft)
+                        m_entropyCoder.codeSaoMerge(mergeUp);
+                    if (!mergeLeft && !mergeUp)
                     {
-                        m_entropyCoder.codeSaoOffset(saoParam->ctuParam[1][cuAddr], 1);
-                        m_entropyCoder.codeSaoOffset(saoParam->ctuParam[2][cuAddr], 2);
+                        if (saoParam->bSaoFlag[0])
+                            m_entropyCoder.codeSaoOffset(saoParam->ctuParam[0][cuAddr], 0);
+                        if (saoParam->bSaoFlag[1])
+                        {
+                            m_entropyCoder.codeSaoOffset(saoParam->ctuParam[1][cuAddr], 1);
+                            m_entropyCoder.codeSaoOffset(saoParam->ctuParam[2][cuAddr], 2);
+                        }
                     }
                 }
+                else
+                {
+                    for (int i = 0; i < (m_param->internalCsp != X265_CSP_I400 ? 3 : 1); i++)
+                        saoParam->ctuParam[i][cuAddr].reset();
+                }
             }
-            else
+
+            // final coding (bitstream generation) for this CU
+            m_entropyCoder.encodeCTU(*ctu, m_cuGeoms[m_ctuGeomMap[cuAddr]]);
+
+            if (m_param->bEnableWavefront)
             {
-                for (int i = 0; i < (m_param->internalCsp != X265_CSP_I400 ? 3 : 1); i++)
-                    saoParam->ctuParam[i][cuAddr].reset();
+                if (col == 1)
+                    // Store probabilities of second CTU in line into buffer
+                    m_rows[row].bufferedEntropy.loadContexts(m_entropyCoder);
+
+                if (col == widthInLCUs - 1)
+                    m_entropyCoder.finishSlice();
             }
         }
 
-        // final coding (bitstream generation) for this CU
-        m_entropyCoder.encodeCTU(*ctu, m_cuGeoms[m_ctuGeomMap[cuAddr]]);
+        if (!m_param->bEnableWavefront)
+            m_entropyCoder.finishSlice();
+    }
 
-        if (m_param->bEnableWavefront)
-        {
-            if (col == 1)
-                // Store probabilities of second CTU in line into buffer
-                m_rows[row].bufferedEntropy.loadContexts(m_entropyCoder);
+    m_bs.resetBits();
+    m_entropyCoder.setBitstream(&m_bs);
+    if (m_param->bOptRefListLengthPPS)
+    {
+        ScopedLock refIdxLock(m_top->m_sliceRefIdxLock);
+        m_top->analyseRefIdx(slice->m_numRefIdx);
+    }
+    m_entropyCoder.codeSliceHeader(*slice, *m_frame->m_encData, sliceAddr, m_sliceAddrBits, slice->m_sliceQp);
 
-            if (col == widthInLCUs - 1)
-                m_entropyCoder.finishSlice();
-        }
+    // serialize each row, record final lengths in slice header
+    const uint32_t numStreams = m_param->bEnableWavefront ? endRow - startRow : 1;
+    uint32_t maxStreamSize = m_nalList.serializeSubstreams(&m_substreamSizes[startRow], numStreams, &m_outStreams[startRow]);
+
+    // complete the slice header by writing WPP row-starts
+    m_entropyCoder.setBitstream(&m_bs);
+    if (slice->m_pps->bEntropyCodingSyncEnabled)
+        m_entropyCoder.codeSliceHeaderWPPEntryPoints(&m_substreamSizes[startRow], numStreams - 1, maxStreamSize);
+    m_bs.writeByteAlignment();
+
+    m_nalList.serialize(slice->m_nalUnitType, m_bs);
+
+    if (m_top->m_nalCallback)
+        streamNals(false);
+}
+
+/* Hand the NALs serialized since the last call to the NAL callback. Frames
+ * stream in encode order, the first call of a frame waits until the previous
+ * frame has streamed its last NAL */
+void FrameEncoder::streamNals(bool bLast)
+{
+    if (!m_streamedNals)
+    {
+        int frameNum = m_frame->m_encodeOrder;
+        int cur;
+        while ((cur = m_top->m_nalStreamFrame.get()) != frameNum && !m_top->m_aborted)
+            m_top->m_nalStreamFrame.waitForChange(cur);
     }
 
-    if (!m_param->bEnableWavefront)
-        m_entropyCoder.finishSlice();
+    m_top->m_nalCallback(m_top->m_nalCallbackOpaque, m_nalList.m_nal + m_streamedNals, m_nalList.m_numNal - m_streamedNals,
+                         m_frame->m_poc, bLast);
+    m_streamedNals = m_nalList.m_numNal;
+
+    if (bLast)
+        m_top->m_nalStreamFrame.set(m_frame->m_encodeOrder + 1);
 }
 
 void FrameEncoder::processRow(int row, int threadId)
@@ -1372,7 +1405,7 @@ void FrameEncoder::processRowEncoder(int intRow, ThreadLocalData& tld)
             {
                 double meanQPOff = 0;
                 bool isReferenced = IS_REFERENCED(m_frame);
-                double *qpoffs = (isReferenced && m_param->rc.cuTree) ? m_frame->m_lowres.qpCuTreeOffset : m_frame->m_lowres.qpAqOffset;
+                int16_t *qpoffs = (isReferenced && m_param->rc.cuTree) ? m_frame->m_lowres.qpCuTreeOffset : m_frame->m_lowres.qpAqOffset;
                 if (qpoffs)
                 {
                     uint32_t loopIncr = (m_param->rc.qgSize == 8) ? 8 : 16;
@@ -1391,7 +1424,7 @@ void FrameEncoder::processRowEncoder(int intRow, ThreadLocalData& tld)
                     {
                         for (uint32_t cuX = 0; cuX < width; cuX += qgSize)
                         {
-                            double qp_offset = 0;
+                            int qp_offset = 0;
                             uint32_t cnt = 0;
 
                             for (uint32_t block_yy = cuY; block_yy < cuY + qgSize && block_yy < m_frame->m_fencPic->m_picHeight; block_yy += loopIncr)
@@ -1403,8 +1436,7 @@ void FrameEncoder::processRowEncoder(int intRow, ThreadLocalData& tld)
                                     cnt++;
                                 }
                             }
-                            qp_offset /= cnt;
-                            meanQPOff += qp_offset;
+                            meanQPOff += x265_fix82qp(qp_offset) / cnt;
                             count++;
                         }
                     }
@@ -1748,7 +1780,7 @@ void FrameEncoder::processRowEncoder(int intRow, ThreadLocalData& tld)
             ScopedLock below(m_rows[row + 1].lock);
 
             if (m_rows[row + 1].active == false &&
-                m_rows[row + 1].completed + 2 <= curRow.completed)
+                (m_rows[row + 1].completed + 2 + m_rowResumeSlack <= curRow.completed || curRow.completed == numCols))
             {
                 m_rows[row + 1].active = true;
                 enqueueRowEncoder(m_row_to_idx[row + 1]);
@@ -138,6 +138,7 @@ public:
     Event                    m_done;
     Event                    m_completionEvent;
     int                      m_localTldIdx;
+    int                      m_numTLD;      /* size of the m_tld array shared by frame encoders of m_pool */
     bool                     m_reconfigure; /* reconfigure in progress */
     volatile bool            m_threadActive;
     volatile bool            m_bAllRowsStop;
@@ -150,6 +151,7 @@ public:
     uint32_t                 m_filterRowDelay;
     uint32_t                 m_filterRowDelayCus;
     uint32_t                 m_refLagRows;
+    uint32_t                 m_rowResumeSlack;           // extra CTUs the row above must complete before a blocked row resumes
 
     CTURow*                  m_rows;
     uint16_t                 m_sliceAddrBits;
@@ -181,6 +183,7 @@ public:
     int64_t                  m_slicetypeWaitTime;        // total elapsed time waiting for decided frame
     int64_t                  m_totalWorkerElapsedTime;   // total elapsed time spent by worker threads processing CTUs
     int64_t                  m_totalNoWorkerTime;        // total elapsed time without any active worker threads
+    int64_t                  m_reconRowWaitTime;         // total elapsed time blocked on reference recon rows
 #if DETAILED_CU_STATS
     CUStats                  m_cuStats;
 #endif
@@ -203,6 +206,7 @@ public:
     Entropy                  m_initSliceContext;
     FrameFilter              m_frameFilter;
     NALList                  m_nalList;
+    uint32_t                 m_streamedNals;  // m_nalList NALs passed to the NAL callback
 
     class WeightAnalysis : public BondedTaskGroup
     {
@@ -226,8 +230,10 @@ protected:
     /* analyze / compress frame, can be run in parallel within reference constraints */
     void compressFrame();
 
-    /* called by compressFrame to generate final per-row bitstreams */
-    void encodeSlice(uint32_t sliceAddr);
+    /* called by compressFrame to generate the final bitstream of a slice and
+     * serialize its NAL */
+    void encodeSlice(uint32_t sliceId);
+    void streamNals(bool bLast);
 
     void threadMain();
     int  collectCTUStatistics(const CUData& ctu, FrameStats* frameLog);
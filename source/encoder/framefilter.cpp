@@ -663,6 +663,9 @@ void FrameFilter::processPostRow(int row)
     // Notify other FrameEncoders that this row of reconstructed pixels is available
     m_frame->m_reconRowFlag[row].set(1);
 
+    if (m_frame->m_encData->m_subpel.bActive)
+        computeSubpelPlanes(row);
+
     uint32_t cuAddr = lineStartCUAddr;
     if (m_param->bEnablePsnr)
     {
@@ -722,6 +725,25 @@ void FrameFilter::processPostRow(int row)
     }
 }
 
+/* The sub-pel planes of a CTU row are interpolated once the rows above and
+ * below it are reconstructed too. With slices the rows complete out of order,
+ * the first thread to see the three rows complete claims the row */
+void FrameFilter::computeSubpelPlanes(int row)
+{
+    SubpelPlanes& subpel = m_frame->m_encData->m_subpel;
+    for (int r = X265_MAX(row - 1, 0); r <= X265_MIN(row + 1, m_numRows - 1); r++)
+    {
+        if ((r && !m_frame->m_reconRowFlag[r - 1].get()) || !m_frame->m_reconRowFlag[r].get() ||
+            (r < m_numRows - 1 && !m_frame->m_reconRowFlag[r + 1].get()))
+            continue;
+        if (ATOMIC_OR(&subpel.rowState[r], SubpelPlanes::ROW_BUSY) & SubpelPlanes::ROW_BUSY)
+            continue;
+
+        subpel.interpolateRow(*m_frame->m_reconPic, r);
+        ATOMIC_OR(&subpel.rowState[r], SubpelPlanes::ROW_DONE);
+    }
+}
+
 void FrameFilter::computeMEIntegral(int row)
 {
     int lastRow = row == (int)m_frame->m_encData->m_slice->m_sps->numCuInHeight - 1;
@@ -130,6 +130,7 @@ public:
     void processRow(int row);
     void processPostRow(int row);
     void computeMEIntegral(int row);
+    void computeSubpelPlanes(int row);
 };
 }
 
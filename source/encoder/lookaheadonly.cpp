@@ -0,0 +1,310 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#include "common.h"
+#include "frame.h"
+#include "picyuv.h"
+#include "arena.h"
+#include "param.h"
+#include "threadpool.h"
+
+#include "encoder.h"
+#include "slicetype.h"
+#include "lookaheadonly.h"
+
+using namespace X265_NS;
+
+/* the lowres motion vectors are handed out as x265_lowres_mv */
+typedef char check_lowres_mv_size[sizeof(MV) == sizeof(x265_lowres_mv) ? 1 : -1];
+
+LookaheadOnly::LookaheadOnly()
+{
+    m_param = NULL;
+    m_lookahead = NULL;
+    m_pool = NULL;
+    m_bSharedPool = false;
+    m_pocLast = -1;
+    m_padX = 0;
+    m_padY = 0;
+    m_bFlushed = false;
+    m_aborted = false;
+    m_lastRef = NULL;
+    m_bLastRefReleased = false;
+}
+
+/* Takes ownership of param, which must have passed x265_check_params() */
+bool LookaheadOnly::create(x265_param* param)
+{
+    m_param = param;
+
+    if (param->rc.bStatRead || param->analysisLoad || param->analysisSave || param->bAnalysisType == AVC_INFO)
+    {
+        x265_log(param, X265_LOG_ERROR, "lookahead: multi-pass and analysis reuse are not supported\n");
+        return false;
+    }
+
+    /* there is no rate control, but the frame costs are only estimated and
+     * cuTree only run when the encode is not CQP */
+    param->bLossless = 0;
+    if (param->rc.rateControlMode == X265_RC_CQP)
+        param->rc.rateControlMode = X265_RC_CRF;
+    param->bCopyPicToFrame = 1;
+
+    /* apply the encoder's parameter adjustments (keyframe interval, AQ and
+     * cuTree dependencies, qg-size) and learn the conformance padding */
+    Encoder* cfg = new Encoder;
+    cfg->configure(param);
+    m_padX = cfg->m_conformanceWindow.rightOffset;
+    m_padY = cfg->m_conformanceWindow.bottomOffset;
+    delete cfg;
+
+    /* the pool belongs to this object, not to the Lookahead, which would
+     * stop and free a pool of lookaheadThreads workers itself */
+    if (param->sharedThreadPool)
+    {
+        if (param->lookaheadThreads)
+            x265_log(param, X265_LOG_WARNING, "--lookahead-threads is ignored with a shared thread pool\n");
+        param->lookaheadThreads = 0;
+        m_pool = static_cast<ThreadPool*>(param->sharedThreadPool);
+        m_bSharedPool = true;
+    }
+    else
+    {
+        int numThreads = param->lookaheadThreads > 0 ? param->lookaheadThreads : ThreadPool::getCpuCount();
+        numThreads = X265_MIN(numThreads, (int)MAX_POOL_THREADS);
+        param->lookaheadThreads = 0;
+
+        int numNumaNodes = X265_MIN(ThreadPool::getNumaNodeCount(), 64);
+        uint64_t nodeMask = (uint64_t)-1 >> (64 - numNumaNodes);
+
+        m_pool = new ThreadPool;
+        if (!m_pool->create(numThreads, 1, nodeMask, !!param->bCacheAffinity))
+        {
+            delete m_pool;
+            m_pool = NULL;
+        }
+        else
+            x265_log(param, X265_LOG_INFO, "lookahead: thread pool created using %d threads\n", numThreads);
+    }
+
+    m_lookahead = new Lookahead(param, m_pool);
+    if (m_pool)
+    {
+        m_lookahead->m_jpId = m_pool->m_numProviders;
+        if (!m_pool->attachProvider(*m_lookahead))
+        {
+            x265_log(param, X265_LOG_ERROR, "lookahead: thread pool has no free job provider slots\n");
+            return false;
+        }
+        m_lookahead->m_numPools = 1;
+    }
+    if (!m_lookahead->create())
+        return false;
+    if (m_pool && !m_bSharedPool)
+        m_pool->start();
+
+    return true;
+}
+
+void LookaheadOnly::destroy()
+{
+    if (m_lookahead)
+        m_lookahead->stopJobs();
+    if (m_bSharedPool)
+    {
+        /* the workers keep running for the other users of the pool */
+        if (m_lookahead && m_lookahead->m_pool)
+            m_pool->detachProvider(*m_lookahead);
+    }
+    else if (m_pool)
+        m_pool->stopWorkers();
+
+    if (m_lookahead)
+    {
+        m_lookahead->destroy();
+        delete m_lookahead;
+    }
+    if (!m_bSharedPool)
+        delete m_pool;
+
+    while (!m_outList.empty())
+    {
+        Frame* curFrame = m_outList.popFront();
+        curFrame->destroy();
+        delete curFrame;
+    }
+    while (!m_freeList.empty())
+    {
+        Frame* curFrame = m_freeList.popFront();
+        curFrame->destroy();
+        delete curFrame;
+    }
+
+    if (m_param->hugePages)
+        x265_pool_trim();
+    PARAM_NS::x265_param_free(m_param);
+}
+
+Frame* LookaheadOnly::allocFrame(const x265_picture& pic)
+{
+    Frame* curFrame;
+    if (m_freeList.empty())
+    {
+        curFrame = new Frame;
+        if (!curFrame->create(m_param, pic.quantOffsets))
+        {
+            curFrame->destroy();
+            delete curFrame;
+            return NULL;
+        }
+    }
+    else
+    {
+        curFrame = m_freeList.popBack();
+        curFrame->m_lowres.bScenecut = false;
+        curFrame->m_lowres.satdCost = (int64_t)-1;
+        curFrame->m_lowresInit = false;
+    }
+
+    if (pic.quantOffsets)
+    {
+        Lowres& lowres = curFrame->m_lowres;
+        int cuCount = m_param->rc.qgSize == 8 ? lowres.maxBlocksInRowFullRes * lowres.maxBlocksInColFullRes :
+                                                lowres.maxBlocksInRow * lowres.maxBlocksInCol;
+        if (!curFrame->m_quantOffsets)
+            curFrame->m_quantOffsets = new float[cuCount];
+        memcpy(curFrame->m_quantOffsets, pic.quantOffsets, cuCount * sizeof(float));
+    }
+
+    return curFrame;
+}
+
+int LookaheadOnly::push(const x265_picture* pic)
+{
+    if (m_aborted)
+        return -1;
+
+    if (!pic)
+    {
+        if (!m_bFlushed)
+            m_lookahead->flush();
+        m_bFlushed = true;
+        return 0;
+    }
+
+    if (m_bFlushed)
+    {
+        x265_log(m_param, X265_LOG_ERROR, "lookahead: picture pushed after the flush\n");
+        return -1;
+    }
+    if (pic->bitDepth < 8 || pic->bitDepth > 16)
+    {
+        x265_log(m_param, X265_LOG_ERROR, "Input bit depth (%d) must be between 8 and 16\n", pic->bitDepth);
+        return -1;
+    }
+
+    Frame* curFrame = allocFrame(*pic);
+    if (!curFrame)
+    {
+        m_aborted = true;
+        x265_log(m_param, X265_LOG_ERROR, "memory allocation failure, aborting lookahead\n");
+        return -1;
+    }
+
+    curFrame->m_fencPic->copyFromPicture(*pic, *m_param, m_padX, m_padY);
+    curFrame->m_poc      = ++m_pocLast;
+    curFrame->m_userData = pic->userData;
+    curFrame->m_pts      = pic->pts;
+    curFrame->m_forceqp  = pic->forceqp;
+    curFrame->m_param    = m_param;
+
+    m_lookahead->addPicture(*curFrame, pic->sliceType);
+    return 0;
+}
+
+int LookaheadOnly::pull(x265_lookahead_frame* out)
+{
+    if (m_aborted)
+        return -1;
+
+    Frame* curFrame = m_lookahead->getDecidedPicture();
+    if (!curFrame)
+        return 0;
+
+    m_outList.pushBack(*curFrame);
+    Lowres& lowres = curFrame->m_lowres;
+    if (!IS_X265_TYPE_B(lowres.sliceType))
+    {
+        if (m_lastRef && m_bLastRefReleased)
+            recycle(m_lastRef);
+        m_lastRef = curFrame;
+        m_bLastRefReleased = false;
+    }
+
+    int p0 = lowres.costRefDist[0];
+    int p1 = lowres.costRefDist[1];
+
+    out->pts = curFrame->m_pts;
+    out->poc = curFrame->m_poc;
+    out->sliceType = lowres.sliceType;
+    out->bKeyframe = lowres.bKeyframe;
+    out->bScenecut = lowres.bScenecut;
+    out->refDist[0] = p0;
+    out->refDist[1] = p1;
+    out->intraCost = lowres.costEst[0][0];
+    out->frameCost = lowres.costEst[p0][p1];
+    out->frameCostAq = lowres.costEstAq[p0][p1];
+
+    out->blockWidth = lowres.maxBlocksInRow;
+    out->blockHeight = lowres.maxBlocksInCol;
+    out->intraCosts = lowres.intraCost;
+    out->interCosts = lowres.lowresCosts[p0][p1];
+    out->mvs[0] = p0 ? (const x265_lowres_mv*)lowres.lowresMvs[0][p0] : NULL;
+    out->mvs[1] = p1 ? (const x265_lowres_mv*)lowres.lowresMvs[1][p1] : NULL;
+
+    bool bQg8 = m_param->rc.qgSize == 8;
+    out->qgWidth = bQg8 ? lowres.maxBlocksInRowFullRes : lowres.maxBlocksInRow;
+    out->qgHeight = bQg8 ? lowres.maxBlocksInColFullRes : lowres.maxBlocksInCol;
+    out->qpAqOffsets = lowres.qpAqOffset;
+    out->qpCuTreeOffsets = m_param->rc.cuTree ? lowres.qpCuTreeOffset : NULL;
+
+    out->opaque = curFrame;
+    return 1;
+}
+
+void LookaheadOnly::release(x265_lookahead_frame* frame)
+{
+    Frame* curFrame = static_cast<Frame*>(frame->opaque);
+    if (!curFrame)
+        return;
+
+    frame->opaque = NULL;
+    if (curFrame == m_lastRef)
+        m_bLastRefReleased = true;
+    else
+        recycle(curFrame);
+}
+
+void LookaheadOnly::recycle(Frame* curFrame)
+{
+    m_outList.remove(*curFrame);
+    m_freeList.pushBack(*curFrame);
+}
@@ -0,0 +1,80 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#ifndef X265_LOOKAHEADONLY_H
+#define X265_LOOKAHEADONLY_H
+
+#include "common.h"
+#include "piclist.h"
+#include "x265.h"
+
+struct x265_lookahead {};
+
+namespace X265_NS {
+// private namespace
+
+class Frame;
+class Lookahead;
+class ThreadPool;
+
+/* A Lookahead driven by the public x265_lookahead_* API rather than by an
+ * Encoder: it owns its input frames, and its thread pool unless attached to
+ * a shared one, and hands the lowres analysis of each decided frame to the
+ * application without copying */
+class LookaheadOnly : public x265_lookahead
+{
+public:
+
+    x265_param*  m_param;
+    Lookahead*   m_lookahead;
+    ThreadPool*  m_pool;
+    bool         m_bSharedPool;  // m_pool is param->sharedThreadPool
+    PicList      m_outList;      // pulled frames, not yet recycled
+    PicList      m_freeList;     // released frames, ready for new input
+    int          m_pocLast;
+    int          m_padX;         // conformance padding of the input pictures
+    int          m_padY;
+    bool         m_bFlushed;
+    bool         m_aborted;
+
+    /* the last non-B frame pulled may still be the reference (m_lastNonB) of
+     * the next slicetype decision, its release is deferred until a later
+     * non-B frame is pulled */
+    Frame*       m_lastRef;
+    bool         m_bLastRefReleased;
+
+    LookaheadOnly();
+
+    bool create(x265_param* param);
+    void destroy();
+
+    int  push(const x265_picture* pic);
+    int  pull(x265_lookahead_frame* out);
+    void release(x265_lookahead_frame* frame);
+
+protected:
+
+    Frame* allocFrame(const x265_picture& pic);
+    void   recycle(Frame* frame);
+};
+}
+
+#endif // ifndef X265_LOOKAHEADONLY_H
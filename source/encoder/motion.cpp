@@ -25,6 +25,7 @@
 #include "common.h"
 #include "primitives.h"
 #include "lowres.h"
+#include "framedata.h"
 #include "motion.h"
 #include "x265.h"
 
@@ -174,6 +175,7 @@ void MotionEstimate::setSourcePU(pixel *fencY, intptr_t stride, intptr_t offset,
 
 
     blockwidth = pwidth;
+    blockheight = pheight;
     blockOffset = offset;
     absPartIdx = ctuAddr = -1;
 
@@ -211,6 +213,7 @@ void MotionEstimate::setSourcePU(const Yuv& srcFencYuv, int _ctuAddr, int cuPart
     ctuAddr = _ctuAddr;
     absPartIdx = cuPartIdx + puPartIdx;
     blockwidth = pwidth;
+    blockheight = pheight;
     blockOffset = 0;
 
     /* copy PU from CU Yuv */
@@ -1564,8 +1567,20 @@ int MotionEstimate::subpelCompare(ReferencePlanes *ref, const MV& qmv, pixelcmp_
 
     ALIGN_VAR_32(pixel, subpelbuf[MAX_CU_SIZE * MAX_CU_SIZE]);
     
+    const pixel* sref = NULL;
+    if ((yFrac | xFrac) && ref->subpel && ref->subpel->plane[(yFrac << 2) | xFrac])
+    {
+        /* use the shared sub-pel plane if its rows have been interpolated */
+        int blockY = (int)(blockOffset / refStride);
+        int blockX = (int)(blockOffset - blockY * refStride);
+        if (ref->subpel->isReady(blockX + (qmv.x >> 2), blockY + (qmv.y >> 2), blockwidth, blockheight))
+            sref = ref->subpel->plane[(yFrac << 2) | xFrac] + blockOffset + (qmv.x >> 2) + (qmv.y >> 2) * refStride;
+    }
+
     if (!(yFrac | xFrac))
         cost = cmp(fencPUYuv.m_buf[0], fencStride, fref, refStride);
+    else if (sref)
+        cost = cmp(fencPUYuv.m_buf[0], fencStride, sref, refStride);
     else
     {
         /* we are taking a short-cut here if the reference is weighted. To be
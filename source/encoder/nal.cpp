@@ -23,6 +23,7 @@
 *****************************************************************************/
 
 #include "common.h"
+#include "primitives.h"
 #include "bitstream.h"
 #include "nal.h"
 
@@ -122,17 +123,17 @@ void NALList::serialize(NalUnitType nalUnitType, const Bitstream& bs)
      *  - 0x000000
      *  - 0x000001
      *  - 0x000002 */
-    for (uint32_t i = 0; i < payloadSize; i++)
+    if (nalUnitType == NAL_UNIT_UNSPECIFIED)
     {
-        if (i > 2 && !out[bytes - 2] && !out[bytes - 3] && out[bytes - 1] <= 0x03 && nalUnitType != NAL_UNIT_UNSPECIFIED)
-        {
-            /* inject 0x03 to prevent emulating a start code */
-            out[bytes] = out[bytes - 1];
-            out[bytes - 1] = 0x03;
-            bytes++;
-        }
-
-        out[bytes++] = bpayload[i];
+        memcpy(out + bytes, bpayload, payloadSize);
+        bytes += payloadSize;
+    }
+    else if (payloadSize)
+    {
+        /* the NAL header never ends in 0x00, so the escaping starts with no
+         * zero run. The final payload byte is copied unescaped */
+        bytes += primitives.nalEscape(out + bytes, bpayload, payloadSize - 1, 0);
+        out[bytes++] = bpayload[payloadSize - 1];
     }
 
     X265_CHECK(bytes <= 4 + 2 + payloadSize + (payloadSize >> 1), "NAL buffer overflow\n");
@@ -208,16 +209,12 @@ uint32_t NALList::serializeSubstreams(uint32_t* streamSizeBytes, uint32_t stream
 
         if (inBytes)
         {
-            for (uint32_t i = 0; i < inSize; i++)
-            {
-                if (bytes >= 2 && !out[bytes - 2] && !out[bytes - 1] && inBytes[i] <= 0x03)
-                {
-                    /* inject 0x03 to prevent emulating a start code */
-                    out[bytes++] = 3;
-                }
-
-                out[bytes++] = inBytes[i];
-            }
+            /* the zero run continues across sub-stream boundaries */
+            uint32_t zeros = 0;
+            if (bytes >= 1 && !out[bytes - 1])
+                zeros = (bytes >= 2 && !out[bytes - 2]) ? 2 : 1;
+
+            bytes += primitives.nalEscape(out + bytes, inBytes, inSize, zeros);
         }
 
         if (s < streamCount - 1)
@@ -166,6 +166,7 @@ RateControl::RateControl(x265_param& p)
     m_startEndOrder.set(0);
     m_bTerminated = false;
     m_finalFrameCount = 0;
+    m_finalOrdinal = 0;
     m_numEntries = 0;
     m_isSceneTransition = false;
     m_lastPredictorReset = 0;
@@ -205,6 +206,7 @@ RateControl::RateControl(x265_param& p)
     m_lastAbrResetPoc = -1;
     m_statFileOut = NULL;
     m_cutreeStatFileOut = m_cutreeStatFileIn = NULL;
+    m_binStatFileOut = NULL;
     m_rce2Pass = NULL;
     m_encOrder = NULL;
     m_lastBsliceSatdCost = 0;
@@ -395,7 +397,7 @@ bool RateControl::init(const SPS& sps)
 
     /* Frame Predictors used in vbv */
     initFramePredictors();
-    if (!m_statFileOut && (m_param->rc.bStatWrite || m_param->rc.bStatRead))
+    if (!m_statFileOut && !m_binStatFileOut && (m_param->rc.bStatWrite || m_param->rc.bStatRead))
     {
         /* If the user hasn't defined the stat filename, use the default value */
         const char *fileName = m_param->rc.statFileName;
@@ -405,36 +407,61 @@ bool RateControl::init(const SPS& sps)
         if (m_param->rc.bStatRead)
         {
             m_expectedBitsSum = 0;
-            char *p, *statsIn, *statsBuf;
-            /* read 1st pass stats */
-            statsIn = statsBuf = x265_slurp_file(fileName);
-            if (!statsBuf)
-                return false;
-            if (m_param->rc.cuTree)
-            {
-                char *tmpFile = strcatFilename(fileName, ".cutree");
-                if (!tmpFile)
+            char *p, *statsIn, *statsBuf, *opts;
+            int ncu = m_param->rc.qgSize == 8 ? m_ncu * 4 : m_ncu;
+            FILE* statFileIn = x265_fopen(fileName, "rb");
+            if (statFileIn && StatsFile::isBinary(statFileIn))
+            {
+                /* binary stats, the mapping outlives the file handle */
+                bool bOpen = m_binStatsIn.open(statFileIn);
+                fclose(statFileIn);
+                if (!bOpen)
+                {
+                    x265_log_file(m_param, X265_LOG_ERROR, "stats file %s is damaged\n", fileName);
                     return false;
-                m_cutreeStatFileIn = x265_fopen(tmpFile, "rb");
-                X265_FREE(tmpFile);
-                if (!m_cutreeStatFileIn)
+                }
+                if (m_param->rc.cuTree && m_binStatsIn.cuTreeSize() != ncu)
                 {
-                    x265_log_file(m_param, X265_LOG_ERROR, "can't open stats file %s.cutree\n", fileName);
+                    x265_log(m_param, X265_LOG_ERROR, "CU-tree stats of the 1st pass are missing or of a different size (%d vs %d)\n",
+                             m_binStatsIn.cuTreeSize(), ncu);
                     return false;
                 }
+                size_t optsSize = strlen(m_binStatsIn.options()) + 1;
+                statsIn = NULL;
+                statsBuf = opts = X265_MALLOC(char, optsSize);
+                if (!statsBuf)
+                    return false;
+                memcpy(statsBuf, m_binStatsIn.options(), optsSize);
             }
-
-            /* check whether 1st pass options were compatible with current options */
-            if (strncmp(statsBuf, "#options:", 9))
-            {
-                x265_log(m_param, X265_LOG_ERROR,"options list in stats file not valid\n");
-                return false;
-            }
+            else
             {
-                int i, j, m;
-                uint32_t k , l;
-                bool bErr = false;
-                char *opts = statsBuf;
+                if (statFileIn)
+                    fclose(statFileIn);
+                /* read 1st pass stats */
+                statsIn = statsBuf = x265_slurp_file(fileName);
+                if (!statsBuf)
+                    return false;
+                if (m_param->rc.cuTree)
+                {
+                    char *tmpFile = strcatFilename(fileName, ".cutree");
+                    if (!tmpFile)
+                        return false;
+                    m_cutreeStatFileIn = x265_fopen(tmpFile, "rb");
+                    X265_FREE(tmpFile);
+                    if (!m_cutreeStatFileIn)
+                    {
+                        x265_log_file(m_param, X265_LOG_ERROR, "can't open stats file %s.cutree\n", fileName);
+                        return false;
+                    }
+                }
+
+                /* check whether 1st pass options were compatible with current options */
+                if (strncmp(statsBuf, "#options:", 9))
+                {
+                    x265_log(m_param, X265_LOG_ERROR,"options list in stats file not valid\n");
+                    return false;
+                }
+                opts = statsBuf;
                 statsIn = strchr(statsBuf, '\n');
                 if (!statsIn)
                 {
@@ -443,6 +470,11 @@ bool RateControl::init(const SPS& sps)
                 }
                 *statsIn = '\0';
                 statsIn++;
+            }
+            {
+                int i, j, m;
+                uint32_t k , l;
+                bool bErr = false;
                 if ((p = strstr(opts, " input-res=")) == 0 || sscanf(p, " input-res=%dx%d", &i, &j) != 2)
                 {
                     x265_log(m_param, X265_LOG_ERROR, "Resolution specified in stats file not valid\n");
@@ -515,10 +547,15 @@ bool RateControl::init(const SPS& sps)
                     m_param->lookaheadDepth = i;
             }
             /* find number of pics */
-            p = statsIn;
             int numEntries;
-            for (numEntries = -1; p; numEntries++)
-                p = strchr(p + 1, ';');
+            if (m_binStatsIn.isOpen())
+                numEntries = m_binStatsIn.numEntries();
+            else
+            {
+                p = statsIn;
+                for (numEntries = -1; p; numEntries++)
+                    p = strchr(p + 1, ';');
+            }
             if (!numEntries)
             {
                 x265_log(m_param, X265_LOG_ERROR, "empty stats file\n");
@@ -571,37 +608,84 @@ bool RateControl::init(const SPS& sps)
                 int e;
                 char *next;
                 double qpRc, qpAq, qNoVbv, qRceq;
-                next = strstr(p, ";");
-                if (next)
-                    *next++ = 0;
-                e = sscanf(p, " in:%d out:%d", &frameNumber, &encodeOrder);
-                if (frameNumber < 0 || frameNumber >= m_numEntries)
-                {
-                    x265_log(m_param, X265_LOG_ERROR, "bad frame number (%d) at stats line %d\n", frameNumber, i);
-                    return false;
-                }
-                rce = &m_rce2Pass[encodeOrder];
-                m_encOrder[frameNumber] = encodeOrder;
-                if (!m_param->bMultiPassOptRPS)
+                if (m_binStatsIn.isOpen())
                 {
-                    e += sscanf(p, " in:%*d out:%*d type:%c q:%lf q-aq:%lf q-noVbv:%lf q-Rceq:%lf tex:%d mv:%d misc:%d icu:%lf pcu:%lf scu:%lf",
-                        &picType, &qpRc, &qpAq, &qNoVbv, &qRceq, &rce->coeffBits,
-                        &rce->mvBits, &rce->miscBits, &rce->iCuCount, &rce->pCuCount,
-                        &rce->skipCuCount);
+                    const StatsFile::Entry& entry = m_binStatsIn.entry(i);
+                    frameNumber = entry.poc;
+                    encodeOrder = entry.encodeOrder;
+                    if (frameNumber < 0 || frameNumber >= m_numEntries)
+                    {
+                        x265_log(m_param, X265_LOG_ERROR, "bad frame number (%d) at stats entry %d\n", frameNumber, i);
+                        return false;
+                    }
+                    rce = &m_rce2Pass[encodeOrder];
+                    m_encOrder[frameNumber] = encodeOrder;
+                    picType = entry.type;
+                    qpRc = entry.qpRc;
+                    qpAq = entry.qpAq;
+                    qNoVbv = entry.qpNoVbv;
+                    qRceq = entry.qRceq;
+                    rce->coeffBits = entry.coeffBits;
+                    rce->mvBits = entry.mvBits;
+                    rce->miscBits = entry.miscBits;
+                    rce->iCuCount = entry.iCuCount;
+                    rce->pCuCount = entry.pCuCount;
+                    rce->skipCuCount = entry.skipCuCount;
+                    if (m_param->bMultiPassOptRPS)
+                    {
+                        int num = entry.numberOfPictures;
+                        if (num < 0 || num > MAX_NUM_REF_PICS)
+                        {
+                            x265_log(m_param, X265_LOG_ERROR, "bad RPS at stats entry %d\n", i);
+                            return false;
+                        }
+                        rce->rpsData.numberOfPictures = num;
+                        rce->rpsData.numberOfNegativePictures = entry.numberOfNegativePictures;
+                        rce->rpsData.numberOfPositivePictures = entry.numberOfPositivePictures;
+                        for (int j = 0; j < num; j++)
+                        {
+                            rce->rpsData.deltaPOC[j] = entry.deltaPOC[j];
+                            rce->rpsData.bUsed[j] = !!entry.bUsed[j];
+                        }
+                        rce->rpsIdx = -1;
+                    }
+                    e = 16;
+                    next = NULL;
                 }
                 else
                 {
-                    char deltaPOC[128];
-                    char bUsed[40];
-                    memset(deltaPOC, 0, sizeof(deltaPOC));
-                    memset(bUsed, 0, sizeof(bUsed));
-                    e += sscanf(p, " in:%*d out:%*d type:%c q:%lf q-aq:%lf q-noVbv:%lf q-Rceq:%lf tex:%d mv:%d misc:%d icu:%lf pcu:%lf scu:%lf nump:%d numnegp:%d numposp:%d deltapoc:%s bused:%s",
-                        &picType, &qpRc, &qpAq, &qNoVbv, &qRceq, &rce->coeffBits,
-                        &rce->mvBits, &rce->miscBits, &rce->iCuCount, &rce->pCuCount,
-                        &rce->skipCuCount, &rce->rpsData.numberOfPictures, &rce->rpsData.numberOfNegativePictures, &rce->rpsData.numberOfPositivePictures, deltaPOC, bUsed);
-                    splitdeltaPOC(deltaPOC, rce);
-                    splitbUsed(bUsed, rce);
-                    rce->rpsIdx = -1;
+                    next = strstr(p, ";");
+                    if (next)
+                        *next++ = 0;
+                    e = sscanf(p, " in:%d out:%d", &frameNumber, &encodeOrder);
+                    if (frameNumber < 0 || frameNumber >= m_numEntries)
+                    {
+                        x265_log(m_param, X265_LOG_ERROR, "bad frame number (%d) at stats line %d\n", frameNumber, i);
+                        return false;
+                    }
+                    rce = &m_rce2Pass[encodeOrder];
+                    m_encOrder[frameNumber] = encodeOrder;
+                    if (!m_param->bMultiPassOptRPS)
+                    {
+                        e += sscanf(p, " in:%*d out:%*d type:%c q:%lf q-aq:%lf q-noVbv:%lf q-Rceq:%lf tex:%d mv:%d misc:%d icu:%lf pcu:%lf scu:%lf",
+                            &picType, &qpRc, &qpAq, &qNoVbv, &qRceq, &rce->coeffBits,
+                            &rce->mvBits, &rce->miscBits, &rce->iCuCount, &rce->pCuCount,
+                            &rce->skipCuCount);
+                    }
+                    else
+                    {
+                        char deltaPOC[128];
+                        char bUsed[40];
+                        memset(deltaPOC, 0, sizeof(deltaPOC));
+                        memset(bUsed, 0, sizeof(bUsed));
+                        e += sscanf(p, " in:%*d out:%*d type:%c q:%lf q-aq:%lf q-noVbv:%lf q-Rceq:%lf tex:%d mv:%d misc:%d icu:%lf pcu:%lf scu:%lf nump:%d numnegp:%d numposp:%d deltapoc:%s bused:%s",
+                            &picType, &qpRc, &qpAq, &qNoVbv, &qRceq, &rce->coeffBits,
+                            &rce->mvBits, &rce->miscBits, &rce->iCuCount, &rce->pCuCount,
+                            &rce->skipCuCount, &rce->rpsData.numberOfPictures, &rce->rpsData.numberOfNegativePictures, &rce->rpsData.numberOfPositivePictures, deltaPOC, bUsed);
+                        splitdeltaPOC(deltaPOC, rce);
+                        splitbUsed(bUsed, rce);
+                        rce->rpsIdx = -1;
+                    }
                 }
                 rce->keptAsRef = true;
                 rce->isIdr = false;
@@ -645,21 +729,48 @@ bool RateControl::init(const SPS& sps)
         if (m_param->rc.bStatWrite)
         {
             char *p, *statFileTmpname;
+            bool bBinary = m_param->statsFormat == 2;
             statFileTmpname = strcatFilename(fileName, ".temp");
             if (!statFileTmpname)
                 return false;
-            m_statFileOut = x265_fopen(statFileTmpname, "wb");
+            if (bBinary)
+                m_binStatFileOut = x265_fopen(statFileTmpname, "wb");
+            else
+                m_statFileOut = x265_fopen(statFileTmpname, "wb");
             X265_FREE(statFileTmpname);
-            if (!m_statFileOut)
+            if (!m_statFileOut && !m_binStatFileOut)
             {
                 x265_log_file(m_param, X265_LOG_ERROR, "can't open stats file %s.temp\n", fileName);
                 return false;
             }
+            if (bBinary && m_param->bStatsTextDump)
+            {
+                char *dumpFileName = strcatFilename(fileName, ".txt");
+                if (!dumpFileName)
+                    return false;
+                m_statFileOut = x265_fopen(dumpFileName, "wb");
+                X265_FREE(dumpFileName);
+                if (!m_statFileOut)
+                {
+                    x265_log_file(m_param, X265_LOG_ERROR, "can't open stats dump file %s.txt\n", fileName);
+                    return false;
+                }
+            }
             p = x265_param2string(m_param, sps.conformanceWindow.rightOffset, sps.conformanceWindow.bottomOffset);
-            if (p)
+            if (!p)
+                return false;
+            if (m_statFileOut)
                 fprintf(m_statFileOut, "#options: %s\n", p);
+            if (m_binStatFileOut && !m_binStatsOut.create(m_binStatFileOut, p, m_param->rc.cuTree ? (m_param->rc.qgSize == 8 ? m_ncu * 4 : m_ncu) : 0))
+            {
+                X265_FREE(p);
+                x265_log_file(m_param, X265_LOG_ERROR, "can't write stats file %s.temp\n", fileName);
+                return false;
+            }
             X265_FREE(p);
-            if (m_param->rc.cuTree && !m_param->rc.bStatRead)
+            /* binary stats hold the cuTree offsets, the text stats of a later pass
+             * reuse the .cutree file of the first pass unless there is none */
+            if (m_param->rc.cuTree && !bBinary && (!m_param->rc.bStatRead || m_binStatsIn.isOpen()))
             {
                 statFileTmpname = strcatFilename(fileName, ".cutree.temp");
                 if (!statFileTmpname)
@@ -673,7 +784,8 @@ bool RateControl::init(const SPS& sps)
                 }
             }
         }
-        if (m_param->rc.cuTree)
+        /* binary stats are read in place */
+        if (m_param->rc.cuTree && !m_binStatsIn.isOpen())
         {
             if (m_param->rc.qgSize == 8)
             {
@@ -1223,7 +1335,7 @@ void RateControl::initFramePredictors()
 int RateControl::rateControlStart(Frame* curFrame, RateControlEntry* rce, Encoder* enc)
 {
     int orderValue = m_startEndOrder.get();
-    int startOrdinal = rce->encodeOrder * 2;
+    int startOrdinal = rce->startOrdinal;
 
     while (orderValue < startOrdinal && !m_bTerminated)
         orderValue = m_startEndOrder.waitForChange(orderValue);
@@ -1592,6 +1704,16 @@ bool RateControl::cuTreeReadFor2Pass(Frame* frame)
     {
         /* TODO: We don't need pre-lookahead to measure AQ offsets, but there is currently
          * no way to signal this */
+        if (m_binStatsIn.isOpen())
+        {
+            const int16_t* offsets = m_binStatsIn.cuTree(index);
+            if (!offsets)
+                goto fail;
+            memcpy(frame->m_lowres.qpCuTreeOffset, offsets, ncu * sizeof(int16_t));
+            for (int i = 0; i < ncu; i++)
+                frame->m_lowres.invQscaleFactor[i] = x265_exp2fix8(frame->m_lowres.qpCuTreeOffset[i]);
+            return true;
+        }
         uint8_t type;
         if (m_cuTreeStats.qpBufPos < 0)
         {
@@ -1612,7 +1734,8 @@ bool RateControl::cuTreeReadFor2Pass(Frame* frame)
             }
             while(type != sliceTypeActual);
         }
-        primitives.fix8Unpack(frame->m_lowres.qpCuTreeOffset, m_cuTreeStats.qpBuffer[m_cuTreeStats.qpBufPos], ncu);
+        /* the stats file holds the Q8.8 offsets as they are kept in Lowres */
+        memcpy(frame->m_lowres.qpCuTreeOffset, m_cuTreeStats.qpBuffer[m_cuTreeStats.qpBufPos], ncu * sizeof(int16_t));
         for (int i = 0; i < ncu; i++)
             frame->m_lowres.invQscaleFactor[i] = x265_exp2fix8(frame->m_lowres.qpCuTreeOffset[i]);
         m_cuTreeStats.qpBufPos--;
@@ -2090,7 +2213,7 @@ void RateControl::rateControlUpdateStats(RateControlEntry* rce)
     {
         m_startEndOrder.incr();
 
-        if (rce->encodeOrder < m_param->frameNumThreads - 1)
+        if (rce->bFakeEnd)
             m_startEndOrder.incr(); // faked rateControlEnd calls for negative frames
     }
 }
@@ -2653,13 +2776,13 @@ int RateControl::updateVbv(int64_t bits, RateControlEntry* rce)
 int RateControl::rateControlEnd(Frame* curFrame, int64_t bits, RateControlEntry* rce, int *filler)
 {
     int orderValue = m_startEndOrder.get();
-    int endOrdinal = (rce->encodeOrder + m_param->frameNumThreads) * 2 - 1;
+    int endOrdinal = rce->endOrdinal;
     while (orderValue < endOrdinal && !m_bTerminated)
     {
         /* no more frames are being encoded, so fake the start event if we would
          * have blocked on it. Note that this does not enforce rateControlEnd()
          * ordering during flush, but this has no impact on the outputs */
-        if (m_finalFrameCount && orderValue >= 2 * m_finalFrameCount)
+        if (m_finalFrameCount && orderValue >= m_finalOrdinal)
             break;
         orderValue = m_startEndOrder.waitForChange(orderValue);
     }
@@ -2835,7 +2958,41 @@ int RateControl::writeRateControlFrameStats(Frame* curFrame, RateControlEntry* r
     char cType = rce->sliceType == I_SLICE ? (curFrame->m_lowres.sliceType == X265_TYPE_IDR ? 'I' : 'i')
         : rce->sliceType == P_SLICE ? 'P'
         : IS_REFERENCED(curFrame) ? 'B' : 'b';
-    
+
+    if (m_binStatFileOut)
+    {
+        const RPS& rps = curFrame->m_encData->m_slice->m_rps;
+        StatsFile::Entry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.poc = rce->poc;
+        entry.encodeOrder = rce->encodeOrder;
+        entry.type = cType;
+        entry.qpRc = curEncData.m_avgQpRc;
+        entry.qpAq = curEncData.m_avgQpAq;
+        entry.qpNoVbv = rce->qpNoVbv;
+        entry.qRceq = rce->qRceq;
+        entry.coeffBits = curEncData.m_frameStats.coeffBits;
+        entry.mvBits = curEncData.m_frameStats.mvBits;
+        entry.miscBits = curEncData.m_frameStats.miscBits;
+        entry.iCuCount = curEncData.m_frameStats.percent8x8Intra * m_ncu;
+        entry.pCuCount = curEncData.m_frameStats.percent8x8Inter * m_ncu;
+        entry.skipCuCount = curEncData.m_frameStats.percent8x8Skip * m_ncu;
+        entry.numberOfPictures = rps.numberOfPictures;
+        entry.numberOfNegativePictures = rps.numberOfNegativePictures;
+        entry.numberOfPositivePictures = rps.numberOfPositivePictures;
+        for (int i = 0; i < rps.numberOfPictures; i++)
+        {
+            entry.deltaPOC[i] = rps.deltaPOC[i];
+            entry.bUsed[i] = rps.bUsed[i];
+        }
+        /* a later pass copies the cuTree offsets it read from the previous stats */
+        const int16_t* cuTree = m_param->rc.cuTree && IS_REFERENCED(curFrame) ? curFrame->m_lowres.qpCuTreeOffset : NULL;
+        if (!m_binStatsOut.write(entry, cuTree))
+            goto writeFailure;
+    }
+    if (!m_statFileOut)
+        return 0;
+
     if (!curEncData.m_param->bMultiPassOptRPS)
     {
         if (fprintf(m_statFileOut,
@@ -2885,14 +3042,13 @@ int RateControl::writeRateControlFrameStats(Frame* curFrame, RateControlEntry* r
             deltaPOC, bUsed) < 0)
             goto writeFailure;
     }
-    /* Don't re-write the data in multi-pass mode. */
-    if (m_param->rc.cuTree && IS_REFERENCED(curFrame) && !m_param->rc.bStatRead)
+    /* Don't re-write the data in multi-pass mode, unless it came from binary stats. */
+    if (m_cutreeStatFileOut && IS_REFERENCED(curFrame))
     {
         uint8_t sliceType = (uint8_t)rce->sliceType;
-        primitives.fix8Pack(m_cuTreeStats.qpBuffer[0], curFrame->m_lowres.qpCuTreeOffset, ncu);
         if (fwrite(&sliceType, 1, 1, m_cutreeStatFileOut) < 1)
             goto writeFailure;
-        if (fwrite(m_cuTreeStats.qpBuffer[0], sizeof(uint16_t), ncu, m_cutreeStatFileOut) < (size_t)ncu)
+        if (fwrite(curFrame->m_lowres.qpCuTreeOffset, sizeof(int16_t), ncu, m_cutreeStatFileOut) < (size_t)ncu)
             goto writeFailure;
     }
     return 0;
@@ -2907,9 +3063,10 @@ int RateControl::writeRateControlFrameStats(Frame* curFrame, RateControlEntry* r
 
 /* called when the encoder is flushing, and thus the final frame count is
  * unambiguously known */
-void RateControl::setFinalFrameCount(int count)
+void RateControl::setFinalFrameCount(int count, int finalOrdinal)
 {
     m_finalFrameCount = count;
+    m_finalOrdinal = finalOrdinal;
     /* unblock waiting threads */
     m_startEndOrder.poke();
 }
@@ -2930,9 +3087,26 @@ void RateControl::destroy()
     if (!fileName)
         fileName = s_defaultStatFileName;
 
-    if (m_statFileOut)
+    /* a multi-pass encode reads and rewrites the same stats files, the
+     * mapping and handles of the previous pass must be gone before they are
+     * replaced (Windows refuses to unlink or rename over a mapped file) */
+    if (m_cutreeStatFileIn)
+        fclose(m_cutreeStatFileIn);
+    m_binStatsIn.close();
+
+    if (m_binStatFileOut)
     {
+        if (!m_binStatsOut.finish())
+            x265_log_file(m_param, X265_LOG_ERROR, "failed to complete output stats file \"%s.temp\"\n", fileName);
+        m_binStatsOut.close();
+        fclose(m_binStatFileOut);
+        if (m_statFileOut)
+            fclose(m_statFileOut);   /* text dump, written in place */
+    }
+    else if (m_statFileOut)
         fclose(m_statFileOut);
+    if (m_statFileOut || m_binStatFileOut)
+    {
         char *tmpFileName = strcatFilename(fileName, ".temp");
         int bError = 1;
         if (tmpFileName)
@@ -2966,9 +3140,6 @@ void RateControl::destroy()
         X265_FREE(newFileName);
     }
 
-    if (m_cutreeStatFileIn)
-        fclose(m_cutreeStatFileIn);
-
     X265_FREE(m_rce2Pass);
     X265_FREE(m_encOrder);
     for (int i = 0; i < 2; i++)
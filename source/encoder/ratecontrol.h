@@ -28,6 +28,7 @@
 
 #include "common.h"
 #include "sei.h"
+#include "statsfile.h"
 
 namespace X265_NS {
 // encoder namespace
@@ -92,6 +93,9 @@ struct RateControlEntry
     int     bframes;
     int     poc;
     int     encodeOrder;
+    int     startOrdinal;  /* m_startEndOrder value at which rateControlStart may proceed */
+    int     endOrdinal;    /* m_startEndOrder value at which rateControlEnd may proceed */
+    bool    bFakeEnd;      /* next frame goes to a frame encoder with no prior frame */
     bool    bLastMiniGopBFrame;
     bool    isActive;
     double  amortizeFrames;
@@ -203,9 +207,12 @@ public:
      * rceEnd    10
      * rceStart  12
      * rceUpdate 12
-     * rceEnd    11 */
+     * rceEnd    11
+     * The ordinals of each frame are assigned by the Encoder as it dispatches
+     * frames, since the number of active frame encoders may change */
     ThreadSafeInteger m_startEndOrder;
     int     m_finalFrameCount;   /* set when encoder begins flushing */
+    int     m_finalOrdinal;      /* m_startEndOrder value once all frames have started */
     bool    m_bTerminated;       /* set true when encoder is closing */
 
     /* hrd stuff */
@@ -220,9 +227,12 @@ public:
     int     m_numEntries;
     int     m_start;
     int     m_reencode;
-    FILE*   m_statFileOut;
+    FILE*   m_statFileOut;       /* text stats, or the text dump of stats-format 2 */
     FILE*   m_cutreeStatFileOut;
     FILE*   m_cutreeStatFileIn;
+    FILE*   m_binStatFileOut;
+    StatsFile m_binStatsOut;     /* stats-format 2 output */
+    StatsFile m_binStatsIn;      /* mapped binary stats of the previous pass */
     double  m_lastAccumPNorm;
     double  m_expectedBitsSum;   /* sum of qscale2bits after rceq, ratefactor, and overflow, only includes finished frames */
     int64_t m_predictedBits;
@@ -240,7 +250,7 @@ public:
     void initHRD(SPS& sps);
     void reconfigureRC();
 
-    void setFinalFrameCount(int count);
+    void setFinalFrameCount(int count, int finalOrdinal);
     void terminate();          /* un-block all waiting functions so encoder may close */
     void destroy();
 
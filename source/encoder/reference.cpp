@@ -27,6 +27,7 @@
 #include "primitives.h"
 #include "slice.h"
 #include "picyuv.h"
+#include "framedata.h"
 
 #include "reference.h"
 
@@ -48,7 +49,7 @@ MotionReference::~MotionReference()
     X265_FREE(weightBuffer[2]);
 }
 
-int MotionReference::init(PicYuv* recPic, WeightParam *wp, const x265_param& p)
+int MotionReference::init(PicYuv* recPic, WeightParam *wp, const x265_param& p, SubpelPlanes* subpelPlanes)
 {
     reconPic = recPic;
     lumaStride = recPic->m_stride;
@@ -113,6 +114,9 @@ int MotionReference::init(PicYuv* recPic, WeightParam *wp, const x265_param& p)
         isWeighted = true;
     }
 
+    /* the shared sub-pel planes are interpolated from the unweighted picture */
+    subpel = subpelPlanes && subpelPlanes->bActive && fpelPlane[0] == recPic->m_picOrg[0] ? subpelPlanes : NULL;
+
     return 0;
 }
 
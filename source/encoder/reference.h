@@ -34,6 +34,7 @@ namespace X265_NS {
 // private x265 namespace
 
 struct WeightParam;
+struct SubpelPlanes;
 
 class MotionReference : public ReferencePlanes
 {
@@ -41,7 +42,7 @@ public:
 
     MotionReference();
     ~MotionReference();
-    int  init(PicYuv*, WeightParam* wp, const x265_param& p);
+    int  init(PicYuv*, WeightParam* wp, const x265_param& p, SubpelPlanes* subpelPlanes);
     void applyWeight(uint32_t finishedRows, uint32_t maxNumRows, uint32_t maxNumRowsInSlice, uint32_t sliceId);
 
     pixel*      weightBuffer[3];
@@ -83,6 +83,34 @@ inline uint32_t acEnergyPlane(Frame *curFrame, pixel* src, intptr_t srcStride, i
     }
 }
 
+/* Q8.8 QP offset of a lowres CU when the offsets are kept per 8x8 quant
+ * group, the mean of the four groups it covers */
+inline int qpOffset8x8(const int16_t* qpOffsets, intptr_t stride)
+{
+    return (qpOffsets[0] + qpOffsets[1] + qpOffsets[stride] + qpOffsets[stride + 1] + 2) >> 2;
+}
+
+/* Sum of the lowres costs of CUs [cuStart, cuEnd) of row cuy weighted by
+ * their QP offsets */
+int64_t weightedRowCost(const uint16_t* costs, const int16_t* qpOffsets, int widthInCU, int cuy, int cuStart, int cuEnd, bool bQgSize8)
+{
+    costs += cuy * widthInCU;
+    if (!bQgSize8)
+        return primitives.cutreeWeightCost(costs + cuStart, qpOffsets + cuy * widthInCU + cuStart, cuEnd - cuStart);
+
+    const int16_t* qpRow = qpOffsets + cuy * widthInCU * 4;
+    ALIGN_VAR_16(int16_t, qp[64]);
+    int64_t cost = 0;
+    for (int cux = cuStart; cux < cuEnd; cux += 64)
+    {
+        int count = X265_MIN(64, cuEnd - cux);
+        for (int i = 0; i < count; i++)
+            qp[i] = (int16_t)qpOffset8x8(qpRow + (cux + i) * 2, widthInCU * 2);
+        cost += primitives.cutreeWeightCost(costs + cux, qp, count);
+    }
+    return cost;
+}
+
 } // end anonymous namespace
 
 /* Find the total AC energy of each block in all planes */
@@ -138,9 +166,9 @@ void LookaheadTLD::xPreanalyzeQp(Frame* curFrame)
         PicQPAdaptationLayer* pcAQLayer = &curFrame->m_lowres.pAQLayer[d];
         const uint32_t aqPartWidth = pcAQLayer->aqPartWidth;
         const uint32_t aqPartHeight = pcAQLayer->aqPartHeight;
-        double* pcAQU = pcAQLayer->dActivity;
-        double* pcQP = pcAQLayer->dQpOffset;
-        double* pcCuTree = pcAQLayer->dCuTreeOffset;
+        float* pcAQU = pcAQLayer->dActivity;
+        int16_t* pcQP = pcAQLayer->dQpOffset;
+        int16_t* pcCuTree = pcAQLayer->dCuTreeOffset;
 
         for (uint32_t y = 0; y < height; y += aqPartHeight)
         {
@@ -152,8 +180,8 @@ void LookaheadTLD::xPreanalyzeQp(Frame* curFrame)
 
                 double dNormAct = (dMaxQScale*dCUAct + dAvgAct) / (dCUAct + dMaxQScale*dAvgAct);
                 double dQpOffset = (X265_LOG2(dNormAct) / X265_LOG2(2.0)) * 6.0;
-                *pcQP = dQpOffset;
-                *pcCuTree = dQpOffset;
+                *pcQP = x265_qp2fix8(dQpOffset);
+                *pcCuTree = *pcQP;
             }
         }
     }
@@ -176,7 +204,7 @@ void LookaheadTLD::xPreanalyze(Frame* curFrame)
         PicQPAdaptationLayer* pQPLayer = &curFrame->m_lowres.pAQLayer[d];
         const uint32_t aqPartWidth = pQPLayer->aqPartWidth;
         const uint32_t aqPartHeight = pQPLayer->aqPartHeight;
-        double* pcAQU = pQPLayer->dActivity;
+        float* pcAQU = pQPLayer->dActivity;
 
         double dSumAct = 0.0;
         for (uint32_t y = 0; y < height; y += aqPartHeight)
@@ -241,7 +269,7 @@ void LookaheadTLD::xPreanalyze(Frame* curFrame)
                     dMinVar = 0.0;
                 }
                 double dActivity = 1.0 + dMinVar;
-                *pcAQU = dActivity;
+                *pcAQU = (float)dActivity;
                 dSumAct += dActivity;
             }
             src += stride * currAQPartHeight;
@@ -258,7 +286,7 @@ void LookaheadTLD::xPreanalyze(Frame* curFrame)
     PicQPAdaptationLayer* pQPLayer = &curFrame->m_lowres.pAQLayer[minAQDepth];
     const uint32_t aqPartWidth = pQPLayer->aqPartWidth;
     const uint32_t aqPartHeight = pQPLayer->aqPartHeight;
-    double* pcQP = pQPLayer->dQpOffset;
+    int16_t* pcQP = pQPLayer->dQpOffset;
 
     // Use new qp offset values for qpAqOffset, qpCuTreeOffset and invQscaleFactor buffer
     int blockXY = 0;
@@ -314,14 +342,14 @@ void LookaheadTLD::calcAdaptiveQuantFrame(Frame *curFrame, x265_param* param)
                 {
                     for (int cuxy = 0; cuxy < blockCount; cuxy++)
                     {
-                        curFrame->m_lowres.qpCuTreeOffset[cuxy] = curFrame->m_lowres.qpAqOffset[cuxy] = quantOffsets[cuxy];
+                        curFrame->m_lowres.qpCuTreeOffset[cuxy] = curFrame->m_lowres.qpAqOffset[cuxy] = x265_qp2fix8(quantOffsets[cuxy]);
                         curFrame->m_lowres.invQscaleFactor[cuxy] = x265_exp2fix8(curFrame->m_lowres.qpCuTreeOffset[cuxy]);
                     }
                 }
                 else
                 {
-                    memset(curFrame->m_lowres.qpCuTreeOffset, 0, blockCount * sizeof(double));
-                    memset(curFrame->m_lowres.qpAqOffset, 0, blockCount * sizeof(double));
+                    memset(curFrame->m_lowres.qpCuTreeOffset, 0, blockCount * sizeof(int16_t));
+                    memset(curFrame->m_lowres.qpAqOffset, 0, blockCount * sizeof(int16_t));
                     for (int cuxy = 0; cuxy < blockCount; cuxy++)
                         curFrame->m_lowres.invQscaleFactor[cuxy] = 256;
                 }
@@ -358,7 +386,7 @@ void LookaheadTLD::calcAdaptiveQuantFrame(Frame *curFrame, x265_param* param)
                         {
                             uint32_t energy = acEnergyCu(curFrame, blockX, blockY, param->internalCsp, param->rc.qgSize);
                             qp_adj = pow(energy * bit_depth_correction + 1, 0.1);
-                            curFrame->m_lowres.qpCuTreeOffset[blockXY] = qp_adj;
+                            aqScratch[blockXY] = (float)qp_adj;
                             avg_adj += qp_adj;
                             avg_adj_pow2 += qp_adj * qp_adj;
                             blockXY++;
@@ -380,12 +408,12 @@ void LookaheadTLD::calcAdaptiveQuantFrame(Frame *curFrame, x265_param* param)
                     {
                         if (param->rc.aqMode == X265_AQ_AUTO_VARIANCE_BIASED)
                         {
-                            qp_adj = curFrame->m_lowres.qpCuTreeOffset[blockXY];
+                            qp_adj = aqScratch[blockXY];
                             qp_adj = strength * (qp_adj - avg_adj) + bias_strength * (1.f - modeTwoConst / (qp_adj * qp_adj));
                         }
                         else if (param->rc.aqMode == X265_AQ_AUTO_VARIANCE)
                         {
-                            qp_adj = curFrame->m_lowres.qpCuTreeOffset[blockXY];
+                            qp_adj = aqScratch[blockXY];
                             qp_adj = strength * (qp_adj - avg_adj);
                         }
                         else
@@ -419,9 +447,9 @@ void LookaheadTLD::calcAdaptiveQuantFrame(Frame *curFrame, x265_param* param)
                         }
                         if (quantOffsets != NULL)
                             qp_adj += quantOffsets[blockXY];
-                        curFrame->m_lowres.qpAqOffset[blockXY] = qp_adj;
-                        curFrame->m_lowres.qpCuTreeOffset[blockXY] = qp_adj;
-                        curFrame->m_lowres.invQscaleFactor[blockXY] = x265_exp2fix8(qp_adj);
+                        curFrame->m_lowres.qpAqOffset[blockXY] = x265_qp2fix8(qp_adj);
+                        curFrame->m_lowres.qpCuTreeOffset[blockXY] = curFrame->m_lowres.qpAqOffset[blockXY];
+                        curFrame->m_lowres.invQscaleFactor[blockXY] = x265_exp2fix8(curFrame->m_lowres.qpAqOffset[blockXY]);
                         blockXY++;
                     }
                 }
@@ -761,6 +789,15 @@ Lookahead::Lookahead(x265_param *param, ThreadPool* pool)
     m_lastNonB = NULL;
     m_isSceneTransition = false;
     m_scratch  = NULL;
+    m_zeroQscale = NULL;
+    m_cuTreeAccum = NULL;
+    m_cuTreeScratch = NULL;
+    m_cuTreeRun = 0;
+    m_cuTreeHead = -1;
+    m_cuTreeEnd = -1;
+    m_cuTreeElapsedTime = 0;
+    m_countCuTree = 0;
+    m_countCuTreeIncremental = 0;
     m_tld      = NULL;
     m_filled   = false;
     m_outputSignalRequired = false;
@@ -774,6 +811,9 @@ Lookahead::Lookahead(x265_param *param, ThreadPool* pool)
     m_isFadeIn = false;
     m_fadeCount = 0;
     m_fadeStart = -1;
+    m_share = NULL;
+    m_bShareFollower = false;
+    m_shareSeq = 0;
 
     /* Allow the strength to be adjusted via qcompress, since the two concepts
      * are very similar. */
@@ -865,8 +905,31 @@ bool Lookahead::create()
     int numTLD = 1 + (m_pool ? m_pool->m_numWorkers : 0);
     m_tld = new LookaheadTLD[numTLD];
     for (int i = 0; i < numTLD; i++)
+    {
         m_tld[i].init(m_8x8Width, m_8x8Height, m_8x8Blocks);
+        if (m_param->rc.aqMode == X265_AQ_AUTO_VARIANCE || m_param->rc.aqMode == X265_AQ_AUTO_VARIANCE_BIASED)
+        {
+            /* 8x8 quant groups are a quarter of a lowres CU */
+            m_tld[i].aqScratch = X265_MALLOC(float, m_cuCount * 4);
+            if (!m_tld[i].aqScratch)
+                return false;
+        }
+    }
     m_scratch = X265_MALLOC(int, m_tld[0].widthInCU);
+    if (m_param->rc.cuTree && m_param->bCUTreeIncremental)
+    {
+        m_zeroQscale = X265_MALLOC(int32_t, m_8x8Width);
+        if (!m_zeroQscale)
+            return false;
+        memset(m_zeroQscale, 0, m_8x8Width * sizeof(int32_t));
+    }
+    if (m_param->rc.cuTree && m_pool && m_pool->m_numWorkers > 1)
+    {
+        m_cuTreeAccum = X265_MALLOC(int32_t, CUTreeGroup::MAX_TARGETS * m_cuCount);
+        m_cuTreeScratch = X265_MALLOC(int, numTLD * m_8x8Width);
+        if (!m_cuTreeAccum || !m_cuTreeScratch)
+            return false;
+    }
 
     return m_tld && m_scratch;
 }
@@ -883,6 +946,14 @@ void Lookahead::stopJobs()
         if (wait)
             m_outputSignal.wait();
     }
+    if (m_share)
+    {
+        /* a closing leader releases followers blocked on its next group */
+        if (m_bShareFollower)
+            m_share->removeFollower(*this, m_shareSeq);
+        else
+            m_share->closeLeader();
+    }
     if (m_pool && m_param->lookaheadThreads > 0)
     {
         for (int i = 0; i < m_numPools; i++)
@@ -907,9 +978,14 @@ void Lookahead::destroy()
     }
 
     X265_FREE(m_scratch);
+    X265_FREE(m_zeroQscale);
+    X265_FREE(m_cuTreeAccum);
+    X265_FREE(m_cuTreeScratch);
     delete [] m_tld;
     if (m_param->lookaheadThreads > 0)
         delete [] m_pool;
+    if (m_share)
+        m_share->release();
 }
 /* The synchronization of slicetypeDecide is managed here.  The findJob() method
  * polls the occupancy of the input queue. If the queue is
@@ -991,7 +1067,8 @@ void Lookahead::findJob(int /*workerThreadID*/)
     bool doDecide;
 
     m_inputLock.acquire();
-    if (m_inputQueue.size() >= m_fullQueueSize && !m_sliceTypeBusy && m_isActive)
+    if (m_inputQueue.size() >= m_fullQueueSize && !m_sliceTypeBusy && m_isActive &&
+        (!m_bShareFollower || m_share->isReady(m_shareSeq, m_inputQueue.size())))
         doDecide = m_sliceTypeBusy = true;
     else
         doDecide = m_helpWanted = false;
@@ -1003,7 +1080,10 @@ void Lookahead::findJob(int /*workerThreadID*/)
     ProfileLookaheadTime(m_slicetypeDecideElapsedTime, m_countSlicetypeDecide);
     ProfileScopeEvent(slicetypeDecideEV);
 
-    slicetypeDecide();
+    if (m_bShareFollower)
+        slicetypeFollow();
+    else
+        slicetypeDecide();
 
     m_inputLock.acquire();
     if (m_outputSignalRequired)
@@ -1033,19 +1113,30 @@ Frame* Lookahead::getDecidedPicture()
         if (m_param->analysisLoad && m_param->bDisableLookahead)
             return NULL;
 
-        findJob(-1); /* run slicetypeDecide() if necessary */
+        for (;;)
+        {
+            int published = m_bShareFollower ? m_share->m_numPublished : 0;
+            int updates = m_bShareFollower ? m_share->m_updates.get() : 0;
+
+            findJob(-1); /* run slicetypeDecide() if necessary */
 
-        m_inputLock.acquire();
-        bool wait = m_outputSignalRequired = m_sliceTypeBusy;
-        m_inputLock.release();
+            m_inputLock.acquire();
+            bool wait = m_outputSignalRequired = m_sliceTypeBusy;
+            bool bFull = m_inputQueue.size() >= m_fullQueueSize;
+            m_inputLock.release();
 
-        if (wait)
-            m_outputSignal.wait();
+            if (wait)
+                m_outputSignal.wait();
 
-        out = m_outputQueue.popFront();
-        if (out)
-            m_inputCount--;
-        return out;
+            out = m_outputQueue.popFront();
+            if (out)
+                m_inputCount--;
+
+            /* a follower with a full queue blocks until the leader publishes
+             * the group it is waiting for */
+            if (out || !m_bShareFollower || !bFull || !m_share->waitForGroup(m_shareSeq, published, updates))
+                return out;
+        }
     }
     else
         return NULL;
@@ -1104,7 +1195,11 @@ void Lookahead::getEstimatedPictureCost(Frame *curFrame)
     {
         X265_CHECK(curFrame->m_lowres.costEst[b - p0][p1 - b] > 0, "Slice cost not estimated\n")
 
-        if (m_param->rc.cuTree && !m_param->rc.bStatRead)
+        /* followers without VBV only have the scaled costs of their leader */
+        bool bSharedCosts = m_bShareFollower && !(m_param->rc.vbvBufferSize && m_param->rc.vbvMaxBitrate);
+        if (m_param->rc.cuTree && !m_param->rc.bStatRead && bSharedCosts && curFrame->m_lowres.costEstCuTree[b - p0][p1 - b] >= 0)
+            curFrame->m_lowres.satdCost = curFrame->m_lowres.costEstCuTree[b - p0][p1 - b];
+        else if (m_param->rc.cuTree && !m_param->rc.bStatRead && !bSharedCosts)
             /* update row satds based on cutree offsets */
             curFrame->m_lowres.satdCost = frameCostRecalculate(frames, p0, p1, b);
         else if (!m_param->analysisLoad || m_param->scaleFactor || m_param->bAnalysisType == HEVC_INFO)
@@ -1122,7 +1217,7 @@ void Lookahead::getEstimatedPictureCost(Frame *curFrame)
             uint32_t scale = m_param->maxCUSize / (2 * X265_LOWRES_CU_SIZE);
             uint32_t numCuInHeight = (m_param->sourceHeight + m_param->maxCUSize - 1) / m_param->maxCUSize;
             uint32_t widthInLowresCu = (uint32_t)m_8x8Width, heightInLowresCu = (uint32_t)m_8x8Height;
-            double *qp_offset = 0;
+            int16_t *qp_offset = 0;
             /* Factor in qpoffsets based on Aq/Cutree in CU costs */
             if (m_param->rc.aqMode || m_param->bAQMotion)
                 qp_offset = (frames[b]->sliceType == X265_TYPE_B || !m_param->rc.cuTree) ? frames[b]->qpAqOffset : frames[b]->qpCuTreeOffset;
@@ -1140,12 +1235,9 @@ void Lookahead::getEstimatedPictureCost(Frame *curFrame)
                         uint16_t lowresCuCost = curFrame->m_lowres.lowresCostForRc[lowresCuIdx] & LOWRES_COST_MASK;
                         if (qp_offset)
                         {
-                            double qpOffset;
+                            int qpOffset;
                             if (m_param->rc.qgSize == 8)
-                                qpOffset = (qp_offset[lowresCol * 2 + lowresRow * widthInLowresCu * 4] +
-                                qp_offset[lowresCol * 2 + lowresRow * widthInLowresCu * 4 + 1] +
-                                qp_offset[lowresCol * 2 + lowresRow * widthInLowresCu * 4 + curFrame->m_lowres.maxBlocksInRowFullRes] +
-                                qp_offset[lowresCol * 2 + lowresRow * widthInLowresCu * 4 + curFrame->m_lowres.maxBlocksInRowFullRes + 1]) / 4;
+                                qpOffset = qpOffset8x8(qp_offset + lowresCol * 2 + lowresRow * widthInLowresCu * 4, curFrame->m_lowres.maxBlocksInRowFullRes);
                             else
                                 qpOffset = qp_offset[lowresCuIdx];
                             lowresCuCost = (uint16_t)((lowresCuCost * x265_exp2fix8(qpOffset) + 128) >> 8);
@@ -1235,7 +1327,7 @@ void Lookahead::slicetypeDecide()
     if (pre.m_jobTotal)
     {
         if (m_pool)
-            pre.tryBondPeers(*m_pool, pre.m_jobTotal);
+            pre.tryBondPeers(*m_pool, pre.m_jobTotal, this);
         pre.processTasks(-1);
         pre.waitForExit();
     }
@@ -1438,7 +1530,6 @@ void Lookahead::slicetypeDecide()
     /* calculate the frame costs ahead of time for estimateFrameCost while we still have lowres */
     if (m_param->rc.rateControlMode != X265_RC_CQP)
     {
-        int p0, p1, b;
         /* For zero latency tuning, calculate frame cost to be used later in RC */
         if (!maxSearch)
         {
@@ -1446,39 +1537,7 @@ void Lookahead::slicetypeDecide()
                frames[i + 1] = &list[i]->m_lowres;
         }
 
-        /* estimate new non-B cost */
-        p1 = b = bframes + 1;
-        p0 = (IS_X265_TYPE_I(frames[bframes + 1]->sliceType)) ? b : 0;
-
-        CostEstimateGroup estGroup(*this, frames);
-
-        estGroup.singleCost(p0, p1, b);
-
-        if (bframes)
-        {
-            p0 = 0; // last nonb
-            bool isp0available = frames[bframes + 1]->sliceType == X265_TYPE_IDR ? false : true;
-
-            for (b = 1; b <= bframes; b++)
-            {
-                if (!isp0available)
-                    p0 = b;
-
-                if (frames[b]->sliceType == X265_TYPE_B)
-                    for (p1 = b; frames[p1]->sliceType == X265_TYPE_B; p1++)
-                        ; // find new nonb or bref
-                else
-                    p1 = bframes + 1;
-
-                estGroup.singleCost(p0, p1, b);
-
-                if (frames[b]->sliceType == X265_TYPE_BREF)
-                {
-                    p0 = b;
-                    isp0available = true;
-                }
-            }
-        }
+        miniGopCosts(frames, bframes);
     }
 
     m_inputLock.acquire();
@@ -1553,9 +1612,427 @@ void Lookahead::slicetypeDecide()
             vbvLookahead(frames, numFrames, true);
         }
     }
+
+    if (m_share && m_share->m_numFollowers)
+        publishDecisions(list, bframes);
+    m_outputLock.release();
+}
+
+/* Estimate the frame costs of a decided mini-GOP; frames[0] is the last
+ * non-B frame of the previous mini-GOP */
+void Lookahead::miniGopCosts(Lowres **frames, int bframes)
+{
+    int p0, p1, b;
+
+    /* estimate new non-B cost */
+    p1 = b = bframes + 1;
+    p0 = (IS_X265_TYPE_I(frames[bframes + 1]->sliceType)) ? b : 0;
+
+    CostEstimateGroup estGroup(*this, frames);
+
+    estGroup.singleCost(p0, p1, b);
+    frames[b]->costRefDist[0] = b - p0;
+    frames[b]->costRefDist[1] = 0;
+
+    if (bframes)
+    {
+        p0 = 0; // last nonb
+        bool isp0available = frames[bframes + 1]->sliceType == X265_TYPE_IDR ? false : true;
+
+        for (b = 1; b <= bframes; b++)
+        {
+            if (!isp0available)
+                p0 = b;
+
+            if (frames[b]->sliceType == X265_TYPE_B)
+                for (p1 = b; frames[p1]->sliceType == X265_TYPE_B; p1++)
+                    ; // find new nonb or bref
+            else
+                p1 = bframes + 1;
+
+            estGroup.singleCost(p0, p1, b);
+            frames[b]->costRefDist[0] = b - p0;
+            frames[b]->costRefDist[1] = p1 - b;
+
+            if (frames[b]->sliceType == X265_TYPE_BREF)
+            {
+                p0 = b;
+                isp0available = true;
+            }
+        }
+    }
+}
+
+/* Called by the leader with m_outputLock held, once the types, costs and
+ * cuTree offsets of the mini-GOP are final and before the API thread can
+ * withdraw its frames */
+void Lookahead::publishDecisions(Frame **list, int bframes)
+{
+    LookaheadShare::Group* group = new LookaheadShare::Group;
+    group->frames = new LookaheadShare::Decision[bframes + 1];
+    group->numFrames = bframes + 1;
+    group->next = NULL;
+
+    bool bIsVbv = m_param->rc.vbvBufferSize > 0 && m_param->rc.vbvMaxBitrate > 0;
+    int mapSize = m_share->m_mapWidth * m_share->m_mapHeight;
+
+    for (int i = 0; i <= bframes; i++)
+    {
+        Lowres& frm = list[i]->m_lowres;
+        LookaheadShare::Decision& d = group->frames[i];
+
+        d.poc = list[i]->m_poc;
+        d.sliceType = frm.sliceType;
+        d.leadingBframes = frm.leadingBframes;
+        d.bKeyframe = frm.bKeyframe;
+        d.bScenecut = frm.bScenecut;
+        d.bLastMiniGopBFrame = frm.bLastMiniGopBFrame;
+        memcpy(d.costEst, frm.costEst, sizeof(d.costEst));
+        memcpy(d.costEstAq, frm.costEstAq, sizeof(d.costEstAq));
+        for (int x = 0; x < X265_BFRAME_MAX + 2; x++)
+        {
+            for (int y = 0; y < X265_BFRAME_MAX + 2; y++)
+            {
+                bool bCosted = frm.costEst[x][y] >= 0 && frm.rowSatds[x][y][0] != -1;
+                d.costEstCuTree[x][y] = bCosted && m_param->rc.cuTree ? cuTreeWeightedCost(frm, x, y) : -1;
+            }
+        }
+        if (bIsVbv)
+        {
+            memcpy(d.plannedType, frm.plannedType, sizeof(d.plannedType));
+            memcpy(d.plannedSatd, frm.plannedSatd, sizeof(d.plannedSatd));
+        }
+        else
+            d.plannedType[0] = X265_TYPE_AUTO;
+
+        d.cuTreeDelta = NULL;
+        if (m_param->rc.cuTree && frm.qpCuTreeOffset)
+        {
+            d.cuTreeDelta = X265_MALLOC(int16_t, mapSize);
+            if (d.cuTreeDelta)
+            {
+                for (int j = 0; j < mapSize; j++)
+                    d.cuTreeDelta[j] = x265_clip_fix8(frm.qpCuTreeOffset[j] - frm.qpAqOffset[j]);
+            }
+        }
+    }
+
+    m_share->publish(group);
+}
+
+/* Followers replace slicetypeDecide() by the next group of decisions of the
+ * leader. The inter costs of the leader are scaled by the ratio of the intra
+ * costs both lookaheads estimated for the frame, and the cuTree adjustments
+ * of the leader are resampled onto this encoder's QP offset grid and added
+ * to its own AQ offsets */
+void Lookahead::slicetypeFollow()
+{
+    PreLookaheadGroup pre(*this);
+    Lowres* frames[X265_BFRAME_MAX + 4];
+    Frame*  list[X265_BFRAME_MAX + 2];
+    memset(frames, 0, sizeof(frames));
+
+    LookaheadShare::Group* group = m_share->peek(m_shareSeq);
+    int numFrames = group->numFrames;
+    int bframes = numFrames - 1;
+
+    {
+        ScopedLock lock(m_inputLock);
+
+        Frame *curFrame = m_inputQueue.first();
+        for (int j = 0; j < numFrames; j++)
+        {
+            list[j] = curFrame;
+            if (!curFrame->m_lowresInit)
+                pre.m_preframes[pre.m_jobTotal++] = curFrame;
+            curFrame = curFrame->m_next;
+        }
+    }
+
+    if (pre.m_jobTotal)
+    {
+        if (m_pool)
+            pre.tryBondPeers(*m_pool, pre.m_jobTotal, this);
+        pre.processTasks(-1);
+        pre.waitForExit();
+    }
+
+    bool bIsVbv = m_param->rc.vbvBufferSize > 0 && m_param->rc.vbvMaxBitrate > 0;
+    double areaScale = ((double)m_param->sourceWidth * m_param->sourceHeight) / ((double)m_share->m_width * m_share->m_height);
+    bool qg8 = m_param->rc.qgSize == 8;
+    int mapWidth = qg8 ? m_8x8Width * 2 : m_8x8Width;
+    int mapHeight = qg8 ? m_8x8Height * 2 : m_8x8Height;
+    int brefs = 0;
+
+    for (int i = 0; i < numFrames; i++)
+    {
+        const LookaheadShare::Decision& d = group->frames[i];
+        Lowres& frm = list[i]->m_lowres;
+
+        X265_CHECK(d.poc == list[i]->m_poc, "lookahead follower input does not match its leader\n");
+        frm.sliceType = d.sliceType;
+        frm.leadingBframes = d.leadingBframes;
+        frm.bKeyframe = d.bKeyframe;
+        frm.bScenecut = d.bScenecut;
+        frm.bLastMiniGopBFrame = d.bLastMiniGopBFrame;
+        if (frm.bKeyframe)
+            m_lastKeyframe = frm.frameNum;
+        if (frm.sliceType == X265_TYPE_BREF)
+            brefs++;
+
+        /* the intra costs were estimated by this lookahead's pre-analysis */
+        double costScale = d.costEst[0][0] > 0 ? (double)frm.costEst[0][0] / d.costEst[0][0] : areaScale;
+        double costScaleAq = d.costEstAq[0][0] > 0 ? (double)frm.costEstAq[0][0] / d.costEstAq[0][0] : areaScale;
+        for (int x = 0; x < X265_BFRAME_MAX + 2; x++)
+        {
+            for (int y = 0; y < X265_BFRAME_MAX + 2; y++)
+            {
+                if (d.costEst[x][y] >= 0 && (x || y))
+                {
+                    frm.costEst[x][y] = (int64_t)(d.costEst[x][y] * costScale);
+                    frm.costEstAq[x][y] = (int64_t)(d.costEstAq[x][y] * costScaleAq);
+                }
+                frm.costEstCuTree[x][y] = d.costEstCuTree[x][y] >= 0 ? (int64_t)(d.costEstCuTree[x][y] * costScaleAq) : -1;
+            }
+        }
+
+        if (bIsVbv)
+        {
+            for (int j = 0; j <= X265_LOOKAHEAD_MAX; j++)
+            {
+                frm.plannedType[j] = d.plannedType[j];
+                if (d.plannedType[j] == X265_TYPE_AUTO)
+                    break;
+                frm.plannedSatd[j] = (int64_t)(d.plannedSatd[j] * (m_param->rc.aqMode ? costScaleAq : costScale));
+            }
+        }
+
+        if (d.cuTreeDelta && frm.qpCuTreeOffset)
+        {
+            for (int y = 0; y < mapHeight; y++)
+            {
+                const int16_t* srcRow = d.cuTreeDelta + ((2 * y + 1) * m_share->m_mapHeight / (2 * mapHeight)) * m_share->m_mapWidth;
+                for (int x = 0; x < mapWidth; x++)
+                {
+                    int idx = y * mapWidth + x;
+                    frm.qpCuTreeOffset[idx] = x265_clip_fix8(frm.qpAqOffset[idx] + srcRow[(2 * x + 1) * m_share->m_mapWidth / (2 * mapWidth)]);
+                }
+            }
+        }
+    }
+
+    /* row level VBV needs this encoder's own lowres costs of the decided
+     * references, they replace the scaled estimates of the leader */
+    if (bIsVbv)
+    {
+        frames[0] = m_lastNonB;
+        for (int i = 0; i < numFrames; i++)
+            frames[i + 1] = &list[i]->m_lowres;
+        miniGopCosts(frames, bframes);
+    }
+
+    m_lastNonB = &list[bframes]->m_lowres;
+    m_histogram[bframes]++;
+    m_share->consume(m_shareSeq++);
+
+    m_inputLock.acquire();
+    int64_t pts[X265_BFRAME_MAX + 1];
+    for (int i = 0; i <= bframes; i++)
+        pts[i] = m_inputQueue.popFront()->m_pts;
+    m_inputLock.release();
+
+    /* same coded order as slicetypeDecide(): the non-B, the B-ref then the B frames */
+    m_outputLock.acquire();
+    int idx = 0;
+    list[bframes]->m_reorderedPts = pts[idx++];
+    m_outputQueue.pushBack(*list[bframes]);
+    if (brefs)
+    {
+        for (int i = 0; i < bframes; i++)
+        {
+            if (list[i]->m_lowres.sliceType == X265_TYPE_BREF)
+            {
+                list[i]->m_reorderedPts = pts[idx++];
+                m_outputQueue.pushBack(*list[i]);
+            }
+        }
+    }
+    for (int i = 0; i < bframes; i++)
+    {
+        if (list[i]->m_lowres.sliceType != X265_TYPE_BREF)
+        {
+            list[i]->m_reorderedPts = pts[idx++];
+            m_outputQueue.pushBack(*list[i]);
+        }
+    }
     m_outputLock.release();
 }
 
+bool Lookahead::addFollower(Lookahead& follower)
+{
+    if (!m_share)
+    {
+        bool qg8 = m_param->rc.qgSize == 8;
+        m_share = new LookaheadShare(m_param->sourceWidth, m_param->sourceHeight,
+                                     qg8 ? m_8x8Width * 2 : m_8x8Width, qg8 ? m_8x8Height * 2 : m_8x8Height);
+    }
+    if (!m_share->addFollower(follower))
+        return false;
+
+    follower.m_share = m_share;
+    follower.m_bShareFollower = true;
+    follower.m_shareSeq = m_share->m_numPublished;
+    return true;
+}
+
+LookaheadShare::LookaheadShare(int width, int height, int mapWidth, int mapHeight)
+{
+    m_head = m_tail = NULL;
+    m_headSeq = 0;
+    m_numPublished = 0;
+    m_numFollowers = 0;
+    m_refCount = 1;
+    m_bLeaderClosed = false;
+    m_width = width;
+    m_height = height;
+    m_mapWidth = mapWidth;
+    m_mapHeight = mapHeight;
+    memset(m_followers, 0, sizeof(m_followers));
+}
+
+LookaheadShare::~LookaheadShare()
+{
+    while (m_head)
+    {
+        Group* group = m_head;
+        m_head = group->next;
+        for (int i = 0; i < group->numFrames; i++)
+            X265_FREE(group->frames[i].cuTreeDelta);
+        delete [] group->frames;
+        delete group;
+    }
+}
+
+bool LookaheadShare::addFollower(Lookahead& follower)
+{
+    ScopedLock lock(m_lock);
+    if (m_numFollowers == MAX_FOLLOWERS || m_bLeaderClosed)
+        return false;
+    m_followers[m_numFollowers++] = &follower;
+    m_refCount++;
+    return true;
+}
+
+/* Drop a follower, releasing the groups it has not consumed */
+void LookaheadShare::removeFollower(Lookahead& follower, int seq)
+{
+    ScopedLock lock(m_lock);
+    for (int i = 0; i < m_numFollowers; i++)
+    {
+        if (m_followers[i] == &follower)
+        {
+            m_followers[i] = m_followers[--m_numFollowers];
+            for (; seq < m_numPublished; seq++)
+                consumeLocked(seq);
+            break;
+        }
+    }
+}
+
+void LookaheadShare::publish(Group* group)
+{
+    {
+        ScopedLock lock(m_lock);
+        group->pending = m_numFollowers;
+        if (m_tail)
+            m_tail->next = group;
+        else
+            m_head = group;
+        m_tail = group;
+        m_numPublished++;
+
+        for (int i = 0; i < m_numFollowers; i++)
+        {
+            if (m_followers[i]->m_pool)
+                m_followers[i]->tryWakeOne();
+        }
+    }
+    m_updates.incr();
+}
+
+LookaheadShare::Group* LookaheadShare::peek(int seq)
+{
+    ScopedLock lock(m_lock);
+    Group* group = m_head;
+    for (int i = m_headSeq; group && i < seq; i++)
+        group = group->next;
+    return group;
+}
+
+bool LookaheadShare::isReady(int seq, int numFrames)
+{
+    Group* group = peek(seq);
+    return group && group->numFrames <= numFrames;
+}
+
+void LookaheadShare::consume(int seq)
+{
+    ScopedLock lock(m_lock);
+    consumeLocked(seq);
+}
+
+void LookaheadShare::consumeLocked(int seq)
+{
+    Group* group = m_head;
+    for (int i = m_headSeq; group && i < seq; i++)
+        group = group->next;
+    if (group)
+        group->pending--;
+
+    /* followers consume groups in order, so only the head can be complete */
+    while (m_head && !m_head->pending)
+    {
+        group = m_head;
+        m_head = group->next;
+        if (!m_head)
+            m_tail = NULL;
+        m_headSeq++;
+        for (int i = 0; i < group->numFrames; i++)
+            X265_FREE(group->frames[i].cuTreeDelta);
+        delete [] group->frames;
+        delete group;
+    }
+}
+
+/* Block until the leader publishes or closes after the caller sampled
+ * m_numPublished and m_updates. Returns false without waiting if group seq
+ * was already published, since the caller could not use it, or if the
+ * leader has closed */
+bool LookaheadShare::waitForGroup(int seq, int published, int updates)
+{
+    if (published > seq || m_bLeaderClosed)
+        return false;
+    int val = m_updates.get();
+    while (val == updates)
+        val = m_updates.waitForChange(val);
+    return true;
+}
+
+void LookaheadShare::closeLeader()
+{
+    m_bLeaderClosed = true;
+    m_updates.incr();
+}
+
+void LookaheadShare::release()
+{
+    m_lock.acquire();
+    bool bLast = !--m_refCount;
+    m_lock.release();
+    if (bLast)
+        delete this;
+}
+
 void Lookahead::vbvLookahead(Lowres **frames, int numFrames, int keyframe)
 {
     int prevNonB = 0, curNonB = 1, idx = 0;
@@ -1725,9 +2202,11 @@ void Lookahead::slicetypeAnalyse(Lowres **frames, bool bKeyframe)
                 if (frames[b]->lowresMvs[0][i][0].x != 0x7FFF)
                     continue;
 
-                /* perform search to p1 at same distance, if possible */
+                /* perform search to p1 at same distance, if possible. Budget
+                 * mode has no cost arrays for distances past a mini-GOP */
                 int p1 = b + i;
-                if (p1 >= numFrames || frames[b]->lowresMvs[1][i][0].x != 0x7FFF)
+                if (p1 >= numFrames || frames[b]->lowresMvs[1][i][0].x != 0x7FFF ||
+                    (m_param->memoryBudget && 2 * i > m_param->bframes + 1))
                     p1 = b;
 
                 estGroup.add(p0, p1, b);
@@ -1760,6 +2239,11 @@ void Lookahead::slicetypeAnalyse(Lowres **frames, bool bKeyframe)
                         if (p1 >= numFrames)
                             break;
 
+                        /* no mini-GOP spans more than bframes + 1 frames, the
+                         * lowres frames of budget mode have no costs past it */
+                        if (m_param->memoryBudget && i + j > m_param->bframes + 1)
+                            break;
+
                         /* ensure P1 search is done */
                         if (j && frames[b]->lowresMvs[1][j][0].x == 0x7FFF)
                             continue;
@@ -2221,7 +2705,7 @@ void Lookahead::calcMotionAdaptiveQuantFrame(Lowres **frames, int p0, int p1, in
             if (lists_used == 3)
                 displacement = displacement / 2;
             qp_adj = pow(displacement, 0.1);
-            frames[b]->qpAqMotionOffset[cuIndex] = qp_adj;
+            frames[b]->qpAqMotionOffset[cuIndex] = x265_qp2fix8(qp_adj);
             avg_adj += qp_adj;
             avg_adj_pow2 += qp_adj * qp_adj;
         }
@@ -2236,13 +2720,14 @@ void Lookahead::calcMotionAdaptiveQuantFrame(Lowres **frames, int p0, int p1, in
             int cuIndex = blocky * strideInCU;
             for (uint16_t blockx = 0; blockx < m_8x8Width; blockx++, cuIndex++)
             {
-                qp_adj = frames[b]->qpAqMotionOffset[cuIndex];
+                qp_adj = x265_fix82qp(frames[b]->qpAqMotionOffset[cuIndex]);
                 qp_adj = (qp_adj - avg_adj) / sd;
                 if (qp_adj > 1)
                 {
-                    frames[b]->qpAqOffset[cuIndex] += qp_adj;
-                    frames[b]->qpCuTreeOffset[cuIndex] += qp_adj;
-                    frames[b]->invQscaleFactor[cuIndex] += x265_exp2fix8(qp_adj);
+                    int16_t qpAdjFix8 = x265_qp2fix8(qp_adj);
+                    frames[b]->qpAqOffset[cuIndex] = x265_clip_fix8(frames[b]->qpAqOffset[cuIndex] + qpAdjFix8);
+                    frames[b]->qpCuTreeOffset[cuIndex] = x265_clip_fix8(frames[b]->qpCuTreeOffset[cuIndex] + qpAdjFix8);
+                    frames[b]->invQscaleFactor[cuIndex] += x265_exp2fix8(qpAdjFix8);
                 }
             }
         }
@@ -2269,6 +2754,12 @@ void Lookahead::cuTree(Lowres **frames, int numframes, bool bIntra)
 
     lastnonb = i;
 
+    /* frames whose propagate cost starts from zero, and the propagations of
+     * the window from its last frame backwards */
+    CUTreeStep steps[X265_LOOKAHEAD_MAX + 1];
+    int resets[X265_LOOKAHEAD_MAX + 1];
+    int numSteps = 0, numResets = 0;
+
     /* Lookaheadless MB-tree is not a theoretically distinct case; the same extrapolation could
      * be applied to the end of a lookahead buffer of any size.  However, it's most needed when
      * lookahead=0, so that's what's currently implemented. */
@@ -2278,9 +2769,9 @@ void Lookahead::cuTree(Lowres **frames, int numframes, bool bIntra)
         {
             memset(frames[0]->propagateCost, 0, m_cuCount * sizeof(uint16_t));
             if (m_param->rc.qgSize == 8)
-                memcpy(frames[0]->qpCuTreeOffset, frames[0]->qpAqOffset, m_cuCount * 4 * sizeof(double));
+                memcpy(frames[0]->qpCuTreeOffset, frames[0]->qpAqOffset, m_cuCount * 4 * sizeof(int16_t));
             else
-                memcpy(frames[0]->qpCuTreeOffset, frames[0]->qpAqOffset, m_cuCount * sizeof(double));
+                memcpy(frames[0]->qpCuTreeOffset, frames[0]->qpAqOffset, m_cuCount * sizeof(int16_t));
             return;
         }
         std::swap(frames[lastnonb]->propagateCost, frames[0]->propagateCost);
@@ -2290,7 +2781,7 @@ void Lookahead::cuTree(Lowres **frames, int numframes, bool bIntra)
     {
         if (lastnonb < idx)
             return;
-        memset(frames[lastnonb]->propagateCost, 0, m_cuCount * sizeof(uint16_t));
+        resets[numResets++] = lastnonb;
     }
 
     CostEstimateGroup estGroup(*this, frames);
@@ -2306,13 +2797,13 @@ void Lookahead::cuTree(Lowres **frames, int numframes, bool bIntra)
 
         estGroup.singleCost(curnonb, lastnonb, lastnonb);
 
-        memset(frames[curnonb]->propagateCost, 0, m_cuCount * sizeof(uint16_t));
+        resets[numResets++] = curnonb;
         bframes = lastnonb - curnonb - 1;
         if (m_param->bBPyramid && bframes > 1)
         {
             int middle = (bframes + 1) / 2 + curnonb;
             estGroup.singleCost(curnonb, lastnonb, middle);
-            memset(frames[middle]->propagateCost, 0, m_cuCount * sizeof(uint16_t));
+            resets[numResets++] = middle;
             while (i > curnonb)
             {
                 int p0 = i > middle ? middle : curnonb;
@@ -2320,26 +2811,54 @@ void Lookahead::cuTree(Lowres **frames, int numframes, bool bIntra)
                 if (i != middle)
                 {
                     estGroup.singleCost(p0, p1, i);
-                    estimateCUPropagate(frames, averageDuration, p0, p1, i, 0);
+                    CUTreeStep step = { p0, p1, i, false };
+                    steps[numSteps++] = step;
                 }
                 i--;
             }
 
-            estimateCUPropagate(frames, averageDuration, curnonb, lastnonb, middle, 1);
+            CUTreeStep step = { curnonb, lastnonb, middle, true };
+            steps[numSteps++] = step;
         }
         else
         {
             while (i > curnonb)
             {
                 estGroup.singleCost(curnonb, lastnonb, i);
-                estimateCUPropagate(frames, averageDuration, curnonb, lastnonb, i, 0);
+                CUTreeStep step = { curnonb, lastnonb, i, false };
+                steps[numSteps++] = step;
                 i--;
             }
         }
-        estimateCUPropagate(frames, averageDuration, curnonb, lastnonb, lastnonb, 1);
+        CUTreeStep step = { curnonb, lastnonb, lastnonb, true };
+        steps[numSteps++] = step;
         lastnonb = curnonb;
     }
 
+    {
+        ScopedElapsedTime propagateTime(m_cuTreeElapsedTime);
+        m_countCuTree++;
+
+        bool bIncremental = m_param->bCUTreeIncremental && m_param->lookaheadDepth && !bIntra && !m_param->bAQMotion &&
+                            cuTreeIncremental(frames, numframes, averageDuration, steps, numSteps);
+        if (bIncremental)
+            m_countCuTreeIncremental++;
+        else
+        {
+            for (int r = 0; r < numResets; r++)
+                memset(frames[resets[r]]->propagateCost, 0, m_cuCount * sizeof(uint16_t));
+            if (m_cuTreeAccum)
+                cuTreeParallel(frames, averageDuration, steps, numSteps);
+            else
+            {
+                for (int s = 0; s < numSteps; s++)
+                    estimateCUPropagate(frames, averageDuration, steps[s].p0, steps[s].p1, steps[s].b, steps[s].referenced);
+            }
+        }
+        if (m_param->bCUTreeIncremental)
+            cuTreeRecord(frames, steps, numSteps, resets, numResets);
+    }
+
     if (!m_param->lookaheadDepth)
     {
         estGroup.singleCost(0, lastnonb, lastnonb);
@@ -2347,49 +2866,291 @@ void Lookahead::cuTree(Lowres **frames, int numframes, bool bIntra)
         std::swap(frames[lastnonb]->propagateCost, frames[0]->propagateCost);
     }
 
-    cuTreeFinish(frames[lastnonb], averageDuration, lastnonb);
-    if (m_param->bBPyramid && bframes > 1 && !m_param->rc.vbvBufferSize)
-        cuTreeFinish(frames[lastnonb + (bframes + 1) / 2], averageDuration, 0);
+    if (m_cuTreeAccum)
+    {
+        CUTreeGroup finish(*this, frames, averageDuration);
+        finish.addFinish(lastnonb, lastnonb);
+        if (m_param->bBPyramid && bframes > 1 && !m_param->rc.vbvBufferSize)
+            finish.addFinish(lastnonb + (bframes + 1) / 2, 0);
+        finish.finishBatch();
+    }
+    else
+    {
+        cuTreeFinish(frames[lastnonb], averageDuration, lastnonb);
+        if (m_param->bBPyramid && bframes > 1 && !m_param->rc.vbvBufferSize)
+            cuTreeFinish(frames[lastnonb + (bframes + 1) / 2], averageDuration, 0);
+    }
+}
+
+/* Propagates the steps of a window in batches of frames which do not
+ * propagate into each other, typically a non-B frame and the B frames of
+ * the mini-GOP before it, each batch split in rows by a CUTreeGroup */
+void Lookahead::cuTreeParallel(Lowres **frames, double averageDuration, const CUTreeStep* steps, int numSteps)
+{
+    CUTreeGroup group(*this, frames, averageDuration);
+    bool bVbvLookahead = m_param->rc.vbvBufferSize && m_param->lookaheadDepth;
+
+    for (int s = 0; s < numSteps; s++)
+    {
+        int p0 = steps[s].p0, p1 = steps[s].p1, b = steps[s].b;
+        bool referenced = steps[s].referenced;
+        Lowres* fenc = frames[b];
+        const int32_t* invQscales = m_param->rc.qgSize == 8 ? fenc->invQscaleFactor8x8 : fenc->invQscaleFactor;
+
+        /* the propagate cost of frame b must be complete */
+        if (group.isTarget(fenc->propagateCost))
+            group.finishBatch();
+
+        /* For non-referred frames the source costs are always zero, so just memset one row and re-use it. */
+        if (!referenced)
+            memset(fenc->propagateCost, 0, m_8x8Width * sizeof(uint16_t));
+
+        /* a P frame propagates into list 0 only */
+        uint16_t* refCosts[2] = { frames[p0]->propagateCost, b == p1 ? NULL : frames[p1]->propagateCost };
+        if (!group.addPropagate(p0, p1, b, fenc->propagateCost, referenced ? m_8x8Width : 0, invQscales, m_8x8Width, refCosts))
+        {
+            group.finishBatch();
+            group.addPropagate(p0, p1, b, fenc->propagateCost, referenced ? m_8x8Width : 0, invQscales, m_8x8Width, refCosts);
+        }
+        if (bVbvLookahead && referenced && !group.addFinish(b, b == p1 ? b - p0 : 0))
+        {
+            group.finishBatch();
+            group.addFinish(b, b == p1 ? b - p0 : 0);
+        }
+    }
+    group.finishBatch();
+}
+
+/* Propagates the window starting from the propagate costs of the previous
+ * run. Consecutive windows share all but their newest frames: each frame
+ * after the head which repeats its propagation of the last run keeps its
+ * propagate cost as a base. What changed since is accumulated in
+ * propagateDelta: the cost added by new frames and by frames whose
+ * references were re-decided, and the cost the last run propagated from
+ * the frames no longer doing so, which is propagated again to be removed.
+ * The changes are carried through the referenced frames on their own; the
+ * propagation is linear in the propagate-in cost, and with zero invQscales
+ * it yields just the propagated change. A change too small to move the QP
+ * offsets of its frame is not carried further. The head, fed by the frames
+ * of the previous mini-GOP, is recomputed like the re-decided frames.
+ * Returns false, having changed nothing, when the last run can't be reused */
+bool Lookahead::cuTreeIncremental(Lowres **frames, int numframes, double averageDuration, const CUTreeStep* steps, int numSteps)
+{
+    /* propagate a change when it is more than 1/4096 of the frame's cost */
+    const int deltaShift = 12;
+
+    if (!numSteps || frames[0]->frameNum != m_cuTreeHead || frames[numframes]->frameNum < m_cuTreeEnd)
+        return false;
+
+    int head = steps[numSteps - 1].p0;
+    int prevRun = m_cuTreeRun;
+    int stepOf[X265_LOOKAHEAD_MAX + 2];
+    bool kept[X265_LOOKAHEAD_MAX + 2];
+    bool retract[X265_LOOKAHEAD_MAX + 2];
+    for (int j = 0; j <= numframes; j++)
+    {
+        stepOf[j] = -1;
+        kept[j] = retract[j] = false;
+    }
+    for (int s = 0; s < numSteps; s++)
+        stepOf[steps[s].b] = s;
+
+    for (int j = 1; j <= numframes; j++)
+    {
+        Lowres* fenc = frames[j];
+        if (fenc->cuTreeRun != prevRun)
+            continue;
+        const CUTreeStep* step = stepOf[j] >= 0 ? &steps[stepOf[j]] : NULL;
+        kept[j] = j > head && step && fenc->cuTreeStep[0] == frames[step->p0]->frameNum &&
+                  fenc->cuTreeStep[1] == frames[step->p1]->frameNum && fenc->cuTreeStep[2] == (int)step->referenced;
+        retract[j] = !kept[j] && fenc->cuTreeStep[0] >= 0;
+    }
+
+    for (int j = head + 1; j <= numframes; j++)
+        if (kept[j])
+            memset(frames[j]->propagateDelta, 0, 2 * m_cuCount * sizeof(uint16_t));
+
+    /* remove what the propagations no longer made contributed to the kept
+     * frames, while the old propagate costs are still there */
+    for (int j = 1; j <= numframes; j++)
+    {
+        if (!retract[j])
+            continue;
+        Lowres* fenc = frames[j];
+        int p0 = fenc->cuTreeStep[0] - frames[0]->frameNum;
+        int p1 = fenc->cuTreeStep[1] - frames[0]->frameNum;
+        bool referenced = !!fenc->cuTreeStep[2];
+        uint16_t* refCosts[2] = { kept[p0] ? frames[p0]->propagateDelta + m_cuCount : NULL,
+                                  kept[p1] ? frames[p1]->propagateDelta + m_cuCount : NULL };
+        if (!refCosts[0] && !refCosts[1])
+            continue;
+        if (!referenced)
+            memset(fenc->propagateCost, 0, m_8x8Width * sizeof(uint16_t));
+        propagateCUCost(frames, averageDuration, p0, p1, j, fenc->propagateCost, referenced ? m_8x8Width : 0,
+                        m_param->rc.qgSize == 8 ? fenc->invQscaleFactor8x8 : fenc->invQscaleFactor, m_8x8Width, refCosts);
+    }
+
+    memset(frames[head]->propagateCost, 0, m_cuCount * sizeof(uint16_t));
+    for (int j = head + 1; j <= numframes; j++)
+        if (!kept[j] && stepOf[j] >= 0 && steps[stepOf[j]].referenced)
+            memset(frames[j]->propagateCost, 0, m_cuCount * sizeof(uint16_t));
+
+    bool bVbvLookahead = m_param->rc.vbvBufferSize && m_param->lookaheadDepth;
+    for (int s = 0; s < numSteps; s++)
+    {
+        int p0 = steps[s].p0, p1 = steps[s].p1, b = steps[s].b;
+        bool referenced = steps[s].referenced;
+        Lowres* fenc = frames[b];
+        int32_t* invQscales = m_param->rc.qgSize == 8 ? fenc->invQscaleFactor8x8 : fenc->invQscaleFactor;
+
+        if (!kept[b])
+        {
+            uint16_t* refCosts[2] = { kept[p0] ? frames[p0]->propagateDelta : frames[p0]->propagateCost,
+                                      kept[p1] ? frames[p1]->propagateDelta : frames[p1]->propagateCost };
+            if (!referenced)
+                memset(fenc->propagateCost, 0, m_8x8Width * sizeof(uint16_t));
+            propagateCUCost(frames, averageDuration, p0, p1, b, fenc->propagateCost, referenced ? m_8x8Width : 0,
+                            invQscales, m_8x8Width, refCosts);
+            if (bVbvLookahead && referenced)
+                cuTreeFinish(fenc, averageDuration, b == p1 ? b - p0 : 0);
+            continue;
+        }
+
+        /* apply the change to the base, keeping what survives the clip */
+        bool bAdded = false, bRemoved = false;
+        if (referenced)
+        {
+            uint16_t* cost = fenc->propagateCost;
+            uint16_t* added = fenc->propagateDelta;
+            uint16_t* removed = fenc->propagateDelta + m_cuCount;
+            uint64_t addedSum = 0, removedSum = 0, costSum = 0;
+            for (int k = 0; k < m_cuCount; k++)
+            {
+                int val = x265_clip3(0, 65535, (int)cost[k] + added[k] - removed[k]);
+                int change = val - cost[k];
+                added[k] = (uint16_t)X265_MAX(change, 0);
+                removed[k] = (uint16_t)X265_MAX(-change, 0);
+                cost[k] = (uint16_t)val;
+                addedSum += added[k];
+                removedSum += removed[k];
+                costSum += val + fenc->intraCost[k];
+            }
+            bAdded = (addedSum << deltaShift) > costSum;
+            bRemoved = (removedSum << deltaShift) > costSum;
+        }
+
+        /* references recomputed from zero, the head or re-decided frames,
+         * need everything this frame propagates */
+        if (!kept[p0] || !kept[p1])
+        {
+            uint16_t* refCosts[2] = { kept[p0] ? NULL : frames[p0]->propagateCost,
+                                      kept[p1] ? NULL : frames[p1]->propagateCost };
+            if (!referenced)
+                memset(fenc->propagateCost, 0, m_8x8Width * sizeof(uint16_t));
+            propagateCUCost(frames, averageDuration, p0, p1, b, fenc->propagateCost, referenced ? m_8x8Width : 0,
+                            invQscales, m_8x8Width, refCosts);
+        }
+        for (int half = 0; half < 2; half++)
+        {
+            if (!(half ? bRemoved : bAdded) || (!kept[p0] && !kept[p1]))
+                continue;
+            int offset = half * m_cuCount;
+            uint16_t* refCosts[2] = { kept[p0] ? frames[p0]->propagateDelta + offset : NULL,
+                                      kept[p1] ? frames[p1]->propagateDelta + offset : NULL };
+            propagateCUCost(frames, averageDuration, p0, p1, b, fenc->propagateDelta + offset, m_8x8Width,
+                            m_zeroQscale, 0, refCosts);
+        }
+        if (bVbvLookahead && referenced)
+            cuTreeFinish(fenc, averageDuration, b == p1 ? b - p0 : 0);
+    }
+
+    return true;
+}
+
+/* Remember the propagations of this run for cuTreeIncremental() */
+void Lookahead::cuTreeRecord(Lowres **frames, const CUTreeStep* steps, int numSteps, const int* resets, int numResets)
+{
+    int run = ++m_cuTreeRun;
+    for (int r = 0; r < numResets; r++)
+    {
+        frames[resets[r]]->cuTreeRun = run;
+        frames[resets[r]]->cuTreeStep[0] = -1;
+    }
+    for (int s = 0; s < numSteps; s++)
+    {
+        Lowres* fenc = frames[steps[s].b];
+        fenc->cuTreeRun = run;
+        fenc->cuTreeStep[0] = frames[steps[s].p0]->frameNum;
+        fenc->cuTreeStep[1] = frames[steps[s].p1]->frameNum;
+        fenc->cuTreeStep[2] = steps[s].referenced;
+    }
+    m_cuTreeHead = numSteps ? frames[steps[numSteps - 1].p0]->frameNum : -1;
+    m_cuTreeEnd = numResets ? frames[resets[0]]->frameNum : -1;
 }
 
 void Lookahead::estimateCUPropagate(Lowres **frames, double averageDuration, int p0, int p1, int b, int referenced)
 {
     uint16_t *refCosts[2] = { frames[p0]->propagateCost, frames[p1]->propagateCost };
-    int32_t distScaleFactor = (((b - p0) << 8) + ((p1 - p0) >> 1)) / (p1 - p0);
-    int32_t bipredWeight = m_param->bEnableWeightedBiPred ? 64 - (distScaleFactor >> 2) : 32;
-    int32_t bipredWeights[2] = { bipredWeight, 64 - bipredWeight };
-    int listDist[2] = { b - p0, p1 - b };
+    int32_t* invQscales = m_param->rc.qgSize == 8 ? frames[b]->invQscaleFactor8x8 : frames[b]->invQscaleFactor;
 
-    memset(m_scratch, 0, m_8x8Width * sizeof(int));
+    /* For non-referred frames the source costs are always zero, so just memset one row and re-use it. */
+    if (!referenced)
+        memset(frames[b]->propagateCost, 0, m_8x8Width * sizeof(uint16_t));
+
+    propagateCUCost(frames, averageDuration, p0, p1, b, frames[b]->propagateCost, referenced ? m_8x8Width : 0,
+                    invQscales, m_8x8Width, refCosts);
 
-    uint16_t *propagateCost = frames[b]->propagateCost;
+    if (m_param->rc.vbvBufferSize && m_param->lookaheadDepth && referenced)
+        cuTreeFinish(frames[b], averageDuration, b == p1 ? b - p0 : 0);
+}
+
+/* Adds the propagate amount of frame b, from propagateIn and its intra cost
+ * scaled by invQscales, to the refCosts of its references following the
+ * lowres motion vectors. A NULL refCosts list is left out */
+void Lookahead::propagateCUCost(Lowres **frames, double averageDuration, int p0, int p1, int b, const uint16_t* propagateIn,
+                                int inStride, const int32_t* invQscales, int qscaleStride, uint16_t* refCosts[2])
+{
+    int32_t* refAccum[2] = { NULL, NULL };
+
+    memset(m_scratch, 0, m_8x8Width * sizeof(int));
 
     x265_emms();
     double fpsFactor = CLIP_DURATION((double)m_param->fpsDenom / m_param->fpsNum) / CLIP_DURATION(averageDuration);
 
-    /* For non-referred frames the source costs are always zero, so just memset one row and re-use it. */
-    if (!referenced)
-        memset(frames[b]->propagateCost, 0, m_8x8Width * sizeof(uint16_t));
+    propagateCURows(frames, fpsFactor, p0, p1, b, propagateIn, inStride, invQscales, qscaleStride,
+                    refCosts, refAccum, 0, m_8x8Height, m_scratch);
+}
+
+/* Propagates rows [rowStart, rowEnd) of frame b. Lists with a refAccum add
+ * to that 32bit accumulator atomically, unclipped, so that other rows and
+ * frames may propagate into the same reference concurrently, see
+ * CUTreeGroup. propagateIn and invQscales point to row 0 */
+void Lookahead::propagateCURows(Lowres **frames, double fpsFactor, int p0, int p1, int b, const uint16_t* propagateIn,
+                                int inStride, const int32_t* invQscales, int qscaleStride, uint16_t* refCosts[2],
+                                int32_t* refAccum[2], int rowStart, int rowEnd, int* scratch)
+{
+    int32_t distScaleFactor = (((b - p0) << 8) + ((p1 - p0) >> 1)) / (p1 - p0);
+    int32_t bipredWeight = m_param->bEnableWeightedBiPred ? 64 - (distScaleFactor >> 2) : 32;
+    int32_t bipredWeights[2] = { bipredWeight, 64 - bipredWeight };
+    int listDist[2] = { b - p0, p1 - b };
+
+    propagateIn += rowStart * inStride;
+    invQscales += rowStart * qscaleStride;
 
     int32_t strideInCU = m_8x8Width;
-    for (uint16_t blocky = 0; blocky < m_8x8Height; blocky++)
+    for (uint16_t blocky = (uint16_t)rowStart; blocky < rowEnd; blocky++)
     {
         int cuIndex = blocky * strideInCU;
-        if (m_param->rc.qgSize == 8)
-            primitives.propagateCost(m_scratch, propagateCost,
-                       frames[b]->intraCost + cuIndex, frames[b]->lowresCosts[b - p0][p1 - b] + cuIndex,
-                       frames[b]->invQscaleFactor8x8 + cuIndex, &fpsFactor, m_8x8Width);
-        else
-            primitives.propagateCost(m_scratch, propagateCost,
-                       frames[b]->intraCost + cuIndex, frames[b]->lowresCosts[b - p0][p1 - b] + cuIndex,
-                       frames[b]->invQscaleFactor + cuIndex, &fpsFactor, m_8x8Width);
+        primitives.propagateCost(scratch, propagateIn,
+                   frames[b]->intraCost + cuIndex, frames[b]->lowresCosts[b - p0][p1 - b] + cuIndex,
+                   invQscales, &fpsFactor, m_8x8Width);
 
-        if (referenced)
-            propagateCost += m_8x8Width;
+        propagateIn += inStride;
+        invQscales += qscaleStride;
 
         for (uint16_t blockx = 0; blockx < m_8x8Width; blockx++, cuIndex++)
         {
-            int32_t propagate_amount = m_scratch[blockx];
+            int32_t propagate_amount = scratch[blockx];
             /* Don't propagate for an intra block. */
             if (propagate_amount > 0)
             {
@@ -2398,9 +3159,13 @@ void Lookahead::estimateCUPropagate(Lowres **frames, double averageDuration, int
                 /* Follow the MVs to the previous frame(s). */
                 for (uint16_t list = 0; list < 2; list++)
                 {
-                    if ((lists_used >> list) & 1)
+                    if (((lists_used >> list) & 1) && (refCosts[list] || refAccum[list]))
                     {
 #define CLIP_ADD(s, x) (s) = (uint16_t)X265_MIN((s) + (x), (1 << 16) - 1)
+/* the sum of non-negative amounts clipped once equals the clipped sum */
+#define PROPAGATE_ADD(idx, x) do { \
+    if (refAccum[list]) { int32_t amount = (x); if (amount) ATOMIC_ADD(&refAccum[list][idx], amount); } \
+    else CLIP_ADD(refCosts[list][idx], (x)); } while (0)
                         int32_t listamount = propagate_amount;
                         /* Apply bipred weighting. */
                         if (lists_used == 3)
@@ -2411,7 +3176,7 @@ void Lookahead::estimateCUPropagate(Lowres **frames, double averageDuration, int
                         /* Early termination for simple case of mv0. */
                         if (!mvs[cuIndex].word)
                         {
-                            CLIP_ADD(refCosts[list][cuIndex], listamount);
+                            PROPAGATE_ADD(cuIndex, listamount);
                             continue;
                         }
 
@@ -2434,30 +3199,27 @@ void Lookahead::estimateCUPropagate(Lowres **frames, double averageDuration, int
                          * be counted. */
                         if (cux < m_8x8Width - 1 && cuy < m_8x8Height - 1 && cux >= 0 && cuy >= 0)
                         {
-                            CLIP_ADD(refCosts[list][idx0], (listamount * idx0weight + 512) >> 10);
-                            CLIP_ADD(refCosts[list][idx1], (listamount * idx1weight + 512) >> 10);
-                            CLIP_ADD(refCosts[list][idx2], (listamount * idx2weight + 512) >> 10);
-                            CLIP_ADD(refCosts[list][idx3], (listamount * idx3weight + 512) >> 10);
+                            PROPAGATE_ADD(idx0, (listamount * idx0weight + 512) >> 10);
+                            PROPAGATE_ADD(idx1, (listamount * idx1weight + 512) >> 10);
+                            PROPAGATE_ADD(idx2, (listamount * idx2weight + 512) >> 10);
+                            PROPAGATE_ADD(idx3, (listamount * idx3weight + 512) >> 10);
                         }
                         else /* Check offsets individually */
                         {
                             if (cux < m_8x8Width && cuy < m_8x8Height && cux >= 0 && cuy >= 0)
-                                CLIP_ADD(refCosts[list][idx0], (listamount * idx0weight + 512) >> 10);
+                                PROPAGATE_ADD(idx0, (listamount * idx0weight + 512) >> 10);
                             if (cux + 1 < m_8x8Width && cuy < m_8x8Height && cux + 1 >= 0 && cuy >= 0)
-                                CLIP_ADD(refCosts[list][idx1], (listamount * idx1weight + 512) >> 10);
+                                PROPAGATE_ADD(idx1, (listamount * idx1weight + 512) >> 10);
                             if (cux < m_8x8Width && cuy + 1 < m_8x8Height && cux >= 0 && cuy + 1 >= 0)
-                                CLIP_ADD(refCosts[list][idx2], (listamount * idx2weight + 512) >> 10);
+                                PROPAGATE_ADD(idx2, (listamount * idx2weight + 512) >> 10);
                             if (cux + 1 < m_8x8Width && cuy + 1 < m_8x8Height && cux + 1 >= 0 && cuy + 1 >= 0)
-                                CLIP_ADD(refCosts[list][idx3], (listamount * idx3weight + 512) >> 10);
+                                PROPAGATE_ADD(idx3, (listamount * idx3weight + 512) >> 10);
                         }
                     }
                 }
             }
         }
     }
-
-    if (m_param->rc.vbvBufferSize && m_param->lookaheadDepth && referenced)
-        cuTreeFinish(frames[b], averageDuration, b == p1 ? b - p0 : 0);
 }
 
 void Lookahead::computeCUTreeQpOffset(Lowres *frame, double averageDuration, int ref0Distance)
@@ -2477,7 +3239,7 @@ void Lookahead::computeCUTreeQpOffset(Lowres *frame, double averageDuration, int
         int minAQDepth = frame->pAQLayer->minAQDepth;
 
         PicQPAdaptationLayer* pQPLayerMin = &frame->pAQLayer[minAQDepth];
-        double* pcCuTree8x8 = pQPLayerMin->dCuTreeOffset8x8;
+        int16_t* pcCuTree8x8 = pQPLayerMin->dCuTreeOffset8x8;
 
         for (int cuY = 0; cuY < m_8x8Height; cuY++)
         {
@@ -2488,7 +3250,7 @@ void Lookahead::computeCUTreeQpOffset(Lowres *frame, double averageDuration, int
                 if (intracost)
                 {
                     int propagateCost = ((frame->propagateCost[cuXY] / 4)  * fpsFactor + 128) >> 8;
-                    double log2_ratio = X265_LOG2(intracost + propagateCost) - X265_LOG2(intracost) + weightdelta;
+                    int16_t log2_ratio = x265_qp2fix8(X265_LOG2(intracost + propagateCost) - X265_LOG2(intracost) + weightdelta);
 
                     pcCuTree8x8[cuX * 2 + cuY * m_8x8Width * 4] = log2_ratio;
                     pcCuTree8x8[cuX * 2 + cuY * m_8x8Width * 4 + 1] = log2_ratio;
@@ -2512,8 +3274,8 @@ void Lookahead::computeCUTreeQpOffset(Lowres *frame, double averageDuration, int
             const uint32_t numAQPartInWidth = pQPLayer->numAQPartInWidth;
             const uint32_t numAQPartInHeight = pQPLayer->numAQPartInHeight;
 
-            double* pcQP = pQPLayer->dQpOffset;
-            double* pcCuTree = pQPLayer->dCuTreeOffset;
+            int16_t* pcQP = pQPLayer->dQpOffset;
+            int16_t* pcCuTree = pQPLayer->dCuTreeOffset;
 
             uint32_t maxCols = frame->maxBlocksInRowFullRes;
 
@@ -2525,7 +3287,7 @@ void Lookahead::computeCUTreeQpOffset(Lowres *frame, double averageDuration, int
                     uint32_t block_y = y * aqPartHeight;
 
                     uint32_t blockXY = 0;
-                    double log2_ratio = 0;
+                    int log2_ratio = 0;
                     for (uint32_t block_yy = block_y; block_yy < block_y + aqPartHeight && block_yy < heightFullRes; block_yy += loopIncr)
                     {
                         for (uint32_t block_xx = block_x; block_xx < block_x + aqPartWidth && block_xx < widthFullRes; block_xx += loopIncr)
@@ -2538,9 +3300,9 @@ void Lookahead::computeCUTreeQpOffset(Lowres *frame, double averageDuration, int
                         }
                     }
 
-                    double qp_offset = (m_cuTreeStrength * log2_ratio) / blockXY;
+                    double qp_offset = (m_cuTreeStrength * x265_fix82qp(log2_ratio)) / blockXY;
 
-                    *pcCuTree = *pcQP - qp_offset;
+                    *pcCuTree = x265_clip_fix8(*pcQP - x265_qp2fix8(qp_offset));
                 }
             }
         }
@@ -2561,8 +3323,8 @@ void Lookahead::computeCUTreeQpOffset(Lowres *frame, double averageDuration, int
             const uint32_t numAQPartInWidth = pQPLayer->numAQPartInWidth;
             const uint32_t numAQPartInHeight = pQPLayer->numAQPartInHeight;
 
-            double* pcQP = pQPLayer->dQpOffset;
-            double* pcCuTree = pQPLayer->dCuTreeOffset;
+            int16_t* pcQP = pQPLayer->dQpOffset;
+            int16_t* pcCuTree = pQPLayer->dCuTreeOffset;
 
             uint32_t maxCols = frame->maxBlocksInRow;
 
@@ -2592,7 +3354,7 @@ void Lookahead::computeCUTreeQpOffset(Lowres *frame, double averageDuration, int
 
                     double qp_offset = (m_cuTreeStrength * log2_ratio) / blockXY;
 
-                    *pcCuTree = *pcQP - qp_offset;
+                    *pcCuTree = x265_clip_fix8(*pcQP - x265_qp2fix8(qp_offset));
 
                 }
             }
@@ -2607,44 +3369,49 @@ void Lookahead::cuTreeFinish(Lowres *frame, double averageDuration, int ref0Dist
         computeCUTreeQpOffset(frame, averageDuration, ref0Distance);
     }
     else
-    {
-        int fpsFactor = (int)(CLIP_DURATION(averageDuration) / CLIP_DURATION((double)m_param->fpsDenom / m_param->fpsNum) * 256);
-        double weightdelta = 0.0;
+        cuTreeFinishRows(frame, averageDuration, ref0Distance, 0, m_8x8Height);
+}
 
-        if (ref0Distance && frame->weightedCostDelta[ref0Distance - 1] > 0)
-            weightdelta = (1.0 - frame->weightedCostDelta[ref0Distance - 1]);
+/* cuTree QP offsets of the lowres rows [rowStart, rowEnd), without hevc-aq */
+void Lookahead::cuTreeFinishRows(Lowres *frame, double averageDuration, int ref0Distance, int rowStart, int rowEnd)
+{
+    int fpsFactor = (int)(CLIP_DURATION(averageDuration) / CLIP_DURATION((double)m_param->fpsDenom / m_param->fpsNum) * 256);
+    double weightdelta = 0.0;
 
-        if (m_param->rc.qgSize == 8)
+    if (ref0Distance && frame->weightedCostDelta[ref0Distance - 1] > 0)
+        weightdelta = (1.0 - frame->weightedCostDelta[ref0Distance - 1]);
+
+    if (m_param->rc.qgSize == 8)
+    {
+        for (int cuY = rowStart; cuY < rowEnd; cuY++)
         {
-            for (int cuY = 0; cuY < m_8x8Height; cuY++)
+            for (int cuX = 0; cuX < m_8x8Width; cuX++)
             {
-                for (int cuX = 0; cuX < m_8x8Width; cuX++)
+                const int cuXY = cuX + cuY * m_8x8Width;
+                int intracost = ((frame->intraCost[cuXY]) / 4 * frame->invQscaleFactor8x8[cuXY] + 128) >> 8;
+                if (intracost)
                 {
-                    const int cuXY = cuX + cuY * m_8x8Width;
-                    int intracost = ((frame->intraCost[cuXY]) / 4 * frame->invQscaleFactor8x8[cuXY] + 128) >> 8;
-                    if (intracost)
-                    {
-                        int propagateCost = ((frame->propagateCost[cuXY]) / 4 * fpsFactor + 128) >> 8;
-                        double log2_ratio = X265_LOG2(intracost + propagateCost) - X265_LOG2(intracost) + weightdelta;
-                        frame->qpCuTreeOffset[cuX * 2 + cuY * m_8x8Width * 4] = frame->qpAqOffset[cuX * 2 + cuY * m_8x8Width * 4] - m_cuTreeStrength * (log2_ratio);
-                        frame->qpCuTreeOffset[cuX * 2 + cuY * m_8x8Width * 4 + 1] = frame->qpAqOffset[cuX * 2 + cuY * m_8x8Width * 4 + 1] - m_cuTreeStrength * (log2_ratio);
-                        frame->qpCuTreeOffset[cuX * 2 + cuY * m_8x8Width * 4 + frame->maxBlocksInRowFullRes] = frame->qpAqOffset[cuX * 2 + cuY * m_8x8Width * 4 + frame->maxBlocksInRowFullRes] - m_cuTreeStrength * (log2_ratio);
-                        frame->qpCuTreeOffset[cuX * 2 + cuY * m_8x8Width * 4 + frame->maxBlocksInRowFullRes + 1] = frame->qpAqOffset[cuX * 2 + cuY * m_8x8Width * 4 + frame->maxBlocksInRowFullRes + 1] - m_cuTreeStrength * (log2_ratio);
-                    }
+                    int propagateCost = ((frame->propagateCost[cuXY]) / 4 * fpsFactor + 128) >> 8;
+                    double log2_ratio = X265_LOG2(intracost + propagateCost) - X265_LOG2(intracost) + weightdelta;
+                    int qpOffset = x265_qp2fix8(m_cuTreeStrength * log2_ratio);
+                    frame->qpCuTreeOffset[cuX * 2 + cuY * m_8x8Width * 4] = x265_clip_fix8(frame->qpAqOffset[cuX * 2 + cuY * m_8x8Width * 4] - qpOffset);
+                    frame->qpCuTreeOffset[cuX * 2 + cuY * m_8x8Width * 4 + 1] = x265_clip_fix8(frame->qpAqOffset[cuX * 2 + cuY * m_8x8Width * 4 + 1] - qpOffset);
+                    frame->qpCuTreeOffset[cuX * 2 + cuY * m_8x8Width * 4 + frame->maxBlocksInRowFullRes] = x265_clip_fix8(frame->qpAqOffset[cuX * 2 + cuY * m_8x8Width * 4 + frame->maxBlocksInRowFullRes] - qpOffset);
+                    frame->qpCuTreeOffset[cuX * 2 + cuY * m_8x8Width * 4 + frame->maxBlocksInRowFullRes + 1] = x265_clip_fix8(frame->qpAqOffset[cuX * 2 + cuY * m_8x8Width * 4 + frame->maxBlocksInRowFullRes + 1] - qpOffset);
                 }
             }
         }
-        else
+    }
+    else
+    {
+        for (int cuIndex = rowStart * m_8x8Width; cuIndex < rowEnd * m_8x8Width; cuIndex++)
         {
-            for (int cuIndex = 0; cuIndex < m_cuCount; cuIndex++)
+            int intracost = (frame->intraCost[cuIndex] * frame->invQscaleFactor[cuIndex] + 128) >> 8;
+            if (intracost)
             {
-                int intracost = (frame->intraCost[cuIndex] * frame->invQscaleFactor[cuIndex] + 128) >> 8;
-                if (intracost)
-                {
-                    int propagateCost = (frame->propagateCost[cuIndex] * fpsFactor + 128) >> 8;
-                    double log2_ratio = X265_LOG2(intracost + propagateCost) - X265_LOG2(intracost) + weightdelta;
-                    frame->qpCuTreeOffset[cuIndex] = frame->qpAqOffset[cuIndex] - m_cuTreeStrength * log2_ratio;
-                }
+                int propagateCost = (frame->propagateCost[cuIndex] * fpsFactor + 128) >> 8;
+                double log2_ratio = X265_LOG2(intracost + propagateCost) - X265_LOG2(intracost) + weightdelta;
+                frame->qpCuTreeOffset[cuIndex] = x265_clip_fix8(frame->qpAqOffset[cuIndex] - x265_qp2fix8(m_cuTreeStrength * log2_ratio));
             }
         }
     }
@@ -2659,73 +3426,45 @@ int64_t Lookahead::frameCostRecalculate(Lowres** frames, int p0, int p1, int b)
 
     int64_t score = 0;
     int *rowSatd = frames[b]->rowSatds[b - p0][p1 - b];
-
-    x265_emms();
-
+    const uint16_t* costs = frames[b]->lowresCosts[b - p0][p1 - b];
+    const int16_t* qpOffsets = frames[b]->qpCuTreeOffset;
     if (m_param->rc.hevcAq)
+        qpOffsets = frames[b]->pAQLayer[frames[b]->pAQLayer->minAQDepth].dCuTreeOffset;
+    bool bQgSize8 = m_param->rc.qgSize == 8;
+    bool bBorders = m_8x8Width <= 2 || m_8x8Height <= 2;
+
+    for (int cuy = 0; cuy < m_8x8Height; cuy++)
     {
-        int minAQDepth = frames[b]->pAQLayer->minAQDepth;
-        PicQPAdaptationLayer* pQPLayer = &frames[b]->pAQLayer[minAQDepth];
-        double* pcQPCuTree = pQPLayer->dCuTreeOffset;
+        int64_t rowCost = weightedRowCost(costs, qpOffsets, m_8x8Width, cuy, 0, m_8x8Width, bQgSize8);
+        rowSatd[cuy] = (int)rowCost;
+        if (bBorders)
+            score += rowCost;
+        else if (cuy > 0 && cuy < m_8x8Height - 1)
+            score += rowCost - weightedRowCost(costs, qpOffsets, m_8x8Width, cuy, 0, 1, bQgSize8) -
+                     weightedRowCost(costs, qpOffsets, m_8x8Width, cuy, m_8x8Width - 1, m_8x8Width, bQgSize8);
+    }
 
-        // Use new qp offset values for qpAqOffset, qpCuTreeOffset and invQscaleFactor buffer
-        for (int cuy = m_8x8Height - 1; cuy >= 0; cuy--)
-        {
-            rowSatd[cuy] = 0;
-            for (int cux = m_8x8Width - 1; cux >= 0; cux--)
-            {
-                int cuxy = cux + cuy * m_8x8Width;
-                int cuCost = frames[b]->lowresCosts[b - p0][p1 - b][cuxy] & LOWRES_COST_MASK;
-                double qp_adj;
+    return score;
+}
 
-                if (m_param->rc.qgSize == 8)
-                    qp_adj = (pcQPCuTree[cux * 2 + cuy * m_8x8Width * 4] +
-                    pcQPCuTree[cux * 2 + cuy * m_8x8Width * 4 + 1] +
-                    pcQPCuTree[cux * 2 + cuy * m_8x8Width * 4 + frames[b]->maxBlocksInRowFullRes] +
-                    pcQPCuTree[cux * 2 + cuy * m_8x8Width * 4 + frames[b]->maxBlocksInRowFullRes + 1]) / 4;
-                else
-                    qp_adj = *(pcQPCuTree + cuxy);
+/* The cost frameCostRecalculate() would return, without updating the row
+ * satds; published by a leader for its followers */
+int64_t Lookahead::cuTreeWeightedCost(Lowres& frame, int p0Dist, int p1Dist)
+{
+    if (frame.sliceType == X265_TYPE_B)
+        return frame.costEstAq[p0Dist][p1Dist];
 
-                cuCost = (cuCost * x265_exp2fix8(qp_adj) + 128) >> 8;
-                rowSatd[cuy] += cuCost;
-                if ((cuy > 0 && cuy < m_8x8Height - 1 &&
-                    cux > 0 && cux < m_8x8Width - 1) ||
-                    m_8x8Width <= 2 || m_8x8Height <= 2)
-                {
-                    score += cuCost;
-                }
-            }
-        }
-    }
-    else
+    int64_t score = 0;
+    const uint16_t* costs = frame.lowresCosts[p0Dist][p1Dist];
+    bool bQgSize8 = m_param->rc.qgSize == 8;
+    bool bBorders = m_8x8Width <= 2 || m_8x8Height <= 2;
+
+    for (int cuy = 0; cuy < m_8x8Height; cuy++)
     {
-        double *qp_offset = frames[b]->qpCuTreeOffset;
-
-        for (int cuy = m_8x8Height - 1; cuy >= 0; cuy--)
-        {
-            rowSatd[cuy] = 0;
-            for (int cux = m_8x8Width - 1; cux >= 0; cux--)
-            {
-                int cuxy = cux + cuy * m_8x8Width;
-                int cuCost = frames[b]->lowresCosts[b - p0][p1 - b][cuxy] & LOWRES_COST_MASK;
-                double qp_adj;
-                if (m_param->rc.qgSize == 8)
-                    qp_adj = (qp_offset[cux * 2 + cuy * m_8x8Width * 4] +
-                    qp_offset[cux * 2 + cuy * m_8x8Width * 4 + 1] +
-                    qp_offset[cux * 2 + cuy * m_8x8Width * 4 + frames[b]->maxBlocksInRowFullRes] +
-                    qp_offset[cux * 2 + cuy * m_8x8Width * 4 + frames[b]->maxBlocksInRowFullRes + 1]) / 4;
-                else 
-                    qp_adj = qp_offset[cuxy];
-                cuCost = (cuCost * x265_exp2fix8(qp_adj) + 128) >> 8;
-                rowSatd[cuy] += cuCost;
-                if ((cuy > 0 && cuy < m_8x8Height - 1 &&
-                    cux > 0 && cux < m_8x8Width - 1) ||
-                    m_8x8Width <= 2 || m_8x8Height <= 2)
-                {
-                    score += cuCost;
-                }
-            }
-        }
+        if (bBorders)
+            score += weightedRowCost(costs, frame.qpCuTreeOffset, m_8x8Width, cuy, 0, m_8x8Width, bQgSize8);
+        else if (cuy > 0 && cuy < m_8x8Height - 1)
+            score += weightedRowCost(costs, frame.qpCuTreeOffset, m_8x8Width, cuy, 1, m_8x8Width - 1, bQgSize8);
     }
 
     return score;
@@ -2755,7 +3494,7 @@ void CostEstimateGroup::add(int p0, int p1, int b)
 void CostEstimateGroup::finishBatch()
 {
     if (m_lookahead.m_pool)
-        tryBondPeers(*m_lookahead.m_pool, m_jobTotal);
+        tryBondPeers(*m_lookahead.m_pool, m_jobTotal, &m_lookahead);
     processTasks(-1);
     waitForExit();
     m_jobTotal = m_jobAcquired = 0;
@@ -2790,6 +3529,25 @@ void CostEstimateGroup::processTasks(int workerThreadID)
 
             X265_CHECK(i < MAX_COOP_SLICES, "impossible number of coop slices\n");
 
+            if (m_coop.bLowerRes)
+            {
+                int heightInCU = (m_lookahead.m_8x8Height + 1) >> 1;
+                int firstY = heightInCU * i / m_jobTotal;
+                int lastY = heightInCU * (i + 1) / m_jobTotal - 1;
+
+                bool lastRow = true;
+                for (int cuY = lastY; cuY >= firstY; cuY--)
+                {
+                    for (int cuX = ((m_lookahead.m_8x8Width + 1) >> 1) - 1; cuX >= 0; cuX--)
+                        estimateLowerResMV(tld, cuX, cuY, m_coop.p0, m_coop.p1, m_coop.b, m_coop.bDoSearch, lastRow);
+
+                    lastRow = false;
+                }
+
+                m_lock.acquire();
+                continue;
+            }
+
             int firstY = m_lookahead.m_numRowsPerSlice * i;
             int lastY = (i == m_jobTotal - 1) ? m_lookahead.m_8x8Height - 1 : m_lookahead.m_numRowsPerSlice * (i + 1) - 1;
 
@@ -2838,6 +3596,10 @@ int64_t CostEstimateGroup::estimateFrameCost(LookaheadTLD& tld, int p0, int p1,
         fenc->costEst[b - p0][p1 - b] = 0;
         fenc->costEstAq[b - p0][p1 - b] = 0;
 
+        /* the quarter resolution search of --lookahead-hme runs first, as a
+         * pass of its own, and seeds the lowres search */
+        bool bLowerRes = param->bLookaheadHME && (bDoSearch[0] || bDoSearch[1]);
+
         if (!m_batchMode && m_lookahead.m_numCoopSlices > 1 && ((p1 > b) || bDoSearch[0] || bDoSearch[1]))
         {
             /* Use cooperative mode if a thread pool is available and the cost estimate is
@@ -2845,22 +3607,26 @@ int64_t CostEstimateGroup::estimateFrameCost(LookaheadTLD& tld, int p0, int p1,
 
             memset(&m_slice, 0, sizeof(Slice) * m_lookahead.m_numCoopSlices);
 
-            m_lock.acquire();
-            X265_CHECK(!m_batchMode, "single CostEstimateGroup instance cannot mix batch modes\n");
-            m_coop.p0 = p0;
-            m_coop.p1 = p1;
-            m_coop.b = b;
-            m_coop.bDoSearch[0] = bDoSearch[0];
-            m_coop.bDoSearch[1] = bDoSearch[1];
-            m_jobTotal = m_lookahead.m_numCoopSlices;
-            m_jobAcquired = 0;
-            m_lock.release();
-
-            tryBondPeers(*m_lookahead.m_pool, m_jobTotal);
-
-            processTasks(-1);
-
-            waitForExit();
+            for (int pass = bLowerRes ? 0 : 1; pass < 2; pass++)
+            {
+                m_lock.acquire();
+                X265_CHECK(!m_batchMode, "single CostEstimateGroup instance cannot mix batch modes\n");
+                m_coop.p0 = p0;
+                m_coop.p1 = p1;
+                m_coop.b = b;
+                m_coop.bDoSearch[0] = bDoSearch[0];
+                m_coop.bDoSearch[1] = bDoSearch[1];
+                m_coop.bLowerRes = !pass;
+                m_jobTotal = m_lookahead.m_numCoopSlices;
+                m_jobAcquired = 0;
+                m_lock.release();
+
+                tryBondPeers(*m_lookahead.m_pool, m_jobTotal, &m_lookahead);
+
+                processTasks(-1);
+
+                waitForExit();
+            }
 
             for (int i = 0; i < m_lookahead.m_numCoopSlices; i++)
             {
@@ -2872,6 +3638,18 @@ int64_t CostEstimateGroup::estimateFrameCost(LookaheadTLD& tld, int p0, int p1,
         }
         else
         {
+            if (bLowerRes)
+            {
+                bool lastRow = true;
+                for (int cuY = ((m_lookahead.m_8x8Height + 1) >> 1) - 1; cuY >= 0; cuY--)
+                {
+                    for (int cuX = ((m_lookahead.m_8x8Width + 1) >> 1) - 1; cuX >= 0; cuX--)
+                        estimateLowerResMV(tld, cuX, cuY, p0, p1, b, bDoSearch, lastRow);
+
+                    lastRow = false;
+                }
+            }
+
             bool lastRow = true;
             for (int cuY = m_lookahead.m_8x8Height - 1; cuY >= 0; cuY--)
             {
@@ -2914,8 +3692,11 @@ void CostEstimateGroup::estimateCUCost(LookaheadTLD& tld, int cuX, int cuY, int
     const int cuSize = X265_LOWRES_CU_SIZE;
     const intptr_t pelOffset = cuSize * cuX + cuSize * cuY * fenc->lumaStride;
 
+    /* with --lookahead-hme the search starts from the quarter resolution
+     * vectors, a diamond search is enough to refine them */
+    const bool bLowerRes = !!m_lookahead.m_param->bLookaheadHME;
     if (bBidir || bDoSearch[0] || bDoSearch[1])
-        tld.me.setSourcePU(fenc->lowresPlane[0], fenc->lumaStride, pelOffset, cuSize, cuSize, X265_HEX_SEARCH, 1);
+        tld.me.setSourcePU(fenc->lowresPlane[0], fenc->lumaStride, pelOffset, cuSize, cuSize, bLowerRes ? X265_DIA_SEARCH : X265_HEX_SEARCH, 1);
 
     /* A small, arbitrary bias to avoid VBV problems caused by zero-residual lookahead blocks. */
     int lowresPenalty = 4;
@@ -2944,7 +3725,7 @@ void CostEstimateGroup::estimateCUCost(LookaheadTLD& tld, int cuX, int cuY, int
         }
 
         int numc = 0;
-        MV mvc[4], mvp;
+        MV mvc[5], mvp;
         MV* fencMV = &fenc->lowresMvs[i][listDist[i]][cuXY];
         ReferencePlanes* fref = i ? fref1 : wfref0;
 
@@ -2960,6 +3741,11 @@ void CostEstimateGroup::estimateCUCost(LookaheadTLD& tld, int cuX, int cuY, int
             if (cuX < widthInCU - 1)
                 MVC(fencMV[widthInCU + 1]);
         }
+        if (bLowerRes)
+        {
+            const MV& lowerMV = fenc->lowerResMvs[i][listDist[i]][(cuX >> 1) + (cuY >> 1) * ((widthInCU + 1) >> 1)];
+            MVC((lowerMV * 2).clipped(mvmin.toQPel(), mvmax.toQPel()));
+        }
 #undef MVC
 
         if (!numc)
@@ -2986,7 +3772,7 @@ void CostEstimateGroup::estimateCUCost(LookaheadTLD& tld, int cuX, int cuY, int
 
         /* ME will never return a cost larger than the cost @MVP, so we do not
          * have to check that ME cost is more than the estimated merge cost */
-        fencCost = tld.me.motionEstimate(fref, mvmin, mvmax, mvp, 0, NULL, s_merange, *fencMV, m_lookahead.m_param->maxSlices);
+        fencCost = tld.me.motionEstimate(fref, mvmin, mvmax, mvp, 0, NULL, bLowerRes ? s_merange / 4 : s_merange, *fencMV, m_lookahead.m_param->maxSlices);
         if (skipCost < 64 && skipCost < fencCost && bBidir)
         {
             fencCost = skipCost;
@@ -3058,3 +3844,210 @@ void CostEstimateGroup::estimateCUCost(LookaheadTLD& tld, int cuX, int cuY, int
     fenc->rowSatds[b - p0][p1 - b][cuY] += bcostAq;
     fenc->lowresCosts[b - p0][p1 - b][cuXY] = (uint16_t)(X265_MIN(bcost, LOWRES_COST_MASK) | (listused << LOWRES_COST_SHIFT));
 }
+
+/* --lookahead-hme search of an 8x8 block of the quarter resolution plane,
+ * covering 2x2 lowres CUs, like the lowres search. Weighted prediction is
+ * not used at this level */
+void CostEstimateGroup::estimateLowerResMV(LookaheadTLD& tld, int cuX, int cuY, int p0, int p1, int b, bool bDoSearch[2], bool lastRow)
+{
+    Lowres *fenc = m_frames[b];
+
+    const int widthInCU = (m_lookahead.m_8x8Width + 1) >> 1;
+    const int heightInCU = (m_lookahead.m_8x8Height + 1) >> 1;
+    const int cuXY = cuX + cuY * widthInCU;
+    const int cuSize = X265_LOWRES_CU_SIZE;
+    const intptr_t stride = fenc->lowerRes.lumaStride;
+    const intptr_t pelOffset = cuSize * cuX + cuSize * cuY * stride;
+    int listDist[2] = { b - p0, p1 - b };
+
+    tld.me.setSourcePU(fenc->lowerRes.lowresPlane[0], stride, pelOffset, cuSize, cuSize, X265_HEX_SEARCH, 1);
+
+    MV mvmin, mvmax;
+    mvmin.x = (int32_t)(-cuX * cuSize - 8);
+    mvmin.y = (int32_t)(-cuY * cuSize - 8);
+    mvmax.x = (int32_t)((widthInCU - cuX - 1) * cuSize + 8);
+    mvmax.y = (int32_t)((heightInCU - cuY - 1) * cuSize + 8);
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (!bDoSearch[i])
+            continue;
+
+        int numc = 0;
+        MV mvc[4];
+        MV* fencMV = &fenc->lowerResMvs[i][listDist[i]][cuXY];
+        ReferencePlanes* fref = &m_frames[i ? p1 : p0]->lowerRes;
+
+        /* Reverse-order MV prediction */
+#define MVC(mv) mvc[numc++] = mv;
+        if (cuX < widthInCU - 1)
+            MVC(fencMV[1]);
+        if (!lastRow)
+        {
+            MVC(fencMV[widthInCU]);
+            if (cuX > 0)
+                MVC(fencMV[widthInCU - 1]);
+            if (cuX < widthInCU - 1)
+                MVC(fencMV[widthInCU + 1]);
+        }
+#undef MVC
+
+        /* the neighbor MV of lowest SATD cost is the MVP */
+        MV mvp = 0;
+        if (numc)
+        {
+            ALIGN_VAR_32(pixel, subpelbuf[X265_LOWRES_CU_SIZE * X265_LOWRES_CU_SIZE]);
+            int mvpcost = MotionEstimate::COST_MAX;
+            for (int idx = 0; idx < numc; idx++)
+            {
+                intptr_t bufStride = X265_LOWRES_CU_SIZE;
+                pixel *src = fref->lowresMC(pelOffset, mvc[idx], subpelbuf, bufStride);
+                int cost = tld.me.bufSATD(src, bufStride);
+                COPY2_IF_LT(mvpcost, cost, mvp, mvc[idx]);
+            }
+        }
+
+        tld.me.motionEstimate(fref, mvmin, mvmax, mvp, 0, NULL, s_merange, *fencMV, m_lookahead.m_param->maxSlices);
+    }
+}
+
+CUTreeGroup::CUTreeGroup(Lookahead& l, Lowres** f, double averageDuration)
+    : m_lookahead(l), m_frames(f), m_averageDuration(averageDuration)
+{
+    x265_emms();
+    m_fpsFactor = CLIP_DURATION((double)l.m_param->fpsDenom / l.m_param->fpsNum) / CLIP_DURATION(averageDuration);
+    m_numJobs = 0;
+    m_numTargets = 0;
+    m_numBands = (l.m_8x8Height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+}
+
+bool CUTreeGroup::isTarget(const uint16_t* costs) const
+{
+    for (int t = 0; t < m_numTargets; t++)
+        if (m_targets[t] == costs)
+            return true;
+    return false;
+}
+
+bool CUTreeGroup::addPropagate(int p0, int p1, int b, const uint16_t* propagateIn, int inStride,
+                               const int32_t* invQscales, int qscaleStride, uint16_t* refCosts[2])
+{
+    if (m_numJobs == MAX_BATCH_SIZE)
+        return false;
+
+    int target[2] = { -1, -1 };
+    int numTargets = m_numTargets;
+    for (int list = 0; list < 2; list++)
+    {
+        if (!refCosts[list])
+            continue;
+        int t = 0;
+        while (t < numTargets && m_targets[t] != refCosts[list])
+            t++;
+        if (t == numTargets)
+        {
+            if (numTargets == MAX_TARGETS)
+                return false;
+            m_targets[numTargets++] = refCosts[list];
+        }
+        target[list] = t;
+    }
+    m_numTargets = numTargets;
+
+    Job& job = m_jobs[m_numJobs++];
+    job.p0 = p0;
+    job.p1 = p1;
+    job.b = b;
+    job.propagateIn = propagateIn;
+    job.inStride = inStride;
+    job.invQscales = invQscales;
+    job.qscaleStride = qscaleStride;
+    job.target[0] = target[0];
+    job.target[1] = target[1];
+    job.ref0Distance = 0;
+    return true;
+}
+
+bool CUTreeGroup::addFinish(int b, int ref0Distance)
+{
+    if (m_numJobs == MAX_BATCH_SIZE)
+        return false;
+
+    Job& job = m_jobs[m_numJobs++];
+    job.p0 = job.p1 = job.b = b;
+    job.propagateIn = NULL;
+    job.invQscales = NULL;
+    job.inStride = job.qscaleStride = 0;
+    job.target[0] = job.target[1] = -1;
+    job.ref0Distance = ref0Distance;
+    return true;
+}
+
+void CUTreeGroup::finishBatch()
+{
+    if (!m_numJobs)
+        return;
+
+    int cuCount = m_lookahead.m_cuCount;
+    for (int t = 0; t < m_numTargets; t++)
+    {
+        int32_t* accum = m_lookahead.m_cuTreeAccum + t * cuCount;
+        for (int i = 0; i < cuCount; i++)
+            accum[i] = m_targets[t][i];
+    }
+
+    m_jobTotal = m_numJobs * m_numBands;
+    m_jobAcquired = 0;
+    tryBondPeers(*m_lookahead.m_pool, m_jobTotal, &m_lookahead);
+    processTasks(-1);
+    waitForExit();
+
+    for (int t = 0; t < m_numTargets; t++)
+    {
+        int32_t* accum = m_lookahead.m_cuTreeAccum + t * cuCount;
+        for (int i = 0; i < cuCount; i++)
+            m_targets[t][i] = (uint16_t)X265_MIN(accum[i], (1 << 16) - 1);
+    }
+
+    m_numJobs = m_numTargets = 0;
+    m_jobTotal = m_jobAcquired = 0;
+}
+
+void CUTreeGroup::processTasks(int workerThreadID)
+{
+    ThreadPool* pool = m_lookahead.m_pool;
+    int id = workerThreadID < 0 ? pool->m_numWorkers : workerThreadID;
+    int* scratch = m_lookahead.m_cuTreeScratch + id * m_lookahead.m_8x8Width;
+
+    m_lock.acquire();
+    while (m_jobAcquired < m_jobTotal)
+    {
+        int i = m_jobAcquired++;
+        m_lock.release();
+
+        Job& job = m_jobs[i / m_numBands];
+        int rowStart = (i % m_numBands) * ROWS_PER_TASK;
+        int rowEnd = X265_MIN(rowStart + ROWS_PER_TASK, m_lookahead.m_8x8Height);
+
+        if (job.propagateIn)
+        {
+            uint16_t* refCosts[2] = { NULL, NULL };
+            int32_t* refAccum[2];
+            for (int list = 0; list < 2; list++)
+                refAccum[list] = job.target[list] < 0 ? NULL : m_lookahead.m_cuTreeAccum + job.target[list] * m_lookahead.m_cuCount;
+            m_lookahead.propagateCURows(m_frames, m_fpsFactor, job.p0, job.p1, job.b, job.propagateIn, job.inStride,
+                                        job.invQscales, job.qscaleStride, refCosts, refAccum, rowStart, rowEnd, scratch);
+        }
+        else if (m_lookahead.m_param->rc.hevcAq)
+        {
+            /* the hevc-aq offsets are computed for the whole frame */
+            if (!rowStart)
+                m_lookahead.cuTreeFinish(m_frames[job.b], m_averageDuration, job.ref0Distance);
+        }
+        else
+            m_lookahead.cuTreeFinishRows(m_frames[job.b], m_averageDuration, job.ref0Distance, rowStart, rowEnd);
+
+        m_lock.acquire();
+    }
+    m_lock.release();
+}
@@ -46,6 +46,7 @@ struct LookaheadTLD
 {
     MotionEstimate  me;
     pixel*          wbuffer[4];
+    float*          aqScratch;  // per quant group, for the auto-variance AQ modes
     int             widthInCU;
     int             heightInCU;
     int             ncu;
@@ -64,6 +65,7 @@ struct LookaheadTLD
         me.setQP(X265_LOOKAHEAD_QP);
         for (int i = 0; i < 4; i++)
             wbuffer[i] = NULL;
+        aqScratch = NULL;
         widthInCU = heightInCU = ncu = paddedLines = 0;
 
 #if DETAILED_CU_STATS
@@ -81,7 +83,7 @@ struct LookaheadTLD
         ncu = n;
     }
 
-    ~LookaheadTLD() { X265_FREE(wbuffer[0]); }
+    ~LookaheadTLD() { X265_FREE(wbuffer[0]); X265_FREE(aqScratch); }
 
     void calcAdaptiveQuantFrame(Frame *curFrame, x265_param* param);
     void lowresIntraEstimate(Lowres& fenc, uint32_t qgSize);
@@ -97,6 +99,85 @@ protected:
     bool     allocWeightedRef(Lowres& fenc);
 };
 
+/* Slice decisions of a leader lookahead handed to the lookaheads of other
+ * encoders (followers) encoding the same source at other resolutions. The
+ * leader publishes one group per mini-GOP it outputs and every follower
+ * consumes the groups in the same order */
+class LookaheadShare
+{
+public:
+
+    struct Decision
+    {
+        int       poc;
+        int       sliceType;
+        int       leadingBframes;
+        bool      bKeyframe;
+        bool      bScenecut;
+        bool      bLastMiniGopBFrame;
+        int64_t   costEst[X265_BFRAME_MAX + 2][X265_BFRAME_MAX + 2];
+        int64_t   costEstAq[X265_BFRAME_MAX + 2][X265_BFRAME_MAX + 2];
+        int64_t   costEstCuTree[X265_BFRAME_MAX + 2][X265_BFRAME_MAX + 2];
+        int       plannedType[X265_LOOKAHEAD_MAX + 1];
+        int64_t   plannedSatd[X265_LOOKAHEAD_MAX + 1];
+        int16_t*  cuTreeDelta;     // qpCuTreeOffset - qpAqOffset on the leader's grid, or NULL
+    };
+
+    struct Group
+    {
+        Decision* frames;          // in input order
+        int       numFrames;
+        int       pending;         // followers which have not consumed this group
+        Group*    next;
+    };
+
+    enum { MAX_FOLLOWERS = 16 };
+
+    Lock              m_lock;
+    Group*            m_head;          // oldest group not consumed by every follower
+    Group*            m_tail;
+    int               m_headSeq;       // sequence number of m_head
+    volatile int      m_numPublished;  // number of groups published so far
+    ThreadSafeInteger m_updates;       // advanced by each publish and by closeLeader()
+    Lookahead*        m_followers[MAX_FOLLOWERS];
+    int               m_numFollowers;
+    int               m_refCount;
+    volatile bool     m_bLeaderClosed;
+
+    /* leader geometry, used to scale costs and cuTree offsets */
+    int               m_width;
+    int               m_height;
+    int               m_mapWidth;
+    int               m_mapHeight;
+
+    LookaheadShare(int width, int height, int mapWidth, int mapHeight);
+    ~LookaheadShare();
+
+    bool   addFollower(Lookahead& follower);
+    void   removeFollower(Lookahead& follower, int seq);
+    void   publish(Group* group);
+    bool   isReady(int seq, int numFrames);
+    Group* peek(int seq);
+    void   consume(int seq);
+    bool   waitForGroup(int seq, int published, int updates);
+    void   closeLeader();
+    void   release();
+
+protected:
+
+    void   consumeLocked(int seq);
+};
+
+/* one propagation of a cuTree() run, from frame b into its references p0
+ * and p1, in the order they are applied */
+struct CUTreeStep
+{
+    int  p0;
+    int  p1;
+    int  b;
+    bool referenced;
+};
+
 class Lookahead : public JobProvider
 {
 public:
@@ -110,6 +191,15 @@ public:
     x265_param*   m_param;
     Lowres*       m_lastNonB;
     int*          m_scratch;         // temp buffer for cutree propagate
+    int32_t*      m_zeroQscale;      // one row of zero invQscales, propagates a delta alone
+    int32_t*      m_cuTreeAccum;     // CUTreeGroup reference accumulators, NULL when propagating serially
+    int*          m_cuTreeScratch;   // one propagate row per worker thread, for CUTreeGroup
+    int           m_cuTreeRun;       // number of cuTree() runs, see Lowres::cuTreeRun
+    int           m_cuTreeHead;      // frameNum of the first and last non-B frame of the last run
+    int           m_cuTreeEnd;
+    int64_t       m_cuTreeElapsedTime; // time spent propagating in cuTree()
+    uint32_t      m_countCuTree;
+    uint32_t      m_countCuTreeIncremental;
 
     /* pre-lookahead */
     int           m_fullQueueSize;
@@ -138,6 +228,11 @@ public:
     bool          m_isFadeIn;
     uint64_t      m_fadeCount;
     int           m_fadeStart;
+
+    /* decisions shared with the lookaheads of other encoders */
+    LookaheadShare* m_share;
+    bool          m_bShareFollower;
+    int           m_shareSeq;        // next group to consume, followers only
     Lookahead(x265_param *param, ThreadPool *pool);
 #if DETAILED_CU_STATS
     int64_t       m_slicetypeDecideElapsedTime;
@@ -160,11 +255,23 @@ public:
     void    getEstimatedPictureCost(Frame *pic);
     void    setLookaheadQueue();
 
+    bool    addFollower(Lookahead& follower);
+
+    /* called by CUTreeGroup for bands of rows */
+    void    propagateCURows(Lowres **frames, double fpsFactor, int p0, int p1, int b, const uint16_t* propagateIn,
+                            int inStride, const int32_t* invQscales, int qscaleStride, uint16_t* refCosts[2],
+                            int32_t* refAccum[2], int rowStart, int rowEnd, int* scratch);
+    void    cuTreeFinish(Lowres *frame, double averageDuration, int ref0Distance);
+    void    cuTreeFinishRows(Lowres *frame, double averageDuration, int ref0Distance, int rowStart, int rowEnd);
+
 protected:
 
     void    findJob(int workerThreadID);
     void    slicetypeDecide();
     void    slicetypeAnalyse(Lowres **frames, bool bKeyframe);
+    void    slicetypeFollow();
+    void    miniGopCosts(Lowres **frames, int bframes);
+    void    publishDecisions(Frame **list, int bframes);
 
     /* called by slicetypeAnalyse() to make slice decisions */
     bool    scenecut(Lowres **frames, int p0, int p1, bool bRealScenecut, int numFrames);
@@ -178,12 +285,17 @@ protected:
     /* called by slicetypeAnalyse() to effect cuTree adjustments to adaptive
      * quant offsets */
     void    cuTree(Lowres **frames, int numframes, bool bintra);
+    bool    cuTreeIncremental(Lowres **frames, int numframes, double averageDuration, const CUTreeStep* steps, int numSteps);
+    void    cuTreeRecord(Lowres **frames, const CUTreeStep* steps, int numSteps, const int* resets, int numResets);
+    void    cuTreeParallel(Lowres **frames, double averageDuration, const CUTreeStep* steps, int numSteps);
     void    estimateCUPropagate(Lowres **frames, double average_duration, int p0, int p1, int b, int referenced);
-    void    cuTreeFinish(Lowres *frame, double averageDuration, int ref0Distance);
+    void    propagateCUCost(Lowres **frames, double averageDuration, int p0, int p1, int b, const uint16_t* propagateIn,
+                            int inStride, const int32_t* invQscales, int qscaleStride, uint16_t* refCosts[2]);
     void    computeCUTreeQpOffset(Lowres *frame, double averageDuration, int ref0Distance);
 
     /* called by getEstimatedPictureCost() to finalize cuTree costs */
     int64_t frameCostRecalculate(Lowres **frames, int p0, int p1, int b);
+    int64_t cuTreeWeightedCost(Lowres& frame, int p0Dist, int p1Dist);
 };
 
 class PreLookaheadGroup : public BondedTaskGroup
@@ -217,6 +329,7 @@ public:
     {
         int  p0, b, p1;
         bool bDoSearch[2];
+        bool bLowerRes;     // quarter resolution search pass of --lookahead-hme
     } m_coop;
 
     enum { MAX_COOP_SLICES = 32 };
@@ -247,10 +360,62 @@ protected:
 
     int64_t estimateFrameCost(LookaheadTLD& tld, int p0, int p1, int b, bool intraPenalty);
     void    estimateCUCost(LookaheadTLD& tld, int cux, int cuy, int p0, int p1, int b, bool bDoSearch[2], bool lastRow, int slice);
+    void    estimateLowerResMV(LookaheadTLD& tld, int cux, int cuy, int p0, int p1, int b, bool bDoSearch[2], bool lastRow);
 
     CostEstimateGroup& operator=(const CostEstimateGroup&);
 };
 
+/* Row parallel cuTree propagation. The propagations and cuTreeFinish()
+ * calls of a batch are split in bands of rows, processed by bonded worker
+ * threads. The frames of a batch must not propagate into each other, but
+ * rows of several of them may add to the same reference, so references are
+ * accumulated in 32 bits with atomic adds and clipped when the batch is
+ * done. The result is identical to the serial propagation */
+class CUTreeGroup : public BondedTaskGroup
+{
+public:
+
+    enum { MAX_BATCH_SIZE = X265_BFRAME_MAX + 4 };
+    enum { MAX_TARGETS = 4 };
+    enum { ROWS_PER_TASK = 8 };
+
+    struct Job
+    {
+        int             p0, p1, b;
+        const uint16_t* propagateIn;     // NULL for a cuTreeFinish() job
+        int             inStride;
+        const int32_t*  invQscales;
+        int             qscaleStride;
+        int             target[2];       // index in m_targets, -1 when the list is left out
+        int             ref0Distance;
+    };
+
+    Lookahead& m_lookahead;
+    Lowres**   m_frames;
+    double     m_averageDuration;
+    double     m_fpsFactor;
+    Job        m_jobs[MAX_BATCH_SIZE];
+    int        m_numJobs;
+    uint16_t*  m_targets[MAX_TARGETS];
+    int        m_numTargets;
+    int        m_numBands;
+
+    CUTreeGroup(Lookahead& l, Lowres** f, double averageDuration);
+
+    /* returns false when the batch is full, it must be finished first */
+    bool addPropagate(int p0, int p1, int b, const uint16_t* propagateIn, int inStride,
+                      const int32_t* invQscales, int qscaleStride, uint16_t* refCosts[2]);
+    bool addFinish(int b, int ref0Distance);
+    bool isTarget(const uint16_t* costs) const;
+    void finishBatch();
+
+protected:
+
+    void processTasks(int workerThreadID);
+
+    CUTreeGroup& operator=(const CUTreeGroup&);
+};
+
 }
 
 #endif // ifndef X265_SLICETYPE_H
@@ -0,0 +1,211 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#include "common.h"
+#include "statsfile.h"
+
+using namespace X265_NS;
+
+namespace {
+
+const char     s_magic[8] = { 'X', '2', '6', '5', 'S', 'T', 'A', 'T' };
+const uint32_t s_version = 1;
+const uint32_t BLOCK_ALIGN = 16;
+
+inline uint64_t alignBlock(uint64_t pos)
+{
+    return (pos + BLOCK_ALIGN - 1) & ~(uint64_t)(BLOCK_ALIGN - 1);
+}
+
+} // end anonymous namespace
+
+StatsFile::StatsFile()
+{
+    /* close() releases these before it resets every member */
+    m_writeEntries = NULL;
+    m_base = NULL;
+    close();
+}
+
+bool StatsFile::append(const void* data, size_t bytes)
+{
+    static const uint8_t zeros[BLOCK_ALIGN] = { 0 };
+    if (bytes && fwrite(data, 1, bytes, m_fp) != bytes)
+        return false;
+    m_pos += bytes;
+
+    size_t padding = (size_t)(alignBlock(m_pos) - m_pos);
+    if (padding && fwrite(zeros, 1, padding, m_fp) != padding)
+        return false;
+    m_pos += padding;
+    return true;
+}
+
+bool StatsFile::create(FILE* fp, const char* options, int cuTreeSize)
+{
+    memset(&m_header, 0, sizeof(m_header));
+    memcpy(m_header.magic, s_magic, sizeof(m_header.magic));
+    m_header.version = s_version;
+    m_header.cuTreeSize = (uint32_t)cuTreeSize;
+    m_header.optionsSize = (uint32_t)strlen(options) + 1;
+
+    m_fp = fp;
+    m_pos = 0;
+    if (!append(&m_header, sizeof(m_header)))
+        return false;
+    m_header.optionsOffset = m_pos;
+    return append(options, m_header.optionsSize);
+}
+
+bool StatsFile::write(const Entry& entry, const int16_t* cuTree)
+{
+    if (m_header.entryCount == m_maxEntries)
+    {
+        uint32_t maxEntries = m_maxEntries ? 2 * m_maxEntries : 1024;
+        Entry* entries = X265_MALLOC(Entry, maxEntries);
+        if (!entries)
+            return false;
+        if (m_header.entryCount)
+            memcpy(entries, m_writeEntries, m_header.entryCount * sizeof(Entry));
+        X265_FREE(m_writeEntries);
+        m_writeEntries = entries;
+        m_maxEntries = maxEntries;
+    }
+
+    Entry& dst = m_writeEntries[m_header.entryCount++];
+    dst = entry;
+    dst.cuTreeOffset = 0;
+    if (cuTree && m_header.cuTreeSize)
+    {
+        dst.cuTreeOffset = m_pos;
+        return append(cuTree, m_header.cuTreeSize * sizeof(int16_t));
+    }
+    return true;
+}
+
+bool StatsFile::finish()
+{
+    /* frames are written as they are output, which is nearly encode order */
+    Entry* entries = m_writeEntries;
+    for (uint32_t i = 1; i < m_header.entryCount; i++)
+    {
+        Entry e = entries[i];
+        uint32_t j = i;
+        for (; j > 0 && entries[j - 1].encodeOrder > e.encodeOrder; j--)
+            entries[j] = entries[j - 1];
+        entries[j] = e;
+    }
+
+    m_header.entriesOffset = m_pos;
+    if (!append(entries, m_header.entryCount * sizeof(Entry)))
+        return false;
+    if (fseeko(m_fp, 0, SEEK_SET) || fwrite(&m_header, sizeof(m_header), 1, m_fp) != 1)
+        return false;
+    return !fseeko(m_fp, 0, SEEK_END);
+}
+
+bool StatsFile::isBinary(FILE* fp)
+{
+    char magic[sizeof(s_magic)];
+    bool bBinary = fread(magic, sizeof(magic), 1, fp) == 1 && !memcmp(magic, s_magic, sizeof(magic));
+    fseeko(fp, 0, SEEK_SET);
+    return bBinary;
+}
+
+bool StatsFile::open(FILE* fp)
+{
+    if (fseeko(fp, 0, SEEK_END))
+        return false;
+    int64_t size = ftello(fp);
+    if (size < (int64_t)sizeof(Header))
+        return false;
+
+    m_size = (uint64_t)size;
+    m_base = x265_map_file(fp, m_size);
+    m_bMapped = !!m_base;
+    if (!m_base)
+    {
+        /* no mapping, read the whole file instead */
+        uint8_t* buf = (uint64_t)(size_t)m_size == m_size ? X265_MALLOC(uint8_t, (size_t)m_size) : NULL;
+        m_base = buf;
+        if (!buf || fseeko(fp, 0, SEEK_SET) || fread(buf, 1, (size_t)m_size, fp) != (size_t)m_size)
+        {
+            close();
+            return false;
+        }
+    }
+
+    const Header& h = m_header;
+    memcpy(&m_header, m_base, sizeof(m_header));
+    if (memcmp(h.magic, s_magic, sizeof(s_magic)) || h.version != s_version ||
+        h.optionsOffset < sizeof(h) || h.optionsOffset > m_size || !h.optionsSize || h.optionsSize > m_size - h.optionsOffset ||
+        m_base[h.optionsOffset + h.optionsSize - 1] ||
+        h.entriesOffset < sizeof(h) || h.entriesOffset > m_size || (h.entriesOffset & (BLOCK_ALIGN - 1)) ||
+        h.entryCount > (m_size - h.entriesOffset) / sizeof(Entry) ||
+        h.cuTreeSize > h.entriesOffset / sizeof(int16_t))
+    {
+        close();
+        return false;
+    }
+
+    m_entries = (const Entry*)(m_base + h.entriesOffset);
+    uint64_t cuTreeBytes = (uint64_t)h.cuTreeSize * sizeof(int16_t);
+    for (uint32_t i = 0; i < h.entryCount; i++)
+    {
+        const Entry& e = m_entries[i];
+        if (e.encodeOrder != (int32_t)i ||
+            (e.cuTreeOffset && (e.cuTreeOffset < sizeof(h) || (e.cuTreeOffset & (BLOCK_ALIGN - 1)) ||
+                                e.cuTreeOffset > h.entriesOffset - cuTreeBytes)))
+        {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+const int16_t* StatsFile::cuTree(int encodeOrder) const
+{
+    uint64_t offset = m_entries[encodeOrder].cuTreeOffset;
+    return offset && m_header.cuTreeSize ? (const int16_t*)(m_base + offset) : NULL;
+}
+
+void StatsFile::close()
+{
+    if (m_base)
+    {
+        if (m_bMapped)
+            x265_unmap_file(m_base, m_size);
+        else
+            X265_FREE((void*)m_base);
+    }
+    X265_FREE(m_writeEntries);
+
+    memset(&m_header, 0, sizeof(m_header));
+    m_fp = NULL;
+    m_pos = 0;
+    m_writeEntries = NULL;
+    m_maxEntries = 0;
+    m_base = NULL;
+    m_size = 0;
+    m_bMapped = false;
+    m_entries = NULL;
+}
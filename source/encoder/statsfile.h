@@ -0,0 +1,128 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+#ifndef X265_STATSFILE_H
+#define X265_STATSFILE_H
+
+#include "common.h"
+
+namespace X265_NS {
+// private namespace
+
+/* Binary multi-pass stats of --stats-format 2. The file starts with a
+ * header, followed by the options string of the pass which wrote it and
+ * by the cuTree QP offsets of each referenced frame. The frame entries,
+ * sorted by encode order, are written at close and located by the header.
+ * Every block starts on a 16 byte boundary, so a later pass maps the file
+ * and reads the entries and cuTree offsets in place */
+class StatsFile
+{
+public:
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t cuTreeSize;     // QP offsets of each cuTree record
+        uint32_t optionsSize;    // bytes of the options string, with its NUL
+        uint64_t optionsOffset;
+        uint64_t entriesOffset;
+    };
+
+    /* the fields of one line of the text stats */
+    struct Entry
+    {
+        int32_t  poc;
+        int32_t  encodeOrder;
+        int32_t  coeffBits;
+        int32_t  mvBits;
+        int32_t  miscBits;
+        char     type;           // I, i, P, B or b, as in the text stats
+        uint8_t  reserved[3];
+        double   qpRc;
+        double   qpAq;
+        double   qpNoVbv;
+        double   qRceq;
+        double   iCuCount;
+        double   pCuCount;
+        double   skipCuCount;
+        int32_t  numberOfPictures;
+        int32_t  numberOfNegativePictures;
+        int32_t  numberOfPositivePictures;
+        int32_t  deltaPOC[MAX_NUM_REF_PICS];
+        uint8_t  bUsed[MAX_NUM_REF_PICS];
+        int32_t  reserved2;
+        uint64_t cuTreeOffset;   // file offset of the cuTree QP offsets, 0 if none
+    };
+
+    StatsFile();
+    ~StatsFile()                { close(); }
+
+    bool isOpen() const         { return m_fp || m_base; }
+
+    /* write: start the file with the options of this pass, cuTreeSize is
+     * the number of QP offsets of each cuTree record */
+    bool create(FILE* fp, const char* options, int cuTreeSize);
+
+    /* write: append the entry of one frame and its cuTree offsets, if any */
+    bool write(const Entry& entry, const int16_t* cuTree);
+
+    /* write: append the entries and complete the header */
+    bool finish();
+
+    /* read: true if fp, at its start, holds this format */
+    static bool isBinary(FILE* fp);
+
+    /* read: map the file, which the caller may close afterwards */
+    bool open(FILE* fp);
+
+    const char*  options() const        { return (const char*)(m_base + m_header.optionsOffset); }
+    int          numEntries() const     { return (int)m_header.entryCount; }
+    int          cuTreeSize() const     { return (int)m_header.cuTreeSize; }
+    const Entry& entry(int encodeOrder) const { return m_entries[encodeOrder]; }
+
+    /* read: cuTree offsets of the frame, NULL if it has none */
+    const int16_t* cuTree(int encodeOrder) const;
+
+    void close();
+
+protected:
+
+    Header       m_header;
+
+    /* write */
+    FILE*        m_fp;
+    uint64_t     m_pos;
+    Entry*       m_writeEntries;
+    uint32_t     m_maxEntries;
+
+    /* read */
+    const uint8_t* m_base;
+    uint64_t     m_size;
+    bool         m_bMapped;
+    const Entry* m_entries;
+
+    bool append(const void* data, size_t bytes);
+};
+}
+
+#endif // ifndef X265_STATSFILE_H
@@ -21,10 +21,21 @@
  * For more information, contact us at license @ x265.com.
  *****************************************************************************/
 
+#define _FILE_OFFSET_BITS 64
+#define _LARGEFILE_SOURCE
+#include "common.h"
 #include "input.h"
 #include "yuv.h"
 #include "y4m.h"
 
+#if !_WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 using namespace X265_NS;
 
 InputFile* InputFile::open(InputFileInfo& info, bool bForceY4m)
@@ -36,3 +47,143 @@ InputFile* InputFile::open(InputFileInfo& info, bool bForceY4m)
     else
         return new YUVInput(info);
 }
+
+RawFile::RawFile()
+{
+    fileSize = 0;
+    fd = -1;
+    map = NULL;
+}
+
+RawFile::~RawFile()
+{
+    close();
+}
+
+#if _WIN32
+
+bool RawFile::open(const char *, int)
+{
+    return false;
+}
+
+void RawFile::close() {}
+void RawFile::prefetch(int64_t, int64_t) {}
+void RawFile::drop(int64_t, int64_t) {}
+char* RawFile::allocBuffer(size_t) { return NULL; }
+void RawFile::freeBuffer(char*) {}
+size_t RawFile::read(int64_t, size_t, char*, char*&) { return 0; }
+
+#else /* POSIX */
+
+bool RawFile::open(const char *filename, int readMode)
+{
+    int flags = O_RDONLY;
+#ifdef O_DIRECT
+    if (readMode == INPUT_READ_DIRECT)
+        flags |= O_DIRECT;
+#endif
+    fd = ::open(filename, flags);
+#ifdef O_DIRECT
+    if (fd < 0 && errno == EINVAL && readMode == INPUT_READ_DIRECT)
+    {
+        x265_log(NULL, X265_LOG_WARNING, "input: O_DIRECT not supported by the file system, reading through the page cache\n");
+        fd = ::open(filename, O_RDONLY);
+    }
+#elif defined(F_NOCACHE)
+    if (fd >= 0 && readMode == INPUT_READ_DIRECT)
+        fcntl(fd, F_NOCACHE, 1);
+#endif
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size)
+    {
+        close();
+        return false;
+    }
+    fileSize = st.st_size;
+
+    if (readMode == INPUT_READ_MMAP)
+    {
+        void* ptr = mmap(NULL, (size_t)fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        map = (char*)ptr;
+        madvise(map, (size_t)fileSize, MADV_SEQUENTIAL);
+    }
+    else
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    return true;
+}
+
+void RawFile::close()
+{
+    if (map)
+        munmap(map, (size_t)fileSize);
+    if (fd >= 0)
+        ::close(fd);
+    map = NULL;
+    fd = -1;
+}
+
+void RawFile::prefetch(int64_t offset, int64_t len)
+{
+    int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t start = offset & ~(page - 1);
+    int64_t end = X265_MIN(offset + len, fileSize);
+    if (end > start)
+        madvise(map + start, (size_t)(end - start), MADV_WILLNEED);
+}
+
+/* only the pages entirely within the range are dropped, the first and last
+ * may be shared with the frames around it */
+void RawFile::drop(int64_t offset, int64_t len)
+{
+    int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t start = (offset + page - 1) & ~(page - 1);
+    int64_t end = (offset + len) & ~(page - 1);
+    if (end > start)
+        madvise(map + start, (size_t)(end - start), MADV_DONTNEED);
+}
+
+char* RawFile::allocBuffer(size_t len)
+{
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, DIRECT_ALIGN, len + 2 * DIRECT_ALIGN))
+        return NULL;
+    return (char*)ptr;
+}
+
+void RawFile::freeBuffer(char* buf)
+{
+    free(buf);
+}
+
+size_t RawFile::read(int64_t offset, size_t len, char* buf, char*& data)
+{
+    /* O_DIRECT transfers must start and end on aligned file offsets */
+    int64_t start = offset & ~(int64_t)(DIRECT_ALIGN - 1);
+    size_t skip = (size_t)(offset - start);
+    size_t total = (skip + len + DIRECT_ALIGN - 1) & ~(size_t)(DIRECT_ALIGN - 1);
+
+    size_t got = 0;
+    while (got < skip + len)
+    {
+        ssize_t ret = pread(fd, buf + got, total - got, start + got);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            break;
+        got += ret;
+    }
+    data = buf + skip;
+    return got > skip ? X265_MIN(got - skip, len) : 0;
+}
+
+#endif // if _WIN32
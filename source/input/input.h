@@ -36,6 +36,19 @@
 namespace X265_NS {
 // private x265 namespace
 
+enum InputReadMode
+{
+    INPUT_READ_BUFFERED, // fread() by a reader thread into a ring of frame buffers
+    INPUT_READ_MMAP,     // pictures point into a mapping of the file, no reader thread
+    INPUT_READ_DIRECT    // O_DIRECT reads by a reader thread, bypassing the page cache
+};
+
+static const char * const x265_input_read_names[] = { "buffered", "mmap", "direct", 0 };
+
+#define QUEUE_SIZE 5          // default read-ahead of the buffered reader
+#define DIRECT_QUEUE_SIZE 16  // default read-ahead of the O_DIRECT reader
+#define MAX_QUEUE_SIZE 256
+
 struct InputFileInfo
 {
     /* possibly user-supplied, possibly read from file header */
@@ -53,9 +66,49 @@ struct InputFileInfo
 
     /* user supplied */
     int skipFrames;
+    int readMode;    // InputReadMode
+    int queueSize;   // frames read ahead of the encoder, 0 for the default of the mode
     const char *filename;
 };
 
+/* Unbuffered access to a regular input file, for the mmap and O_DIRECT read
+ * modes. The whole file is mapped at once in mmap mode; in direct mode
+ * frames are read with pread() into buffers from allocBuffer(), widened to
+ * the alignment O_DIRECT requires */
+class RawFile
+{
+public:
+
+    enum { DIRECT_ALIGN = 4096 };
+
+    int64_t fileSize;
+
+    RawFile();
+    ~RawFile();
+
+    bool open(const char *filename, int readMode);
+    void close();
+
+    /* mmap mode, the mapping is private and writable so that pictures may
+     * be modified in place (dither) without touching the file */
+    char* mapping() const  { return map; }
+    void  prefetch(int64_t offset, int64_t len);
+    void  drop(int64_t offset, int64_t len);
+
+    /* direct mode, reads up to len bytes at offset into a buffer from
+     * allocBuffer(len) and returns the number of bytes read, data is set to
+     * their start within buf */
+    static char* allocBuffer(size_t len);
+    static void  freeBuffer(char* buf);
+    size_t       read(int64_t offset, size_t len, char* buf, char*& data);
+
+protected:
+
+    int   fd;
+    char* map;
+};
+
+
 class InputFile
 {
 protected:
@@ -40,10 +40,23 @@
 using namespace X265_NS;
 using namespace std;
 static const char header[] = {'F','R','A','M','E'};
+
+/* frame parameters are rarely used, the O_DIRECT reader reads this much past
+ * each picture for the header of the next */
+#define MAX_FRAME_HEADER 256
+
 Y4MInput::Y4MInput(InputFileInfo& info)
 {
-    for (int i = 0; i < QUEUE_SIZE; i++)
-        buf[i] = NULL;
+    readMode = info.readMode;
+    queueSize = info.queueSize > 0 ? X265_MIN(info.queueSize, MAX_QUEUE_SIZE) :
+                readMode == INPUT_READ_DIRECT ? DIRECT_QUEUE_SIZE : QUEUE_SIZE;
+    buf = X265_MALLOC(char*, queueSize);
+    frameData = X265_MALLOC(char*, queueSize);
+    for (int i = 0; i < queueSize; i++)
+        buf[i] = frameData[i] = NULL;
+    rawOffset = 0;
+    prevFrame = -1;
+    rawEof = false;
 
     threadActive = false;
     colorSpace = info.csp;
@@ -75,10 +88,32 @@ Y4MInput::Y4MInput(InputFileInfo& info)
             framesize += (stride * (height >> x265_cli_csps[colorSpace].height[i]));
         }
 
+        /* the stream header has been parsed from ifs, the frames are read
+         * from the raw file */
+        if (readMode != INPUT_READ_BUFFERED)
+        {
+            rawOffset = ifs != stdin ? ftello(ifs) : -1;
+            if (rawOffset >= 0 && raw.open(info.filename, readMode))
+            {
+                fclose(ifs);
+                ifs = NULL;
+            }
+            else
+            {
+                x265_log(NULL, X265_LOG_WARNING, "y4m: %s reads need a regular file, using buffered reads\n",
+                         x265_input_read_names[readMode]);
+                readMode = INPUT_READ_BUFFERED;
+            }
+        }
+
         threadActive = true;
-        for (int q = 0; q < QUEUE_SIZE; q++)
+        for (int q = 0; q < queueSize && readMode != INPUT_READ_MMAP; q++)
         {
-            buf[q] = X265_MALLOC(char, framesize);
+            size_t bufSize = framesize;
+            if (readMode == INPUT_READ_DIRECT)
+                bufSize += MAX_FRAME_HEADER;
+            buf[q] = readMode == INPUT_READ_DIRECT ? RawFile::allocBuffer(bufSize) : X265_MALLOC(char, bufSize);
+            frameData[q] = buf[q];
             if (!buf[q])
             {
                 x265_log(NULL, X265_LOG_ERROR, "y4m: buffer allocation failure, aborting");
@@ -92,6 +127,8 @@ Y4MInput::Y4MInput(InputFileInfo& info)
         if (ifs && ifs != stdin)
             fclose(ifs);
         ifs = NULL;
+        raw.close();
+        raw.fileSize = 0;
         return;
     }
 
@@ -105,8 +142,10 @@ Y4MInput::Y4MInput(InputFileInfo& info)
     info.depth = depth;
     info.frameCount = -1;
     size_t estFrameSize = framesize + sizeof(header) + 1; /* assume basic FRAME\n headers */
+    if (readMode != INPUT_READ_BUFFERED)
+        info.frameCount = (int)((raw.fileSize - rawOffset) / estFrameSize);
     /* try to estimate frame count, if this is not stdin */
-    if (ifs != stdin)
+    else if (ifs != stdin)
     {
         int64_t cur = ftello(ifs);
         if (cur >= 0)
@@ -119,21 +158,58 @@ Y4MInput::Y4MInput(InputFileInfo& info)
         }
     }
     if (info.skipFrames)
+        skipFrames(info.skipFrames);
+    if (readMode == INPUT_READ_MMAP)
+        raw.prefetch(rawOffset, (int64_t)estFrameSize * queueSize);
+}
+
+/* Frame headers may carry parameters, so the pictures are skipped one frame
+ * header at a time rather than by an estimate of the frame size */
+void Y4MInput::skipFrames(int numFrames)
+{
+    for (int i = 0; i < numFrames; i++)
     {
-        if (ifs != stdin)
-            fseeko(ifs, (int64_t)estFrameSize * info.skipFrames, SEEK_CUR);
+        if (readMode == INPUT_READ_BUFFERED)
+        {
+            if (!ifs || !readFrameHeader())
+                return;
+            if (ifs != stdin ? fseeko(ifs, (int64_t)framesize, SEEK_CUR) != 0 : fread(buf[0], framesize, 1, ifs) != 1)
+                return;
+        }
         else
-            for (int i = 0; i < info.skipFrames; i++)
-                if (fread(buf[0], estFrameSize - framesize, 1, ifs) + fread(buf[0], framesize, 1, ifs) != 2)
-                    break;
+        {
+            char* data;
+            int64_t avail;
+            if (readMode == INPUT_READ_MMAP)
+            {
+                data = raw.mapping() + rawOffset;
+                avail = raw.fileSize - rawOffset;
+            }
+            else
+                avail = (int64_t)raw.read(rawOffset, MAX_FRAME_HEADER, buf[0], data);
+            int hdr = avail > 0 ? frameHeaderSize(data, avail, false) : -1;
+            if (hdr < 0)
+            {
+                rawEof = true;
+                return;
+            }
+            rawOffset += hdr + framesize;
+        }
     }
 }
 Y4MInput::~Y4MInput()
 {
     if (ifs && ifs != stdin)
         fclose(ifs);
-    for (int i = 0; i < QUEUE_SIZE; i++)
-        X265_FREE(buf[i]);
+    for (int i = 0; i < queueSize; i++)
+    {
+        if (readMode == INPUT_READ_DIRECT)
+            RawFile::freeBuffer(buf[i]);
+        else
+            X265_FREE(buf[i]);
+    }
+    X265_FREE(buf);
+    X265_FREE(frameData);
 }
 
 void Y4MInput::release()
@@ -311,7 +387,7 @@ bool Y4MInput::parseHeader()
 void Y4MInput::startReader()
 {
 #if ENABLE_THREADING
-    if (threadActive)
+    if (threadActive && readMode != INPUT_READ_MMAP)
         start();
 #endif
 }
@@ -331,32 +407,42 @@ void Y4MInput::threadMain()
 }
 bool Y4MInput::populateFrameQueue()
 {
-    if (!ifs || ferror(ifs))
-        return false;
-    /* strip off the FRAME\n header */
-    char hbuf[sizeof(header) + 1];
-    if (fread(hbuf, sizeof(hbuf), 1, ifs) != 1 || memcmp(hbuf, header, sizeof(header)))
+    if (readMode == INPUT_READ_DIRECT)
     {
-        if (!feof(ifs))
-            x265_log(NULL, X265_LOG_ERROR, "y4m: frame header missing\n");
-        return false;
+        int written = writeCount.get();
+        int read = readCount.get();
+        while (written - read > queueSize - 2)
+        {
+            read = readCount.waitForChange(read);
+            if (!threadActive)
+                return false;
+        }
+        ProfileScopeEvent(frameRead);
+        int slot = written % queueSize;
+        char* data;
+        size_t avail = raw.read(rawOffset, framesize + MAX_FRAME_HEADER, buf[slot], data);
+        int hdr = frameHeaderSize(data, avail);
+        if (hdr < 0)
+            return false;
+        frameData[slot] = data + hdr;
+        rawOffset += hdr + framesize;
+        writeCount.incr();
+        return true;
     }
-    /* consume bytes up to line feed */
-    int c = hbuf[sizeof(header)];
-    while (c != '\n')
-        if ((c = fgetc(ifs)) == EOF)
-            break;
+
+    if (!ifs || ferror(ifs) || !readFrameHeader())
+        return false;
     /* wait for room in the ring buffer */
     int written = writeCount.get();
     int read = readCount.get();
-    while (written - read > QUEUE_SIZE - 2)
+    while (written - read > queueSize - 2)
     {
         read = readCount.waitForChange(read);
         if (!threadActive)
             return false;
     }
     ProfileScopeEvent(frameRead);
-    if (fread(buf[written % QUEUE_SIZE], framesize, 1, ifs) == 1)
+    if (fread(buf[written % queueSize], framesize, 1, ifs) == 1)
     {
         writeCount.incr();
         return true;
@@ -365,8 +451,84 @@ bool Y4MInput::populateFrameQueue()
         return false;
 }
 
+/* strip off the FRAME\n header of the next picture from ifs */
+bool Y4MInput::readFrameHeader()
+{
+    char hbuf[sizeof(header) + 1];
+    if (fread(hbuf, sizeof(hbuf), 1, ifs) != 1 || memcmp(hbuf, header, sizeof(header)))
+    {
+        if (!feof(ifs))
+            x265_log(NULL, X265_LOG_ERROR, "y4m: frame header missing\n");
+        return false;
+    }
+    /* consume bytes up to line feed */
+    int c = hbuf[sizeof(header)];
+    while (c != '\n')
+        if ((c = fgetc(ifs)) == EOF)
+            break;
+    return true;
+}
+
+/* Returns the length of the FRAME header at the start of data, or -1 at the
+ * end of the file or if the header is malformed or does not fit within the
+ * avail bytes that are, if bPicture, followed by a complete picture */
+int Y4MInput::frameHeaderSize(const char* data, int64_t avail, bool bPicture)
+{
+    if (avail < (int64_t)sizeof(header) + 1)
+    {
+        rawEof = true;
+        return -1;
+    }
+    if (memcmp(data, header, sizeof(header)))
+    {
+        x265_log(NULL, X265_LOG_ERROR, "y4m: frame header missing\n");
+        return -1;
+    }
+    const char* eol = (const char*)memchr(data, '\n', (size_t)X265_MIN(avail, (int64_t)MAX_FRAME_HEADER));
+    if (!eol)
+    {
+        if (avail >= MAX_FRAME_HEADER)
+            x265_log(NULL, X265_LOG_ERROR, "y4m: frame header too long\n");
+        rawEof = true;
+        return -1;
+    }
+    int hdr = (int)(eol - data) + 1;
+    if (bPicture && avail < hdr + (int64_t)framesize)
+    {
+        rawEof = true;
+        return -1;
+    }
+    return hdr;
+}
+
+/* mmap mode, see YUVInput::mapFrame() */
+char* Y4MInput::mapFrame()
+{
+    int hdr = rawOffset < raw.fileSize ? frameHeaderSize(raw.mapping() + rawOffset, raw.fileSize - rawOffset) : -1;
+    if (hdr < 0)
+    {
+        rawEof = true;
+        return NULL;
+    }
+    if (prevFrame >= 0)
+        raw.drop(prevFrame, framesize);
+    prevFrame = rawOffset + hdr;
+    rawOffset = prevFrame + framesize;
+    raw.prefetch(rawOffset + (int64_t)(framesize + hdr) * (queueSize - 1), framesize + hdr);
+    return raw.mapping() + prevFrame;
+}
+
 bool Y4MInput::readPicture(x265_picture& pic)
 {
+    if (readMode == INPUT_READ_MMAP)
+    {
+        char* data = mapFrame();
+        if (!data)
+            return false;
+        setPicture(pic, data);
+        return true;
+    }
+
     int read = readCount.get();
     int written = writeCount.get();
 
@@ -384,17 +546,7 @@ bool Y4MInput::readPicture(x265_picture& pic)
 
     if (read < written)
     {
-        int pixelbytes = depth > 8 ? 2 : 1;
-        pic.bitDepth = depth;
-        pic.framesize = framesize;
-        pic.height = height;
-        pic.colorSpace = colorSpace;
-        pic.stride[0] = width * pixelbytes;
-        pic.stride[1] = pic.stride[0] >> x265_cli_csps[colorSpace].width[1];
-        pic.stride[2] = pic.stride[0] >> x265_cli_csps[colorSpace].width[2];
-        pic.planes[0] = buf[read % QUEUE_SIZE];
-        pic.planes[1] = (char*)pic.planes[0] + pic.stride[0] * height;
-        pic.planes[2] = (char*)pic.planes[1] + pic.stride[1] * (height >> x265_cli_csps[colorSpace].height[1]);
+        setPicture(pic, frameData[read % queueSize]);
         readCount.incr();
         return true;
     }
@@ -402,3 +554,18 @@ bool Y4MInput::readPicture(x265_picture& pic)
         return false;
 }
 
+void Y4MInput::setPicture(x265_picture& pic, char* data)
+{
+    int pixelbytes = depth > 8 ? 2 : 1;
+    pic.bitDepth = depth;
+    pic.framesize = framesize;
+    pic.height = height;
+    pic.colorSpace = colorSpace;
+    pic.stride[0] = width * pixelbytes;
+    pic.stride[1] = pic.stride[0] >> x265_cli_csps[colorSpace].width[1];
+    pic.stride[2] = pic.stride[0] >> x265_cli_csps[colorSpace].width[2];
+    pic.planes[0] = data;
+    pic.planes[1] = (char*)pic.planes[0] + pic.stride[0] * height;
+    pic.planes[2] = (char*)pic.planes[1] + pic.stride[1] * (height >> x265_cli_csps[colorSpace].height[1]);
+}
+
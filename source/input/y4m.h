@@ -28,8 +28,6 @@
 #include "threading.h"
 #include <fstream>
 
-#define QUEUE_SIZE 5
-
 namespace X265_NS {
 // x265 private namespace
 
@@ -60,21 +58,38 @@ protected:
     ThreadSafeInteger readCount;
 
     ThreadSafeInteger writeCount;
-    char* buf[QUEUE_SIZE];
+    int readMode;      //< InputReadMode
+    int queueSize;
+    char** buf;
+    char** frameData;  //< start of each queued frame within buf
     FILE *ifs;
+    RawFile raw;       //< mmap and O_DIRECT reads, instead of ifs
+    int64_t rawOffset; //< file offset of the next frame header
+    int64_t prevFrame; //< file offset of the last mapped picture
+    bool rawEof;
     bool parseHeader();
     void threadMain();
 
     bool populateFrameQueue();
 
+    bool readFrameHeader();
+
+    char* mapFrame();
+
+    int frameHeaderSize(const char* data, int64_t avail, bool bPicture = true);
+
+    void skipFrames(int numFrames);
+
+    void setPicture(x265_picture& pic, char* data);
+
 public:
 
     Y4MInput(InputFileInfo& info);
 
     virtual ~Y4MInput();
     void release();
-    bool isEof() const            { return ifs && feof(ifs); }
-    bool isFail()                 { return !(ifs && !ferror(ifs) && threadActive); }
+    bool isEof() const            { return ifs ? !!feof(ifs) : rawEof; }
+    bool isFail()                 { return !((ifs ? !ferror(ifs) : raw.fileSize > 0) && threadActive); }
     void startReader();
     bool readPicture(x265_picture&);
 
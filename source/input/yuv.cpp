@@ -42,8 +42,13 @@ using namespace std;
 
 YUVInput::YUVInput(InputFileInfo& info)
 {
-    for (int i = 0; i < QUEUE_SIZE; i++)
-        buf[i] = NULL;
+    readMode = info.readMode;
+    queueSize = info.queueSize > 0 ? X265_MIN(info.queueSize, MAX_QUEUE_SIZE) :
+                readMode == INPUT_READ_DIRECT ? DIRECT_QUEUE_SIZE : QUEUE_SIZE;
+    buf = X265_MALLOC(char*, queueSize);
+    frameData = X265_MALLOC(char*, queueSize);
+    for (int i = 0; i < queueSize; i++)
+        buf[i] = frameData[i] = NULL;
 
     depth = info.depth;
     width = info.width;
@@ -51,6 +56,8 @@ YUVInput::YUVInput(InputFileInfo& info)
     colorSpace = info.csp;
     threadActive = false;
     ifs = NULL;
+    rawOffset = 0;
+    rawEof = false;
 
     uint32_t pixelbytes = depth > 8 ? 2 : 1;
     framesize = 0;
@@ -66,7 +73,16 @@ YUVInput::YUVInput(InputFileInfo& info)
         x265_log(NULL, X265_LOG_ERROR, "yuv: width, height, and FPS must be specified\n");
         return;
     }
-    if (!strcmp(info.filename, "-"))
+    if (readMode != INPUT_READ_BUFFERED && (!strcmp(info.filename, "-") || !raw.open(info.filename, readMode)))
+    {
+        x265_log(NULL, X265_LOG_WARNING, "yuv: %s reads need a regular file, using buffered reads\n",
+                 x265_input_read_names[readMode]);
+        readMode = INPUT_READ_BUFFERED;
+    }
+
+    if (readMode != INPUT_READ_BUFFERED)
+        threadActive = true;
+    else if (!strcmp(info.filename, "-"))
     {
         ifs = stdin;
 #if _WIN32
@@ -77,7 +93,7 @@ YUVInput::YUVInput(InputFileInfo& info)
         ifs = x265_fopen(info.filename, "rb");
     if (ifs && !ferror(ifs))
         threadActive = true;
-    else
+    else if (readMode == INPUT_READ_BUFFERED)
     {
         if (ifs && ifs != stdin)
             fclose(ifs);
@@ -85,9 +101,11 @@ YUVInput::YUVInput(InputFileInfo& info)
         return;
     }
 
-    for (uint32_t i = 0; i < QUEUE_SIZE; i++)
+    /* mmap pictures point into the mapping, they need no buffers */
+    for (int i = 0; i < queueSize && readMode != INPUT_READ_MMAP; i++)
     {
-        buf[i] = X265_MALLOC(char, framesize);
+        buf[i] = readMode == INPUT_READ_DIRECT ? RawFile::allocBuffer(framesize) : X265_MALLOC(char, framesize);
+        frameData[i] = buf[i];
         if (buf[i] == NULL)
         {
             x265_log(NULL, X265_LOG_ERROR, "yuv: buffer allocation failure, aborting\n");
@@ -97,8 +115,15 @@ YUVInput::YUVInput(InputFileInfo& info)
     }
 
     info.frameCount = -1;
+    if (readMode != INPUT_READ_BUFFERED)
+    {
+        info.frameCount = (int)(raw.fileSize / framesize);
+        rawOffset = (int64_t)framesize * info.skipFrames;
+        if (readMode == INPUT_READ_MMAP)
+            raw.prefetch(rawOffset, (int64_t)framesize * queueSize);
+    }
     /* try to estimate frame count, if this is not stdin */
-    if (ifs != stdin)
+    else if (ifs != stdin)
     {
         int64_t cur = ftello(ifs);
         if (cur >= 0)
@@ -110,7 +135,7 @@ YUVInput::YUVInput(InputFileInfo& info)
                 info.frameCount = (int)((size - cur) / framesize);
         }
     }
-    if (info.skipFrames)
+    if (info.skipFrames && ifs)
     {
         if (ifs != stdin)
             fseeko(ifs, (int64_t)framesize * info.skipFrames, SEEK_CUR);
@@ -124,8 +149,15 @@ YUVInput::~YUVInput()
 {
     if (ifs && ifs != stdin)
         fclose(ifs);
-    for (int i = 0; i < QUEUE_SIZE; i++)
-        X265_FREE(buf[i]);
+    for (int i = 0; i < queueSize; i++)
+    {
+        if (readMode == INPUT_READ_DIRECT)
+            RawFile::freeBuffer(buf[i]);
+        else
+            X265_FREE(buf[i]);
+    }
+    X265_FREE(buf);
+    X265_FREE(frameData);
 }
 
 void YUVInput::release()
@@ -139,7 +171,7 @@ void YUVInput::release()
 void YUVInput::startReader()
 {
 #if ENABLE_THREADING
-    if (threadActive)
+    if (threadActive && readMode != INPUT_READ_MMAP)
         start();
 #endif
 }
@@ -158,12 +190,12 @@ void YUVInput::threadMain()
 }
 bool YUVInput::populateFrameQueue()
 {
-    if (!ifs || ferror(ifs))
+    if (readMode == INPUT_READ_BUFFERED && (!ifs || ferror(ifs)))
         return false;
     /* wait for room in the ring buffer */
     int written = writeCount.get();
     int read = readCount.get();
-    while (written - read > QUEUE_SIZE - 2)
+    while (written - read > queueSize - 2)
     {
         read = readCount.waitForChange(read);
         if (!threadActive)
@@ -171,7 +203,19 @@ bool YUVInput::populateFrameQueue()
             return false;
     }
     ProfileScopeEvent(frameRead);
-    if (fread(buf[written % QUEUE_SIZE], framesize, 1, ifs) == 1)
+    int slot = written % queueSize;
+    if (readMode == INPUT_READ_DIRECT)
+    {
+        if (raw.read(rawOffset, framesize, buf[slot], frameData[slot]) < framesize)
+        {
+            rawEof = true;
+            return false;
+        }
+        rawOffset += framesize;
+        writeCount.incr();
+        return true;
+    }
+    if (fread(buf[slot], framesize, 1, ifs) == 1)
     {
         writeCount.incr();
         return true;
@@ -180,8 +224,36 @@ bool YUVInput::populateFrameQueue()
         return false;
 }
 
+/* mmap mode, the picture is handed out in place. The previous one has been
+ * copied by the encoder, its pages are dropped from the mapping, and the
+ * frame entering the read-ahead window is prefetched */
+char* YUVInput::mapFrame()
+{
+    if (rawOffset + framesize > raw.fileSize)
+    {
+        rawEof = true;
+        return NULL;
+    }
+    if (readCount.get())
+        raw.drop(rawOffset - framesize, framesize);
+    raw.prefetch(rawOffset + (int64_t)framesize * queueSize, framesize);
+    char* data = raw.mapping() + rawOffset;
+    rawOffset += framesize;
+    readCount.incr();
+    return data;
+}
+
 bool YUVInput::readPicture(x265_picture& pic)
 {
+    if (readMode == INPUT_READ_MMAP)
+    {
+        char* data = mapFrame();
+        if (!data)
+            return false;
+        setPicture(pic, data);
+        return true;
+    }
+
     int read = readCount.get();
     int written = writeCount.get();
 
@@ -199,20 +271,25 @@ bool YUVInput::readPicture(x265_picture& pic)
 
     if (read < written)
     {
-        uint32_t pixelbytes = depth > 8 ? 2 : 1;
-        pic.colorSpace = colorSpace;
-        pic.bitDepth = depth;
-        pic.framesize = framesize;
-        pic.height = height;
-        pic.stride[0] = width * pixelbytes;
-        pic.stride[1] = pic.stride[0] >> x265_cli_csps[colorSpace].width[1];
-        pic.stride[2] = pic.stride[0] >> x265_cli_csps[colorSpace].width[2];
-        pic.planes[0] = buf[read % QUEUE_SIZE];
-        pic.planes[1] = (char*)pic.planes[0] + pic.stride[0] * height;
-        pic.planes[2] = (char*)pic.planes[1] + pic.stride[1] * (height >> x265_cli_csps[colorSpace].height[1]);
+        setPicture(pic, frameData[read % queueSize]);
         readCount.incr();
         return true;
     }
     else
         return false;
 }
+
+void YUVInput::setPicture(x265_picture& pic, char* data)
+{
+    uint32_t pixelbytes = depth > 8 ? 2 : 1;
+    pic.colorSpace = colorSpace;
+    pic.bitDepth = depth;
+    pic.framesize = framesize;
+    pic.height = height;
+    pic.stride[0] = width * pixelbytes;
+    pic.stride[1] = pic.stride[0] >> x265_cli_csps[colorSpace].width[1];
+    pic.stride[2] = pic.stride[0] >> x265_cli_csps[colorSpace].width[2];
+    pic.planes[0] = data;
+    pic.planes[1] = (char*)pic.planes[0] + pic.stride[0] * height;
+    pic.planes[2] = (char*)pic.planes[1] + pic.stride[1] * (height >> x265_cli_csps[colorSpace].height[1]);
+}
@@ -28,8 +28,6 @@
 #include "threading.h"
 #include <fstream>
 
-#define QUEUE_SIZE 5
-
 namespace X265_NS {
 // private x265 namespace
 
@@ -52,21 +50,31 @@ protected:
     ThreadSafeInteger readCount;
 
     ThreadSafeInteger writeCount;
-    char* buf[QUEUE_SIZE];
+    int readMode;      //< InputReadMode
+    int queueSize;
+    char** buf;
+    char** frameData;  //< start of each queued frame within buf
     FILE *ifs;
+    RawFile raw;       //< mmap and O_DIRECT reads, instead of ifs
+    int64_t rawOffset; //< file offset of the next frame
+    bool rawEof;
     int guessFrameCount();
     void threadMain();
 
     bool populateFrameQueue();
 
+    char* mapFrame();
+
+    void setPicture(x265_picture& pic, char* data);
+
 public:
 
     YUVInput(InputFileInfo& info);
 
     virtual ~YUVInput();
     void release();
-    bool isEof() const                            { return ifs && feof(ifs); }
-    bool isFail()                                 { return !(ifs && !ferror(ifs) && threadActive); }
+    bool isEof() const                            { return ifs ? !!feof(ifs) : rawEof; }
+    bool isFail()                                 { return !((ifs ? !ferror(ifs) : raw.fileSize > 0) && threadActive); }
     void startReader();
 
     bool readPicture(x265_picture&);
@@ -0,0 +1,286 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+/* Benchmark of the incremental cuTree propagation. The same pictures, a
+ * synthetic pan over a textured background with moving objects or an 8bit
+ * 4:2:0 YUV file, are run through the standalone lookahead with a full
+ * cuTree recompute per slicetype decision and with --cutree-incremental.
+ * Reports the time spent propagating, the lookahead frame rate of both and
+ * how far the cuTree QP offsets and frame types of the incremental run are
+ * from the full one */
+
+#include "common.h"
+#include "slicetype.h"
+#include "lookaheadonly.h"
+#include "x265.h"
+
+using namespace X265_NS;
+
+namespace {
+
+struct BenchConfig
+{
+    const char* input;
+    const char* preset;
+    int width;
+    int height;
+    int numFrames;
+    int lookahead;
+    int bframes;
+    int threads;
+};
+
+struct RunStats
+{
+    double   fps;
+    int64_t  cuTreeTime;
+    uint32_t cuTreeCount;
+    uint32_t incrementalCount;
+};
+
+struct FrameResult
+{
+    int     sliceType;
+    int     numOffsets;
+    int16_t* offsets;
+};
+
+uint8_t noise(int x, int y)
+{
+    uint32_t h = (uint32_t)x * 374761393u + (uint32_t)y * 668265263u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return (uint8_t)(h >> 24);
+}
+
+/* textured background panning right and down, with a few squares moving
+ * across it at their own speed */
+void synthFrame(uint8_t* luma, int width, int height, int frame)
+{
+    int panX = frame * 3, panY = frame;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            int sx = x + panX, sy = y + panY;
+            luma[y * width + x] = (uint8_t)((noise(sx >> 3, sy >> 3) >> 1) + (noise(sx, sy) >> 3) + 32);
+        }
+
+    for (int i = 0; i < 4; i++)
+    {
+        int size = height / 6;
+        int ox = ((i + 1) * width / 5 + frame * (i + 2) * 4) % (width - size);
+        int oy = (i * height / 4 + frame * (3 - i)) % (height - size);
+        for (int y = 0; y < size; y++)
+            for (int x = 0; x < size; x++)
+                luma[(oy + y) * width + ox + x] = noise(x + 1000 * i, y);
+    }
+}
+
+bool runBench(const BenchConfig& cfg, bool bIncremental, FrameResult* results, RunStats& stats)
+{
+    x265_param* param = x265_param_alloc();
+    x265_param_default_preset(param, cfg.preset, NULL);
+    param->sourceWidth = cfg.width;
+    param->sourceHeight = cfg.height;
+    param->fpsNum = 30;
+    param->fpsDenom = 1;
+    param->lookaheadDepth = cfg.lookahead;
+    param->bframes = cfg.bframes;
+    param->lookaheadThreads = cfg.threads;
+    param->bCUTreeIncremental = bIncremental;
+    param->logLevel = X265_LOG_WARNING;
+
+    x265_lookahead* lookahead = x265_lookahead_open(param);
+    if (!lookahead)
+    {
+        x265_param_free(param);
+        return false;
+    }
+
+    FILE* in = cfg.input ? fopen(cfg.input, "rb") : NULL;
+    size_t lumaSize = (size_t)cfg.width * cfg.height;
+    uint8_t* buf = X265_MALLOC(uint8_t, lumaSize * 3 / 2);
+    memset(buf + lumaSize, 128, lumaSize / 2);
+
+    x265_picture pic;
+    x265_picture_init(param, &pic);
+    pic.planes[0] = buf;
+    pic.planes[1] = buf + lumaSize;
+    pic.planes[2] = buf + lumaSize * 5 / 4;
+    pic.stride[0] = cfg.width;
+    pic.stride[1] = pic.stride[2] = cfg.width / 2;
+
+    int64_t elapsed = 0;
+    x265_lookahead_frame out;
+    for (int f = 0; f <= cfg.numFrames; f++)
+    {
+        /* only the lookahead is timed, not the picture source */
+        if (f < cfg.numFrames)
+        {
+            if (in)
+            {
+                if (fread(buf, 1, lumaSize * 3 / 2, in) != lumaSize * 3 / 2)
+                    rewind(in);
+            }
+            else
+                synthFrame(buf, cfg.width, cfg.height, f);
+            pic.pts = f;
+        }
+
+        int64_t start = x265_mdate();
+        x265_lookahead_push(lookahead, f < cfg.numFrames ? &pic : NULL);
+        int ret;
+        while ((ret = x265_lookahead_pull(lookahead, &out)) == 1)
+        {
+            elapsed += x265_mdate() - start;
+            FrameResult& res = results[out.poc];
+            res.sliceType = out.sliceType;
+            if (out.qpCuTreeOffsets)
+            {
+                res.numOffsets = out.qgWidth * out.qgHeight;
+                if (!res.offsets)
+                    res.offsets = X265_MALLOC(int16_t, res.numOffsets);
+                memcpy(res.offsets, out.qpCuTreeOffsets, res.numOffsets * sizeof(int16_t));
+            }
+            x265_lookahead_release(lookahead, &out);
+            start = x265_mdate();
+            if (f < cfg.numFrames)
+                break;
+        }
+        elapsed += x265_mdate() - start;
+        if (ret < 0)
+            break;
+    }
+
+    Lookahead* internal = static_cast<LookaheadOnly*>(lookahead)->m_lookahead;
+    stats.fps = cfg.numFrames * 1000000.0 / elapsed;
+    stats.cuTreeTime = internal->m_cuTreeElapsedTime;
+    stats.cuTreeCount = internal->m_countCuTree;
+    stats.incrementalCount = internal->m_countCuTreeIncremental;
+
+    x265_lookahead_close(lookahead);
+    x265_param_free(param);
+    X265_FREE(buf);
+    if (in)
+        fclose(in);
+
+    return true;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig cfg;
+    cfg.input = NULL;
+    cfg.preset = "medium";
+    cfg.width = 1280;
+    cfg.height = 720;
+    cfg.numFrames = 240;
+    cfg.lookahead = 60;
+    cfg.bframes = 4;
+    cfg.threads = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--input") && i + 1 < argc)
+            cfg.input = argv[++i];
+        else if (!strcmp(argv[i], "--input-res") && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &cfg.width, &cfg.height) != 2)
+                cfg.width = 0;
+        }
+        else if (!strcmp(argv[i], "--preset") && i + 1 < argc)
+            cfg.preset = argv[++i];
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            cfg.numFrames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--rc-lookahead") && i + 1 < argc)
+            cfg.lookahead = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--bframes") && i + 1 < argc)
+            cfg.bframes = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            cfg.threads = atoi(argv[++i]);
+        else
+        {
+            printf("Usage: CuTreeBench [--input file.yuv] [--input-res WxH] [--preset name] [--frames N]\n"
+                   "                   [--rc-lookahead N] [--bframes N] [--threads N]\n");
+            return 1;
+        }
+    }
+
+    if (cfg.width < 64 || cfg.height < 64 || (cfg.width | cfg.height) & 1 || cfg.numFrames < 1)
+    {
+        printf("CuTreeBench: parameter out of range\n");
+        return 1;
+    }
+
+    FrameResult* full = X265_MALLOC(FrameResult, cfg.numFrames);
+    FrameResult* incr = X265_MALLOC(FrameResult, cfg.numFrames);
+    memset(full, 0, cfg.numFrames * sizeof(FrameResult));
+    memset(incr, 0, cfg.numFrames * sizeof(FrameResult));
+
+    printf("cuTree propagation, %dx%d %s, %d frames, preset %s, rc-lookahead %d, bframes %d\n",
+           cfg.width, cfg.height, cfg.input ? cfg.input : "synthetic", cfg.numFrames, cfg.preset,
+           cfg.lookahead, cfg.bframes);
+    RunStats fullStats, incrStats;
+    if (!runBench(cfg, false, full, fullStats) || !runBench(cfg, true, incr, incrStats))
+    {
+        printf("CuTreeBench: unable to open the lookahead\n");
+        return 1;
+    }
+    printf("mode            lookahead fps  cuTree runs  incremental  propagate ms  ms/run\n");
+    const RunStats* runs[2] = { &fullStats, &incrStats };
+    for (int i = 0; i < 2; i++)
+    {
+        const RunStats& r = *runs[i];
+        printf("%-14s  %13.2f  %11u  %11u  %12.1f  %6.3f\n", i ? "incremental" : "full recompute",
+               r.fps, r.cuTreeCount, r.incrementalCount, r.cuTreeTime / 1000.0,
+               r.cuTreeCount ? r.cuTreeTime / 1000.0 / r.cuTreeCount : 0.0);
+    }
+
+    int typeDiffs = 0;
+    double maxDiff = 0, sumDiff = 0;
+    int64_t count = 0;
+    for (int f = 0; f < cfg.numFrames; f++)
+    {
+        typeDiffs += full[f].sliceType != incr[f].sliceType;
+        if (!full[f].offsets || !incr[f].offsets)
+            continue;
+        for (int i = 0; i < full[f].numOffsets; i++)
+        {
+            double diff = x265_fix82qp(abs(full[f].offsets[i] - incr[f].offsets[i]));
+            maxDiff = X265_MAX(maxDiff, diff);
+            sumDiff += diff;
+            count++;
+        }
+    }
+    printf("frame type differences %d, cuTree QP offset difference max %.4f mean %.6f\n",
+           typeDiffs, maxDiff, count ? sumDiff / count : 0.0);
+
+    for (int f = 0; f < cfg.numFrames; f++)
+    {
+        X265_FREE(full[f].offsets);
+        X265_FREE(incr[f].offsets);
+    }
+    X265_FREE(full);
+    X265_FREE(incr);
+    x265_cleanup();
+    return 0;
+}
@@ -1597,24 +1597,19 @@ bool PixelHarness::check_cutree_propagate_cost(cutree_propagate_cost ref, cutree
     return true;
 }
 
-bool PixelHarness::check_cutree_fix8_pack(cutree_fix8_pack ref, cutree_fix8_pack opt)
+bool PixelHarness::check_cutree_weight_cost(cutree_weight_cost ref, cutree_weight_cost opt)
 {
-    ALIGN_VAR_32(uint16_t, ref_dest[64 * 64]);
-    ALIGN_VAR_32(uint16_t, opt_dest[64 * 64]);
-
-    memset(ref_dest, 0xCD, sizeof(ref_dest));
-    memset(opt_dest, 0xCD, sizeof(opt_dest));
-
     int j = 0;
 
     for (int i = 0; i < ITERS; i++)
     {
-        int count = 256 + i;
-        int index = i % TEST_CASES;
-        checked(opt, opt_dest, double_test_buff[index] + j, count);
-        ref(ref_dest, double_test_buff[index] + j, count);
+        int count = 1 + rand() % 256;
+        int index1 = rand() % TEST_CASES;
+        int index2 = rand() % TEST_CASES;
+        int64_t optres = (int64_t)checked(opt, ushort_test_buff[index1] + j, short_test_buff[index2] + j, count);
+        int64_t refres = ref(ushort_test_buff[index1] + j, short_test_buff[index2] + j, count);
 
-        if (memcmp(ref_dest, opt_dest, 64 * 64 * sizeof(uint16_t)))
+        if (optres != refres)
             return false;
 
         reportfail();
@@ -1624,24 +1619,52 @@ bool PixelHarness::check_cutree_fix8_pack(cutree_fix8_pack ref, cutree_fix8_pack
     return true;
 }
 
-bool PixelHarness::check_cutree_fix8_unpack(cutree_fix8_unpack ref, cutree_fix8_unpack opt)
+bool PixelHarness::check_nal_escape(nal_escape_t ref, nal_escape_t opt)
 {
-    ALIGN_VAR_32(double, ref_dest[64 * 64]);
-    ALIGN_VAR_32(double, opt_dest[64 * 64]);
+    ALIGN_VAR_16(uint8_t, ref_dest[64 * 64 * 3 / 2]);
+    ALIGN_VAR_16(uint8_t, opt_dest[64 * 64 * 3 / 2]);
+    uint8_t src[64 * 64];
 
-    memset(ref_dest, 0xCD, sizeof(ref_dest));
-    memset(opt_dest, 0xCD, sizeof(opt_dest));
+    for (int i = 0; i < ITERS; i++)
+    {
+        /* random bytes with runs of zeros, so every escaping case occurs */
+        int density = rand() % 8;
+        for (int k = 0; k < 64 * 64; k++)
+            src[k] = (rand() % 8) < density ? 0 : (uint8_t)(rand() % 6);
+        if (i & 1)
+            memcpy(src, uchar_test_buff[rand() % TEST_CASES] + rand() % 1024, 64 * 32);
+
+        memset(ref_dest, 0xCD, sizeof(ref_dest));
+        memset(opt_dest, 0xCD, sizeof(opt_dest));
+
+        uint32_t size = rand() % (64 * 64 + 1);
+        uint32_t zeros = rand() % 3;
+        uint32_t optres = (uint32_t)checked(opt, opt_dest, src, size, zeros);
+        uint32_t refres = ref(ref_dest, src, size, zeros);
+
+        if (optres != refres || memcmp(ref_dest, opt_dest, sizeof(ref_dest)))
+            return false;
+
+        reportfail();
+    }
+
+    return true;
+}
 
+bool PixelHarness::check_pic_hash_crc(pic_hash_crc_t ref, pic_hash_crc_t opt)
+{
     int j = 0;
 
     for (int i = 0; i < ITERS; i++)
     {
-        int count = 256 + i;
-        int index = i % TEST_CASES;
-        checked(opt, opt_dest, ushort_test_buff[index] + j, count);
-        ref(ref_dest, ushort_test_buff[index] + j, count);
+        int index = rand() % TEST_CASES;
+        uint32_t width = 1 + rand() % STRIDE;
+        uint32_t height = 1 + rand() % MAX_HEIGHT;
+        uint32_t crc = rand() & 0xffff;
+        uint32_t optres = (uint32_t)checked(opt, pixel_test_buff[index] + j, (intptr_t)STRIDE, width, height, crc);
+        uint32_t refres = ref(pixel_test_buff[index] + j, STRIDE, width, height, crc);
 
-        if (memcmp(ref_dest, opt_dest, 64 * 64 * sizeof(double)))
+        if (optres != refres)
             return false;
 
         reportfail();
@@ -1651,6 +1674,62 @@ bool PixelHarness::check_cutree_fix8_unpack(cutree_fix8_unpack ref, cutree_fix8_
     return true;
 }
 
+bool PixelHarness::check_pic_hash_checksum(pic_hash_checksum_t ref, pic_hash_checksum_t opt)
+{
+    int j = 0;
+
+    for (int i = 0; i < ITERS; i++)
+    {
+        int index = rand() % TEST_CASES;
+        uint32_t width = 1 + rand() % STRIDE;
+        uint32_t height = 1 + rand() % MAX_HEIGHT;
+        uint32_t y = rand() % 4096;
+        uint32_t checksum = rand();
+        uint32_t optres = (uint32_t)checked(opt, pixel_test_buff[index] + j, (intptr_t)STRIDE, width, height, y, checksum);
+        uint32_t refres = ref(pixel_test_buff[index] + j, STRIDE, width, height, y, checksum);
+
+        if (optres != refres)
+            return false;
+
+        reportfail();
+        j += INCR;
+    }
+
+    return true;
+}
+
+bool PixelHarness::check_md5_blocks(md5_blocks_t ref, md5_blocks_t opt)
+{
+    uint32_t ref_state[4][4], opt_state[4][4];
+    uint32_t* ref_ptr[4];
+    uint32_t* opt_ptr[4];
+    const uint8_t* data[4];
+
+    for (int i = 0; i < ITERS; i++)
+    {
+        int numStreams = 1 + rand() % 4;
+        uint32_t numBlocks = 1 + rand() % 8;
+        for (int k = 0; k < 4; k++)
+        {
+            for (int n = 0; n < 4; n++)
+                ref_state[k][n] = opt_state[k][n] = (uint32_t)rand() * 65536 + rand();
+            ref_ptr[k] = ref_state[k];
+            opt_ptr[k] = opt_state[k];
+            data[k] = uchar_test_buff[rand() % TEST_CASES] + rand() % 1024;
+        }
+
+        checked(opt, opt_ptr, data, numStreams, numBlocks);
+        ref(ref_ptr, data, numStreams, numBlocks);
+
+        if (memcmp(ref_state, opt_state, sizeof(ref_state)))
+            return false;
+
+        reportfail();
+    }
+
+    return true;
+}
+
 bool PixelHarness::check_psyCost_pp(pixelcmp_t ref, pixelcmp_t opt)
 {
     int j = 0, index1, index2, optres, refres;
@@ -2994,20 +3073,47 @@ bool PixelHarness::testCorrectness(const EncoderPrimitives& ref, const EncoderPr
         }
     }
 
-    if (opt.fix8Pack)
+    if (opt.cutreeWeightCost)
+    {
+        if (!check_cutree_weight_cost(ref.cutreeWeightCost, opt.cutreeWeightCost))
+        {
+            printf("cutreeWeightCost failed\n");
+            return false;
+        }
+    }
+
+    if (opt.nalEscape)
     {
-        if (!check_cutree_fix8_pack(ref.fix8Pack, opt.fix8Pack))
+        if (!check_nal_escape(ref.nalEscape, opt.nalEscape))
         {
-            printf("cuTreeFix8Pack failed\n");
+            printf("nalEscape failed\n");
             return false;
         }
     }
 
-    if (opt.fix8Unpack)
+    if (opt.picHashCRC)
     {
-        if (!check_cutree_fix8_unpack(ref.fix8Unpack, opt.fix8Unpack))
+        if (!check_pic_hash_crc(ref.picHashCRC, opt.picHashCRC))
         {
-            printf("cuTreeFix8Unpack failed\n");
+            printf("picHashCRC failed\n");
+            return false;
+        }
+    }
+
+    if (opt.picHashChecksum)
+    {
+        if (!check_pic_hash_checksum(ref.picHashChecksum, opt.picHashChecksum))
+        {
+            printf("picHashChecksum failed\n");
+            return false;
+        }
+    }
+
+    if (opt.md5Blocks)
+    {
+        if (!check_md5_blocks(ref.md5Blocks, opt.md5Blocks))
+        {
+            printf("md5Blocks failed\n");
             return false;
         }
     }
@@ -3637,16 +3743,37 @@ void PixelHarness::measureSpeed(const EncoderPrimitives& ref, const EncoderPrimi
         REPORT_SPEEDUP(opt.propagateCost, ref.propagateCost, ibuf1, ushort_test_buff[0], int_test_buff[0], ushort_test_buff[0], int_test_buff[0], double_test_buff[0], 80);
     }
 
-    if (opt.fix8Pack)
+    if (opt.cutreeWeightCost)
+    {
+        HEADER0("cutreeWeightCost");
+        REPORT_SPEEDUP(opt.cutreeWeightCost, ref.cutreeWeightCost, ushort_test_buff[0], short_test_buff[0], 240);
+    }
+
+    if (opt.nalEscape)
+    {
+        HEADER0("nalEscape");
+        REPORT_SPEEDUP(opt.nalEscape, ref.nalEscape, (uint8_t*)ibuf1, uchar_test_buff[0], 4096, 0);
+    }
+
+    if (opt.picHashCRC)
+    {
+        HEADER0("picHashCRC");
+        REPORT_SPEEDUP(opt.picHashCRC, ref.picHashCRC, pbuf1, STRIDE, 64, 64, 0);
+    }
+
+    if (opt.picHashChecksum)
     {
-        HEADER0("cuTreeFix8Pack");
-        REPORT_SPEEDUP(opt.fix8Pack, ref.fix8Pack, ushort_test_buff[0], double_test_buff[0], 390);
+        HEADER0("picHashChecksum");
+        REPORT_SPEEDUP(opt.picHashChecksum, ref.picHashChecksum, pbuf1, STRIDE, 64, 64, 0, 0);
     }
 
-    if (opt.fix8Unpack)
+    if (opt.md5Blocks)
     {
-        HEADER0("cuTreeFix8Unpack");
-        REPORT_SPEEDUP(opt.fix8Unpack, ref.fix8Unpack, double_test_buff[0], ushort_test_buff[0], 390);
+        HEADER0("md5Blocks");
+        uint32_t state[3][4] = { { 0 } };
+        uint32_t* states[3] = { state[0], state[1], state[2] };
+        const uint8_t* data[3] = { uchar_test_buff[0], uchar_test_buff[1], uchar_test_buff[2] };
+        REPORT_SPEEDUP(opt.md5Blocks, ref.md5Blocks, states, data, 3, 64);
     }
 
     if (opt.scanPosLast)
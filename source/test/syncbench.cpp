@@ -0,0 +1,209 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+/* Microbenchmark of the Event and ThreadSafeInteger primitives, followed by
+ * an encode of synthetic frames at a high frame thread count. Build with
+ * ENABLE_FUTEX on and off to compare the futex and pthread implementations */
+
+#include "common.h"
+#include "threading.h"
+#include "x265.h"
+
+using namespace X265_NS;
+
+namespace {
+
+enum { ROUND_TRIPS = 20000 };
+enum { CHAIN_THREADS = 8, CHAIN_STEPS = 5000 };
+
+/* two threads trigger each other's Event; half a round trip is one wake */
+class PingThread : public Thread
+{
+public:
+
+    Event* m_wait;
+    Event* m_signal;
+
+    void threadMain()
+    {
+        for (int i = 0; i < ROUND_TRIPS; i++)
+        {
+            m_wait->wait();
+            m_signal->trigger();
+        }
+    }
+};
+
+/* a chain of threads, each advancing its row after the row above advanced,
+ * the pattern of WPP row and reference row dependencies */
+class ChainThread : public Thread
+{
+public:
+
+    ThreadSafeInteger* m_above;
+    ThreadSafeInteger* m_row;
+
+    void threadMain()
+    {
+        for (int i = 1; i <= CHAIN_STEPS; i++)
+        {
+            if (m_above)
+            {
+                int val = m_above->get();
+                while (val < i)
+                    val = m_above->waitForChange(val);
+            }
+            m_row->incr();
+        }
+    }
+};
+
+double eventWakeLatency()
+{
+    Event ping, pong;
+    PingThread peer;
+    peer.m_wait = &ping;
+    peer.m_signal = &pong;
+    peer.start();
+
+    int64_t start = x265_mdate();
+    for (int i = 0; i < ROUND_TRIPS; i++)
+    {
+        ping.trigger();
+        pong.wait();
+    }
+    int64_t elapsed = x265_mdate() - start;
+    peer.stop();
+
+    return (double)elapsed * 1000 / (2 * ROUND_TRIPS);
+}
+
+double chainStepTime()
+{
+    ThreadSafeInteger rows[CHAIN_THREADS];
+    ChainThread threads[CHAIN_THREADS];
+
+    int64_t start = x265_mdate();
+    for (int i = 0; i < CHAIN_THREADS; i++)
+    {
+        threads[i].m_above = i ? &rows[i - 1] : NULL;
+        threads[i].m_row = &rows[i];
+        threads[i].start();
+    }
+    for (int i = 0; i < CHAIN_THREADS; i++)
+        threads[i].stop();
+    int64_t elapsed = x265_mdate() - start;
+
+    return (double)elapsed * 1000 / CHAIN_STEPS;
+}
+
+double encodeFps(int frameThreads, int numFrames)
+{
+    const int width = 1280, height = 720;
+
+    x265_param* param = x265_param_alloc();
+    x265_param_default_preset(param, "ultrafast", NULL);
+    param->sourceWidth = width;
+    param->sourceHeight = height;
+    param->fpsNum = 30;
+    param->fpsDenom = 1;
+    param->frameNumThreads = frameThreads;
+    param->logLevel = X265_LOG_WARNING;
+    param->bRepeatHeaders = 0;
+
+    x265_encoder* encoder = x265_encoder_open(param);
+    if (!encoder)
+    {
+        x265_param_free(param);
+        return 0;
+    }
+
+    pixel* planes = X265_MALLOC(pixel, width * height * 3 / 2);
+    if (!planes)
+    {
+        x265_encoder_close(encoder);
+        x265_param_free(param);
+        return 0;
+    }
+
+    x265_picture pic;
+    x265_picture_init(param, &pic);
+    pic.planes[0] = planes;
+    pic.planes[1] = planes + width * height;
+    pic.planes[2] = planes + width * height * 5 / 4;
+    pic.stride[0] = width * sizeof(pixel);
+    pic.stride[1] = pic.stride[2] = width / 2 * sizeof(pixel);
+
+    x265_nal* nal;
+    uint32_t numNal;
+    int64_t start = x265_mdate();
+    for (int f = 0; f < numFrames; f++)
+    {
+        /* a moving gradient with some texture, so motion search has work */
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                planes[y * width + x] = (pixel)(((x + f * 3) ^ (y + f)) & 0xff);
+        for (int i = 0; i < width * height / 2; i++)
+            planes[width * height + i] = (pixel)((i + f) & 0xff);
+
+        pic.pts = f;
+        x265_encoder_encode(encoder, &nal, &numNal, &pic, NULL);
+    }
+    while (x265_encoder_encode(encoder, &nal, &numNal, NULL, NULL) > 0)
+    {}
+    int64_t elapsed = x265_mdate() - start;
+
+    X265_FREE(planes);
+    x265_encoder_close(encoder);
+    x265_param_free(param);
+
+    return numFrames * 1000000.0 / elapsed;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    int frameThreads = 16;
+    int numFrames = 120;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--frame-threads") && i + 1 < argc)
+            frameThreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            numFrames = atoi(argv[++i]);
+        else
+        {
+            printf("Usage: SyncBench [--frame-threads N] [--frames N]\n");
+            return 1;
+        }
+    }
+
+    printf("Synchronization primitives: %s\n", X265_FUTEX ? "futex" : "pthread");
+    printf("Event wake latency               %8.0f ns\n", eventWakeLatency());
+    printf("ThreadSafeInteger chain step     %8.0f ns (%d threads)\n", chainStepTime(), CHAIN_THREADS);
+    if (numFrames > 0)
+        printf("Encode 720p ultrafast            %8.2f fps (%d frame threads, %d frames)\n",
+               encodeFps(frameThreads, numFrames), frameThreads, numFrames);
+
+    x265_cleanup();
+    return 0;
+}
@@ -0,0 +1,301 @@
+/*****************************************************************************
+ * Copyright (C) 2013-2017 MulticoreWare, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at license @ x265.com.
+ *****************************************************************************/
+
+/* Benchmark of the WaveFront row scheduler. Several synthetic frames are
+ * compressed concurrently, each CTU waiting on the CTU above-right and each
+ * row on the reconstructed rows of the previous frame, like FrameEncoder.
+ * The default scheduler (row batches, row locality, resume slack) is
+ * compared with one row per findJob(), no locality and no slack */
+
+#include "common.h"
+#include "threading.h"
+#include "threadpool.h"
+#include "wavefront.h"
+#include "x265.h"
+
+using namespace X265_NS;
+
+namespace {
+
+enum { MAX_BENCH_ROWS = 256, MAX_BENCH_FRAMES = 1024 };
+
+struct BenchConfig
+{
+    int numRows;
+    int numCols;
+    int refLagRows;
+    int frameThreads;
+    int numFrames;
+    int ctuWork;     // spin iterations per CTU
+    bool bLegacy;
+};
+
+ThreadSafeInteger* g_reconRows; // rows reconstructed, per frame number
+
+volatile uint32_t g_spinSink;
+
+void spin(int iterations)
+{
+    uint32_t x = 0;
+    for (int i = 0; i < iterations; i++)
+        x = x * 1664525u + 1013904223u;
+    g_spinSink = x;
+}
+
+class BenchFrame : public WaveFront, public Thread
+{
+public:
+
+    struct Row
+    {
+        Lock              lock;
+        volatile bool     active;
+        volatile uint32_t completed;
+    };
+
+    const BenchConfig& m_cfg;
+    Row                m_rows[MAX_BENCH_ROWS];
+    uint32_t           m_resumeSlack;
+    int                m_frameNum;
+    volatile int       m_rowsDone;
+    volatile int       m_rowBlocks;
+    bool               m_bExit;
+    Event              m_start;
+    Event              m_done;
+
+    BenchFrame(const BenchConfig& cfg) : m_cfg(cfg)
+    {
+        m_resumeSlack = 0;
+        m_frameNum = 0;
+        m_rowsDone = 0;
+        m_rowBlocks = 0;
+        m_bExit = false;
+        m_sliceType = 1;
+    }
+
+    bool init()
+    {
+        if (!WaveFront::init(m_cfg.numRows))
+            return false;
+        if (m_cfg.bLegacy)
+        {
+            m_rowBatch = 1;
+            m_rowStride = 0;
+        }
+        else
+            m_resumeSlack = m_cfg.numCols >= 64 ? 1 : 0;
+        return true;
+    }
+
+    void processRow(int row, int /*threadId*/)
+    {
+        Row& cur = m_rows[row];
+        const uint32_t numCols = m_cfg.numCols;
+
+        {
+            ScopedLock self(cur.lock);
+            if (!cur.active)
+                return;
+        }
+
+        while (cur.completed < numCols)
+        {
+            spin(m_cfg.ctuWork);
+            cur.completed++;
+
+            if (row + 1 < m_cfg.numRows)
+            {
+                Row& below = m_rows[row + 1];
+                ScopedLock belowLock(below.lock);
+                if (!below.active &&
+                    (below.completed + 2 + m_resumeSlack <= cur.completed || cur.completed == numCols))
+                {
+                    below.active = true;
+                    enqueueRow(row + 1);
+                    tryWakeOne();
+                }
+            }
+
+            ScopedLock self(cur.lock);
+            if (row && (cur.completed < numCols - 1 || m_rows[row - 1].completed < numCols) &&
+                m_rows[row - 1].completed < cur.completed + 2)
+            {
+                cur.active = false;
+                ATOMIC_INC(&m_rowBlocks);
+                return;
+            }
+        }
+
+        g_reconRows[m_frameNum].incr();
+        if (ATOMIC_INC(&m_rowsDone) == m_cfg.numRows)
+            m_done.trigger();
+    }
+
+    void threadMain()
+    {
+        for (;;)
+        {
+            m_start.wait();
+            if (m_bExit)
+                break;
+
+            clearEnabledRowMask();
+            for (int r = 0; r < m_cfg.numRows; r++)
+            {
+                m_rows[r].active = !r;
+                m_rows[r].completed = 0;
+            }
+            m_rowsDone = 0;
+
+            /* enable rows as the reference frame reconstructs them */
+            for (int r = 0; r < m_cfg.numRows; r++)
+            {
+                if (m_frameNum)
+                {
+                    ThreadSafeInteger& ref = g_reconRows[m_frameNum - 1];
+                    int need = X265_MIN(m_cfg.numRows, r + m_cfg.refLagRows + 1);
+                    int val = ref.get();
+                    while (val < need)
+                        val = ref.waitForChange(val);
+                }
+                enableRow(r);
+                if (!r)
+                    enqueueRow(0);
+                tryWakeOne();
+            }
+        }
+    }
+};
+
+double runBench(const BenchConfig& cfg, int numThreads, int& rowBlocks)
+{
+    ThreadPool* pool = ThreadPool::allocSharedPool(numThreads, cfg.frameThreads);
+    if (!pool)
+        return 0;
+
+    BenchFrame* frames[X265_MAX_FRAME_THREADS];
+    for (int i = 0; i < cfg.frameThreads; i++)
+    {
+        frames[i] = new BenchFrame(cfg);
+        pool->attachProvider(*frames[i]);
+        frames[i]->init();
+        frames[i]->start();
+    }
+
+    g_reconRows = new ThreadSafeInteger[cfg.numFrames];
+
+    int64_t start = x265_mdate();
+    for (int f = 0; f < cfg.numFrames; f++)
+    {
+        BenchFrame* enc = frames[f % cfg.frameThreads];
+        if (f >= cfg.frameThreads)
+            enc->m_done.wait();
+        enc->m_frameNum = f;
+        enc->m_start.trigger();
+    }
+    for (int f = X265_MAX(cfg.numFrames - cfg.frameThreads, 0); f < cfg.numFrames; f++)
+        frames[f % cfg.frameThreads]->m_done.wait();
+    int64_t elapsed = x265_mdate() - start;
+
+    rowBlocks = 0;
+    for (int i = 0; i < cfg.frameThreads; i++)
+    {
+        rowBlocks += frames[i]->m_rowBlocks;
+        frames[i]->m_bExit = true;
+        frames[i]->m_start.trigger();
+        frames[i]->stop();
+        pool->detachProvider(*frames[i]);
+        delete frames[i];
+    }
+    pool->stopWorkers();
+    delete pool;
+    delete [] g_reconRows;
+
+    return cfg.numFrames * 1000000.0 / elapsed;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig cfg;
+    cfg.numRows = 68;       /* 8K with 64x64 CTUs */
+    cfg.numCols = 120;
+    cfg.refLagRows = 2;
+    cfg.frameThreads = 4;
+    cfg.numFrames = 16;
+    cfg.ctuWork = 20000;
+    cfg.bLegacy = false;
+
+    int threadCounts[8] = { 32, 64, 128 };
+    int numThreadCounts = 3;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--rows") && i + 1 < argc)
+            cfg.numRows = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--cols") && i + 1 < argc)
+            cfg.numCols = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frame-threads") && i + 1 < argc)
+            cfg.frameThreads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            cfg.numFrames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--ctu-work") && i + 1 < argc)
+            cfg.ctuWork = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            numThreadCounts = 0;
+            char* list = argv[++i];
+            for (char* tok = strtok(list, ","); tok && numThreadCounts < 8; tok = strtok(NULL, ","))
+                threadCounts[numThreadCounts++] = atoi(tok);
+        }
+        else
+        {
+            printf("Usage: WaveBench [--rows N] [--cols N] [--frame-threads N] [--frames N]\n"
+                   "                 [--ctu-work N] [--threads N,N,...]\n");
+            return 1;
+        }
+    }
+
+    if (cfg.numRows < 1 || cfg.numRows > MAX_BENCH_ROWS || cfg.numCols < 3 ||
+        cfg.frameThreads < 1 || cfg.frameThreads > X265_MAX_FRAME_THREADS ||
+        cfg.numFrames < 1 || cfg.numFrames > MAX_BENCH_FRAMES)
+    {
+        printf("WaveBench: parameter out of range\n");
+        return 1;
+    }
+
+    printf("WaveFront scheduling, %dx%d CTUs, %d frame threads, %d frames\n",
+           cfg.numCols, cfg.numRows, cfg.frameThreads, cfg.numFrames);
+    printf("threads   legacy fps  row blocks   batched fps  row blocks\n");
+    for (int t = 0; t < numThreadCounts; t++)
+    {
+        int legacyBlocks, batchedBlocks;
+        cfg.bLegacy = true;
+        double legacy = runBench(cfg, threadCounts[t], legacyBlocks);
+        cfg.bLegacy = false;
+        double batched = runBench(cfg, threadCounts[t], batchedBlocks);
+        printf("%7d   %10.2f  %10d   %11.2f  %10d\n", threadCounts[t], legacy, legacyBlocks, batched, batchedBlocks);
+    }
+
+    x265_cleanup();
+    return 0;
+}
@@ -85,7 +85,10 @@ struct CLIOptions
     bool bForceY4m;
     bool bDither;
     uint32_t seek;              // number of frames to skip from the beginning
+    int inputReadMode;          // InputReadMode
+    int inputQueueSize;         // frames read ahead, 0 for the default of the mode
     uint32_t framesToBeEncoded; // number of frames to encode
+    InputFileInfo inputInfo;    // of the opened input, to open it again at another frame
     uint64_t totalbytes;
     int64_t startTime;
     int64_t prevUpdateTime;
@@ -106,12 +109,15 @@ struct CLIOptions
         param = NULL;
         vmafData = NULL;
         framesToBeEncoded = seek = 0;
+        memset(&inputInfo, 0, sizeof(inputInfo));
         totalbytes = 0;
         bProgress = true;
         bForceY4m = false;
         startTime = x265_mdate();
         prevUpdateTime = 0;
         bDither = false;
+        inputReadMode = INPUT_READ_BUFFERED;
+        inputQueueSize = 0;
     }
 
     void destroy();
@@ -426,6 +432,19 @@ bool CLIOptions::parse(int argc, char **argv)
             OPT("dither") this->bDither = true;
             OPT("recon-depth") reconFileBitDepth = (uint32_t)x265_atoi(optarg, bError);
             OPT("y4m") this->bForceY4m = true;
+            OPT("input-read")
+            {
+                int i;
+                for (i = 0; x265_input_read_names[i] && strcmp(optarg, x265_input_read_names[i]); i++)
+                    ;
+                this->inputReadMode = i;
+                bError |= !x265_input_read_names[i];
+            }
+            OPT("input-queue")
+            {
+                this->inputQueueSize = x265_atoi(optarg, bError);
+                bError |= this->inputQueueSize < 2 || this->inputQueueSize > MAX_QUEUE_SIZE;
+            }
             OPT("profile") /* handled above */;
             OPT("preset")  /* handled above */;
             OPT("tune")    /* handled above */;
@@ -513,6 +532,14 @@ bool CLIOptions::parse(int argc, char **argv)
     }
 #endif
 
+    /* the encoder pads a picture it does not copy in place, which would
+     * overwrite the file data around it */
+    if (inputReadMode != INPUT_READ_BUFFERED && !param->bCopyPicToFrame)
+    {
+        x265_log(param, X265_LOG_ERROR, "--input-read %s requires --copy-pic\n", x265_input_read_names[inputReadMode]);
+        return true;
+    }
+
     InputFileInfo info;
     info.filename = inputfn;
     info.depth = inputBitDepth;
@@ -524,6 +551,8 @@ bool CLIOptions::parse(int argc, char **argv)
     info.sarWidth = param->vui.sarWidth;
     info.sarHeight = param->vui.sarHeight;
     info.skipFrames = seek;
+    info.readMode = inputReadMode;
+    info.queueSize = inputQueueSize;
     info.frameCount = 0;
     getParamAspectRatio(param, info.sarWidth, info.sarHeight);
 
@@ -574,6 +603,7 @@ bool CLIOptions::parse(int argc, char **argv)
     /* Force CFR until we have support for VFR */
     info.timebaseNum = param->fpsDenom;
     info.timebaseDenom = param->fpsNum;
+    this->inputInfo = info;
 
     if (param->bField && param->interlaceMode)
     {   // Field FPS
@@ -834,6 +864,119 @@ static int rpuParser(x265_picture * pic, FILE * ptr)
 }
 
 
+/* Input and output of a chunk-parallel encode. Each reader of the library
+ * reads from an input file of its own, opened again at the first frame of
+ * every chunk it encodes */
+struct ChunkedIO
+{
+    CLIOptions* cliopt;
+    InputFile*  input[X265_MAX_CHUNK_PARALLEL + 1];
+    int         nextFrame[X265_MAX_CHUNK_PARALLEL + 1];
+    uint32_t    outFrameCount;
+};
+
+static int chunkReadPicture(void* opaque, int reader, int frameNum, x265_picture* pic)
+{
+    ChunkedIO* io = (ChunkedIO*)opaque;
+    CLIOptions& cliopt = *io->cliopt;
+    if (b_ctrl_c)
+        return -1;
+    if (cliopt.framesToBeEncoded && (uint32_t)frameNum >= cliopt.framesToBeEncoded)
+        return 1;
+
+    InputFile*& input = io->input[reader];
+    if (!input || io->nextFrame[reader] != frameNum)
+    {
+        if (input)
+            input->release();
+        InputFileInfo info = cliopt.inputInfo;
+        info.skipFrames = cliopt.seek + frameNum;
+        input = InputFile::open(info, cliopt.bForceY4m);
+        if (!input || input->isFail())
+        {
+            x265_log(NULL, X265_LOG_ERROR, "unable to open input file <%s> at frame %d\n", info.filename, info.skipFrames);
+            return -1;
+        }
+        input->startReader();
+        io->nextFrame[reader] = frameNum;
+    }
+
+    if (!input->readPicture(*pic))
+        return 1;
+    io->nextFrame[reader]++;
+    pic->pts = frameNum;
+    return 0;
+}
+
+static int chunkWriteNals(void* opaque, const x265_nal* nal, uint32_t numNal, const x265_picture* pic_out)
+{
+    ChunkedIO* io = (ChunkedIO*)opaque;
+    CLIOptions& cliopt = *io->cliopt;
+    if (!pic_out)
+        cliopt.totalbytes += cliopt.output->writeHeaders(nal, numNal);
+    else
+    {
+        x265_picture pic = *pic_out;
+        cliopt.totalbytes += cliopt.output->writeFrame(nal, numNal, pic);
+        cliopt.printStatus(++io->outFrameCount);
+    }
+    return b_ctrl_c ? -1 : 0;
+}
+
+/* Encode the whole input as chunks split at IDR pictures, several of them at
+ * once, with x265_encode_chunked(). The chunks are read from the input file
+ * at random, piped input is not supported */
+static int encodeChunked(CLIOptions& cliopt)
+{
+    x265_param* param = cliopt.param;
+    const char* unsupported = NULL;
+    if (!strcmp(cliopt.inputInfo.filename, "-"))
+        unsupported = "piped input";
+    else if (cliopt.recon || cliopt.reconPlayCmd)
+        unsupported = "recon output";
+    else if (cliopt.qpfile)
+        unsupported = "qpfile";
+    else if (cliopt.bDither)
+        unsupported = "dither";
+    else if (cliopt.dolbyVisionRpu)
+        unsupported = "dolby-vision-rpu";
+    if (unsupported)
+    {
+        x265_log(param, X265_LOG_ERROR, "chunk-parallel: %s is not supported\n", unsupported);
+        return 1;
+    }
+
+    ChunkedIO chunkedIO;
+    memset(&chunkedIO, 0, sizeof(chunkedIO));
+    chunkedIO.cliopt = &cliopt;
+
+    /* the lookahead reads the input as it was opened, from the first frame */
+    chunkedIO.input[param->chunkParallel] = cliopt.input;
+
+    x265_chunk_io io;
+    io.readPicture = chunkReadPicture;
+    io.writeNals = chunkWriteNals;
+    io.opaque = &chunkedIO;
+
+    if (signal(SIGINT, sigint_handler) == SIG_ERR)
+        x265_log(param, X265_LOG_ERROR, "Unable to register CTRL+C handler: %s\n", strerror(errno));
+
+    int frames = cliopt.api->encode_chunked(param, &io);
+
+    for (int i = 0; i < param->chunkParallel; i++)
+        if (chunkedIO.input[i])
+            chunkedIO.input[i]->release();
+
+    if (cliopt.bProgress)
+        fprintf(stderr, "%*s\r", 80, " ");
+    cliopt.output->closeFile(0, 0);
+
+    if (b_ctrl_c)
+        general_log(param, NULL, X265_LOG_INFO, "aborted at output frame %d\n", chunkedIO.outFrameCount);
+    return frames < 0 ? 4 : 0;
+}
+
+
 /* CLI return codes:
  *
  * 0 - encode successful
@@ -894,6 +1037,22 @@ int main(int argc, char **argv)
      * the profile found during option parsing, but it must be done before
      * opening an encoder */
 
+    if (param->chunkParallel)
+    {
+        int ret = encodeChunked(cliopt);
+        delete reconPlay;
+        api->cleanup();
+        cliopt.destroy();
+        api->param_free(param);
+        SetConsoleTitle(orgConsoleTitle);
+        SetThreadExecutionState(ES_CONTINUOUS);
+#if _WIN32
+        if (argv != orgArgv)
+            free(argv);
+#endif
+        return ret;
+    }
+
     x265_encoder *encoder = api->encoder_open(param);
     if (!encoder)
     {
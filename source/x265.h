@@ -43,6 +43,14 @@ typedef struct x265_encoder x265_encoder;
  *      opaque handler for PicYuv */
 typedef struct x265_picyuv x265_picyuv;
 
+/* x265_threadpool:
+ *      opaque handler for a thread pool shared by several encoders */
+typedef struct x265_threadpool x265_threadpool;
+
+/* x265_lookahead:
+ *      opaque handler for a lookahead running without an encoder */
+typedef struct x265_lookahead x265_lookahead;
+
 /* Application developers planning to link against a shared library version of
  * libx265 from a Microsoft Visual Studio or similar development environment
  * will need to define X265_API_IMPORTS before including this header.
@@ -97,6 +105,12 @@ typedef struct x265_nal
     uint8_t* payload;
 } x265_nal;
 
+/* Receives the NAL units of each picture as they are coded, see
+ * x265_encoder_nal_callback(). nal points to nalCount NAL units which are
+ * only valid for the duration of the call. bLast is 1 on the last call for
+ * the picture with the given POC */
+typedef void (*x265_nal_callback)(void *opaque, const x265_nal *nal, uint32_t nalCount, int poc, int bLast);
+
 #define X265_LOOKAHEAD_MAX 250
 
 typedef struct x265_lookahead_data
@@ -113,6 +127,89 @@ typedef struct x265_lookahead_data
     int64_t   reorderedPts;
 } x265_lookahead_data;
 
+/* Motion vector of a lowres block, in quarter pels of the half resolution
+ * lowres picture */
+typedef struct x265_lowres_mv
+{
+    int32_t   x;
+    int32_t   y;
+} x265_lowres_mv;
+
+/* Analysis of one frame output by x265_lookahead_pull(). The arrays point into
+ * the buffers of the lookahead and remain valid until the frame is handed back
+ * with x265_lookahead_release(). Lowres blocks are 8x8 pixels of the half
+ * resolution picture, 16x16 pixels of the source, in raster order */
+typedef struct x265_lookahead_frame
+{
+    int64_t   pts;
+    int       poc;              /* display order, from 0 */
+    int       sliceType;        /* X265_TYPE_IDR, I, P, BREF or B */
+    int       bKeyframe;
+    int       bScenecut;
+
+    /* distance in frames to the past (refDist[0]) and future (refDist[1])
+     * references the frame costs were estimated against, 0 when unused */
+    int       refDist[2];
+    int64_t   intraCost;        /* lowres SATD cost of the frame coded intra */
+    int64_t   frameCost;        /* lowres SATD cost against the references above */
+    int64_t   frameCostAq;      /* frameCost weighted by the adaptive quant offsets */
+
+    int       blockWidth;
+    int       blockHeight;
+    const int32_t*        intraCosts;   /* per lowres block */
+    const uint16_t*       interCosts;   /* per lowres block, best of intra and inter against
+                                         * the references above; bits 14 and 15 flag the use
+                                         * of the past and future reference */
+    const x265_lowres_mv* mvs[2];       /* per lowres block, NULL when refDist[i] is 0 */
+
+    /* QP offsets per quant group, 8x8 when --qg-size is 8 and 16x16 otherwise,
+     * in Q8.8 fixed point (1/256 QP). NULL when adaptive quant (and cuTree)
+     * are disabled */
+    int       qgWidth;
+    int       qgHeight;
+    const int16_t*        qpAqOffsets;
+    const int16_t*        qpCuTreeOffsets;
+
+    void*     opaque;           /* owned by the lookahead */
+} x265_lookahead_frame;
+
+#define X265_POOL_COUNT 3
+
+/* Memory held by one of the pools of huge-page slabs the picture ("picture"),
+ * lowres ("lowres") and frame data ("framedata") buffers of encoders are
+ * allocated from when x265_param.hugePages is enabled. The pools are shared
+ * by all the encoders of the process. Output by x265_pool_stats_get() */
+typedef struct x265_pool_stats
+{
+    const char* name;
+    uint64_t  mappedBytes;      /* address space of the pool's slabs */
+    uint64_t  residentBytes;    /* of which resident in memory */
+    uint64_t  hugetlbBytes;     /* of which mapped from hugetlbfs */
+    uint64_t  liveBytes;        /* held by buffers in use */
+    uint64_t  freeBytes;        /* held by freed buffers, ready for reuse */
+    uint32_t  numSlabs;
+} x265_pool_stats;
+
+/* subsystems of an encoder's memory accounting */
+#define X265_MEM_LOOKAHEAD        0   /* lookahead, lowres frames */
+#define X265_MEM_DPB              1   /* pictures, reconstructed pictures, frame data */
+#define X265_MEM_FRAME_ENCODERS   2   /* frame encoders, their rows and entropy coders */
+#define X265_MEM_ANALYSIS         3   /* CU analysis buffers, analysis save/load */
+#define X265_MEM_RATECONTROL      4   /* rate control, VBV and multi-pass state */
+#define X265_MEM_COUNT            5
+
+/* Live bytes allocated by an encoder per subsystem (X265_MEM_*), output by
+ * x265_encoder_memory_stats(). Only the buffers the encoder allocates with
+ * its aligned allocator are accounted, not the C++ objects holding them */
+typedef struct x265_memory_stats
+{
+    uint64_t  liveBytes[X265_MEM_COUNT];
+    uint64_t  totalBytes;       /* sum of liveBytes */
+    uint64_t  peakBytes;        /* highest totalBytes since the encoder was opened */
+    uint64_t  estimatedBytes;   /* footprint estimated from the param, which
+                                 * x265_param.memoryBudget is checked against */
+} x265_memory_stats;
+
 typedef struct x265_analysis_validate
 {
     int     maxNumReferences;
@@ -297,6 +394,10 @@ typedef struct x265_frame_stats
     double           totalFrameTime;
     double           vmafFrameScore;
     double           bufferFillFinal;
+    double           reconRowWaitTime;
+    int              numJobs;
+    int              bondAttempts;
+    int              bondSuccesses;
 } x265_frame_stats;
 
 typedef struct x265_ctu_info_t
@@ -468,6 +569,44 @@ typedef struct x265_picture
     int fieldNum;
 } x265_picture;
 
+/* Notifications of the asynchronous encode API, see x265_encoder_async_start().
+ * They are made from the encoder's driver thread and should return quickly */
+typedef struct x265_async_events
+{
+    /* a picture passed to x265_encoder_submit() has been copied into the
+     * encoder, its planes and the picture structure may be reused. Required */
+    void (*pictureReleased)(void *opaque, x265_picture *pic);
+
+    /* an access unit is ready for x265_encoder_poll(), or the stream has
+     * ended. Optional, for applications which do not poll with a timeout */
+    void (*outputReady)(void *opaque);
+
+    void *opaque;
+} x265_async_events;
+
+/* Input and output of x265_encode_chunked(). The callbacks are made from
+ * the threads of the chunk encoders and of the splitting lookahead */
+typedef struct x265_chunk_io
+{
+    /* fill pic, initialized by x265_picture_init(), with the planes, strides,
+     * bit depth, color space and pts of picture frameNum of the input,
+     * counted from 0 in display order. The planes must remain valid until the
+     * next call for the same reader. Readers 0 to chunkParallel - 1 are used
+     * by the chunk encoders and reader chunkParallel by the lookahead which
+     * splits the input; different readers may be called concurrently. The
+     * frame numbers of one reader increase by one, except when it starts on
+     * a new chunk. Returns 0 on success, 1 past the end of the input and
+     * negative on error. Required */
+    int  (*readPicture)(void *opaque, int reader, int frameNum, x265_picture *pic);
+
+    /* receive the stream headers, with pic_out NULL, or the NAL units of one
+     * access unit, in stream order. Calls are made one at a time. Returns 0
+     * on success, negative to abort the encode. Required */
+    int  (*writeNals)(void *opaque, const x265_nal *nal, uint32_t numNal, const x265_picture *pic_out);
+
+    void *opaque;
+} x265_chunk_io;
+
 typedef enum
 {
     X265_DIA_SEARCH,
@@ -499,6 +638,7 @@ typedef enum
 #define X265_CPU_BMI2            (1 << 14)  /* BMI2 */
 #define X265_CPU_AVX2            (1 << 15)  /* AVX2 */
 #define X265_CPU_AVX512          (1 << 16)  /* AVX-512 {F, CD, BW, DQ, VL}, requires OS support */
+#define X265_CPU_PCLMUL          (1 << 26)  /* PCLMULQDQ carry-less multiply */
 /* x86 modifiers */
 #define X265_CPU_CACHELINE_32    (1 << 17)  /* avoid memory loads that span the border between two cachelines */
 #define X265_CPU_CACHELINE_64    (1 << 18)  /* 32/64 is the size of a cacheline in bytes */
@@ -545,6 +685,7 @@ typedef enum
 
 #define X265_BFRAME_MAX         16
 #define X265_MAX_FRAME_THREADS  16
+#define X265_MAX_CHUNK_PARALLEL 64
 
 #define X265_TYPE_AUTO          0x0000  /* Let x265 choose the right type */
 #define X265_TYPE_IDR           0x0001
@@ -644,6 +785,20 @@ typedef struct x265_stats
     x265_sliceType_stats  statsB;               /* statistics of B slice */
     uint16_t              maxCLL;               /* maximum content light level */
     uint16_t              maxFALL;              /* maximum frame average light level */
+
+    /* Scheduler telemetry. Worker times and job counts are summed over the
+     * worker threads of the encoder's thread pools, and so include the work of
+     * other encoders attached to a shared pool */
+    int                   numWorkerThreads;     /* worker threads in the encoder's pools */
+    double                workerBusyTime;       /* seconds workers spent awake, summed over workers */
+    double                workerIdleTime;       /* seconds workers spent sleeping, summed over workers */
+    double                maxWorkerBusyTime;    /* busy seconds of the busiest worker */
+    uint64_t              workerJobs;           /* jobs run by pool workers, all job providers */
+    uint64_t              frameJobs;            /* jobs run for this encoder's frame encoders */
+    uint64_t              lookaheadJobs;        /* jobs run for this encoder's lookahead */
+    uint64_t              bondAttempts;         /* attempts to bond idle peers (pmode, pme, lookahead) */
+    uint64_t              bondSuccesses;        /* bond attempts which enlisted at least one peer */
+    double                reconRowWaitTime;     /* seconds frame encoders blocked on reference rows */
 } x265_stats;
 
 /* String values accepted by x265_param_parse() (and CLI) for various parameters */
@@ -1783,6 +1938,117 @@ typedef struct x265_param
 
     /*Emit content light level info SEI*/
     int         bEmitCLL;
+
+    /* Thread pool created by x265_threadpool_create() which this encoder
+     * attaches to instead of allocating its own pools. The pool may be shared
+     * by any number of encoders in the same process, and its workers serve
+     * the frame encoders and lookahead of all of them. --pools, --numa-pools
+     * and --lookahead-threads are ignored when set. The pool must outlive the
+     * encoder. API only, default NULL */
+    x265_threadpool* sharedThreadPool;
+
+    /* Group the worker threads of each pool by the last level cache they
+     * share and give each group affinity to the CPUs of its cache. Frame
+     * encoders then prefer the workers of one cache, spread round-robin, and
+     * the lookahead those of the last cache. The workers of a shared pool are
+     * pinned once an encoder with this option attaches. Has no effect unless
+     * the CPUs of a pool span several last level caches (Linux only).
+     * Default disabled */
+    int       bCacheAffinity;
+
+    /* Minimum number of frame encoders kept active when the encoder adapts its
+     * frame parallelism at run time. When non-zero and less than
+     * frameNumThreads, frame encoders are activated or parked at keyframes,
+     * within [minFrameThreads .. frameNumThreads], depending on how long they
+     * were blocked on reference rows and how busy the thread pool was.
+     * Default 0, disabled */
+    int       minFrameThreads;
+
+    /* Filename to which the decisions of the adaptive frame thread mode are
+     * written, one "encodeOrder numFrameEncoders" line per change. Default NULL */
+    const char* frameThreadsLogSave;
+
+    /* Filename of a decision log written by frameThreadsLogSave. The encoder
+     * replays the logged frame encoder counts instead of measuring, which
+     * makes an adaptive encode repeatable. frameNumThreads must be at least
+     * the largest logged count. Default NULL */
+    const char* frameThreadsLogLoad;
+
+    /* Reuse the cuTree propagation of the previous slicetype decision. The
+     * lookahead windows of consecutive decisions overlap in all but their
+     * newest frames, so only the propagate cost those frames add, or that
+     * re-decided frames move, is carried back through the references, and
+     * changes too small to move a QP offset are dropped. The offsets match
+     * a full recompute within a small fraction of a QP. Default disabled */
+    int       bCUTreeIncremental;
+
+    /* Hierarchical lowres motion search in the lookahead. The lowres frames
+     * are downscaled once more, and a search at quarter resolution seeds a
+     * short diamond refinement at half resolution instead of the hexagon
+     * search. Frame costs differ slightly from the default search, which
+     * is much slower on 4K and larger sources. Default disabled */
+    int       bLookaheadHME;
+
+    /* Interpolate the luma sub-pel planes of each reference picture once, as
+     * its CTU rows are reconstructed, and have all the motion searches of the
+     * frame encoders referencing it read them instead of interpolating every
+     * sub-pel candidate. 1 builds the three half-pel planes, 2 all fifteen
+     * half and quarter-pel planes, each the size of the luma plane. Motion
+     * vectors are not changed. Default 0 (disabled) */
+    int       subpelPlanes;
+
+    /* Allocate the picture planes, lowres frames and frame data of the
+     * encoder from process-wide pools of 2MB aligned slabs backed by huge
+     * pages, cutting the TLB misses of motion search and interpolation on
+     * large pictures. Freed buffers are kept by the pools for reuse rather
+     * than returned to the system until the pools are empty. 1 advises the
+     * slabs for transparent huge pages, 2 maps them from hugetlbfs (which
+     * needs pages reserved in /proc/sys/vm/nr_hugepages) and falls back to
+     * transparent huge pages. Not supported on Windows. Default 0 (heap) */
+    int       hugePages;
+
+    /* Memory budget of the encoder in MiB. The footprint of the pictures,
+     * lowres frames, frame data and per frame encoder buffers is estimated
+     * from the param and, when it exceeds the budget, the lookahead depth
+     * and then the number of frame threads are reduced until it fits. The
+     * lookahead also allocates its cost and motion vector arrays only for
+     * the B-frame distances it searches. Output is the same as encoding with
+     * the reduced lookahead depth and frame threads. Default 0 (unlimited) */
+    int       memoryBudget;
+
+    /* Container written by analysis-save. 1 writes the frame records one
+     * after another, which a loader reads in order and skips through. 2
+     * writes an indexed container: its records are made of 16 byte aligned
+     * field blocks and it ends with the offset of the record of every POC,
+     * so a loader maps the file and seeks to any POC directly. The format of
+     * an analysis-load file is detected. Default 1 */
+    int       analysisSaveFormat;
+
+    /* Run-length pack the depth, mode and partition arrays of analysis-save
+     * format 2. Default disabled */
+    int       bAnalysisSaveCompress;
+
+    /* Format of the multi-pass stats file written by a pass which writes
+     * stats. 1 writes a text line per frame to the stats file and the
+     * cuTree offsets to a separate .cutree file. 2 writes a binary file
+     * holding the frame entries, at full precision, and the cuTree offsets,
+     * which a later pass maps in place instead of parsing. The format of
+     * the stats file read by a later pass is detected. Default 1 */
+    int       statsFormat;
+
+    /* With stats format 2, also write the frame entries as text lines to
+     * <stats>.txt, for debugging. Default disabled */
+    int       bStatsTextDump;
+
+    /* Number of chunks x265_encode_chunked() encodes at the same time, each
+     * with an encoder of its own. 0 disables chunked encoding, the param is
+     * ignored by x265_encoder_open(). Default 0 */
+    int       chunkParallel;
+
+    /* Minimum length in frames of the chunks of x265_encode_chunked(). Each
+     * chunk ends at the first IDR picture placed by the lookahead after this
+     * many frames. 0 uses the keyframe interval. Default 0 */
+    int       chunkFrames;
 } x265_param;
 /* x265_param_alloc:
  *  Allocates an x265_param instance. The returned param structure is not
@@ -1944,6 +2210,44 @@ int x265_encoder_headers(x265_encoder *, x265_nal **pp_nal, uint32_t *pi_nal);
  *      Once flushing has begun, all subsequent calls must pass pic_in as NULL. */
 int x265_encoder_encode(x265_encoder *encoder, x265_nal **pp_nal, uint32_t *pi_nal, x265_picture *pic_in, x265_picture *pic_out);
 
+/* x265_encoder_nal_callback:
+ *      stream the NAL units of each picture to callback as soon as they are
+ *      coded: the prefix NALs with the first slice, then each slice once its
+ *      CTU rows are reconstructed, then the suffix SEI, filler and other
+ *      trailing NALs. Calls are made from the frame encoder threads, one at a
+ *      time and in stream order. x265_encoder_encode() still outputs the whole
+ *      access unit, the concatenated NALs of one picture's calls. Must be
+ *      called before the first picture is encoded; a NULL callback disables
+ *      streaming. Returns 0 on success, -1 once encoding has started */
+int x265_encoder_nal_callback(x265_encoder *, x265_nal_callback callback, void *opaque);
+
+/* x265_encoder_async_start:
+ *      switch the encoder to the asynchronous API. A driver thread runs the
+ *      encode loop, including picture ingest, copy and lowres analysis, so
+ *      that x265_encoder_submit() and x265_encoder_poll() never wait on the
+ *      encoder pipeline. Up to queueSize pictures may be queued for input and
+ *      as many access units for output. x265_encoder_encode() may no longer be
+ *      called. Requires copy-pic. Returns 0 on success, -1 on error */
+int x265_encoder_async_start(x265_encoder *, int queueSize, const x265_async_events *events);
+
+/* x265_encoder_submit:
+ *      queue pic_in for encoding, or begin the flush when pic_in is NULL. The
+ *      picture is not copied: the structure and its planes must stay valid
+ *      until the pictureReleased event for it. Returns 1 when the picture was
+ *      queued, 0 when the input queue is full, negative once flushing has
+ *      begun or on error */
+int x265_encoder_submit(x265_encoder *, x265_picture *pic_in);
+
+/* x265_encoder_poll:
+ *      get the next access unit, waiting up to timeoutMs milliseconds for it
+ *      (0 does not wait, negative waits indefinitely). The NALs remain valid
+ *      until the next call. pic_out, if not NULL, receives the POC, slice
+ *      type, timestamps and frame statistics of the output picture but no
+ *      reconstructed planes. Returns 1 when an access unit was output, 0 when
+ *      none was ready in time, -1 once the flush has completed and all access
+ *      units were polled, -2 when the encoder failed */
+int x265_encoder_poll(x265_encoder *, x265_nal **pp_nal, uint32_t *pi_nal, x265_picture *pic_out, int timeoutMs);
+
 /* x265_encoder_reconfig:
  *      various parameters from x265_param are copied.
  *      this takes effect immediately, on whichever frame is encoded next;
@@ -2011,6 +2315,98 @@ int x265_get_ref_frame_list(x265_encoder *encoder, x265_picyuv**, x265_picyuv**,
  *     returns negative on error, 0 access unit were output. */
 int x265_set_analysis_data(x265_encoder *encoder, x265_analysis_data *analysis_data, int poc, uint32_t cuBytes);
 
+/* x265_threadpool_create:
+ *       create a pool of worker threads which encoders of this process may
+ *       share by setting x265_param.sharedThreadPool. numThreads of 0 creates
+ *       one worker per logical CPU core. maxEncoders is the number of encoders
+ *       which may be attached to the pool at the same time. Returns NULL on
+ *       failure */
+x265_threadpool* x265_threadpool_create(int numThreads, int maxEncoders);
+
+/* x265_threadpool_destroy:
+ *       stop and free a pool created by x265_threadpool_create(). All encoders
+ *       using the pool must have been closed */
+void x265_threadpool_destroy(x265_threadpool *);
+
+/* x265_encoder_lookahead_follow:
+ *       make the follower encoder take its frame types, scenecuts, lowres frame
+ *       costs and cuTree offsets from the lookahead of the leader encoder
+ *       instead of running its own slicetype decision and cuTree. Both
+ *       encoders must encode the same source (at any resolution) with the
+ *       same GOP structure, and must not have received a picture yet. Each
+ *       picture must be passed to the leader before its followers, and the
+ *       leader flushed first. Returns 0 on success, negative on error */
+int x265_encoder_lookahead_follow(x265_encoder *follower, x265_encoder *leader);
+
+/* x265_encoder_analysis_follow:
+ *       make the follower encoder take the analysis of each picture from the
+ *       leader encoder as the leader outputs it, instead of from pic_in or an
+ *       analysis file. The leader must be in analysis save mode and the
+ *       follower in analysis load mode with bUseAnalysisFile disabled, both at
+ *       the same analysis-reuse-level and encoding the same source, at the
+ *       same or (with scale-factor) twice the resolution. The follower waits
+ *       in x265_encoder_encode() until the leader has output the picture, so
+ *       they must be driven from different threads. Neither may have received
+ *       a picture yet. Returns 0 on success, negative on error */
+int x265_encoder_analysis_follow(x265_encoder *follower, x265_encoder *leader);
+
+/* x265_encode_chunked:
+ *       encode the whole input of io as one stream, split into chunks which
+ *       are encoded concurrently by param->chunkParallel encoders sharing one
+ *       thread pool. A lookahead pass over the input ends each chunk at an IDR
+ *       picture at least param->chunkFrames frames after its start, and every
+ *       chunk encoder starts with that IDR, so the chunks join into one stream
+ *       with a single set of parameter sets, decodable as a closed-GOP encode.
+ *       Subsequent chunks signal HRD concatenation and, with VBV, end at the
+ *       buffer fill they started with. Open-GOP is disabled. Multi-pass,
+ *       analysis save and load, field coding and CSV logging are not
+ *       supported. Returns the number of frames encoded, negative on error */
+int x265_encode_chunked(x265_param *param, const x265_chunk_io *io);
+
+/* x265_lookahead_open:
+ *       create a lookahead which runs the slice type decision, lowres motion
+ *       search, adaptive quant and cuTree of an encoder configured with param,
+ *       without encoding. It attaches to param->sharedThreadPool when set,
+ *       else uses a thread pool of its own, of param->lookaheadThreads
+ *       workers or one per logical CPU core when 0.
+ *       Rate control is not run; a CQP configuration is analysed as CRF.
+ *       Returns NULL on failure */
+x265_lookahead* x265_lookahead_open(x265_param *);
+
+/* x265_lookahead_push:
+ *       pass the next input picture in display order, or NULL once all the
+ *       input was passed to flush the lookahead. pic_in->sliceType may force a
+ *       frame type. Returns 0 on success, negative on error */
+int x265_lookahead_push(x265_lookahead *, x265_picture *pic_in);
+
+/* x265_lookahead_pull:
+ *       get the analysis of the next frame in encode order. Once the lookahead
+ *       holds enough pictures, one frame is output for each picture pushed.
+ *       Returns 1 when a frame was output, 0 when more input is needed or the
+ *       flush is complete, negative on error. Each frame must be handed back
+ *       with x265_lookahead_release() */
+int x265_lookahead_pull(x265_lookahead *, x265_lookahead_frame *frame);
+
+/* x265_lookahead_release:
+ *       return the buffers of a pulled frame to the lookahead */
+void x265_lookahead_release(x265_lookahead *, x265_lookahead_frame *frame);
+
+/* x265_lookahead_close:
+ *       stop the lookahead and free it, along with frames not yet released */
+void x265_lookahead_close(x265_lookahead *);
+
+/* x265_pool_stats_get:
+ *       fill stats with the memory held by up to count of the huge-page buffer
+ *       pools, X265_POOL_COUNT of them at most. Returns the number of pools
+ *       reported. Each encoder also logs this on close */
+int x265_pool_stats_get(x265_pool_stats *stats, int count);
+
+/* x265_encoder_memory_stats:
+ *       fill stats with the live bytes of the encoder per subsystem, its peak
+ *       and its estimated footprint. Returns 0 on success, -1 when the encoder
+ *       has no memory accounting */
+int x265_encoder_memory_stats(x265_encoder *, x265_memory_stats *stats);
+
 /* x265_cleanup:
  *       release library static allocations, reset configured CTU size */
 void x265_cleanup(void);
@@ -2110,6 +2506,22 @@ typedef struct x265_api
     void          (*vmaf_encoder_log)(x265_encoder*, int, char**, x265_param *, x265_vmaf_data *);
 #endif
     int           (*zone_param_parse)(x265_param*, const char*, const char*);
+    x265_threadpool* (*threadpool_create)(int, int);
+    void          (*threadpool_destroy)(x265_threadpool*);
+    int           (*encoder_lookahead_follow)(x265_encoder*, x265_encoder*);
+    x265_lookahead* (*lookahead_open)(x265_param*);
+    int           (*lookahead_push)(x265_lookahead*, x265_picture*);
+    int           (*lookahead_pull)(x265_lookahead*, x265_lookahead_frame*);
+    void          (*lookahead_release)(x265_lookahead*, x265_lookahead_frame*);
+    void          (*lookahead_close)(x265_lookahead*);
+    int           (*pool_stats_get)(x265_pool_stats*, int);
+    int           (*encoder_memory_stats)(x265_encoder*, x265_memory_stats*);
+    int           (*encoder_nal_callback)(x265_encoder*, x265_nal_callback, void*);
+    int           (*encoder_async_start)(x265_encoder*, int, const x265_async_events*);
+    int           (*encoder_submit)(x265_encoder*, x265_picture*);
+    int           (*encoder_poll)(x265_encoder*, x265_nal**, uint32_t*, x265_picture*, int);
+    int           (*encoder_analysis_follow)(x265_encoder*, x265_encoder*);
+    int           (*encode_chunked)(x265_param*, const x265_chunk_io*);
     /* add new pointers to the end, or increment X265_MAJOR_VERSION */
 } x265_api;
 
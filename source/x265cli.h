@@ -43,10 +43,17 @@ static const struct option long_options[] =
     { "asm",            required_argument, NULL, 0 },
     { "no-asm",               no_argument, NULL, 0 },
     { "pools",          required_argument, NULL, 0 },
+    { "huge-pages",     required_argument, NULL, 0 },
+    { "memory-budget",  required_argument, NULL, 0 },
     { "numa-pools",     required_argument, NULL, 0 },
+    { "cache-affinity",       no_argument, NULL, 0 },
+    { "no-cache-affinity",    no_argument, NULL, 0 },
     { "preset",         required_argument, NULL, 'p' },
     { "tune",           required_argument, NULL, 't' },
     { "frame-threads",  required_argument, NULL, 'F' },
+    { "min-frame-threads", required_argument, NULL, 0 },
+    { "frame-threads-log-save", required_argument, NULL, 0 },
+    { "frame-threads-log-load", required_argument, NULL, 0 },
     { "no-pmode",             no_argument, NULL, 0 },
     { "pmode",                no_argument, NULL, 0 },
     { "no-pme",               no_argument, NULL, 0 },
@@ -71,6 +78,8 @@ static const struct option long_options[] =
     { "input-depth",    required_argument, NULL, 0 },
     { "input-res",      required_argument, NULL, 0 },
     { "input-csp",      required_argument, NULL, 0 },
+    { "input-read",     required_argument, NULL, 0 },
+    { "input-queue",    required_argument, NULL, 0 },
     { "interlace",      required_argument, NULL, 0 },
     { "no-interlace",         no_argument, NULL, 0 },
     { "field",                no_argument, NULL, 0 },
@@ -91,6 +100,7 @@ static const struct option long_options[] =
     { "limit-tu",       required_argument, NULL, 0 },
     { "me",             required_argument, NULL, 0 },
     { "subme",          required_argument, NULL, 'm' },
+    { "subpel-planes",  required_argument, NULL, 0 },
     { "merange",        required_argument, NULL, 0 },
     { "max-merge",      required_argument, NULL, 0 },
     { "no-temporal-mvp",      no_argument, NULL, 0 },
@@ -133,6 +143,8 @@ static const struct option long_options[] =
     { "intra-refresh",        no_argument, NULL, 0 },
     { "rc-lookahead",   required_argument, NULL, 0 },
     { "lookahead-slices", required_argument, NULL, 0 },
+    { "lookahead-hme",        no_argument, NULL, 0 },
+    { "no-lookahead-hme",     no_argument, NULL, 0 },
     { "lookahead-threads", required_argument, NULL, 0 },
     { "bframes",        required_argument, NULL, 'b' },
     { "bframe-bias",    required_argument, NULL, 0 },
@@ -158,6 +170,8 @@ static const struct option long_options[] =
     { "vbv-end-fr-adj", required_argument, NULL, 0 },
     { "chunk-start",    required_argument, NULL, 0 },
     { "chunk-end",      required_argument, NULL, 0 },
+    { "chunk-parallel", required_argument, NULL, 0 },
+    { "chunk-frames",   required_argument, NULL, 0 },
     { "bitrate",        required_argument, NULL, 0 },
     { "qp",             required_argument, NULL, 'q' },
     { "aq-mode",        required_argument, NULL, 0 },
@@ -209,6 +223,8 @@ static const struct option long_options[] =
     { "strong-intra-smoothing",    no_argument, NULL, 0 },
     { "no-cutree",                 no_argument, NULL, 0 },
     { "cutree",                    no_argument, NULL, 0 },
+    { "no-cutree-incremental",     no_argument, NULL, 0 },
+    { "cutree-incremental",        no_argument, NULL, 0 },
     { "no-hrd",               no_argument, NULL, 0 },
     { "hrd",                  no_argument, NULL, 0 },
     { "sar",            required_argument, NULL, 0 },
@@ -253,6 +269,9 @@ static const struct option long_options[] =
     { "nr-intra",       required_argument, NULL, 0 },
     { "nr-inter",       required_argument, NULL, 0 },
     { "stats",          required_argument, NULL, 0 },
+    { "stats-format",   required_argument, NULL, 0 },
+    { "stats-text-dump",      no_argument, NULL, 0 },
+    { "no-stats-text-dump",   no_argument, NULL, 0 },
     { "pass",           required_argument, NULL, 0 },
     { "multi-pass-opt-analysis", no_argument, NULL, 0 },
     { "no-multi-pass-opt-analysis",    no_argument, NULL, 0 },
@@ -267,6 +286,9 @@ static const struct option long_options[] =
     { "analysis-reuse-level", required_argument, NULL, 0 },
     { "analysis-save",  required_argument, NULL, 0 },
     { "analysis-load",  required_argument, NULL, 0 },
+    { "analysis-save-format", required_argument, NULL, 0 },
+    { "analysis-save-compress", no_argument, NULL, 0 },
+    { "no-analysis-save-compress", no_argument, NULL, 0 },
     { "scale-factor",   required_argument, NULL, 0 },
     { "refine-intra",   required_argument, NULL, 0 },
     { "refine-inter",   required_argument, NULL, 0 },
@@ -384,6 +406,8 @@ static void showHelp(x265_param *param)
     H1("                                 1 - i420 (4:2:0 default)\n");
     H1("                                 2 - i422 (4:2:2)\n");
     H1("                                 3 - i444 (4:4:4)\n");
+    H1("   --input-read <string>         How the input file is read - buffered, mmap, direct. Default buffered\n");
+    H1("   --input-queue <integer>       Frames read ahead of the encoder (2..256). Default 5, 16 with direct\n");
 #if ENABLE_HDR10_PLUS
     H0("   --dhdr10-info <filename>      JSON file containing the Creative Intent Metadata to be encoded as Dynamic Tone Mapping\n");
     H0("   --[no-]dhdr10-opt             Insert tone mapping SEI only for IDR frames and when the tone mapping information changes. Default disabled\n");
@@ -410,12 +434,18 @@ static void showHelp(x265_param *param)
     H0("\nThreading, performance:\n");
     H0("   --pools <integer,...>         Comma separated thread count per thread pool (pool per NUMA node)\n");
     H0("                                 '-' implies no threads on node, '+' implies one thread per core on node\n");
+    H0("   --[no-]cache-affinity         Group pool threads by shared last level cache. Default %s\n", OPT(param->bCacheAffinity));
     H0("-F/--frame-threads <integer>     Number of concurrently encoded frames. 0: auto-determined by core count\n");
+    H0("   --min-frame-threads <integer> Adapt concurrently encoded frames at keyframes, down to this count. Default %d (disabled)\n", param->minFrameThreads);
+    H1("   --frame-threads-log-save <filename> Write adaptive frame thread decisions to file. Default Disabled\n");
+    H1("   --frame-threads-log-load <filename> Replay adaptive frame thread decisions from file. Default Disabled\n");
     H0("   --[no-]wpp                    Enable Wavefront Parallel Processing. Default %s\n", OPT(param->bEnableWavefront));
     H0("   --[no-]slices <integer>       Enable Multiple Slices feature. Default %d\n", param->maxSlices);
     H0("   --[no-]pmode                  Parallel mode analysis. Default %s\n", OPT(param->bDistributeModeAnalysis));
     H0("   --[no-]pme                    Parallel motion estimation. Default %s\n", OPT(param->bDistributeMotionEstimation));
     H0("   --[no-]asm <bool|int|string>  Override CPU detection. Default: auto\n");
+    H1("   --huge-pages <0..2>           Allocate frame buffers from huge-page pools, 1:transparent 2:hugetlbfs. Default %d\n", param->hugePages);
+    H0("   --memory-budget <integer>     Reduce lookahead depth and frame threads to fit a budget in MiB. Default %d (unlimited)\n", param->memoryBudget);
     H0("\nPresets:\n");
     H0("-p/--preset <string>             Trade off performance for compression efficiency. Default medium\n");
     H0("                                 ultrafast, superfast, veryfast, faster, fast, medium, slow, slower, veryslow, or placebo\n");
@@ -459,6 +489,7 @@ static void showHelp(x265_param *param)
     H0("   --limit-refs <0|1|2|3>        Limit references per depth (1) or CU (2) or both (3). Default %d\n", param->limitReferences);
     H0("   --me <string>                 Motion search method dia hex umh star full. Default %d\n", param->searchMethod);
     H0("-m/--subme <integer>             Amount of subpel refinement to perform (0:least .. 7:most). Default %d \n", param->subpelRefine);
+    H1("   --subpel-planes <0..2>        Share interpolated reference planes between motion searches, 1:half-pel 2:quarter-pel. Default %d\n", param->subpelPlanes);
     H0("   --merange <integer>           Motion search range. Default %d\n", param->searchRange);
     H0("   --[no-]rect                   Enable rectangular motion partitions Nx2N and 2NxN. Default %s\n", OPT(param->bEnableRectInter));
     H0("   --[no-]amp                    Enable asymmetric motion partitions, requires --rect. Default %s\n", OPT(param->bEnableAMP));
@@ -483,6 +514,7 @@ static void showHelp(x265_param *param)
     H0("   --intra-refresh               Use Periodic Intra Refresh instead of IDR frames\n");
     H0("   --rc-lookahead <integer>      Number of frames for frame-type lookahead (determines encoder latency) Default %d\n", param->lookaheadDepth);
     H1("   --lookahead-slices <0..16>    Number of slices to use per lookahead cost estimate. Default %d\n", param->lookaheadSlices);
+    H1("   --[no-]lookahead-hme          Seed the lookahead motion search with a quarter resolution search. Default %s\n", OPT(param->bLookaheadHME));
     H0("   --lookahead-threads <integer> Number of threads to be dedicated to perform lookahead only. Default %d\n", param->lookaheadThreads);
     H0("-b/--bframes <0..16>             Maximum number of consecutive b-frames. Default %d\n", param->bframes);
     H1("   --bframe-bias <integer>       Bias towards B frame decisions. Default %d\n", param->bFrameBias);
@@ -513,6 +545,8 @@ static void showHelp(x265_param *param)
     H0("   --vbv-end-fr-adj <float>      Frame from which qp has to be adjusted to achieve final decode buffer emptiness. Default 0\n");
     H0("   --chunk-start <integer>       First frame of the chunk. Default 0 (disabled)\n");
     H0("   --chunk-end <integer>         Last frame of the chunk. Default 0 (disabled)\n");
+    H0("   --chunk-parallel <integer>    Encode the input as chunks split at IDR pictures, this many at a time. Default %d (disabled)\n", param->chunkParallel);
+    H0("   --chunk-frames <integer>      Minimum length of the chunks of chunk-parallel. Default %d (keyint)\n", param->chunkFrames);
     H0("   --pass                        Multi pass rate control.\n"
        "                                   - 1 : First pass, creates stats file\n"
        "                                   - 2 : Last pass, does not overwrite stats file\n"
@@ -520,11 +554,15 @@ static void showHelp(x265_param *param)
     H0("   --[no-]multi-pass-opt-analysis   Refine analysis in 2 pass based on analysis information from pass 1\n");
     H0("   --[no-]multi-pass-opt-distortion Use distortion of CTU from pass 1 to refine qp in 2 pass\n");
     H0("   --stats                       Filename for stats file in multipass pass rate control. Default x265_2pass.log\n");
+    H0("   --stats-format <1|2>          Stats file written by a pass, 1:text and .cutree file 2:binary, memory-mappable. Default %d\n", param->statsFormat);
+    H0("   --[no-]stats-text-dump        Also write the frame stats of stats-format 2 as text to <stats>.txt. Default %s\n", OPT(param->bStatsTextDump));
     H0("   --[no-]analyze-src-pics       Motion estimation uses source frame planes. Default disable\n");
     H0("   --[no-]slow-firstpass         Enable a slow first pass in a multipass rate control mode. Default %s\n", OPT(param->rc.bEnableSlowFirstPass));
     H0("   --[no-]strict-cbr             Enable stricter conditions and tolerance for bitrate deviations in CBR mode. Default %s\n", OPT(param->rc.bStrictCbr));
     H0("   --analysis-save <filename>    Dump analysis info into the specified file. Default Disabled\n");
     H0("   --analysis-load <filename>    Load analysis buffers from the file specified. Default Disabled\n");
+    H0("   --analysis-save-format <1|2>  Analysis save container, 1:sequential records 2:indexed, memory-mappable records. Default %d\n", param->analysisSaveFormat);
+    H0("   --[no-]analysis-save-compress Run-length pack the depth and mode arrays of analysis-save-format 2. Default %s\n", OPT(param->bAnalysisSaveCompress));
     H0("   --analysis-reuse-file <filename>    Specify file name used for either dumping or reading analysis data. Deault x265_analysis.dat\n");
     H0("   --analysis-reuse-level <1..10>      Level of analysis reuse indicates amount of info stored/reused in save/load mode, 1:least..10:most. Default %d\n", param->analysisReuseLevel);
     H0("   --refine-analysis-type <string>     Reuse anlaysis information received through API call. Supported options are avc and hevc. Default disabled - %d\n", param->bAnalysisType);
@@ -556,6 +594,7 @@ static void showHelp(x265_param *param)
     H0("   --[no-]aq-motion              Adaptive Quantization based on the relative motion of each CU w.r.t., frame. Default %s\n", OPT(param->bOptCUDeltaQP));
     H0("   --qg-size <int>               Specifies the size of the quantization group (64, 32, 16, 8). Default %d\n", param->rc.qgSize);
     H0("   --[no-]cutree                 Enable cutree for Adaptive Quantization. Default %s\n", OPT(param->rc.cuTree));
+    H1("   --[no-]cutree-incremental     Reuse the cutree propagation of the previous lookahead window. Default %s\n", OPT(param->bCUTreeIncremental));
     H0("   --[no-]rc-grain               Enable ratecontrol mode to handle grains specifically. turned on with tune grain. Default %s\n", OPT(param->rc.bEnableGrain));
     H1("   --ipratio <float>             QP factor between I and P. Default %.2f\n", param->rc.ipFactor);
     H1("   --pbratio <float>             QP factor between P and B. Default %.2f\n", param->rc.pbFactor);